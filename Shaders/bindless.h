@@ -0,0 +1,30 @@
+// Global descriptor heap (see BindlessHeap)
+// The indices come from the push constants of the draw, ex:
+//
+//   #define BINDLESS_SET 0
+//   #include "bindless.h"
+//   layout(push_constant) uniform block
+//   {
+//       uint textureIndex;
+//       uint samplerIndex;
+//   } uDraw;
+//   ...
+//   oColor0 = texture(bindlessSampler2D(uDraw.textureIndex, uDraw.samplerIndex), vTexcoord);
+
+#extension GL_EXT_nonuniform_qualifier : require
+
+#ifndef BINDLESS_SET
+#define BINDLESS_SET 0
+#endif
+
+layout(set = BINDLESS_SET, binding = 0) uniform texture2D uTextures[];
+layout(set = BINDLESS_SET, binding = 1) uniform sampler uSamplers[];
+layout(std430, set = BINDLESS_SET, binding = 2) buffer BindlessBuffer
+{
+    uint data[];
+} uBuffers[];
+
+// nonuniformEXT is required when the index can differ inside a subgroup (ex: read from a buffer per instance),
+// it's free when the index is uniform (push constant)
+#define bindlessSampler2D(pTextureIndex, pSamplerIndex) sampler2D(uTextures[nonuniformEXT(pTextureIndex)], uSamplers[nonuniformEXT(pSamplerIndex)])
+#define bindlessBuffer(pBufferIndex) uBuffers[nonuniformEXT(pBufferIndex)]
@@ -0,0 +1,28 @@
+#version 460
+
+// Used by 04-DescriptorBenchmark: each dispatch reads and writes its own buffer ranges
+
+layout (local_size_x = 64) in;
+
+layout(set = 0, binding = 0) uniform Params
+{
+    uint count;
+    float scale;
+} uParams;
+
+layout(std430, set = 0, binding = 1) readonly buffer Source
+{
+    float values[];
+} uSource;
+
+layout(std430, set = 0, binding = 2) writeonly buffer Destination
+{
+    float values[];
+} uDestination;
+
+void main()
+{
+    uint i = gl_GlobalInvocationID.x;
+    if (i < uParams.count)
+        uDestination.values[i] = uSource.values[i] * uParams.scale;
+}
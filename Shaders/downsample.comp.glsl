@@ -0,0 +1,61 @@
+#version 460
+
+// Mip chain generation for the formats that can't be blitted (see MipmapGenerator)
+// Each dispatch build up to 4 levels from the source level :
+// a 8x8 group write a 8x8 tile of the first level, then reduce it in shared memory for the next ones.
+// Box filter, the reads outside of odd sized levels are clamped to the edge.
+
+layout (local_size_x = 8, local_size_y = 8) in;
+
+layout(set = 0, binding = 0) uniform sampler2D uSource;            // Whole mip chain, read with texelFetch
+layout(set = 0, binding = 1) uniform writeonly image2D uDest[4];    // Destination levels (without format, shaderStorageImageWriteWithoutFormat)
+
+layout (push_constant) uniform constants_t {
+    ivec2 srcSize;      // Size of the source level
+    int srcLevel;
+    int levelCount;     // Number of levels to write [1, 4]
+} PushConstants;
+
+shared vec4 sTile[64];
+
+void storeLevel(int pLevel, ivec2 pCoord, vec4 pColor)
+{
+    ivec2 size = max(PushConstants.srcSize >> (pLevel + 1), ivec2(1));
+    if (all(lessThan(pCoord, size)))
+        imageStore(uDest[pLevel], pCoord, pColor);
+}
+
+void main()
+{
+    ivec2 dstCoord = ivec2(gl_GlobalInvocationID.xy);
+    ivec2 srcCoord = dstCoord * 2;
+    ivec2 srcMax = PushConstants.srcSize - 1;
+    int level = PushConstants.srcLevel;
+
+    vec4 color = texelFetch(uSource, min(srcCoord, srcMax), level)
+               + texelFetch(uSource, min(srcCoord + ivec2(1, 0), srcMax), level)
+               + texelFetch(uSource, min(srcCoord + ivec2(0, 1), srcMax), level)
+               + texelFetch(uSource, min(srcCoord + ivec2(1, 1), srcMax), level);
+    color *= 0.25;
+    storeLevel(0, dstCoord, color);
+
+    // levelCount is uniform, the barriers stay in uniform control flow
+    uint index = gl_LocalInvocationIndex;
+    uvec2 local = gl_LocalInvocationID.xy;
+    sTile[index] = color;
+
+    for (int i = 1; i < PushConstants.levelCount; ++i)
+    {
+        barrier();
+        uint step = 1u << (i - 1);          // Distance between the values of the previous level in the tile
+        uint mask = (step << 1) - 1;
+        if ((local.x & mask) == 0 && (local.y & mask) == 0)
+        {
+            color = (color + sTile[index + step] + sTile[index + step * 8] + sTile[index + step * 9]) * 0.25;
+            storeLevel(i, dstCoord >> i, color);
+        }
+        barrier();
+        if ((local.x & mask) == 0 && (local.y & mask) == 0)
+            sTile[index] = color;
+    }
+}
@@ -1,6 +1,8 @@
 #version 460
 
+// 16x16 unless specialized, see WorkgroupTuner
 layout (local_size_x = 16, local_size_y = 16) in;
+layout (local_size_x_id = 0, local_size_y_id = 1) in;
 
 layout(rgba8, set = 0, binding = 0) uniform image2D image;
 
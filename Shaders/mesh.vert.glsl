@@ -14,35 +14,34 @@ layout (location = 0) out vec2 vTexcoord;
 layout (location = 1) out vec4 vColor;
 
 
+// Variants, see ShaderPermutations
+// @keywords OBJECT_SBO OBJECT_TRANSFORM OBJECT_COLOR NORMAL_COLOR
+
+#ifdef OBJECT_SBO
+layout(std430, set = 0, binding = 0) readonly buffer SBO
+#else
 layout(binding = 0) uniform UBO
-//layout(binding = 0) readonly buffer UBO
+#endif
 {
     Object object;
 };
 
-//layout(std430, set = 0, binding = 0) buffer SBO
-
 void main()
 {
     vTexcoord = iTexCoord;
-    //vColor = vec4(iNormal * 0.5 + vec3(0.5), 1.0);
-    //vColor = vColor * object.color;
 
+#ifdef NORMAL_COLOR
+    vColor = vec4(iNormal * 0.5 + vec3(0.5), 1.0);
+#else
     vColor = vec4(iTexCoord.xy, 0.0, 1.0);
-    /*
-    if
-        (object.color.r != 0 && object.color.g != 0)
-    {
-        // Should not happen
-        vColor = vec4(0.0, 0.0, 1.0,1.0);
-    }
-    else
-    {
-        vColor = object.color;
-    }
-    */
-     
-
-    //gl_Position = object.proj * object.view * object.model * vec4(iPosition, 1.0);
+#endif
+#ifdef OBJECT_COLOR
+    vColor = vColor * object.color;
+#endif
+
+#ifdef OBJECT_TRANSFORM
+    gl_Position = object.proj * object.view * object.model * vec4(iPosition, 1.0);
+#else
     gl_Position = vec4(iPosition, 1.0);
-}
\ No newline at end of file
+#endif
+}
@@ -0,0 +1,37 @@
+// Texture streaming feedback (see TextureStreamer)
+// One uint per streamed texture, reset to 0xFFFFFFFF by the cpu each frame.
+// The fragment shaders record the finest level they would like to sample,
+// relative to the levels currently resident in the image, plus STREAMING_LOD_BIAS
+// so the levels finer than the resident ones (negative lod) fit in a uint.
+//
+// Usage:
+//   #define STREAMING_FEEDBACK_BINDING 2
+//   #include "texture_streaming.h"
+//   ...
+//   recordStreamingFeedback(uTextureId, uColorMap, vTexcoord);
+
+// Must match TextureStreamer::cFeedbackLodBias
+#define STREAMING_LOD_BIAS 16.0
+
+#ifndef STREAMING_FEEDBACK_SET
+#define STREAMING_FEEDBACK_SET 0
+#endif
+
+layout(std430, set = STREAMING_FEEDBACK_SET, binding = STREAMING_FEEDBACK_BINDING) buffer StreamingFeedback
+{
+    uint mips[];
+} uStreamingFeedback;
+
+// Only one pixel of each 8x8 tile write to keep the atomics cheap.
+// Objects covering less than a tile may be missed, they only need the low mips anyway.
+// textureQueryLod().y is the lod before the clamp to the image levels, negative when a level
+// finer than the resident ones is wanted: biased to be stored unsigned.
+void recordStreamingFeedback(uint pTextureId, sampler2D pTexture, vec2 pUV)
+{
+    uvec2 lPixel = uvec2(gl_FragCoord.xy) & 7u;
+    if (lPixel.x != 0u || lPixel.y != 0u)
+        return;
+
+    float lLod = max(textureQueryLod(pTexture, pUV).y + STREAMING_LOD_BIAS, 0.0);
+    atomicMin(uStreamingFeedback.mips[pTextureId], uint(lLod));
+}
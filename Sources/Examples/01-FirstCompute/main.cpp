@@ -4,14 +4,19 @@
 #include <GLFW/glfw3native.h>
 
 #include <VulkanHelper.h>
-#include <VulkanImage.h>
 #include <VulkanDescriptor.h>
 #include <VulkanShader.h>
+#include <VulkanShaderCompiler.h>
+#include <VulkanShaderHotReload.h>
 #include <VulkanPipeline.h>
+#include <VulkanPipelineCache.h>
+#include <VulkanPipelineCompiler.h>
+#include <VulkanWorkgroupTuner.h>
+#include <FrameArena.h>
 
 #include "assert.h"
+#include <math.h>
 #include <vector>
-#include <functional>
 
 // Imgui
 #include "imgui.h"
@@ -50,12 +55,19 @@ struct FrameData
     CommandBuffer mCommandBuffer;       // Command buffer for rendering the frame
     VkSemaphore mSwapchainSemaphore;    // Wait the swapchain image to be available
     VkSemaphore mRenderSemaphore;       // Control presenting image
+    FrameArena mArena;                  // Transient cpu memory of the frame, reset when mFence is signaled
+    DescriptorAllocator mDescriptors;   // Transient descriptor sets of the frame, reset when mFence is signaled
 };
 
 struct VulkanApp
 {
     VulkanInstance* mInstance;
     VulkanDevice* mDevice;
+    PipelineCache mPipelineCache;
+    PipelineCompiler mPipelineCompiler;
+    WorkgroupTuner mWorkgroupTuner;
+    ShaderCompiler mShaderCompiler;
+    ShaderHotReload mShaderHotReload;
     VulkanSwapchain* mSwapchain;
     VulkanGLFWWindow* mWindow;
 
@@ -81,12 +93,15 @@ struct VulkanApp
     VkDescriptorSetLayout mDrawImageDescriptorLayout;    
 
     // Resources
-    VulkanImage mDrawImage;
+    ImageHandle mDrawImage;
 
 
     VulkanShader mGradientComputeShader; 
     VkPipelineLayout mGradientPipelineLayout;
-    VkPipeline mGradientPipeline;
+    PipelineHandle mGradientPipeline;
+    AsyncPipeline mGradientPipelineAsync;
+    WorkgroupTuner::Config mGradientConfig;
+    WorkgroupTuner::Specialization mGradientSpecialization;    // Referenced by the async compile
 
 
     std::string getShaderPath()
@@ -118,6 +133,18 @@ struct VulkanApp
         mDevice->createLogicalDevice(VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT | VK_QUEUE_TRANSFER_BIT, mInstance->mVulkanInstance);
 
         mImmediateCommandBuffer.initialize(mDevice);
+
+        // Before any pipeline creation
+        PipelineCache::Settings lPipelineCacheSettings;
+        mPipelineCache.init(mDevice, lPipelineCacheSettings);
+        mPipelineCompiler.init(mDevice);
+
+        WorkgroupTuner::Settings lWorkgroupTunerSettings;
+        mWorkgroupTuner.init(mDevice, lWorkgroupTunerSettings);
+
+        ShaderCompiler::Settings lShaderCompilerSettings;
+        lShaderCompilerSettings.mShaderPath = getShaderPath();
+        mShaderCompiler.init(lShaderCompilerSettings);
     }
 
     void initSwapchain()
@@ -137,7 +164,23 @@ struct VulkanApp
             // The semaphore is used to synchronize the image acquisition and the rendering
             lFrameData.mSwapchainSemaphore = vkh::createSemaphore(mDevice->mLogicalDevice);
             lFrameData.mRenderSemaphore = vkh::createSemaphore(mDevice->mLogicalDevice);
+
+            lFrameData.mArena.init();
+
+            // Sizes are only a first guess, the allocator grows and learns the real usage
+            lFrameData.mDescriptors.initPool(mDevice->mLogicalDevice, 64,
+            {
+                { VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1 },
+                { VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 2 },
+                { VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1 },
+                { VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1 },
+            });
         }
+
+        // A replaced pipeline can be used by every frame of the ring
+        ShaderHotReload::Settings lShaderHotReloadSettings;
+        lShaderHotReloadSettings.mFramesInFlight = (uint32_t)mFrameData.size();
+        mShaderHotReload.init(mDevice, &mShaderCompiler, lShaderHotReloadSettings);
     }    
 
     void initDescriptors()
@@ -157,7 +200,7 @@ struct VulkanApp
 
         VkDescriptorImageInfo lImgInfo{};
         lImgInfo.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
-        lImgInfo.imageView = mDrawImage.mView;
+        lImgInfo.imageView = mDevice->getImageView(mDrawImage);
 
         VkWriteDescriptorSet lDrawImageWrite = {};
         lDrawImageWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
@@ -174,7 +217,7 @@ struct VulkanApp
 
     void initPipelines()
     {
-        mGradientComputeShader = VulkanShader::loadFromFile(mDevice->mLogicalDevice, getShaderPath() + "gradient.comp.glsl.spv");
+        mGradientComputeShader = mShaderCompiler.load(mDevice->mLogicalDevice, "gradient.comp.glsl");
         assert(mGradientComputeShader.isValid());
 
         // Create a compute pipeline
@@ -182,17 +225,46 @@ struct VulkanApp
         VkPipelineLayoutCreateInfo gradientPipelineLayout = vkh::pipelineLayoutCreateInfo(&mDrawImageDescriptorLayout, 1, &lPushConstantRange, 1);
 
         VK_CHECK(vkCreatePipelineLayout(mDevice->mLogicalDevice, &gradientPipelineLayout, nullptr, &mGradientPipelineLayout));
-        VkPipelineShaderStageCreateInfo gradientShaderStage = vkh::pipelineShaderStageCreateInfo(mGradientComputeShader.mStage, mGradientComputeShader.mShaderModule);
-        VkComputePipelineCreateInfo gradientPipeline = vkh::computePipelineCreateInfo(mGradientPipelineLayout, gradientShaderStage);
-        VK_CHECK(vkCreateComputePipelines(mDevice->mLogicalDevice, VK_NULL_HANDLE, 1, &gradientPipeline, nullptr, &mGradientPipeline));
+
+        // Local size of this device, measured on the first run only (the draw image must be in its compute layout)
+        immediateSubmit([&](VkCommandBuffer pCmd) { vkh::transitionImage(pCmd, mDevice->getImage(mDrawImage), VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL); });
+        const VkExtent3D lDrawExtent = mDevice->getImageExtent(mDrawImage);
+        mGradientConfig = mWorkgroupTuner.getConfig("gradient.comp.glsl", mGradientComputeShader, mGradientPipelineLayout,
+            [&](VkCommandBuffer pCmd, const WorkgroupTuner::Config& pConfig)
+            {
+                vkCmdBindDescriptorSets(pCmd, VK_PIPELINE_BIND_POINT_COMPUTE, mGradientPipelineLayout, 0, 1, &mDrawImageDescriptors, 0, nullptr);
+                vkCmdPushConstants(pCmd, mGradientPipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(PushConstantData), &mPushConstants);
+                vkCmdDispatch(pCmd, pConfig.groupCount(lDrawExtent.width, 0), pConfig.groupCount(lDrawExtent.height, 1), 1);
+            });
+
+        mGradientSpecialization.init(mGradientComputeShader, mGradientConfig);
+        VkComputePipelineCreateInfo gradientPipeline = vkh::computePipelineCreateInfo(mGradientPipelineLayout, mGradientSpecialization.mStage);
+        // Compiled on the workers while the rest is initialized, see waitPipelines
+        mGradientPipelineAsync = mPipelineCompiler.compile(gradientPipeline);
+    }
+
+    void waitPipelines()
+    {
+        mPipelineCompiler.waitIdle();
+        mGradientPipeline = mDevice->addPipeline(mGradientPipelineAsync.wait(), mGradientPipelineLayout, VK_PIPELINE_BIND_POINT_COMPUTE);
+        mGradientPipelineAsync = AsyncPipeline();
+
+        // Edit gradient.comp.glsl while running, the pipeline is rebuilt with the tuned local size
+        mShaderHotReload.add(mGradientPipeline, { "gradient.comp.glsl" }, [this](const VulkanShader* pShaders, uint32_t /*pShaderCount*/)
+        {
+            WorkgroupTuner::Specialization lSpecialization;
+            lSpecialization.init(pShaders[0], mGradientConfig);
+            VkComputePipelineCreateInfo lPipelineInfo = vkh::computePipelineCreateInfo(mGradientPipelineLayout, lSpecialization.mStage);
+            return mDevice->createComputePipeline(lPipelineInfo);
+        });
         // TODO : Can destroy the shader module now
     }
 
     void initResources()
     {
         // draw image size will match the window
-        mDrawImage.mExtent = { mWindow->width(), mWindow->height(), 1};
-        mDrawImage.mFormat = VK_FORMAT_R8G8B8A8_UNORM;
+        VkExtent3D lDrawImageExtent = { mWindow->width(), mWindow->height(), 1};
+        VkFormat lDrawImageFormat = VK_FORMAT_R8G8B8A8_UNORM;
 
         VkImageUsageFlags lDrawImageUsages{};
         lDrawImageUsages |= VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
@@ -200,19 +272,11 @@ struct VulkanApp
         lDrawImageUsages |= VK_IMAGE_USAGE_STORAGE_BIT;
         lDrawImageUsages |= VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
 
-        VkImageCreateInfo rimg_info = vkh::imageCreateInfo(mDrawImage.mFormat, lDrawImageUsages, mDrawImage.mExtent);
-
-        //for the draw image, we want to allocate it from gpu local memory
-        VmaAllocationCreateInfo rimg_allocinfo = {};
-        rimg_allocinfo.usage = VMA_MEMORY_USAGE_GPU_ONLY;
-        rimg_allocinfo.requiredFlags = VkMemoryPropertyFlags(VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
-
-        //allocate and create the image
-        VK_CHECK(vmaCreateImage(mDevice->mAllocator, &rimg_info, &rimg_allocinfo, &mDrawImage.mImage, &mDrawImage.mAllocation, nullptr));
+        VkImageCreateInfo rimg_info = vkh::imageCreateInfo(lDrawImageFormat, lDrawImageUsages, lDrawImageExtent);
 
-        //build a image-view for the draw image to use for rendering
-        VkImageViewCreateInfo rview_info = vkh::imageViewCreateInfo(mDrawImage.mImage, mDrawImage.mFormat, VK_IMAGE_ASPECT_COLOR_BIT);
-        VK_CHECK(vkCreateImageView(mDevice->mLogicalDevice, &rview_info, nullptr, &mDrawImage.mView));       
+        // The device pool allocate the image in gpu local memory and build its view
+        mDrawImage = mDevice->createImage(rimg_info, VK_IMAGE_ASPECT_COLOR_BIT);
+        assert(mDrawImage.isValid());
     }
 
     void draw_background_by_clearing_swapchain_image(VkCommandBuffer pCmd)
@@ -289,66 +353,90 @@ struct VulkanApp
         //immediateSubmit([&](VkCommandBuffer cmd) { ImGui_ImplVulkan_CreateFontsTexture(cmd); });
     }
 
-    // Clear the mDrawImage.mImage
-    // Copy the mDrawImage.mImage to the swapchain image
+    // Clear the mDrawImage
+    // Copy the mDrawImage to the swapchain image
     // Make the swapchain image ready for presentation
     void draw_background_by_clearing_image(VkCommandBuffer pCmd)
     {
+        // Resolve the handle once, O(1) lookup in the device pool
+        VkImage lDrawImage = mDevice->getImage(mDrawImage);
+        VkExtent3D lDrawExtent = mDevice->getImageExtent(mDrawImage);
+
         // Make the swapchain image ready for dst copy 
         vkh::transitionImage(pCmd, mSwapchain->getImage(), VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
 
         // VK_IMAGE_LAYOUT_GENERAL to do clearing
-        vkh::transitionImage(pCmd, mDrawImage.mImage, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL);
+        vkh::transitionImage(pCmd, lDrawImage, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL);
 
         float flash = (float)fabs(sin(mCurrentFrame / 120.0f));
         VkClearColorValue lClearColor = { 0.3f, 0.3f, flash, 1.0f };
         VkImageSubresourceRange lClearRange = vkh::imageSubresourceRange(VK_IMAGE_ASPECT_COLOR_BIT);
-        vkCmdClearColorImage(pCmd, mDrawImage.mImage, VK_IMAGE_LAYOUT_GENERAL, &lClearColor, 1, &lClearRange);
+        vkCmdClearColorImage(pCmd, lDrawImage, VK_IMAGE_LAYOUT_GENERAL, &lClearColor, 1, &lClearRange);
 
         // Ready fo src transfert
-        vkh::transitionImage(pCmd, mDrawImage.mImage, VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL);
+        vkh::transitionImage(pCmd, lDrawImage, VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL);
 
-        // Copy the mDrawImage.mImage to the swapchain image
-        vkh::copyImageToImage(pCmd, mDrawImage.mImage, mSwapchain->getImage(), { mDrawImage.mExtent.width, mDrawImage.mExtent.height }, { mDrawImage.mExtent.width, mDrawImage.mExtent.height });
+        // Copy the lDrawImage to the swapchain image
+        vkh::copyImageToImage(pCmd, lDrawImage, mSwapchain->getImage(), { lDrawExtent.width, lDrawExtent.height }, { lDrawExtent.width, lDrawExtent.height });
 
         // Make the swapchain ready for presentation
         vkh::transitionImage(pCmd, mSwapchain->getImage(), VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_PRESENT_SRC_KHR);
     }
    
     // dispatch the compute shader
-    // Copy the mDrawImage.mImage to the swapchain image
+    // Copy the mDrawImage to the swapchain image
     // Make the swapchain image ready for presentation
-    void draw_background_with_gradient_compute_shader(VkCommandBuffer pCmd)
+    void draw_background_with_gradient_compute_shader(VkCommandBuffer pCmd, FrameData& pFrame)
     {
-        // Make the swapchain image ready for dst copy 
-        vkh::transitionImage(pCmd, mSwapchain->getImage(), VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
+        // Resolve the handle once, O(1) lookup in the device pool
+        VkImage lDrawImage = mDevice->getImage(mDrawImage);
+        VkExtent3D lDrawExtent = mDevice->getImageExtent(mDrawImage);
 
+        // One barrier for both transitions, the list is transient memory of the frame
+        FrameVector<VkImageMemoryBarrier2> lBarriers(&pFrame.mArena);
+        lBarriers.reserve(2);
+        // Make the swapchain image ready for dst copy 
+        lBarriers.push_back(vkh::imageTransitionBarrier(mSwapchain->getImage(), VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL));
         // VK_IMAGE_LAYOUT_GENERAL to do clearing
-        vkh::transitionImage(pCmd, mDrawImage.mImage, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL);
+        lBarriers.push_back(vkh::imageTransitionBarrier(lDrawImage, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL));
+        vkh::pipelineBarrier(pCmd, lBarriers.data(), (uint32_t)lBarriers.size());
 
         // Bind the pipeline
-        vkCmdBindPipeline(pCmd, VK_PIPELINE_BIND_POINT_COMPUTE, mGradientPipeline);
+        vkCmdBindPipeline(pCmd, VK_PIPELINE_BIND_POINT_COMPUTE, mDevice->getPipeline(mGradientPipeline));
+
+        // Transient set of the frame, recycled by clearDescriptors once the frame fence has signaled
+        VkDescriptorSet lSet = pFrame.mDescriptors.allocate(mDevice->mLogicalDevice, mDrawImageDescriptorLayout);
+        VkDescriptorImageInfo lImageInfo = { VK_NULL_HANDLE, mDevice->getImageView(mDrawImage), VK_IMAGE_LAYOUT_GENERAL };
+        VkWriteDescriptorSet lWrite = { VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET };
+        lWrite.dstSet = lSet;
+        lWrite.dstBinding = 0;
+        lWrite.descriptorCount = 1;
+        lWrite.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+        lWrite.pImageInfo = &lImageInfo;
+        vkUpdateDescriptorSets(mDevice->mLogicalDevice, 1, &lWrite, 0, nullptr);
 
         // Bind the descriptor set
-        vkCmdBindDescriptorSets(pCmd, VK_PIPELINE_BIND_POINT_COMPUTE, mGradientPipelineLayout, 0, 1, &mDrawImageDescriptors, 0, nullptr);
+        vkCmdBindDescriptorSets(pCmd, VK_PIPELINE_BIND_POINT_COMPUTE, mGradientPipelineLayout, 0, 1, &lSet, 0, nullptr);
 
         // Push constant
         vkCmdPushConstants(pCmd, mGradientPipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(PushConstantData), &mPushConstants);
         
         // Dispatch
-        vkCmdDispatch(pCmd, (uint32_t)ceil(mDrawImage.mExtent.width / 16.0), (uint32_t)ceil(mDrawImage.mExtent.height / 16.0), 1);
+        vkCmdDispatch(pCmd, mGradientConfig.groupCount(lDrawExtent.width, 0), mGradientConfig.groupCount(lDrawExtent.height, 1), 1);
 
         // Ready fo src transfert
-        vkh::transitionImage(pCmd, mDrawImage.mImage, VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL);
+        vkh::transitionImage(pCmd, lDrawImage, VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL);
 
-        // Copy the mDrawImage.mImage to the swapchain image
-        vkh::copyImageToImage(pCmd, mDrawImage.mImage, mSwapchain->getImage(), { mDrawImage.mExtent.width, mDrawImage.mExtent.height }, { mDrawImage.mExtent.width, mDrawImage.mExtent.height });
+        // Copy the lDrawImage to the swapchain image
+        vkh::copyImageToImage(pCmd, lDrawImage, mSwapchain->getImage(), { lDrawExtent.width, lDrawExtent.height }, { lDrawExtent.width, lDrawExtent.height });
 
         // Make the swapchain ready for presentation
         vkh::transitionImage(pCmd, mSwapchain->getImage(), VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_PRESENT_SRC_KHR);
     }
 
-    void immediateSubmit(std::function<void(VkCommandBuffer cmd)>&& function)
+    // Template instead of std::function to not heap allocate the captures
+    template<typename Function>
+    void immediateSubmit(Function&& function)
     {               
         VK_CHECK(vkResetFences(mDevice->mLogicalDevice, 1, &mImmediateCommandBuffer.mFence));
         VK_CHECK(vkResetCommandBuffer(mImmediateCommandBuffer.mCommandBuffer, 0));
@@ -390,6 +478,18 @@ struct VulkanApp
         VK_CHECK(vkWaitForFences(mDevice->mLogicalDevice, 1, &lCurrentFrame.mCommandBuffer.mFence, VK_TRUE, UINT64_MAX));
         VK_CHECK(vkResetFences(mDevice->mLogicalDevice, 1, &lCurrentFrame.mCommandBuffer.mFence));
 
+        // May save the pipeline cache, allocates
+        mPipelineCache.update();
+        // Swap the pipelines of the edited shaders
+        mShaderHotReload.beginFrame();
+
+        // The gpu no more use the frame data, its transient memory can be reused
+        lCurrentFrame.mArena.reset();
+        lCurrentFrame.mDescriptors.clearDescriptors(mDevice->mLogicalDevice);
+
+        // From here the frame must only allocate in its arena
+        NoHeapAllocationScope lNoAllocScope("render");
+
         mSwapchain->acquireNextImage(getCurrentFrame().mSwapchainSemaphore);
 
         VK_CHECK(vkResetCommandBuffer(lCommandBuffer, 0));
@@ -400,7 +500,7 @@ struct VulkanApp
 
         
         //draw_background_by_clearing_image(lCommandBuffer);
-        draw_background_with_gradient_compute_shader(lCommandBuffer);
+        draw_background_with_gradient_compute_shader(lCommandBuffer, lCurrentFrame);
         
         vkh::transitionImage(lCommandBuffer, mSwapchain->getImage(), VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_ATTACHMENT_OPTIMAL);
         drawImGui(lCommandBuffer, mSwapchain->getImageView());
@@ -449,6 +549,7 @@ struct VulkanApp
         initPipelines();
 
         initImGui();
+        waitPipelines();
 
         while (!mWindow->shouldClose())
         {
@@ -469,6 +570,17 @@ struct VulkanApp
             render();
         }
 
+        vkDeviceWaitIdle(mDevice->mLogicalDevice);
+        mShaderHotReload.shutdown();
+        mPipelineCompiler.shutdown();
+        mWorkgroupTuner.shutdown();
+        mShaderCompiler.shutdown();
+        mPipelineCache.shutdown();
+        for (FrameData& lFrameData : mFrameData)
+            lFrameData.mDescriptors.destroyPool(mDevice->mLogicalDevice);
+        mGlobalDescriptorAllocator.destroyPool(mDevice->mLogicalDevice);
+        DescriptorLayoutBuilder::destroy(mDevice->mLogicalDevice, mDrawImageDescriptorLayout);
+        mDevice->destroyResources();
         return 0;
     }
 };
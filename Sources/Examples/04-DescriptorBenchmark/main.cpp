@@ -0,0 +1,382 @@
+#include <VulkanContext.h>
+#include <VulkanDevice.h>
+#include <VulkanHelper.h>
+#include <VulkanDescriptor.h>
+#include <VulkanDescriptorBuffer.h>
+#include <VulkanDescriptorCache.h>
+#include <VulkanShader.h>
+#include <VulkanShaderArchive.h>
+#include <VulkanPipelineLayout.h>
+#include <VulkanPipelineCache.h>
+
+#include "assert.h"
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+#include <string>
+
+// CPU cost of the descriptor backends
+// Each frame records cDispatchCount dispatches, each one with its own resources
+// (1 uniform buffer range + 2 storage buffer ranges), bound with:
+//   - Sets : DescriptorAllocator::allocate + DescriptorWriter::updateSet + vkCmdBindDescriptorSets
+//   - Cached sets : DescriptorSetCache::get + vkCmdBindDescriptorSets, the sets are written on the first frame only
+//   - Push descriptors : vkCmdPushDescriptorSetKHR
+//   - Descriptor buffer : DescriptorBufferAllocator::allocate/write + vkCmdSetDescriptorBufferOffsetsEXT (same code as the sets)
+//   - Sets template : PipelineLayoutCache::bindDescriptors fallback, allocate + vkUpdateDescriptorSetWithTemplate + vkCmdBindDescriptorSets
+//   - Push template : PipelineLayoutCache::bindDescriptors, vkCmdPushDescriptorSetWithTemplateKHR
+// The template backends use the layout reflected from the shader (PipelineLayoutCache).
+// The recording time (cpu) and the submit to fence time (gpu + driver) are averaged over cFrameCount frames.
+struct DescriptorBenchmark
+{
+    static const uint32_t cDispatchCount = 4096;
+    static const uint32_t cFrameCount = 64;
+    static const uint32_t cWarmupFrames = 4;
+    static const uint32_t cValuesPerDispatch = 64;
+
+    enum class Backend
+    {
+        Sets,
+        CachedSets,
+        PushDescriptors,
+        DescriptorBuffer,
+        SetsTemplate,
+        PushTemplate,
+    };
+
+    struct Result
+    {
+        double mRecordMs = 0.0;
+        double mExecuteMs = 0.0;
+    };
+
+    VulkanInstance* mInstance;
+    VulkanDevice* mDevice;
+    PipelineCache mPipelineCache;
+
+    VkCommandPool mCommandPool;
+    VkCommandBuffer mCommandBuffer;
+    VkFence mFence;
+
+    ShaderArchive mShaders;
+    const VulkanShader* mShader = nullptr;
+    PipelineLayoutCache mLayouts;
+    DescriptorSetCache::Stats mCacheStats;
+    BufferHandle mParams;
+    BufferHandle mSource;
+    BufferHandle mDestination;
+    VkDeviceSize mParamsStride;
+    VkDeviceSize mStorageStride;
+
+    std::string getShaderPath()
+    {
+        return std::string("../Shaders/");
+    }
+
+    void init()
+    {
+        VK_CHECK(volkInitialize());
+
+        mInstance = new VulkanInstance;
+        mInstance->createInstance(VK_API_VERSION_1_3, true);
+        mInstance->enumeratePhysicalDevices();
+        VkPhysicalDevice lPhysicalDevice = mInstance->pickPhysicalDevice(VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT);
+
+        mDevice = new VulkanDevice(lPhysicalDevice);
+        mDevice->createLogicalDevice(VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT, mInstance->mVulkanInstance);
+
+        PipelineCache::Settings lPipelineCacheSettings;
+        lPipelineCacheSettings.mFilename = "descriptor_benchmark_pipeline_cache.bin";
+        lPipelineCacheSettings.mSaveInterval = 0.0;
+        mPipelineCache.init(mDevice, lPipelineCacheSettings);
+
+        mCommandPool = vkh::createCommandPool(mDevice->mLogicalDevice, mDevice->getQueueFamilyIndex(VulkanQueueType::Graphics), VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT);
+        VkCommandBufferAllocateInfo lCmdAllocInfo = vkh::commandBufferAllocateInfo(mCommandPool, 1, VK_COMMAND_BUFFER_LEVEL_PRIMARY);
+        VK_CHECK(vkAllocateCommandBuffers(mDevice->mLogicalDevice, &lCmdAllocInfo, &mCommandBuffer));
+        mFence = vkh::createFence(mDevice->mLogicalDevice, 0);
+
+        // Packed from the spirv of the shader folder when they changed
+        const std::string lArchive = "shaders.vksa";
+        ShaderArchive::build(lArchive, getShaderPath());
+        mShaders.init(mDevice->mLogicalDevice, lArchive);
+        mShader = &mShaders.get("descriptor_benchmark.comp.glsl");
+        assert(mShader->isValid());
+        mLayouts.init(mDevice->mLogicalDevice);
+
+        // One range per dispatch in each buffer
+        const VkPhysicalDeviceLimits& lLimits = mDevice->mPhysicalDeviceProperties.limits;
+        mParamsStride = std::max<VkDeviceSize>(lLimits.minUniformBufferOffsetAlignment, 2 * sizeof(uint32_t));
+        mStorageStride = std::max<VkDeviceSize>(lLimits.minStorageBufferOffsetAlignment, cValuesPerDispatch * sizeof(float));
+
+        const VkBufferUsageFlags lAddress = VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT;    // For the descriptor buffer backend
+        mParams = mDevice->createBuffer(mParamsStride * cDispatchCount, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT | lAddress,
+            VMA_MEMORY_USAGE_AUTO, VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT | VMA_ALLOCATION_CREATE_MAPPED_BIT);
+        mSource = mDevice->createBuffer(mStorageStride * cDispatchCount, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | lAddress,
+            VMA_MEMORY_USAGE_AUTO, VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT | VMA_ALLOCATION_CREATE_MAPPED_BIT);
+        mDestination = mDevice->createBuffer(mStorageStride * cDispatchCount, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | lAddress);
+
+        uint8_t* lParams = (uint8_t*)mDevice->getBufferMappedData(mParams);
+        uint8_t* lSource = (uint8_t*)mDevice->getBufferMappedData(mSource);
+        for (uint32_t i = 0; i < cDispatchCount; ++i)
+        {
+            uint32_t lCount = cValuesPerDispatch;
+            float lScale = 1.0f + i;
+            memcpy(lParams + i * mParamsStride, &lCount, sizeof(lCount));
+            memcpy(lParams + i * mParamsStride + sizeof(lCount), &lScale, sizeof(lScale));
+            for (uint32_t v = 0; v < cValuesPerDispatch; ++v)
+                ((float*)(lSource + i * mStorageStride))[v] = (float)v;
+        }
+        mDevice->flushBuffer(mParams);
+        mDevice->flushBuffer(mSource);
+    }
+
+    void shutdown()
+    {
+        vkDeviceWaitIdle(mDevice->mLogicalDevice);
+
+        mPipelineCache.shutdown();
+        mLayouts.destroy();
+        mShaders.destroy();
+        vkDestroyFence(mDevice->mLogicalDevice, mFence, nullptr);
+        vkDestroyCommandPool(mDevice->mLogicalDevice, mCommandPool, nullptr);
+        mDevice->destroyResources();
+    }
+
+    // Layout and pipeline of a backend, the layouts only differ by their flags
+    void createPipeline(VkDescriptorSetLayoutCreateFlags pLayoutFlags, VkPipelineCreateFlags pPipelineFlags,
+        VkDescriptorSetLayout& pSetLayout, VkPipelineLayout& pPipelineLayout, VkPipeline& pPipeline)
+    {
+        DescriptorLayoutBuilder lBuilder;
+        lBuilder.addBinding(0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER);
+        lBuilder.addBinding(1, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER);
+        lBuilder.addBinding(2, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER);
+        pSetLayout = lBuilder.build(mDevice->mLogicalDevice, VK_SHADER_STAGE_COMPUTE_BIT, pLayoutFlags);
+
+        VkPipelineLayoutCreateInfo lLayoutInfo = vkh::pipelineLayoutCreateInfo(&pSetLayout, 1);
+        VK_CHECK(vkCreatePipelineLayout(mDevice->mLogicalDevice, &lLayoutInfo, nullptr, &pPipelineLayout));
+        pPipeline = createPipeline(pPipelineLayout, pPipelineFlags);
+    }
+
+    VkPipeline createPipeline(VkPipelineLayout pPipelineLayout, VkPipelineCreateFlags pPipelineFlags)
+    {
+        VkPipelineShaderStageCreateInfo lStage = vkh::pipelineShaderStageCreateInfo(mShader->mStage, mShader->mShaderModule);
+        VkComputePipelineCreateInfo lPipelineInfo = vkh::computePipelineCreateInfo(pPipelineLayout, lStage);
+        lPipelineInfo.flags = pPipelineFlags;
+        return mDevice->createComputePipeline(lPipelineInfo);
+    }
+
+    void writeDispatch(DescriptorWriter& pWriter, uint32_t pIndex)
+    {
+        pWriter.clear();
+        pWriter.writeBuffer(0, mDevice->getBuffer(mParams), 2 * sizeof(uint32_t), pIndex * mParamsStride, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER);
+        pWriter.writeBuffer(1, mDevice->getBuffer(mSource), cValuesPerDispatch * sizeof(float), pIndex * mStorageStride, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER);
+        pWriter.writeBuffer(2, mDevice->getBuffer(mDestination), cValuesPerDispatch * sizeof(float), pIndex * mStorageStride, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER);
+    }
+
+    // Same resources as writeDispatch, in the binding order of the template
+    void writeDispatch(DescriptorInfo* pDescriptors, uint32_t pIndex)
+    {
+        pDescriptors[0] = DescriptorInfo(mDevice->getBuffer(mParams), pIndex * mParamsStride, 2 * sizeof(uint32_t));
+        pDescriptors[1] = DescriptorInfo(mDevice->getBuffer(mSource), pIndex * mStorageStride, cValuesPerDispatch * sizeof(float));
+        pDescriptors[2] = DescriptorInfo(mDevice->getBuffer(mDestination), pIndex * mStorageStride, cValuesPerDispatch * sizeof(float));
+    }
+
+    // Sets and descriptor buffer backends, both allocators have the same interface
+    template<typename Allocator>
+    void bindDispatch(Allocator& pAllocator, DescriptorWriter& pWriter, VkDescriptorSetLayout pSetLayout, VkPipelineLayout pPipelineLayout)
+    {
+        typename Allocator::Set lSet = pAllocator.allocate(mDevice->mLogicalDevice, pSetLayout);
+        pAllocator.write(mDevice->mLogicalDevice, pWriter, lSet);
+        pAllocator.bind(mCommandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pPipelineLayout, 0, lSet);
+    }
+
+    Result run(Backend pBackend)
+    {
+        const bool lTemplate = pBackend == Backend::SetsTemplate || pBackend == Backend::PushTemplate;
+        VkDescriptorSetLayoutCreateFlags lLayoutFlags = 0;
+        VkPipelineCreateFlags lPipelineFlags = 0;
+        if (pBackend == Backend::PushDescriptors)
+            lLayoutFlags = VK_DESCRIPTOR_SET_LAYOUT_CREATE_PUSH_DESCRIPTOR_BIT_KHR;
+        if (pBackend == Backend::DescriptorBuffer)
+        {
+            lLayoutFlags = DescriptorBufferAllocator::cLayoutFlags;
+            lPipelineFlags = VK_PIPELINE_CREATE_DESCRIPTOR_BUFFER_BIT_EXT;
+        }
+
+        VkDescriptorSetLayout lSetLayout = VK_NULL_HANDLE;
+        VkPipelineLayout lPipelineLayout = VK_NULL_HANDLE;
+        VkPipeline lPipeline;
+        const PipelineLayoutCache::Layout* lLayout = nullptr;
+        if (lTemplate)
+        {
+            // Owned by mLayouts
+            const VulkanShader* lShader = mShader;
+            if (pBackend == Backend::PushTemplate)
+                lLayout = mLayouts.getPushLayout(*mDevice, &lShader, 1, VK_PIPELINE_BIND_POINT_COMPUTE);
+            else
+                lLayout = mLayouts.getLayout(&lShader, 1, VK_PIPELINE_BIND_POINT_COMPUTE);
+            assert(lLayout->mDescriptorCounts[0] == 3);
+            lPipeline = createPipeline(lLayout->mPipelineLayout, lPipelineFlags);
+        }
+        else
+        {
+            createPipeline(lLayoutFlags, lPipelineFlags, lSetLayout, lPipelineLayout, lPipeline);
+        }
+
+        // Room for the sets of a frame, the descriptor buffer doesn't grow
+        const std::vector<DescriptorAllocator::PoolSize> lPoolSizes = { { VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1 }, { VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 2 } };
+        DescriptorAllocator lAllocator;
+        DescriptorBufferAllocator lBufferAllocator;
+        if (pBackend == Backend::Sets || (lTemplate && !lLayout->mPushDescriptors))
+            lAllocator.initPool(*mDevice, cDispatchCount, lPoolSizes);
+        if (pBackend == Backend::DescriptorBuffer)
+            lBufferAllocator.initPool(*mDevice, cDispatchCount, lPoolSizes);
+
+        // Registered on the device for its invalidations while the run lasts, one frame in flight (fence wait)
+        DescriptorSetCache lCache;
+        if (pBackend == Backend::CachedSets)
+        {
+            DescriptorSetCache::Settings lCacheSettings;
+            lCacheSettings.mMaxSets = cDispatchCount;
+            lCacheSettings.mFramesInFlight = 1;
+            lCache.init(mDevice, lCacheSettings);
+            mDevice->mDescriptorSetCache = &lCache;
+        }
+
+        DescriptorWriter lWriter;
+        DescriptorInfo lDescriptors[3];
+        Result lResult;
+        for (uint32_t lFrame = 0; lFrame < cWarmupFrames + cFrameCount; ++lFrame)
+        {
+            auto lStart = std::chrono::high_resolution_clock::now();
+
+            VK_CHECK(vkResetCommandBuffer(mCommandBuffer, 0));
+            VkCommandBufferBeginInfo lBeginInfo = vkh::commandBufferBeginInfo(VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT);
+            VK_CHECK(vkBeginCommandBuffer(mCommandBuffer, &lBeginInfo));
+
+            vkCmdBindPipeline(mCommandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, lPipeline);
+            if (pBackend == Backend::DescriptorBuffer)
+                lBufferAllocator.bindBuffer(mCommandBuffer);
+
+            for (uint32_t i = 0; i < cDispatchCount; ++i)
+            {
+                if (lTemplate)
+                {
+                    writeDispatch(lDescriptors, i);
+                    PipelineLayoutCache::bindDescriptors(mDevice->mLogicalDevice, mCommandBuffer, *lLayout, 0, lDescriptors, lAllocator);
+                    vkCmdDispatch(mCommandBuffer, 1, 1, 1);
+                    continue;
+                }
+
+                if (pBackend != Backend::CachedSets)
+                    writeDispatch(lWriter, i);
+                switch (pBackend)
+                {
+                case Backend::Sets:
+                    bindDispatch(lAllocator, lWriter, lSetLayout, lPipelineLayout);
+                    break;
+                case Backend::CachedSets:
+                {
+                    VkDescriptorSet lSet = lCache.get(DescriptorSetKey(lSetLayout)
+                        .buffer(0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, mDevice->getBuffer(mParams), i * mParamsStride, 2 * sizeof(uint32_t))
+                        .buffer(1, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, mDevice->getBuffer(mSource), i * mStorageStride, cValuesPerDispatch * sizeof(float))
+                        .buffer(2, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, mDevice->getBuffer(mDestination), i * mStorageStride, cValuesPerDispatch * sizeof(float)));
+                    vkCmdBindDescriptorSets(mCommandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, lPipelineLayout, 0, 1, &lSet, 0, nullptr);
+                    break;
+                }
+                case Backend::PushDescriptors:
+                    vkCmdPushDescriptorSetKHR(mCommandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, lPipelineLayout, 0, (uint32_t)lWriter.mWrites.size(), lWriter.mWrites.data());
+                    break;
+                case Backend::DescriptorBuffer:
+                    bindDispatch(lBufferAllocator, lWriter, lSetLayout, lPipelineLayout);
+                    break;
+                default:
+                    break;
+                }
+                vkCmdDispatch(mCommandBuffer, 1, 1, 1);
+            }
+            VK_CHECK(vkEndCommandBuffer(mCommandBuffer));
+
+            auto lRecorded = std::chrono::high_resolution_clock::now();
+
+            VkCommandBufferSubmitInfo lCmdInfo = vkh::commandBufferSubmitInfo(mCommandBuffer);
+            VkSubmitInfo2 lSubmitInfo = vkh::submitInfo(&lCmdInfo, nullptr, nullptr);
+            VK_CHECK(vkQueueSubmit2(mDevice->getQueue(VulkanQueueType::Graphics), 1, &lSubmitInfo, mFence));
+            VK_CHECK(vkWaitForFences(mDevice->mLogicalDevice, 1, &mFence, VK_TRUE, UINT64_MAX));
+            VK_CHECK(vkResetFences(mDevice->mLogicalDevice, 1, &mFence));
+
+            auto lExecuted = std::chrono::high_resolution_clock::now();
+
+            // The gpu has finished with the descriptors of the frame
+            lAllocator.clearDescriptors(mDevice->mLogicalDevice);
+            lBufferAllocator.clearDescriptors(mDevice->mLogicalDevice);
+            if (pBackend == Backend::CachedSets)
+                lCache.beginFrame();
+
+            if (lFrame >= cWarmupFrames)
+            {
+                lResult.mRecordMs += std::chrono::duration<double, std::milli>(lRecorded - lStart).count() / cFrameCount;
+                lResult.mExecuteMs += std::chrono::duration<double, std::milli>(lExecuted - lRecorded).count() / cFrameCount;
+            }
+        }
+
+        if (pBackend == Backend::CachedSets)
+        {
+            // Stats of the last frame, all the sets written during the warmup
+            mCacheStats = lCache.getStats();
+            mDevice->mDescriptorSetCache = nullptr;
+            lCache.destroy();
+        }
+        lAllocator.destroyPool(mDevice->mLogicalDevice);
+        lBufferAllocator.destroyPool(mDevice->mLogicalDevice);
+        vkDestroyPipeline(mDevice->mLogicalDevice, lPipeline, nullptr);
+        if (!lTemplate)
+        {
+            vkDestroyPipelineLayout(mDevice->mLogicalDevice, lPipelineLayout, nullptr);
+            DescriptorLayoutBuilder::destroy(mDevice->mLogicalDevice, lSetLayout);
+        }
+        return lResult;
+    }
+
+    void print(const char* pName, const Result& pResult)
+    {
+        printf("%-20s record %8.3f ms (%6.1f ns/dispatch)   submit+wait %8.3f ms\n",
+            pName, pResult.mRecordMs, pResult.mRecordMs * 1e6 / cDispatchCount, pResult.mExecuteMs);
+    }
+
+    int run()
+    {
+        init();
+
+        printf("%u dispatches per frame, %u frames\n", cDispatchCount, cFrameCount);
+        print("Sets", run(Backend::Sets));
+        print("Cached sets", run(Backend::CachedSets));
+        printf("%-20s %u sets, hit rate %5.1f%% (%u hits, %u misses, %u writes), %u evictions, %u invalidations\n", "",
+            mCacheStats.mSetCount, mCacheStats.hitRate() * 100.0f, mCacheStats.mHits, mCacheStats.mMisses, mCacheStats.mWrites,
+            mCacheStats.mEvictions, mCacheStats.mInvalidations);
+
+        if (mDevice->mMaxPushDescriptors > 0)
+            print("Push descriptors", run(Backend::PushDescriptors));
+        else
+            printf("%-20s not supported\n", "Push descriptors");
+
+        // The push template falls back to the sets when push descriptors are not supported
+        print("Sets template", run(Backend::SetsTemplate));
+        print(mDevice->mMaxPushDescriptors > 0 ? "Push template" : "Push template (sets)", run(Backend::PushTemplate));
+
+        if (DescriptorBufferAllocator::isSupported(*mDevice))
+            print("Descriptor buffer", run(Backend::DescriptorBuffer));
+        else
+            printf("%-20s not supported\n", "Descriptor buffer");
+
+        shutdown();
+        return 0;
+    }
+};
+
+
+int main(int argc, const char* argv[])
+{
+    DescriptorBenchmark lBenchmark;
+    return lBenchmark.run();
+}
@@ -0,0 +1,337 @@
+#include <VulkanContext.h>
+#include <VulkanDevice.h>
+#include <VulkanHelper.h>
+#include <VulkanShader.h>
+#include <VulkanShaderCompiler.h>
+#include <VulkanPipeline.h>
+#include <VulkanPipelineLayout.h>
+#include <VulkanPipelineRegistry.h>
+#include <VulkanShaderObject.h>
+#include <VulkanRenderState.h>
+
+#include "assert.h"
+#include <stdio.h>
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include <vector>
+
+// Pipelines against shader objects (VK_EXT_shader_object) and dynamic state
+// cPermutationCount render states (cull mode, front face, topology, blending, color write mask) of the same
+// vertex/fragment shaders, drawn in an offscreen image:
+//   - Pipelines : one pipeline per state (PipelineBuilder), vkCmdBindPipeline per draw
+//   - Dynamic pipelines : PipelineBuilder::enableDynamicState, the states differing only by dynamic state
+//     share a pipeline (PipelineRegistry), RenderStateTracker per draw
+//   - Shader objects : the linked shaders created once, ShaderObjects::setState per draw
+//   - Shader objects tracked : the linked shaders created once, RenderStateTracker per draw
+// First use : creation time of the pipelines (cold, no pipeline cache) / of the shader objects.
+// Each frame records cDrawCount draws cycling through the states (worst case, the state changes at every draw),
+// the recording time (cpu) and the submit to fence time (gpu + driver) are averaged over cFrameCount frames.
+struct ShaderObjectBenchmark
+{
+    static const uint32_t cDrawCount = 4096;
+    static const uint32_t cFrameCount = 64;
+    static const uint32_t cWarmupFrames = 4;
+    static const uint32_t cPermutationCount = 64;
+    static const VkFormat cColorFormat = VK_FORMAT_R8G8B8A8_UNORM;
+
+    enum class Backend
+    {
+        Pipelines,
+        DynamicPipelines,
+        ShaderObjects,
+        ShaderObjectsTracked,
+    };
+
+    struct Result
+    {
+        double mFirstUseMs = 0.0;       // Creation of everything needed by the draws
+        double mFirstUseMaxMs = 0.0;    // Longest single creation (the hitch of a new state)
+        double mRecordMs = 0.0;
+        double mExecuteMs = 0.0;
+        uint32_t mPipelineCount = 0;
+        RenderStateTracker::Stats mTracker;     // Last frame
+    };
+
+    VulkanInstance* mInstance;
+    VulkanDevice* mDevice;
+
+    VkCommandPool mCommandPool;
+    VkCommandBuffer mCommandBuffer;
+    VkFence mFence;
+
+    ShaderCompiler mShaderCompiler;
+    VulkanShader mVertexShader;
+    VulkanShader mFragmentShader;
+    PipelineLayoutCache mLayouts;
+    const PipelineLayoutCache::Layout* mLayout;
+    ImageHandle mTarget;
+    VkExtent2D mExtent = { 256, 256 };
+
+    std::vector<PipelineBuilder> mStates;
+
+    std::string getShaderPath()
+    {
+        return std::string("../Shaders/");
+    }
+
+    void init()
+    {
+        VK_CHECK(volkInitialize());
+
+        mInstance = new VulkanInstance;
+        mInstance->createInstance(VK_API_VERSION_1_3, true);
+        mInstance->enumeratePhysicalDevices();
+        VkPhysicalDevice lPhysicalDevice = mInstance->pickPhysicalDevice(VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT);
+
+        mDevice = new VulkanDevice(lPhysicalDevice);
+        mDevice->createLogicalDevice(VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT, mInstance->mVulkanInstance);
+
+        mCommandPool = vkh::createCommandPool(mDevice->mLogicalDevice, mDevice->getQueueFamilyIndex(VulkanQueueType::Graphics), VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT);
+        VkCommandBufferAllocateInfo lCmdAllocInfo = vkh::commandBufferAllocateInfo(mCommandPool, 1, VK_COMMAND_BUFFER_LEVEL_PRIMARY);
+        VK_CHECK(vkAllocateCommandBuffers(mDevice->mLogicalDevice, &lCmdAllocInfo, &mCommandBuffer));
+        mFence = vkh::createFence(mDevice->mLogicalDevice, 0);
+
+        // Both stages compiled in parallel, or read from the spirv cache when unchanged
+        ShaderCompiler::Settings lCompilerSettings;
+        lCompilerSettings.mShaderPath = getShaderPath();
+        mShaderCompiler.init(lCompilerSettings);
+        std::shared_future<ShaderCompiler::Result> lVertex = mShaderCompiler.compileAsync("triangle.vert.glsl");
+        std::shared_future<ShaderCompiler::Result> lFragment = mShaderCompiler.compileAsync("triangle.frag.glsl");
+        assert(lVertex.get().isValid() && lFragment.get().isValid());
+        mVertexShader = VulkanShader::loadFromCode(mDevice->mLogicalDevice, lVertex.get().mCode.data(), lVertex.get().mCode.size());
+        mFragmentShader = VulkanShader::loadFromCode(mDevice->mLogicalDevice, lFragment.get().mCode.data(), lFragment.get().mCode.size());
+
+        mLayouts.init(mDevice->mLogicalDevice);
+        const VulkanShader* lShaders[] = { &mVertexShader, &mFragmentShader };
+        mLayout = mLayouts.getLayout(lShaders, 2, VK_PIPELINE_BIND_POINT_GRAPHICS);
+
+        VkImageCreateInfo lImageInfo = vkh::imageCreateInfo(cColorFormat, VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT, { mExtent.width, mExtent.height, 1 });
+        mTarget = mDevice->createImage(lImageInfo, VK_IMAGE_ASPECT_COLOR_BIT);
+        assert(mTarget.isValid());
+
+        initStates();
+    }
+
+    void initStates()
+    {
+        const VkCullModeFlags cCullModes[] = { VK_CULL_MODE_NONE, VK_CULL_MODE_BACK_BIT };
+        const VkFrontFace cFrontFaces[] = { VK_FRONT_FACE_COUNTER_CLOCKWISE, VK_FRONT_FACE_CLOCKWISE };
+        const VkPrimitiveTopology cTopologies[] = { VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST, VK_PRIMITIVE_TOPOLOGY_TRIANGLE_STRIP };
+        const VkBool32 cBlendEnables[] = { VK_FALSE, VK_TRUE };
+        const VkColorComponentFlags cWriteMasks[] = {
+            VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT,
+            VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT,
+            VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT,
+            VK_COLOR_COMPONENT_R_BIT,
+        };
+
+        mStates.resize(cPermutationCount);
+        for (uint32_t i = 0; i < cPermutationCount; ++i)
+        {
+            PipelineBuilder& lState = mStates[i];
+            lState.mShaderStages.push_back(vkh::pipelineShaderStageCreateInfo(mVertexShader.mStage, mVertexShader.mShaderModule));
+            lState.mShaderStages.push_back(vkh::pipelineShaderStageCreateInfo(mFragmentShader.mStage, mFragmentShader.mShaderModule));
+            lState.mPipelineLayout = mLayout->mPipelineLayout;
+
+            lState.mInputAssembly.topology = cTopologies[(i / 4) % 2];
+            lState.mRasterizer.polygonMode = VK_POLYGON_MODE_FILL;
+            lState.mRasterizer.lineWidth = 1.0f;
+            lState.mRasterizer.cullMode = cCullModes[i % 2];
+            lState.mRasterizer.frontFace = cFrontFaces[(i / 2) % 2];
+            lState.mMultisampling.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
+            lState.mMultisampling.minSampleShading = 1.0f;
+            lState.mDepthStencil.depthCompareOp = VK_COMPARE_OP_ALWAYS;
+            lState.mDepthStencil.maxDepthBounds = 1.0f;
+
+            VkPipelineColorBlendAttachmentState& lBlend = lState.mColorBlendAttachment;
+            lBlend.blendEnable = cBlendEnables[(i / 8) % 2];
+            lBlend.srcColorBlendFactor = VK_BLEND_FACTOR_SRC_ALPHA;
+            lBlend.dstColorBlendFactor = VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA;
+            lBlend.colorBlendOp = VK_BLEND_OP_ADD;
+            lBlend.srcAlphaBlendFactor = VK_BLEND_FACTOR_ONE;
+            lBlend.dstAlphaBlendFactor = VK_BLEND_FACTOR_ZERO;
+            lBlend.alphaBlendOp = VK_BLEND_OP_ADD;
+            lBlend.colorWriteMask = cWriteMasks[(i / 16) % 4];
+
+            // pColorAttachmentFormats points in the builder, set once the vector is sized
+            lState.mColorAttachmentformat = cColorFormat;
+            lState.mRenderInfo.colorAttachmentCount = 1;
+            lState.mRenderInfo.pColorAttachmentFormats = &lState.mColorAttachmentformat;
+        }
+    }
+
+    void shutdown()
+    {
+        vkDeviceWaitIdle(mDevice->mLogicalDevice);
+
+        mShaderCompiler.shutdown();
+        mLayouts.destroy();
+        vkDestroyShaderModule(mDevice->mLogicalDevice, mVertexShader.mShaderModule, nullptr);
+        vkDestroyShaderModule(mDevice->mLogicalDevice, mFragmentShader.mShaderModule, nullptr);
+        vkDestroyFence(mDevice->mLogicalDevice, mFence, nullptr);
+        vkDestroyCommandPool(mDevice->mLogicalDevice, mCommandPool, nullptr);
+        mDevice->destroyResources();
+    }
+
+    Result run(Backend pBackend)
+    {
+        Result lResult;
+
+        // First use
+        std::vector<VkPipeline> lPipelines;
+        PipelineRegistry lRegistry;
+        ShaderObjects lShaderObjects;
+        const bool lPipelineBackend = pBackend == Backend::Pipelines || pBackend == Backend::DynamicPipelines;
+        const uint32_t lDynamicState = pBackend == Backend::DynamicPipelines ? PipelineBuilder::getSupportedDynamicState(*mDevice) : 0;
+        if (lPipelineBackend)
+        {
+            lRegistry.init(mDevice);
+            for (const PipelineBuilder& lState : mStates)
+            {
+                PipelineBuilder lDynamicBuilder = lState;   // pColorAttachmentFormats still points in lState
+                lDynamicBuilder.mDynamicState = lDynamicState;
+
+                auto lStart = std::chrono::high_resolution_clock::now();
+                lPipelines.push_back(lRegistry.get(lDynamicBuilder));
+                double lMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - lStart).count();
+                lResult.mFirstUseMs += lMs;
+                lResult.mFirstUseMaxMs = std::max(lResult.mFirstUseMaxMs, lMs);
+            }
+            lResult.mPipelineCount = lRegistry.getStats().mPipelineCount;
+        }
+        else
+        {
+            auto lStart = std::chrono::high_resolution_clock::now();
+            const VulkanShader* lShaders[] = { &mVertexShader, &mFragmentShader };
+            lShaderObjects.create(mDevice, lShaders, 2, *mLayout);
+            lResult.mFirstUseMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - lStart).count();
+            lResult.mFirstUseMaxMs = lResult.mFirstUseMs;
+        }
+
+        VkViewport lViewport = { 0.0f, 0.0f, (float)mExtent.width, (float)mExtent.height, 0.0f, 1.0f };
+        VkRect2D lScissor = { { 0, 0 }, mExtent };
+        RenderStateTracker lTracker;
+        for (uint32_t lFrame = 0; lFrame < cWarmupFrames + cFrameCount; ++lFrame)
+        {
+            auto lStart = std::chrono::high_resolution_clock::now();
+
+            VK_CHECK(vkResetCommandBuffer(mCommandBuffer, 0));
+            VkCommandBufferBeginInfo lBeginInfo = vkh::commandBufferBeginInfo(VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT);
+            VK_CHECK(vkBeginCommandBuffer(mCommandBuffer, &lBeginInfo));
+
+            vkh::transitionImage(mCommandBuffer, mDevice->getImage(mTarget), VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL);
+            VkClearValue lClear = {};
+            VkRenderingAttachmentInfo lColorAttachment = vkh::renderingAttachmentInfo(mDevice->getImageView(mTarget), VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, &lClear);
+            VkRenderingInfo lRenderInfo = vkh::renderingInfo(lScissor, &lColorAttachment);
+            vkCmdBeginRendering(mCommandBuffer, &lRenderInfo);
+            lTracker = RenderStateTracker();
+            lTracker.begin(mCommandBuffer);
+
+            switch (pBackend)
+            {
+            case Backend::Pipelines:
+                vkCmdSetViewport(mCommandBuffer, 0, 1, &lViewport);
+                vkCmdSetScissor(mCommandBuffer, 0, 1, &lScissor);
+                for (uint32_t i = 0; i < cDrawCount; ++i)
+                {
+                    vkCmdBindPipeline(mCommandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, lPipelines[i % cPermutationCount]);
+                    vkCmdDraw(mCommandBuffer, 3, 1, 0, 0);
+                }
+                break;
+            case Backend::DynamicPipelines:
+                vkCmdSetViewport(mCommandBuffer, 0, 1, &lViewport);
+                vkCmdSetScissor(mCommandBuffer, 0, 1, &lScissor);
+                for (uint32_t i = 0; i < cDrawCount; ++i)
+                {
+                    lTracker.bindPipeline(lPipelines[i % cPermutationCount], VK_PIPELINE_BIND_POINT_GRAPHICS, lDynamicState);
+                    lTracker.setState(mStates[i % cPermutationCount], lDynamicState);
+                    vkCmdDraw(mCommandBuffer, 3, 1, 0, 0);
+                }
+                break;
+            case Backend::ShaderObjects:
+                lShaderObjects.bind(mCommandBuffer);
+                for (uint32_t i = 0; i < cDrawCount; ++i)
+                {
+                    ShaderObjects::setState(mCommandBuffer, mStates[i % cPermutationCount], mExtent);
+                    vkCmdDraw(mCommandBuffer, 3, 1, 0, 0);
+                }
+                break;
+            case Backend::ShaderObjectsTracked:
+                // The state the tracker does not cover (viewport, vertex input, samples) is set once
+                lShaderObjects.bind(mCommandBuffer);
+                ShaderObjects::setState(mCommandBuffer, mStates[0], mExtent);
+                for (uint32_t i = 0; i < cDrawCount; ++i)
+                {
+                    lTracker.setState(mStates[i % cPermutationCount], PipelineBuilder::cDynamicAll);
+                    vkCmdDraw(mCommandBuffer, 3, 1, 0, 0);
+                }
+                break;
+            }
+
+            vkCmdEndRendering(mCommandBuffer);
+            VK_CHECK(vkEndCommandBuffer(mCommandBuffer));
+
+            auto lRecorded = std::chrono::high_resolution_clock::now();
+
+            VkCommandBufferSubmitInfo lCmdInfo = vkh::commandBufferSubmitInfo(mCommandBuffer);
+            VkSubmitInfo2 lSubmitInfo = vkh::submitInfo(&lCmdInfo, nullptr, nullptr);
+            VK_CHECK(vkQueueSubmit2(mDevice->getQueue(VulkanQueueType::Graphics), 1, &lSubmitInfo, mFence));
+            VK_CHECK(vkWaitForFences(mDevice->mLogicalDevice, 1, &mFence, VK_TRUE, UINT64_MAX));
+            VK_CHECK(vkResetFences(mDevice->mLogicalDevice, 1, &mFence));
+
+            auto lExecuted = std::chrono::high_resolution_clock::now();
+
+            if (lFrame >= cWarmupFrames)
+            {
+                lResult.mRecordMs += std::chrono::duration<double, std::milli>(lRecorded - lStart).count() / cFrameCount;
+                lResult.mExecuteMs += std::chrono::duration<double, std::milli>(lExecuted - lRecorded).count() / cFrameCount;
+            }
+        }
+
+        lResult.mTracker = lTracker.getStats();
+
+        // The registry owns the pipelines
+        lRegistry.destroy();
+        lShaderObjects.destroy(mDevice->mLogicalDevice);
+        return lResult;
+    }
+
+    void print(const char* pName, const Result& pResult)
+    {
+        printf("%-24s first use %8.3f ms (max %7.3f ms)   record %8.3f ms (%6.1f ns/draw)   submit+wait %8.3f ms",
+            pName, pResult.mFirstUseMs, pResult.mFirstUseMaxMs, pResult.mRecordMs, pResult.mRecordMs * 1e6 / cDrawCount, pResult.mExecuteMs);
+        if (pResult.mPipelineCount > 0)
+            printf("   %u pipelines", pResult.mPipelineCount);
+        if (pResult.mTracker.mCalls + pResult.mTracker.mSkipped > 0)
+            printf("   %llu state calls (%llu skipped)", (unsigned long long)pResult.mTracker.mCalls, (unsigned long long)pResult.mTracker.mSkipped);
+        printf("\n");
+    }
+
+    int run()
+    {
+        init();
+
+        printf("%u states, %u draws per frame, %u frames\n", cPermutationCount, cDrawCount, cFrameCount);
+        print("Pipelines", run(Backend::Pipelines));
+        print("Dynamic pipelines", run(Backend::DynamicPipelines));
+
+        if (ShaderObjects::isSupported(*mDevice))
+        {
+            print("Shader objects", run(Backend::ShaderObjects));
+            print("Shader objects tracked", run(Backend::ShaderObjectsTracked));
+        }
+        else
+            printf("%-24s not supported\n", "Shader objects");
+
+        shutdown();
+        return 0;
+    }
+};
+
+
+int main(int argc, const char* argv[])
+{
+    ShaderObjectBenchmark lBenchmark;
+    return lBenchmark.run();
+}
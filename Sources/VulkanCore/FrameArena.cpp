@@ -0,0 +1,214 @@
+#include "FrameArena.h"
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <new>
+#include <algorithm>
+
+static const size_t cBlockGranularity = 4 * 1024;
+static const size_t cMaxOverflowBlocks = 64;
+
+static inline size_t alignUp(size_t pValue, size_t pAlignment)
+{
+    return (pValue + pAlignment - 1) & ~(pAlignment - 1);
+}
+
+/******************************************************************************/
+FrameArena::FrameArena(FrameArena&& pOther) noexcept
+    : mBlock(pOther.mBlock)
+    , mCapacity(pOther.mCapacity)
+    , mOffset(pOther.mOffset)
+    , mUpstream(pOther.mUpstream)
+    , mOverflowBlocks(std::move(pOther.mOverflowBlocks))
+    , mOverflowBytes(pOther.mOverflowBytes)
+    , mOverflowCount(pOther.mOverflowCount)
+    , mHistoryIndex(pOther.mHistoryIndex)
+    , mHighWater(pOther.mHighWater)
+{
+    std::copy(pOther.mHistory, pOther.mHistory + cHistoryCount, mHistory);
+    pOther.mBlock = nullptr;
+    pOther.mCapacity = 0;
+    pOther.mUpstream = nullptr;
+}
+
+/******************************************************************************/
+FrameArena::~FrameArena()
+{
+    release();
+}
+
+/******************************************************************************/
+void FrameArena::init(size_t pInitialSize, std::pmr::memory_resource* pUpstream)
+{
+    release();
+
+    mUpstream = pUpstream;
+    mCapacity = alignUp(pInitialSize, cBlockGranularity);
+    mBlock = static_cast<std::byte*>(mUpstream->allocate(mCapacity, alignof(std::max_align_t)));
+    mOffset = 0;
+    mOverflowBlocks.reserve(cMaxOverflowBlocks);
+}
+
+/******************************************************************************/
+void FrameArena::release()
+{
+    if (mUpstream == nullptr)
+        return;
+
+    for (auto& lBlock : mOverflowBlocks)
+        mUpstream->deallocate(lBlock.first, lBlock.second, alignof(std::max_align_t));
+    mOverflowBlocks.clear();
+
+    if (mBlock != nullptr)
+        mUpstream->deallocate(mBlock, mCapacity, alignof(std::max_align_t));
+    mBlock = nullptr;
+    mCapacity = 0;
+    mOffset = 0;
+    mOverflowBytes = 0;
+}
+
+/******************************************************************************/
+void FrameArena::reset()
+{
+    assert(mUpstream != nullptr && "FrameArena : init() not called");
+
+    // Record the usage of the frame that just finished
+    mHistory[mHistoryIndex] = mOffset + mOverflowBytes;
+    mHistoryIndex = (mHistoryIndex + 1) % cHistoryCount;
+    mHighWater = *std::max_element(mHistory, mHistory + cHistoryCount);
+
+    for (auto& lBlock : mOverflowBlocks)
+        mUpstream->deallocate(lBlock.first, lBlock.second, alignof(std::max_align_t));
+    mOverflowBlocks.clear();
+    mOverflowBytes = 0;
+    mOverflowCount = 0;
+    mOffset = 0;
+
+    // Grow with some margin when a recent frame didn't fit
+    // Shrink only when the block is largely oversized for all the recent frames, to avoid oscillations
+    size_t lNewCapacity = mCapacity;
+    if (mHighWater > mCapacity)
+        lNewCapacity = alignUp(mHighWater + mHighWater / 4, cBlockGranularity);
+    else if (mHighWater * 4 < mCapacity && mCapacity > cDefaultSize)
+        lNewCapacity = std::max(alignUp(mHighWater * 2, cBlockGranularity), cDefaultSize);
+
+    if (lNewCapacity != mCapacity)
+    {
+        mUpstream->deallocate(mBlock, mCapacity, alignof(std::max_align_t));
+        mCapacity = lNewCapacity;
+        mBlock = static_cast<std::byte*>(mUpstream->allocate(mCapacity, alignof(std::max_align_t)));
+    }
+}
+
+/******************************************************************************/
+void* FrameArena::do_allocate(size_t pBytes, size_t pAlignment)
+{
+    size_t lOffset = alignUp(mOffset, pAlignment);
+    if (lOffset + pBytes <= mCapacity)
+    {
+        mOffset = lOffset + pBytes;
+        return mBlock + lOffset;
+    }
+
+    // Doesn't fit, the block will be resized at the next reset()
+    void* lPtr = mUpstream->allocate(pBytes, std::max(pAlignment, alignof(std::max_align_t)));
+    mOverflowBlocks.push_back({ lPtr, pBytes });
+    mOverflowBytes += pBytes;
+    ++mOverflowCount;
+    return lPtr;
+}
+
+/******************************************************************************/
+void FrameArena::do_deallocate(void* pPtr, size_t pBytes, size_t pAlignment)
+{
+    // Memory is released all at once in reset()
+}
+
+/******************************************************************************/
+bool FrameArena::do_is_equal(const std::pmr::memory_resource& pOther) const noexcept
+{
+    return this == &pOther;
+}
+
+/******************************************************************************/
+/******************************************************************************/
+/******************************************************************************/
+// Replace the global operator new in debug to count the heap allocations
+// Only the throwing scalar versions are needed, the array and nothrow versions forward to them
+// The aligned version is used by std::pmr::new_delete_resource()
+#ifndef NDEBUG
+static thread_local uint64_t sHeapAllocationCount = 0;
+
+void* operator new(size_t pSize)
+{
+    ++sHeapAllocationCount;
+    void* lPtr = malloc(pSize ? pSize : 1);
+    if (lPtr == nullptr)
+        throw std::bad_alloc();
+    return lPtr;
+}
+
+void operator delete(void* pPtr) noexcept
+{
+    free(pPtr);
+}
+
+void operator delete(void* pPtr, size_t) noexcept
+{
+    free(pPtr);
+}
+
+void* operator new(size_t pSize, std::align_val_t pAlignment)
+{
+    ++sHeapAllocationCount;
+    size_t lAlignment = (size_t)pAlignment;
+#ifdef _WIN32
+    void* lPtr = _aligned_malloc(pSize ? pSize : 1, lAlignment);
+#else
+    void* lPtr = aligned_alloc(lAlignment, alignUp(pSize ? pSize : 1, lAlignment));
+#endif
+    if (lPtr == nullptr)
+        throw std::bad_alloc();
+    return lPtr;
+}
+
+void operator delete(void* pPtr, std::align_val_t) noexcept
+{
+#ifdef _WIN32
+    _aligned_free(pPtr);
+#else
+    free(pPtr);
+#endif
+}
+
+void operator delete(void* pPtr, size_t, std::align_val_t pAlignment) noexcept
+{
+    operator delete(pPtr, pAlignment);
+}
+
+uint64_t heapAllocationCount()
+{
+    return sHeapAllocationCount;
+}
+#else
+uint64_t heapAllocationCount()
+{
+    return 0;
+}
+#endif // NDEBUG
+
+/******************************************************************************/
+NoHeapAllocationScope::NoHeapAllocationScope(const char* pName)
+    : mName(pName)
+    , mStartCount(heapAllocationCount())
+{
+}
+
+/******************************************************************************/
+NoHeapAllocationScope::~NoHeapAllocationScope()
+{
+    uint64_t lCount = heapAllocationCount() - mStartCount;
+    if (lCount != 0)
+        printf("[NoHeapAllocationScope] %s : %llu heap allocations\n", mName, (unsigned long long)lCount);
+}
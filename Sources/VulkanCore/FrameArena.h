@@ -0,0 +1,83 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <cstddef>
+#include <memory_resource>
+#include <vector>
+
+// Per frame in flight bump allocator for the transient data of the render loop
+// (write descriptor sets, barriers, submit infos...).
+// Allocations are a pointer increment, deallocations are no-op, all the memory is
+// given back at once by reset() when the frame fence has signaled.
+// The block is sized from the high water mark of the previous frames, when a frame
+// doesn't fit the extra requests go to the upstream resource (counted in mOverflowCount)
+// and the block is grown at the next reset.
+// Not thread safe, use one arena per recording thread.
+struct FrameArena : public std::pmr::memory_resource
+{
+    static constexpr size_t cDefaultSize = 64 * 1024;
+    static constexpr uint32_t cHistoryCount = 16;     // Number of frames used to size the block
+
+    FrameArena() = default;
+    FrameArena(const FrameArena&) = delete;
+    FrameArena(FrameArena&& pOther) noexcept;     // To be stored in a std::vector (per frame data)
+    FrameArena& operator=(const FrameArena&) = delete;
+    ~FrameArena();
+
+    void init(size_t pInitialSize = cDefaultSize, std::pmr::memory_resource* pUpstream = std::pmr::new_delete_resource());
+    void release();
+
+    // Call once the gpu has finished with the frame (after the fence wait)
+    // Can reallocate the block, never call it while recording
+    void reset();
+
+    // Typed helpers, the memory is valid until the next reset()
+    template<typename T>
+    inline T* allocArray(size_t pCount)
+    {
+        return static_cast<T*>(allocate(pCount * sizeof(T), alignof(T)));
+    }
+
+    inline size_t capacity() const { return mCapacity; }
+    inline size_t used() const { return mOffset + mOverflowBytes; }
+
+    std::byte* mBlock = nullptr;
+    size_t mCapacity = 0;
+    size_t mOffset = 0;
+
+    // Requests that didn't fit in the block during the current frame
+    std::pmr::memory_resource* mUpstream = nullptr;
+    std::vector<std::pair<void*, size_t>> mOverflowBlocks;     // Reserved in init(), pushing doesn't allocate
+    size_t mOverflowBytes = 0;
+    uint32_t mOverflowCount = 0;
+
+    // Frame high water marks
+    size_t mHistory[cHistoryCount] = {};
+    uint32_t mHistoryIndex = 0;
+    size_t mHighWater = 0;          // Max of mHistory
+
+protected:
+    void* do_allocate(size_t pBytes, size_t pAlignment) override;
+    void do_deallocate(void* pPtr, size_t pBytes, size_t pAlignment) override;
+    bool do_is_equal(const std::pmr::memory_resource& pOther) const noexcept override;
+};
+
+// Containers backed by a frame arena, ex: FrameVector<VkWriteDescriptorSet> lWrites(&lFrame.mArena);
+template<typename T>
+using FrameVector = std::pmr::vector<T>;
+
+// Debug counter of the global heap allocations (operator new) made by the calling thread
+// Always return 0 when NDEBUG is defined (release)
+uint64_t heapAllocationCount();
+
+// Check that no heap allocation is done by the current thread inside a scope
+// (ex: the frame recording), report the number of allocations on exit
+struct NoHeapAllocationScope
+{
+    explicit NoHeapAllocationScope(const char* pName);
+    ~NoHeapAllocationScope();
+
+    const char* mName;
+    uint64_t mStartCount;
+};
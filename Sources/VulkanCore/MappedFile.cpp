@@ -0,0 +1,117 @@
+#include "MappedFile.h"
+
+#include <utility>
+
+#ifdef _WIN32
+#   include <windows.h>
+#else
+#   include <sys/mman.h>
+#   include <sys/stat.h>
+#   include <fcntl.h>
+#   include <unistd.h>
+#endif
+
+/******************************************************************************/
+MappedFile::MappedFile(MappedFile&& pOther) noexcept
+{
+    *this = std::move(pOther);
+}
+
+/******************************************************************************/
+MappedFile& MappedFile::operator=(MappedFile&& pOther) noexcept
+{
+    if (this != &pOther)
+    {
+        close();
+        std::swap(mData, pOther.mData);
+        std::swap(mSize, pOther.mSize);
+#ifdef _WIN32
+        std::swap(mFileHandle, pOther.mFileHandle);
+        std::swap(mMappingHandle, pOther.mMappingHandle);
+#endif
+    }
+    return *this;
+}
+
+/******************************************************************************/
+bool MappedFile::open(const char* pFilename)
+{
+    close();
+
+#ifdef _WIN32
+    HANDLE lFile = CreateFileA(pFilename, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if (lFile == INVALID_HANDLE_VALUE)
+        return false;
+
+    LARGE_INTEGER lSize;
+    if (!GetFileSizeEx(lFile, &lSize) || lSize.QuadPart == 0)
+    {
+        CloseHandle(lFile);
+        return false;
+    }
+
+    HANDLE lMapping = CreateFileMappingA(lFile, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (lMapping == nullptr)
+    {
+        CloseHandle(lFile);
+        return false;
+    }
+
+    void* lData = MapViewOfFile(lMapping, FILE_MAP_READ, 0, 0, 0);
+    if (lData == nullptr)
+    {
+        CloseHandle(lMapping);
+        CloseHandle(lFile);
+        return false;
+    }
+
+    mFileHandle = lFile;
+    mMappingHandle = lMapping;
+    mData = static_cast<const uint8_t*>(lData);
+    mSize = (size_t)lSize.QuadPart;
+#else
+    int lFile = ::open(pFilename, O_RDONLY);
+    if (lFile < 0)
+        return false;
+
+    struct stat lStat;
+    if (fstat(lFile, &lStat) != 0 || lStat.st_size == 0)
+    {
+        ::close(lFile);
+        return false;
+    }
+
+    void* lData = mmap(nullptr, (size_t)lStat.st_size, PROT_READ, MAP_PRIVATE, lFile, 0);
+    ::close(lFile);     // The mapping keep a reference on the file
+    if (lData == MAP_FAILED)
+        return false;
+
+    // Read once front to back
+    madvise(lData, (size_t)lStat.st_size, MADV_SEQUENTIAL);
+
+    mData = static_cast<const uint8_t*>(lData);
+    mSize = (size_t)lStat.st_size;
+#endif
+
+    return true;
+}
+
+/******************************************************************************/
+void MappedFile::close()
+{
+    if (mData == nullptr)
+        return;
+
+#ifdef _WIN32
+    UnmapViewOfFile(mData);
+    CloseHandle((HANDLE)mMappingHandle);
+    CloseHandle((HANDLE)mFileHandle);
+    mFileHandle = nullptr;
+    mMappingHandle = nullptr;
+#else
+    munmap((void*)mData, mSize);
+#endif
+
+    mData = nullptr;
+    mSize = 0;
+}
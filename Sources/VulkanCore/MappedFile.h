@@ -0,0 +1,29 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Read only memory mapped file
+// The content is paged in by the OS on access, no copy in user memory
+struct MappedFile
+{
+    MappedFile() = default;
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+    MappedFile(MappedFile&& pOther) noexcept;
+    MappedFile& operator=(MappedFile&& pOther) noexcept;
+    ~MappedFile() { close(); }
+
+    bool open(const char* pFilename);
+    void close();
+
+    inline bool isOpen() const { return mData != nullptr; }
+
+    const uint8_t* mData = nullptr;
+    size_t mSize = 0;
+
+#ifdef _WIN32
+    void* mFileHandle = nullptr;
+    void* mMappingHandle = nullptr;
+#endif
+};
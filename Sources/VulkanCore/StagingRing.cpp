@@ -0,0 +1,127 @@
+#include "StagingRing.h"
+#include "VulkanDevice.h"
+
+/******************************************************************************/
+static inline uint64_t alignUp(uint64_t pValue, uint64_t pAlignment)
+{
+    return (pValue + pAlignment - 1) & ~(pAlignment - 1);
+}
+
+/******************************************************************************/
+/******************************************************************************/
+/******************************************************************************/
+void StagingRing::init(VulkanDevice* pDevice, VkDeviceSize pSize)
+{
+    assert(mDevice == nullptr && "StagingRing : already initialized");
+
+    mDevice = pDevice;
+    mSize = alignUp(pSize, 256);
+    mBuffer = pDevice->createBuffer(mSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VMA_MEMORY_USAGE_AUTO,
+        VMA_ALLOCATION_CREATE_MAPPED_BIT | VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT);
+    mData = static_cast<uint8_t*>(pDevice->getBufferMappedData(mBuffer));
+    assert(mData != nullptr);
+
+    mEntries.clear();
+    mFirstId = 0;
+    mHead = 0;
+    mTail = 0;
+    mAborted = false;
+}
+
+/******************************************************************************/
+void StagingRing::destroy()
+{
+    if (mDevice == nullptr)
+        return;
+
+    assert(mEntries.empty() && "StagingRing : allocations still in use");
+    mDevice->destroyBuffer(mBuffer);
+    mBuffer = BufferHandle();
+    mData = nullptr;
+    mDevice = nullptr;
+}
+
+/******************************************************************************/
+bool StagingRing::allocate(VkDeviceSize pSize, VkDeviceSize pAlignment, Allocation& pAllocation)
+{
+    assert(pAlignment > 0 && (pAlignment & (pAlignment - 1)) == 0);
+    if (pSize == 0 || pSize > mSize)
+        return false;
+
+    std::unique_lock<std::mutex> lLock(mMutex);
+    for (;;)
+    {
+        if (mAborted)
+            return false;
+
+        // Nothing in flight, restart from the beginning of the buffer
+        if (mEntries.empty())
+            mHead = mTail = 0;
+
+        uint64_t lStart = alignUp(mHead, pAlignment);
+        if ((lStart % mSize) + pSize > mSize)
+            lStart = (lStart / mSize + 1) * mSize;      // Don't split across the end, skip to the next lap
+
+        if (lStart + pSize - mTail <= mSize)
+        {
+            pAllocation.mId = mFirstId + mEntries.size();
+            pAllocation.mOffset = lStart % mSize;
+            pAllocation.mSize = pSize;
+            pAllocation.mData = mData + pAllocation.mOffset;
+
+            mHead = lStart + pSize;
+            mEntries.push_back({ mHead, false });
+            return true;
+        }
+
+        mSpaceAvailable.wait(lLock);
+    }
+}
+
+/******************************************************************************/
+void StagingRing::free(const Allocation& pAllocation)
+{
+    {
+        std::lock_guard<std::mutex> lLock(mMutex);
+        assert(pAllocation.mId >= mFirstId && pAllocation.mId < mFirstId + mEntries.size());
+        mEntries[(size_t)(pAllocation.mId - mFirstId)].mFree = true;
+
+        // Recycle the oldest freed slices
+        while (!mEntries.empty() && mEntries.front().mFree)
+        {
+            mTail = mEntries.front().mEnd;
+            mEntries.pop_front();
+            ++mFirstId;
+        }
+    }
+    mSpaceAvailable.notify_all();
+}
+
+/******************************************************************************/
+void StagingRing::flush(const Allocation& pAllocation)
+{
+    mDevice->flushBuffer(mBuffer, pAllocation.mOffset, pAllocation.mSize);
+}
+
+/******************************************************************************/
+void StagingRing::abort()
+{
+    {
+        std::lock_guard<std::mutex> lLock(mMutex);
+        mAborted = true;
+    }
+    mSpaceAvailable.notify_all();
+}
+
+/******************************************************************************/
+VkBuffer StagingRing::getBuffer() const
+{
+    return mDevice->getBuffer(mBuffer);
+}
+
+/******************************************************************************/
+VkDeviceSize StagingRing::getUsedSize()
+{
+    std::lock_guard<std::mutex> lLock(mMutex);
+    return mHead - mTail;
+}
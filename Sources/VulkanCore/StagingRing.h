@@ -0,0 +1,64 @@
+#pragma once
+
+#include "vk_common.h"
+#include "VulkanHandle.h"
+
+#include <deque>
+#include <mutex>
+#include <condition_variable>
+
+struct VulkanDevice;
+
+// Persistently mapped host buffer used as a ring for the uploads
+// allocate() can be called from any thread (decoder threads write directly into their slice),
+// the slices are recycled in allocation order once free() has been called on them and on all the older ones.
+// The offsets are virtual (monotonic) internally, the Allocation holds the offset in the buffer.
+struct StagingRing
+{
+    struct Allocation
+    {
+        uint64_t mId = 0;
+        VkDeviceSize mOffset = 0;       // In the buffer
+        VkDeviceSize mSize = 0;
+        uint8_t* mData = nullptr;       // Mapped pointer of mOffset
+    };
+
+    static const VkDeviceSize cDefaultSize = 64ull * 1024 * 1024;
+
+    void init(VulkanDevice* pDevice, VkDeviceSize pSize = cDefaultSize);
+    void destroy();
+
+    // Reserve pSize bytes aligned to pAlignment (power of two), block while the ring is full
+    // Return false if pSize can't fit in the ring or if the ring has been aborted
+    bool allocate(VkDeviceSize pSize, VkDeviceSize pAlignment, Allocation& pAllocation);
+    void free(const Allocation& pAllocation);
+
+    // Make the writes of the slice visible to the device (no-op on coherent memory)
+    void flush(const Allocation& pAllocation);
+
+    // Wake up and fail the blocked allocate(), used on shutdown
+    void abort();
+
+    VkBuffer getBuffer() const;
+    inline VkDeviceSize getSize() const { return mSize; }
+    VkDeviceSize getUsedSize();
+
+    struct Entry
+    {
+        uint64_t mEnd;                  // Virtual end offset, include the alignment padding
+        bool mFree;
+    };
+
+    VulkanDevice* mDevice = nullptr;
+    BufferHandle mBuffer;
+    uint8_t* mData = nullptr;
+    VkDeviceSize mSize = 0;
+
+    std::mutex mMutex;
+    std::condition_variable mSpaceAvailable;
+    std::deque<Entry> mEntries;         // Live allocations, oldest first
+    uint64_t mFirstId = 0;              // Id of mEntries.front()
+    uint64_t mHead = 0;
+    uint64_t mTail = 0;
+    bool mAborted = false;
+};
@@ -0,0 +1,449 @@
+#include "TextureFile.h"
+#include "VulkanDevice.h"
+#include "VulkanHelper.h"
+
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+#include <mutex>
+
+#ifdef VULKANCORE_BASISU
+#   include <basisu_transcoder.h>
+#endif
+
+// vkCmdCopyBufferToImage need an offset multiple of the texel block size and of 4
+static const VkDeviceSize cLevelAlignment = 16;
+
+static inline VkDeviceSize alignUp(VkDeviceSize pValue, VkDeviceSize pAlignment)
+{
+    return (pValue + pAlignment - 1) & ~(pAlignment - 1);
+}
+
+/******************************************************************************/
+/******************************************************************************/
+/******************************************************************************/
+// KTX2 : https://registry.khronos.org/KTX/specs/2.0/ktxspec.v2.html
+static const uint8_t cKtx2Identifier[12] = { 0xAB, 'K', 'T', 'X', ' ', '2', '0', 0xBB, '\r', '\n', 0x1A, '\n' };
+
+enum Ktx2Supercompression : uint32_t
+{
+    Ktx2SupercompressionNone = 0,
+    Ktx2SupercompressionBasisLZ = 1,
+    Ktx2SupercompressionZstd = 2,
+};
+
+#pragma pack(push, 1)
+struct Ktx2Header
+{
+    uint8_t mIdentifier[12];
+    uint32_t mVkFormat;
+    uint32_t mTypeSize;
+    uint32_t mPixelWidth;
+    uint32_t mPixelHeight;
+    uint32_t mPixelDepth;
+    uint32_t mLayerCount;
+    uint32_t mFaceCount;
+    uint32_t mLevelCount;
+    uint32_t mSupercompressionScheme;
+    uint32_t mDfdByteOffset;
+    uint32_t mDfdByteLength;
+    uint32_t mKvdByteOffset;
+    uint32_t mKvdByteLength;
+    uint64_t mSgdByteOffset;
+    uint64_t mSgdByteLength;
+};
+
+struct Ktx2LevelIndex
+{
+    uint64_t mByteOffset;
+    uint64_t mByteLength;
+    uint64_t mUncompressedByteLength;
+};
+#pragma pack(pop)
+
+/******************************************************************************/
+static bool parseKtx2(TextureFile& pFile)
+{
+    const uint8_t* lData = pFile.mFile.mData;
+    size_t lSize = pFile.mFile.mSize;
+
+    const Ktx2Header* lHeader = reinterpret_cast<const Ktx2Header*>(lData);
+    if (lHeader->mLayerCount > 1 || lHeader->mFaceCount != 1 || lHeader->mPixelDepth > 1)
+    {
+        printf("TextureFile : only 2D KTX2 textures are supported (no array/cubemap/3D)\n");
+        return false;
+    }
+
+    // levelCount 0 ask for the mips to be generated at load, we keep the base level only
+    uint32_t lLevelCount = lHeader->mLevelCount > 0 ? lHeader->mLevelCount : 1;
+    if (lLevelCount > TextureFile::cMaxLevels || sizeof(Ktx2Header) + lLevelCount * sizeof(Ktx2LevelIndex) > lSize)
+        return false;
+
+    pFile.mExtent = { lHeader->mPixelWidth, lHeader->mPixelHeight > 0 ? lHeader->mPixelHeight : 1, 1 };
+    pFile.mMipLevels = lLevelCount;
+    pFile.mFormat = (VkFormat)lHeader->mVkFormat;
+
+    // BasisLZ (ETC1S) or UASTC (VK_FORMAT_UNDEFINED, optionally zstd supercompressed) need transcoding
+    if (lHeader->mSupercompressionScheme == Ktx2SupercompressionBasisLZ
+        || (lHeader->mVkFormat == VK_FORMAT_UNDEFINED && (lHeader->mSupercompressionScheme == Ktx2SupercompressionNone || lHeader->mSupercompressionScheme == Ktx2SupercompressionZstd)))
+    {
+        pFile.mBasis = true;
+        return true;
+    }
+
+    if (lHeader->mSupercompressionScheme != Ktx2SupercompressionNone)
+    {
+        printf("TextureFile : KTX2 supercompression scheme %u is not supported\n", lHeader->mSupercompressionScheme);
+        return false;
+    }
+
+    const Ktx2LevelIndex* lLevels = reinterpret_cast<const Ktx2LevelIndex*>(lData + sizeof(Ktx2Header));
+    for (uint32_t i = 0; i < lLevelCount; ++i)
+    {
+        if (lLevels[i].mByteOffset + lLevels[i].mByteLength > lSize)
+            return false;
+        pFile.mLevels[i].mData = lData + lLevels[i].mByteOffset;
+        pFile.mLevels[i].mSize = lLevels[i].mByteLength;
+    }
+
+    return true;
+}
+
+/******************************************************************************/
+/******************************************************************************/
+/******************************************************************************/
+// DDS : https://learn.microsoft.com/en-us/windows/win32/direct3ddds/dx-graphics-dds-pguide
+#define DDS_FOURCC(a, b, c, d) ((uint32_t)(a) | ((uint32_t)(b) << 8) | ((uint32_t)(c) << 16) | ((uint32_t)(d) << 24))
+static const uint32_t cDdsMagic = DDS_FOURCC('D', 'D', 'S', ' ');
+static const uint32_t cDdsPixelFormatFourCC = 0x4;
+static const uint32_t cDdsCaps2Cubemap = 0x200;
+
+#pragma pack(push, 1)
+struct DdsPixelFormat
+{
+    uint32_t mSize;
+    uint32_t mFlags;
+    uint32_t mFourCC;
+    uint32_t mRGBBitCount;
+    uint32_t mRBitMask;
+    uint32_t mGBitMask;
+    uint32_t mBBitMask;
+    uint32_t mABitMask;
+};
+
+struct DdsHeader
+{
+    uint32_t mSize;
+    uint32_t mFlags;
+    uint32_t mHeight;
+    uint32_t mWidth;
+    uint32_t mPitchOrLinearSize;
+    uint32_t mDepth;
+    uint32_t mMipMapCount;
+    uint32_t mReserved1[11];
+    DdsPixelFormat mPixelFormat;
+    uint32_t mCaps;
+    uint32_t mCaps2;
+    uint32_t mCaps3;
+    uint32_t mCaps4;
+    uint32_t mReserved2;
+};
+
+struct DdsHeaderDX10
+{
+    uint32_t mDxgiFormat;
+    uint32_t mResourceDimension;
+    uint32_t mMiscFlag;
+    uint32_t mArraySize;
+    uint32_t mMiscFlags2;
+};
+#pragma pack(pop)
+
+/******************************************************************************/
+static VkFormat dxgiToVkFormat(uint32_t pDxgiFormat)
+{
+    switch (pDxgiFormat)
+    {
+    case 28: return VK_FORMAT_R8G8B8A8_UNORM;
+    case 29: return VK_FORMAT_R8G8B8A8_SRGB;
+    case 87: return VK_FORMAT_B8G8R8A8_UNORM;
+    case 91: return VK_FORMAT_B8G8R8A8_SRGB;
+    case 10: return VK_FORMAT_R16G16B16A16_SFLOAT;
+    case 2:  return VK_FORMAT_R32G32B32A32_SFLOAT;
+    case 71: return VK_FORMAT_BC1_RGBA_UNORM_BLOCK;
+    case 72: return VK_FORMAT_BC1_RGBA_SRGB_BLOCK;
+    case 74: return VK_FORMAT_BC2_UNORM_BLOCK;
+    case 75: return VK_FORMAT_BC2_SRGB_BLOCK;
+    case 77: return VK_FORMAT_BC3_UNORM_BLOCK;
+    case 78: return VK_FORMAT_BC3_SRGB_BLOCK;
+    case 80: return VK_FORMAT_BC4_UNORM_BLOCK;
+    case 81: return VK_FORMAT_BC4_SNORM_BLOCK;
+    case 83: return VK_FORMAT_BC5_UNORM_BLOCK;
+    case 84: return VK_FORMAT_BC5_SNORM_BLOCK;
+    case 95: return VK_FORMAT_BC6H_UFLOAT_BLOCK;
+    case 96: return VK_FORMAT_BC6H_SFLOAT_BLOCK;
+    case 98: return VK_FORMAT_BC7_UNORM_BLOCK;
+    case 99: return VK_FORMAT_BC7_SRGB_BLOCK;
+    default: return VK_FORMAT_UNDEFINED;
+    }
+}
+
+/******************************************************************************/
+static VkFormat fourCCToVkFormat(uint32_t pFourCC)
+{
+    switch (pFourCC)
+    {
+    case DDS_FOURCC('D', 'X', 'T', '1'): return VK_FORMAT_BC1_RGBA_UNORM_BLOCK;
+    case DDS_FOURCC('D', 'X', 'T', '3'): return VK_FORMAT_BC2_UNORM_BLOCK;
+    case DDS_FOURCC('D', 'X', 'T', '5'): return VK_FORMAT_BC3_UNORM_BLOCK;
+    case DDS_FOURCC('A', 'T', 'I', '1'):
+    case DDS_FOURCC('B', 'C', '4', 'U'): return VK_FORMAT_BC4_UNORM_BLOCK;
+    case DDS_FOURCC('A', 'T', 'I', '2'):
+    case DDS_FOURCC('B', 'C', '5', 'U'): return VK_FORMAT_BC5_UNORM_BLOCK;
+    default: return VK_FORMAT_UNDEFINED;
+    }
+}
+
+/******************************************************************************/
+static bool parseDds(TextureFile& pFile)
+{
+    const uint8_t* lData = pFile.mFile.mData;
+    size_t lSize = pFile.mFile.mSize;
+
+    const DdsHeader* lHeader = reinterpret_cast<const DdsHeader*>(lData + sizeof(uint32_t));
+    size_t lDataOffset = sizeof(uint32_t) + sizeof(DdsHeader);
+    if (lHeader->mSize != sizeof(DdsHeader) || (lHeader->mCaps2 & cDdsCaps2Cubemap))
+        return false;
+
+    if ((lHeader->mPixelFormat.mFlags & cDdsPixelFormatFourCC) && lHeader->mPixelFormat.mFourCC == DDS_FOURCC('D', 'X', '1', '0'))
+    {
+        if (lDataOffset + sizeof(DdsHeaderDX10) > lSize)
+            return false;
+        const DdsHeaderDX10* lHeader10 = reinterpret_cast<const DdsHeaderDX10*>(lData + lDataOffset);
+        if (lHeader10->mArraySize > 1)
+            return false;
+        pFile.mFormat = dxgiToVkFormat(lHeader10->mDxgiFormat);
+        lDataOffset += sizeof(DdsHeaderDX10);
+    }
+    else if (lHeader->mPixelFormat.mFlags & cDdsPixelFormatFourCC)
+    {
+        pFile.mFormat = fourCCToVkFormat(lHeader->mPixelFormat.mFourCC);
+    }
+
+    if (pFile.mFormat == VK_FORMAT_UNDEFINED)
+    {
+        printf("TextureFile : unsupported DDS pixel format\n");
+        return false;
+    }
+
+    pFile.mExtent = { lHeader->mWidth, lHeader->mHeight, 1 };
+    pFile.mMipLevels = lHeader->mMipMapCount > 0 ? lHeader->mMipMapCount : 1;
+    if (pFile.mMipLevels > TextureFile::cMaxLevels)
+        return false;
+
+    // Levels are stored one after the other, biggest first
+    for (uint32_t i = 0; i < pFile.mMipLevels; ++i)
+    {
+        VkDeviceSize lLevelSize = vkh::levelSize(pFile.mFormat, pFile.mExtent, i);
+        if (lDataOffset + lLevelSize > lSize)
+            return false;
+        pFile.mLevels[i].mData = lData + lDataOffset;
+        pFile.mLevels[i].mSize = lLevelSize;
+        lDataOffset += (size_t)lLevelSize;
+    }
+
+    return true;
+}
+
+/******************************************************************************/
+/******************************************************************************/
+/******************************************************************************/
+#ifdef VULKANCORE_BASISU
+static bool transcodeBasis(const VulkanDevice& pDevice, TextureFile& pFile)
+{
+    // The TextureLoader workers prepare files concurrently
+    static std::once_flag sInitialized;
+    std::call_once(sInitialized, []() { basist::basisu_transcoder_init(); });
+
+    basist::ktx2_transcoder lTranscoder;
+    if (!lTranscoder.init(pFile.mFile.mData, (uint32_t)pFile.mFile.mSize) || !lTranscoder.start_transcoding())
+        return false;
+
+    pFile.mSRGB = lTranscoder.get_dfd_transfer_func() == basist::KTX2_KHR_DF_TRANSFER_SRGB;
+
+    // Best quality per bit first, uncompressed as last resort
+    struct Target
+    {
+        basist::transcoder_texture_format mBasisFormat;
+        VkFormat mUnorm;
+        VkFormat mSRGB;
+    };
+    const Target cTargets[] =
+    {
+        { basist::transcoder_texture_format::cTFBC7_RGBA, VK_FORMAT_BC7_UNORM_BLOCK, VK_FORMAT_BC7_SRGB_BLOCK },
+        { basist::transcoder_texture_format::cTFASTC_4x4_RGBA, VK_FORMAT_ASTC_4x4_UNORM_BLOCK, VK_FORMAT_ASTC_4x4_SRGB_BLOCK },
+        { basist::transcoder_texture_format::cTFETC2_RGBA, VK_FORMAT_ETC2_R8G8B8A8_UNORM_BLOCK, VK_FORMAT_ETC2_R8G8B8A8_SRGB_BLOCK },
+        { basist::transcoder_texture_format::cTFRGBA32, VK_FORMAT_R8G8B8A8_UNORM, VK_FORMAT_R8G8B8A8_SRGB },
+    };
+
+    const Target* lTarget = nullptr;
+    for (const Target& lCandidate : cTargets)
+    {
+        VkFormat lFormat = pFile.mSRGB ? lCandidate.mSRGB : lCandidate.mUnorm;
+        if (pDevice.isFormatSupported(lFormat, VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT | VK_FORMAT_FEATURE_TRANSFER_DST_BIT))
+        {
+            lTarget = &lCandidate;
+            pFile.mFormat = lFormat;
+            break;
+        }
+    }
+    if (lTarget == nullptr)
+        return false;
+
+    pFile.mExtent = { lTranscoder.get_width(), lTranscoder.get_height(), 1 };
+    pFile.mMipLevels = lTranscoder.get_levels() > 0 ? lTranscoder.get_levels() : 1;
+    if (pFile.mMipLevels > TextureFile::cMaxLevels)
+        return false;
+
+    VkDeviceSize lOffsets[TextureFile::cMaxLevels];
+    VkDeviceSize lTotalSize = 0;
+    for (uint32_t i = 0; i < pFile.mMipLevels; ++i)
+    {
+        lOffsets[i] = lTotalSize;
+        pFile.mLevels[i].mSize = vkh::levelSize(pFile.mFormat, pFile.mExtent, i);
+        lTotalSize = alignUp(lTotalSize + pFile.mLevels[i].mSize, cLevelAlignment);
+    }
+    pFile.mTranscoded.resize((size_t)lTotalSize);
+
+    vkh::FormatBlock lBlock;
+    vkh::formatBlock(pFile.mFormat, lBlock);
+    for (uint32_t i = 0; i < pFile.mMipLevels; ++i)
+    {
+        // Output size is in blocks, or in pixels for the uncompressed formats
+        uint32_t lOutputSize = (uint32_t)(pFile.mLevels[i].mSize / lBlock.mBytes);
+        uint8_t* lOutput = pFile.mTranscoded.data() + lOffsets[i];
+        if (!lTranscoder.transcode_image_level(i, 0, 0, lOutput, lOutputSize, lTarget->mBasisFormat))
+            return false;
+        pFile.mLevels[i].mData = lOutput;
+    }
+
+    return true;
+}
+#endif // VULKANCORE_BASISU
+
+/******************************************************************************/
+/******************************************************************************/
+/******************************************************************************/
+bool TextureFile::open(const std::string& pFilename)
+{
+    close();
+
+    if (!mFile.open(pFilename.c_str()))
+    {
+        printf("TextureFile : can't open %s\n", pFilename.c_str());
+        return false;
+    }
+
+    bool lSuccess = false;
+    if (mFile.mSize >= sizeof(Ktx2Header) && memcmp(mFile.mData, cKtx2Identifier, sizeof(cKtx2Identifier)) == 0)
+        lSuccess = parseKtx2(*this);
+    else if (mFile.mSize >= sizeof(uint32_t) + sizeof(DdsHeader) && *reinterpret_cast<const uint32_t*>(mFile.mData) == cDdsMagic)
+        lSuccess = parseDds(*this);
+
+    if (!lSuccess)
+    {
+        printf("TextureFile : %s is not a supported KTX2/DDS texture\n", pFilename.c_str());
+        close();
+    }
+    return lSuccess;
+}
+
+/******************************************************************************/
+void TextureFile::close()
+{
+    mFile.close();
+    mFormat = VK_FORMAT_UNDEFINED;
+    mExtent = { 0, 0, 0 };
+    mMipLevels = 0;
+    memset(mLevels, 0, sizeof(mLevels));
+    mBasis = false;
+    mSRGB = false;
+    mTranscoded.clear();
+}
+
+/******************************************************************************/
+bool TextureFile::prepare(const VulkanDevice& pDevice)
+{
+    if (mBasis)
+    {
+#ifdef VULKANCORE_BASISU
+        if (!transcodeBasis(pDevice, *this))
+        {
+            printf("TextureFile : Basis Universal transcoding failed\n");
+            return false;
+        }
+        // The level data is now in mTranscoded, the file is no more needed
+        mFile.close();
+        return true;
+#else
+        printf("TextureFile : Basis Universal texture, build VulkanCore with the basis_universal transcoder\n");
+        return false;
+#endif
+    }
+
+    if (!pDevice.isFormatSupported(mFormat, VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT | VK_FORMAT_FEATURE_TRANSFER_DST_BIT))
+    {
+        printf("TextureFile : format %d is not supported by the device\n", (int)mFormat);
+        return false;
+    }
+    return true;
+}
+
+/******************************************************************************/
+VkDeviceSize TextureFile::stagingSize() const
+{
+    VkDeviceSize lSize = 0;
+    for (uint32_t i = 0; i < mMipLevels; ++i)
+        lSize = alignUp(lSize + mLevels[i].mSize, cLevelAlignment);
+    return lSize;
+}
+
+/******************************************************************************/
+ImageHandle uploadTexture(VulkanDevice* pDevice, VkCommandBuffer pCmd, const TextureFile& pFile, BufferHandle pStaging, VkDeviceSize pStagingOffset)
+{
+    assert(pFile.mMipLevels > 0 && pFile.mLevels[0].mData != nullptr);
+    assert(pStagingOffset % cLevelAlignment == 0);
+    assert(pStagingOffset + pFile.stagingSize() <= pDevice->getBufferSize(pStaging));
+
+    VkImageCreateInfo lImageInfo = vkh::imageCreateInfo(pFile.mFormat, VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT, pFile.mExtent, pFile.mMipLevels);
+    ImageHandle lTexture = pDevice->createImage(lImageInfo, VK_IMAGE_ASPECT_COLOR_BIT);
+    if (!lTexture.isValid())
+        return lTexture;
+
+    // Straight copy of the compressed levels into the staging memory
+    uint8_t* lStagingData = static_cast<uint8_t*>(pDevice->getBufferMappedData(pStaging));
+    assert(lStagingData != nullptr && "staging buffer must be persistently mapped");
+
+    VkBufferImageCopy lRegions[TextureFile::cMaxLevels] = {};
+    VkDeviceSize lOffset = pStagingOffset;
+    for (uint32_t i = 0; i < pFile.mMipLevels; ++i)
+    {
+        memcpy(lStagingData + lOffset, pFile.mLevels[i].mData, (size_t)pFile.mLevels[i].mSize);
+
+        lRegions[i].bufferOffset = lOffset;
+        lRegions[i].imageSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, i, 0, 1 };
+        lRegions[i].imageExtent = { pFile.mExtent.width >> i, pFile.mExtent.height >> i, 1 };
+        if (lRegions[i].imageExtent.width == 0) lRegions[i].imageExtent.width = 1;
+        if (lRegions[i].imageExtent.height == 0) lRegions[i].imageExtent.height = 1;
+
+        lOffset = alignUp(lOffset + pFile.mLevels[i].mSize, cLevelAlignment);
+    }
+    pDevice->flushBuffer(pStaging, pStagingOffset, lOffset - pStagingOffset);
+
+    VkImage lImage = pDevice->getImage(lTexture);
+    vkh::transitionImage(pCmd, lImage, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
+    vkCmdCopyBufferToImage(pCmd, pDevice->getBuffer(pStaging), lImage, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, pFile.mMipLevels, lRegions);
+    vkh::transitionImage(pCmd, lImage, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+
+    return lTexture;
+}
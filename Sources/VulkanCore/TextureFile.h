@@ -0,0 +1,53 @@
+#pragma once
+
+#include "vk_common.h"
+#include "VulkanHandle.h"
+#include "MappedFile.h"
+
+#include <string>
+#include <vector>
+
+struct VulkanDevice;
+
+// Precompressed texture file (.ktx2, .dds)
+// The file is memory mapped and the levels point directly into it, nothing is decoded:
+// the block compressed data (BC1-7, ETC2, ASTC) is copied as is to the staging memory.
+// KTX2 files supercompressed with Basis Universal (BasisLZ/UASTC) are transcoded by prepare()
+// to a format supported by the device when VulkanCore is built with VULKANCORE_BASISU.
+struct TextureFile
+{
+    static const uint32_t cMaxLevels = 16;
+
+    struct Level
+    {
+        const uint8_t* mData;
+        VkDeviceSize mSize;
+    };
+
+    // Parse the header, the format is detected from the file content
+    bool open(const std::string& pFilename);
+    void close();
+
+    // Check the device support and transcode the Basis payload if needed
+    // Return false if the texture can't be used on this device
+    bool prepare(const VulkanDevice& pDevice);
+
+    // Size of the staging memory needed by uploadTexture()
+    VkDeviceSize stagingSize() const;
+
+    MappedFile mFile;
+    VkFormat mFormat = VK_FORMAT_UNDEFINED;
+    VkExtent3D mExtent = { 0, 0, 0 };
+    uint32_t mMipLevels = 0;
+    Level mLevels[cMaxLevels] = {};
+
+    // KTX2 Basis Universal payload, the levels are valid after prepare()
+    bool mBasis = false;
+    bool mSRGB = false;
+    std::vector<uint8_t> mTranscoded;
+};
+
+// Create the image in the file format with all its levels and record the copy from the staging memory
+// pStaging must be persistently mapped with at least pFile.stagingSize() bytes after pStagingOffset,
+// and kept alive until pCmd has completed. The texture ends in VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL
+ImageHandle uploadTexture(VulkanDevice* pDevice, VkCommandBuffer pCmd, const TextureFile& pFile, BufferHandle pStaging, VkDeviceSize pStagingOffset = 0);
@@ -0,0 +1,570 @@
+#include "TextureLoader.h"
+#include "TextureFile.h"
+#include "VulkanTexture.h"
+#include "VulkanDevice.h"
+#include "VulkanHelper.h"
+
+#include <stb_image.h>
+
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <algorithm>
+#include <chrono>
+
+static const VkDeviceSize cLevelAlignment = 16;
+
+/******************************************************************************/
+static inline VkDeviceSize alignUp(VkDeviceSize pValue, VkDeviceSize pAlignment)
+{
+    return (pValue + pAlignment - 1) & ~(pAlignment - 1);
+}
+
+/******************************************************************************/
+static bool hasExtension(const std::string& pFilename, const char* pExtension)
+{
+    size_t lLength = strlen(pExtension);
+    if (pFilename.size() < lLength)
+        return false;
+
+    const char* lEnd = pFilename.c_str() + pFilename.size() - lLength;
+    for (size_t i = 0; i < lLength; ++i)
+    {
+        char c = lEnd[i];
+        if (c >= 'A' && c <= 'Z')
+            c = c - 'A' + 'a';
+        if (c != pExtension[i])
+            return false;
+    }
+    return true;
+}
+
+/******************************************************************************/
+static float srgbToLinear(uint8_t pValue)
+{
+    static float sTable[256] = {};
+    static bool sInitialized = [&]()
+    {
+        for (int i = 0; i < 256; ++i)
+        {
+            float c = i / 255.0f;
+            sTable[i] = c <= 0.04045f ? c / 12.92f : powf((c + 0.055f) / 1.055f, 2.4f);
+        }
+        return true;
+    }();
+    (void)sInitialized;
+    return sTable[pValue];
+}
+
+/******************************************************************************/
+static uint8_t linearToSrgb(float pValue)
+{
+    float c = pValue <= 0.0031308f ? pValue * 12.92f : 1.055f * powf(pValue, 1.0f / 2.4f) - 0.055f;
+    return (uint8_t)std::min(255.0f, std::max(0.0f, c * 255.0f + 0.5f));
+}
+
+/******************************************************************************/
+// 2x2 box filter of a RGBA8 level, the last row/column is repeated for the odd sizes
+static void downsampleRGBA8(const uint8_t* pSrc, uint32_t pSrcWidth, uint32_t pSrcHeight, uint8_t* pDst, uint32_t pDstWidth, uint32_t pDstHeight, bool pSRGB)
+{
+    for (uint32_t y = 0; y < pDstHeight; ++y)
+    {
+        const uint8_t* lRow0 = pSrc + (size_t)std::min(y * 2, pSrcHeight - 1) * pSrcWidth * 4;
+        const uint8_t* lRow1 = pSrc + (size_t)std::min(y * 2 + 1, pSrcHeight - 1) * pSrcWidth * 4;
+        for (uint32_t x = 0; x < pDstWidth; ++x)
+        {
+            uint32_t x0 = std::min(x * 2, pSrcWidth - 1) * 4;
+            uint32_t x1 = std::min(x * 2 + 1, pSrcWidth - 1) * 4;
+            uint8_t* lOut = pDst + ((size_t)y * pDstWidth + x) * 4;
+            for (uint32_t c = 0; c < 4; ++c)
+            {
+                // Alpha is always linear
+                if (pSRGB && c < 3)
+                {
+                    float lSum = srgbToLinear(lRow0[x0 + c]) + srgbToLinear(lRow0[x1 + c]) + srgbToLinear(lRow1[x0 + c]) + srgbToLinear(lRow1[x1 + c]);
+                    lOut[c] = linearToSrgb(lSum * 0.25f);
+                }
+                else
+                {
+                    uint32_t lSum = lRow0[x0 + c] + lRow0[x1 + c] + lRow1[x0 + c] + lRow1[x1 + c];
+                    lOut[c] = (uint8_t)((lSum + 2) / 4);
+                }
+            }
+        }
+    }
+}
+
+/******************************************************************************/
+/******************************************************************************/
+/******************************************************************************/
+void TextureLoader::init(VulkanDevice* pDevice, MipmapGenerator* pMipmapGenerator, VkDeviceSize pStagingSize, uint32_t pThreadCount)
+{
+    assert(mDevice == nullptr && "TextureLoader : already initialized");
+
+    mDevice = pDevice;
+    mMipmapGenerator = pMipmapGenerator;
+
+    mHandles.init(cMaxTextures);
+    std::vector<Request> lRequests(cMaxTextures);
+    mRequests.swap(lRequests);
+
+    mStagingRing.init(pDevice, pStagingSize);
+
+    // Uploads go on the graphics queue, the gpu mip generation may need blit or compute
+    mCommandPool = vkh::createCommandPool(*pDevice, pDevice->getQueueFamilyIndex(VulkanQueueType::Graphics), VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT);
+    for (Batch& lBatch : mBatches)
+    {
+        VkCommandBufferAllocateInfo lAllocateInfo = vkh::commandBufferAllocateInfo(mCommandPool);
+        VK_CHECK(vkAllocateCommandBuffers(*pDevice, &lAllocateInfo, &lBatch.mCommandBuffer));
+        lBatch.mFence = vkh::createFence(*pDevice, 0);
+        lBatch.mInFlight = false;
+    }
+
+    mWorkers.init(pThreadCount, "TextureLoader");
+    mStats = Stats();
+}
+
+/******************************************************************************/
+void TextureLoader::shutdown()
+{
+    if (mDevice == nullptr)
+        return;
+
+    // Unblock the workers waiting for staging memory, their textures will fail
+    mStagingRing.abort();
+    mWorkers.shutdown();
+
+    for (Batch& lBatch : mBatches)
+    {
+        if (lBatch.mInFlight)
+        {
+            VK_CHECK(vkWaitForFences(*mDevice, 1, &lBatch.mFence, VK_TRUE, UINT64_MAX));
+            completeBatch(lBatch);
+        }
+        vkDestroyFence(*mDevice, lBatch.mFence, nullptr);
+        lBatch.mFence = VK_NULL_HANDLE;
+        lBatch.mCommandBuffer = VK_NULL_HANDLE;
+    }
+    vkDestroyCommandPool(*mDevice, mCommandPool, nullptr);
+    mCommandPool = VK_NULL_HANDLE;
+
+    // Decoded but never submitted
+    for (uint32_t lIndex : mDecoded)
+        freeStaging(mRequests[lIndex]);
+    mDecoded.clear();
+
+    mHandles.forEach([this](uint32_t pIndex) { destroyTexture(pIndex); });
+    mStagingRing.destroy();
+
+    mRequests.clear();
+    mDevice = nullptr;
+    mMipmapGenerator = nullptr;
+}
+
+/******************************************************************************/
+TextureHandle TextureLoader::load(const std::string& pFilename, uint32_t pFlags)
+{
+    uint32_t lIndex = mHandles.allocate();
+    if (lIndex == ~0u)
+        return TextureHandle();
+
+    Request& lRequest = mRequests[lIndex];
+    lRequest.mFilename = pFilename;
+    lRequest.mFlags = pFlags;
+    lRequest.mReleaseRequested.store(false, std::memory_order_relaxed);
+    lRequest.mDecodeFailed = false;
+    lRequest.mState.store(State::Decoding, std::memory_order_release);
+    mPendingCount.fetch_add(1, std::memory_order_relaxed);
+
+    mWorkers.enqueue([this, lIndex]() { decode(lIndex); });
+    return mHandles.makeHandle<TextureTag>(lIndex);
+}
+
+/******************************************************************************/
+bool TextureLoader::isReady(TextureHandle pHandle) const
+{
+    return mHandles.isAlive(pHandle) && mRequests[pHandle.index()].mState.load(std::memory_order_acquire) == State::Ready;
+}
+
+/******************************************************************************/
+bool TextureLoader::isFailed(TextureHandle pHandle) const
+{
+    return !mHandles.isAlive(pHandle) || mRequests[pHandle.index()].mState.load(std::memory_order_acquire) == State::Failed;
+}
+
+/******************************************************************************/
+ImageHandle TextureLoader::getImage(TextureHandle pHandle) const
+{
+    if (!isReady(pHandle))
+        return ImageHandle();
+    return mRequests[pHandle.index()].mImage;
+}
+
+/******************************************************************************/
+void TextureLoader::release(TextureHandle pHandle)
+{
+    if (!mHandles.isAlive(pHandle))
+        return;
+
+    Request& lRequest = mRequests[pHandle.index()];
+    State lState = lRequest.mState.load(std::memory_order_acquire);
+    if (lState == State::Ready || lState == State::Failed)
+        destroyTexture(pHandle.index());
+    else
+        lRequest.mReleaseRequested.store(true, std::memory_order_release);
+}
+
+/******************************************************************************/
+void TextureLoader::update()
+{
+    // Complete the batches whose copies have finished
+    for (Batch& lBatch : mBatches)
+    {
+        if (lBatch.mInFlight && vkGetFenceStatus(*mDevice, lBatch.mFence) == VK_SUCCESS)
+            completeBatch(lBatch);
+    }
+
+    Batch* lBatch = nullptr;
+    for (Batch& lCandidate : mBatches)
+    {
+        if (!lCandidate.mInFlight)
+        {
+            lBatch = &lCandidate;
+            break;
+        }
+    }
+    if (lBatch == nullptr)
+        return;     // Try again next frame, the decoded textures stay queued
+
+    {
+        std::lock_guard<std::mutex> lLock(mDecodedMutex);
+        mDecodedScratch.swap(mDecoded);
+    }
+
+    assert(lBatch->mRequests.empty());
+    for (uint32_t lIndex : mDecodedScratch)
+    {
+        if (mRequests[lIndex].mDecodeFailed)
+            completeRequest(lIndex, false);
+        else
+            lBatch->mRequests.push_back(lIndex);
+    }
+    mDecodedScratch.clear();
+
+    if (lBatch->mRequests.empty())
+        return;
+
+    // All the textures decoded since the last update in one command buffer / one submit
+    VK_CHECK(vkResetFences(*mDevice, 1, &lBatch->mFence));
+    VK_CHECK(vkResetCommandBuffer(lBatch->mCommandBuffer, 0));
+    VkCommandBufferBeginInfo lBeginInfo = vkh::commandBufferBeginInfo(VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT);
+    VK_CHECK(vkBeginCommandBuffer(lBatch->mCommandBuffer, &lBeginInfo));
+
+    for (uint32_t lIndex : lBatch->mRequests)
+        recordUpload(lBatch->mCommandBuffer, mRequests[lIndex]);
+
+    VK_CHECK(vkEndCommandBuffer(lBatch->mCommandBuffer));
+
+    // The compute mip path views must live until the fence
+    lBatch->mTransientViews.swap(mMipmapGenerator->mTransientViews);
+    mMipmapGenerator->mTransientViews.clear();
+
+    VkCommandBufferSubmitInfo lCmdInfo = vkh::commandBufferSubmitInfo(lBatch->mCommandBuffer);
+    VkSubmitInfo2 lSubmitInfo = vkh::submitInfo(&lCmdInfo, nullptr, nullptr);
+    VK_CHECK(vkQueueSubmit2(mDevice->getQueue(VulkanQueueType::Graphics), 1, &lSubmitInfo, lBatch->mFence));
+
+    lBatch->mInFlight = true;
+    mStats.mSubmits++;
+}
+
+/******************************************************************************/
+void TextureLoader::waitAll()
+{
+    for (;;)
+    {
+        update();
+
+        bool lInFlight = false;
+        for (const Batch& lBatch : mBatches)
+            lInFlight |= lBatch.mInFlight;
+
+        if (!lInFlight && mPendingCount.load(std::memory_order_acquire) == 0)
+            return;
+
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+}
+
+/******************************************************************************/
+TextureLoader::Stats TextureLoader::getStats() const
+{
+    Stats lStats = mStats;
+    lStats.mPending = mPendingCount.load(std::memory_order_relaxed);
+    return lStats;
+}
+
+/******************************************************************************/
+/******************************************************************************/
+/******************************************************************************/
+void TextureLoader::decode(uint32_t pIndex)
+{
+    Request& lRequest = mRequests[pIndex];
+
+    bool lSuccess;
+    if (hasExtension(lRequest.mFilename, ".ktx2") || hasExtension(lRequest.mFilename, ".dds"))
+        lSuccess = decodeTextureFile(lRequest);
+    else
+        lSuccess = decodeImage(lRequest);
+
+    // The failures also go through update(), all the final states are set on the main thread
+    lRequest.mDecodeFailed = !lSuccess;
+    if (!lSuccess)
+        freeStaging(lRequest);
+
+    lRequest.mState.store(State::Decoded, std::memory_order_release);
+    std::lock_guard<std::mutex> lLock(mDecodedMutex);
+    mDecoded.push_back(pIndex);
+}
+
+/******************************************************************************/
+bool TextureLoader::decodeTextureFile(Request& pRequest)
+{
+    TextureFile lFile;
+    if (!lFile.open(pRequest.mFilename) || !lFile.prepare(*mDevice))
+    {
+        printf("TextureLoader : can't load %s\n", pRequest.mFilename.c_str());
+        return false;
+    }
+
+    uint8_t* lData = nullptr;
+    if (!allocateStaging(pRequest, lFile.stagingSize(), lData))
+        return false;
+
+    pRequest.mFormat = lFile.mFormat;
+    pRequest.mExtent = lFile.mExtent;
+    pRequest.mMipLevels = lFile.mMipLevels;
+    pRequest.mRegionCount = lFile.mMipLevels;
+
+    // Single level uncompressed file, the chain can still be built on the gpu
+    pRequest.mGpuMips = (pRequest.mFlags & GenerateMips) && lFile.mMipLevels == 1 && mMipmapGenerator->requiredUsage(lFile.mFormat) != 0;
+    if (pRequest.mGpuMips)
+        pRequest.mMipLevels = std::min(vkh::mipLevelCount({ lFile.mExtent.width, lFile.mExtent.height }), TextureFile::cMaxLevels);
+
+    VkDeviceSize lOffset = 0;
+    for (uint32_t i = 0; i < lFile.mMipLevels; ++i)
+    {
+        memcpy(lData + lOffset, lFile.mLevels[i].mData, (size_t)lFile.mLevels[i].mSize);
+
+        VkBufferImageCopy& lRegion = pRequest.mRegions[i];
+        lRegion = {};
+        lRegion.bufferOffset = lOffset;     // Relative to the staging slice, rebased in recordUpload()
+        lRegion.imageSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, i, 0, 1 };
+        lRegion.imageExtent = { std::max(lFile.mExtent.width >> i, 1u), std::max(lFile.mExtent.height >> i, 1u), 1 };
+
+        lOffset = alignUp(lOffset + lFile.mLevels[i].mSize, cLevelAlignment);
+    }
+    return true;
+}
+
+/******************************************************************************/
+bool TextureLoader::decodeImage(Request& pRequest)
+{
+    int lWidth = 0, lHeight = 0, lChannels = 0;
+    stbi_uc* lPixels = stbi_load(pRequest.mFilename.c_str(), &lWidth, &lHeight, &lChannels, STBI_rgb_alpha);
+    if (lPixels == nullptr)
+    {
+        printf("TextureLoader : can't load %s (%s)\n", pRequest.mFilename.c_str(), stbi_failure_reason());
+        return false;
+    }
+
+    const bool lSRGB = (pRequest.mFlags & SRGB) != 0;
+    pRequest.mFormat = lSRGB ? VK_FORMAT_R8G8B8A8_SRGB : VK_FORMAT_R8G8B8A8_UNORM;
+    pRequest.mExtent = { (uint32_t)lWidth, (uint32_t)lHeight, 1 };
+
+    uint32_t lFullChain = std::min(vkh::mipLevelCount({ (uint32_t)lWidth, (uint32_t)lHeight }), TextureFile::cMaxLevels);
+    const bool lCpuMips = (pRequest.mFlags & CpuMips) != 0;
+    pRequest.mGpuMips = !lCpuMips && (pRequest.mFlags & GenerateMips) && mMipmapGenerator->requiredUsage(pRequest.mFormat) != 0;
+    pRequest.mMipLevels = (lCpuMips || pRequest.mGpuMips) ? lFullChain : 1;
+    pRequest.mRegionCount = lCpuMips ? lFullChain : 1;
+
+    VkDeviceSize lSize = 0;
+    for (uint32_t i = 0; i < pRequest.mRegionCount; ++i)
+        lSize = alignUp(lSize + vkh::levelSize(pRequest.mFormat, pRequest.mExtent, i), cLevelAlignment);
+
+    uint8_t* lData = nullptr;
+    if (!allocateStaging(pRequest, lSize, lData))
+    {
+        stbi_image_free(lPixels);
+        return false;
+    }
+
+    // The staging memory is write combined, the filter reads from cached scratch memory
+    // and each level is written once with a memcpy
+    std::vector<uint8_t> lScratch[2];
+    const uint8_t* lSource = lPixels;
+    VkDeviceSize lOffset = 0;
+    for (uint32_t i = 0; i < pRequest.mRegionCount; ++i)
+    {
+        uint32_t lLevelWidth = std::max((uint32_t)lWidth >> i, 1u);
+        uint32_t lLevelHeight = std::max((uint32_t)lHeight >> i, 1u);
+        size_t lLevelSize = (size_t)lLevelWidth * lLevelHeight * 4;
+
+        const uint8_t* lLevel = lSource;
+        if (i > 0)
+        {
+            std::vector<uint8_t>& lDest = lScratch[i & 1];
+            lDest.resize(lLevelSize);
+            downsampleRGBA8(lSource, std::max((uint32_t)lWidth >> (i - 1), 1u), std::max((uint32_t)lHeight >> (i - 1), 1u), lDest.data(), lLevelWidth, lLevelHeight, lSRGB);
+            lLevel = lDest.data();
+        }
+        memcpy(lData + lOffset, lLevel, lLevelSize);
+        lSource = lLevel;
+
+        VkBufferImageCopy& lRegion = pRequest.mRegions[i];
+        lRegion = {};
+        lRegion.bufferOffset = lOffset;
+        lRegion.imageSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, i, 0, 1 };
+        lRegion.imageExtent = { lLevelWidth, lLevelHeight, 1 };
+
+        lOffset = alignUp(lOffset + lLevelSize, cLevelAlignment);
+    }
+
+    stbi_image_free(lPixels);
+    return true;
+}
+
+/******************************************************************************/
+bool TextureLoader::allocateStaging(Request& pRequest, VkDeviceSize pSize, uint8_t*& pData)
+{
+    pRequest.mStaging = StagingRing::Allocation();
+    pRequest.mDedicatedStaging = BufferHandle();
+
+    if (pSize <= mStagingRing.getSize())
+    {
+        if (!mStagingRing.allocate(pSize, cLevelAlignment, pRequest.mStaging))
+            return false;   // Aborted
+        pData = pRequest.mStaging.mData;
+        return true;
+    }
+
+    // Bigger than the whole ring, temporary buffer released with the batch
+    pRequest.mDedicatedStaging = mDevice->createBuffer(pSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VMA_MEMORY_USAGE_AUTO,
+        VMA_ALLOCATION_CREATE_MAPPED_BIT | VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT);
+    if (!pRequest.mDedicatedStaging.isValid())
+        return false;
+
+    pData = static_cast<uint8_t*>(mDevice->getBufferMappedData(pRequest.mDedicatedStaging));
+    return true;
+}
+
+/******************************************************************************/
+void TextureLoader::freeStaging(Request& pRequest)
+{
+    if (pRequest.mStaging.mSize > 0)
+        mStagingRing.free(pRequest.mStaging);
+    pRequest.mStaging = StagingRing::Allocation();
+
+    if (pRequest.mDedicatedStaging.isValid())
+        mDevice->destroyBuffer(pRequest.mDedicatedStaging);
+    pRequest.mDedicatedStaging = BufferHandle();
+}
+
+/******************************************************************************/
+void TextureLoader::recordUpload(VkCommandBuffer pCmd, Request& pRequest)
+{
+    VkImageUsageFlags lUsages = VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+    if (pRequest.mGpuMips)
+        lUsages |= mMipmapGenerator->requiredUsage(pRequest.mFormat);
+
+    VkImageCreateInfo lImageInfo = vkh::imageCreateInfo(pRequest.mFormat, lUsages, pRequest.mExtent, pRequest.mMipLevels);
+    pRequest.mImage = mDevice->createImage(lImageInfo, VK_IMAGE_ASPECT_COLOR_BIT);
+    pRequest.mState.store(State::Uploading, std::memory_order_release);
+    if (!pRequest.mImage.isValid())
+    {
+        printf("TextureLoader : can't create the image of %s\n", pRequest.mFilename.c_str());
+        return;     // Failed when the batch completes, the staging memory is released with it
+    }
+
+    VkBuffer lStagingBuffer;
+    VkDeviceSize lBaseOffset;
+    VkDeviceSize lStagingSize;
+    if (pRequest.mDedicatedStaging.isValid())
+    {
+        mDevice->flushBuffer(pRequest.mDedicatedStaging);
+        lStagingBuffer = mDevice->getBuffer(pRequest.mDedicatedStaging);
+        lBaseOffset = 0;
+        lStagingSize = mDevice->getBufferSize(pRequest.mDedicatedStaging);
+    }
+    else
+    {
+        mStagingRing.flush(pRequest.mStaging);
+        lStagingBuffer = mStagingRing.getBuffer();
+        lBaseOffset = pRequest.mStaging.mOffset;
+        lStagingSize = pRequest.mStaging.mSize;
+    }
+
+    VkBufferImageCopy lRegions[16];
+    for (uint32_t i = 0; i < pRequest.mRegionCount; ++i)
+    {
+        lRegions[i] = pRequest.mRegions[i];
+        lRegions[i].bufferOffset += lBaseOffset;
+    }
+
+    VkImage lImage = mDevice->getImage(pRequest.mImage);
+    vkh::transitionImage(pCmd, lImage, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 0, pRequest.mRegionCount);
+    vkCmdCopyBufferToImage(pCmd, lStagingBuffer, lImage, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, pRequest.mRegionCount, lRegions);
+
+    if (pRequest.mGpuMips)
+        mMipmapGenerator->generate(pCmd, pRequest.mImage, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+    else
+        vkh::transitionImage(pCmd, lImage, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, 0, pRequest.mRegionCount);
+
+    mStats.mUploadedBytes += lStagingSize;
+}
+
+/******************************************************************************/
+void TextureLoader::completeBatch(Batch& pBatch)
+{
+    for (uint32_t lIndex : pBatch.mRequests)
+    {
+        Request& lRequest = mRequests[lIndex];
+        freeStaging(lRequest);
+        completeRequest(lIndex, lRequest.mImage.isValid());
+    }
+    pBatch.mRequests.clear();
+
+    for (VkImageView lView : pBatch.mTransientViews)
+        vkDestroyImageView(*mDevice, lView, nullptr);
+    pBatch.mTransientViews.clear();
+
+    pBatch.mInFlight = false;
+}
+
+/******************************************************************************/
+void TextureLoader::completeRequest(uint32_t pIndex, bool pSuccess)
+{
+    Request& lRequest = mRequests[pIndex];
+    lRequest.mState.store(pSuccess ? State::Ready : State::Failed, std::memory_order_release);
+    mPendingCount.fetch_sub(1, std::memory_order_acq_rel);
+    if (pSuccess)
+        mStats.mLoaded++;
+    else
+        mStats.mFailed++;
+
+    if (lRequest.mReleaseRequested.load(std::memory_order_acquire))
+        destroyTexture(pIndex);
+}
+
+/******************************************************************************/
+void TextureLoader::destroyTexture(uint32_t pIndex)
+{
+    Request& lRequest = mRequests[pIndex];
+    if (lRequest.mImage.isValid())
+        mDevice->destroyImage(lRequest.mImage);
+
+    lRequest.mImage = ImageHandle();
+    lRequest.mFilename.clear();
+    lRequest.mState.store(State::Free, std::memory_order_release);
+    mHandles.release(pIndex);
+}
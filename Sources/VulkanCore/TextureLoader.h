@@ -0,0 +1,137 @@
+#pragma once
+
+#include "vk_common.h"
+#include "VulkanHandle.h"
+#include "ThreadPool.h"
+#include "StagingRing.h"
+
+#include <string>
+#include <vector>
+#include <mutex>
+#include <atomic>
+
+struct VulkanDevice;
+struct MipmapGenerator;
+
+using TextureHandle = Handle<struct TextureTag>;
+
+// Asynchronous texture loading
+// load() returns immediately, the files are decoded by a pool of worker threads directly into
+// slices of a StagingRing (.ktx2/.dds through TextureFile, the other formats through stb_image as RGBA8).
+// update(), called once per frame on the thread owning the graphics queue, records the copies of all
+// the textures decoded since the last call in one command buffer and submits it with a single fence.
+// A TextureHandle becomes ready (getImage() valid) once the fence of its batch is signaled.
+struct TextureLoader
+{
+    enum Flags : uint32_t
+    {
+        GenerateMips = 1 << 0,      // Full mip chain, built on the gpu by the MipmapGenerator
+        CpuMips = 1 << 1,           // Full mip chain, box filtered by the worker (stb formats only)
+        SRGB = 1 << 2,              // Color data, VK_FORMAT_R8G8B8A8_SRGB (stb formats only)
+    };
+
+    struct Stats
+    {
+        uint32_t mPending = 0;      // Requested, not ready yet
+        uint32_t mLoaded = 0;
+        uint32_t mFailed = 0;
+        uint32_t mSubmits = 0;      // Upload batches submitted
+        uint64_t mUploadedBytes = 0;
+    };
+
+    static const uint32_t cMaxTextures = 4096;
+    static const uint32_t cMaxBatchesInFlight = 4;
+
+    // pThreadCount = 0 use the hardware concurrency minus one
+    void init(VulkanDevice* pDevice, MipmapGenerator* pMipmapGenerator, VkDeviceSize pStagingSize = StagingRing::cDefaultSize, uint32_t pThreadCount = 0);
+    void shutdown();
+
+    // Thread safe
+    TextureHandle load(const std::string& pFilename, uint32_t pFlags = GenerateMips);
+    bool isReady(TextureHandle pHandle) const;
+    bool isFailed(TextureHandle pHandle) const;
+
+    // Invalid handle until the texture is ready
+    ImageHandle getImage(TextureHandle pHandle) const;
+
+    // Destroy the texture, deferred until the upload has completed if it is still in flight
+    // Main thread
+    void release(TextureHandle pHandle);
+
+    // Main thread, once per frame
+    void update();
+
+    // Block until all the requested textures are ready or failed (loading screen, startup)
+    void waitAll();
+
+    Stats getStats() const;
+
+    enum class State : uint8_t
+    {
+        Free,
+        Decoding,
+        Decoded,
+        Uploading,
+        Ready,
+        Failed,
+    };
+
+    struct Request
+    {
+        std::string mFilename;
+        uint32_t mFlags = 0;
+        std::atomic<State> mState = { State::Free };
+        std::atomic<bool> mReleaseRequested = { false };
+
+        // Filled by the worker
+        VkFormat mFormat = VK_FORMAT_UNDEFINED;
+        VkExtent3D mExtent = { 0, 0, 0 };
+        uint32_t mMipLevels = 0;
+        uint32_t mRegionCount = 0;          // Levels present in the staging memory
+        bool mGpuMips = false;
+        bool mDecodeFailed = false;
+        VkBufferImageCopy mRegions[16] = {};
+        StagingRing::Allocation mStaging;
+        BufferHandle mDedicatedStaging;     // When the texture doesn't fit in the ring
+
+        ImageHandle mImage;
+    };
+
+    struct Batch
+    {
+        VkCommandBuffer mCommandBuffer = VK_NULL_HANDLE;
+        VkFence mFence = VK_NULL_HANDLE;
+        bool mInFlight = false;
+        std::vector<uint32_t> mRequests;
+        std::vector<VkImageView> mTransientViews;  // Taken from the MipmapGenerator
+    };
+
+    void decode(uint32_t pIndex);
+    bool decodeTextureFile(Request& pRequest);
+    bool decodeImage(Request& pRequest);
+    bool allocateStaging(Request& pRequest, VkDeviceSize pSize, uint8_t*& pData);
+    void freeStaging(Request& pRequest);
+    void recordUpload(VkCommandBuffer pCmd, Request& pRequest);
+    void completeBatch(Batch& pBatch);
+    void completeRequest(uint32_t pIndex, bool pSuccess);
+    void destroyTexture(uint32_t pIndex);
+
+    VulkanDevice* mDevice = nullptr;
+    MipmapGenerator* mMipmapGenerator = nullptr;
+
+    ThreadPool mWorkers;
+    StagingRing mStagingRing;
+
+    HandleAllocator mHandles;
+    std::vector<Request> mRequests;         // Indexed by the handle index, never reallocated
+
+    std::mutex mDecodedMutex;
+    std::vector<uint32_t> mDecoded;         // Waiting for the next batch
+    std::vector<uint32_t> mDecodedScratch;
+
+    VkCommandPool mCommandPool = VK_NULL_HANDLE;
+    Batch mBatches[cMaxBatchesInFlight];
+
+    std::atomic<uint32_t> mPendingCount = { 0 };
+    Stats mStats;
+};
@@ -0,0 +1,520 @@
+#include "TextureStreamer.h"
+#include "VulkanDevice.h"
+#include "VulkanHelper.h"
+
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <algorithm>
+
+static const VkDeviceSize cLevelAlignment = 16;
+static const float cFadeSpeed = 1.0f / 8.0f;     // Levels per frame
+static const uint32_t cNoFeedback = 0xFFFFFFFF;
+
+/******************************************************************************/
+static inline VkDeviceSize alignUp(VkDeviceSize pValue, VkDeviceSize pAlignment)
+{
+    return (pValue + pAlignment - 1) & ~(pAlignment - 1);
+}
+
+/******************************************************************************/
+/******************************************************************************/
+/******************************************************************************/
+void TextureStreamer::init(VulkanDevice* pDevice, const Settings& pSettings)
+{
+    assert(mDevice == nullptr && "TextureStreamer : already initialized");
+    assert(pSettings.mFramesInFlight > 0);
+
+    mDevice = pDevice;
+    mSettings = pSettings;
+
+    mHandles.init(cMaxTextures);
+    std::vector<Texture> lTextures(cMaxTextures);
+    mTextures.swap(lTextures);
+
+    mStagingRing.init(pDevice, pSettings.mStagingSize);
+
+    // Written by the gpu, read and reset by the cpu once the frame has completed
+    mFeedbackBuffers.resize(pSettings.mFramesInFlight);
+    for (BufferHandle& lBuffer : mFeedbackBuffers)
+    {
+        lBuffer = pDevice->createBuffer(cMaxTextures * sizeof(uint32_t), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VMA_MEMORY_USAGE_AUTO,
+            VMA_ALLOCATION_CREATE_MAPPED_BIT | VMA_ALLOCATION_CREATE_HOST_ACCESS_RANDOM_BIT);
+        memset(pDevice->getBufferMappedData(lBuffer), 0xFF, cMaxTextures * sizeof(uint32_t));
+        pDevice->flushBuffer(lBuffer);
+    }
+
+    mRequestStorage.resize(cMaxRequestsInFlight);
+    mFreeRequests.clear();
+    for (Request& lRequest : mRequestStorage)
+        mFreeRequests.push_back(&lRequest);
+
+    mSamplers.assign(TextureFile::cMaxLevels * cMinLodSteps + 1, VK_NULL_HANDLE);
+
+    mWorkers.init(pSettings.mThreadCount, "TextureStreamer");
+
+    mFrame = 0;
+    mResidentBytes = 0;
+    mStats = Stats();
+}
+
+/******************************************************************************/
+void TextureStreamer::shutdown()
+{
+    if (mDevice == nullptr)
+        return;
+
+    // The gpu must be idle, nothing is deferred anymore
+    mStagingRing.abort();
+    mWorkers.shutdown();
+
+    for (Request* lRequest : mCompleted)
+    {
+        if (lRequest->mStaging.mSize > 0)
+            mStagingRing.free(lRequest->mStaging);
+    }
+    mCompleted.clear();
+
+    mHandles.forEach([this](uint32_t pIndex) { destroyTexture(pIndex); });
+
+    for (const Retired& lRetired : mRetired)
+    {
+        if (lRetired.mImage.isValid())
+            mDevice->destroyImage(lRetired.mImage);
+        if (lRetired.mStaging.mSize > 0)
+            mStagingRing.free(lRetired.mStaging);
+    }
+    mRetired.clear();
+
+    for (VkSampler lSampler : mSamplers)
+    {
+        if (lSampler != VK_NULL_HANDLE)
+            mDevice->destroySampler(lSampler);
+    }
+    mSamplers.clear();
+
+    for (BufferHandle lBuffer : mFeedbackBuffers)
+        mDevice->destroyBuffer(lBuffer);
+    mFeedbackBuffers.clear();
+
+    mStagingRing.destroy();
+    mTextures.clear();
+    mRequestStorage.clear();
+    mFreeRequests.clear();
+    mDevice = nullptr;
+}
+
+/******************************************************************************/
+StreamedTextureHandle TextureStreamer::add(const std::string& pFilename)
+{
+    uint32_t lIndex = mHandles.allocate();
+    if (lIndex == ~0u)
+        return StreamedTextureHandle();
+
+    Texture& lTexture = mTextures[lIndex];
+    if (!lTexture.mFile.open(pFilename) || !lTexture.mFile.prepare(*mDevice))
+    {
+        printf("TextureStreamer : can't load %s\n", pFilename.c_str());
+        lTexture.mFile.close();
+        mHandles.release(lIndex);
+        return StreamedTextureHandle();
+    }
+
+    const TextureFile& lFile = lTexture.mFile;
+    uint32_t lTailMip = 0;
+    while (lTailMip + 1 < lFile.mMipLevels && std::max(lFile.mExtent.width >> lTailMip, lFile.mExtent.height >> lTailMip) > cTailSize)
+        ++lTailMip;
+
+    lTexture.mFilename = pFilename;
+    lTexture.mImage = ImageHandle();
+    lTexture.mResidentMip = lFile.mMipLevels;   // Nothing resident, schedule() request the tail first
+    lTexture.mTailMip = lTailMip;
+    lTexture.mDesiredMip = lTailMip;
+    lTexture.mLastUsedFrame = mFrame;
+    lTexture.mMinLod = 0.0f;
+    lTexture.mRequestPending = false;
+    lTexture.mRemoved = false;
+
+    return mHandles.makeHandle<StreamedTextureTag>(lIndex);
+}
+
+/******************************************************************************/
+void TextureStreamer::remove(StreamedTextureHandle pHandle)
+{
+    if (!mHandles.isAlive(pHandle))
+        return;
+
+    Texture& lTexture = mTextures[pHandle.index()];
+    if (lTexture.mRequestPending)
+        lTexture.mRemoved = true;       // The worker is reading the file
+    else
+        destroyTexture(pHandle.index());
+}
+
+/******************************************************************************/
+void TextureStreamer::update(VkCommandBuffer pCmd, uint32_t pFrameIndex)
+{
+    ++mFrame;
+
+    // Release what the completed frames were using
+    size_t lKept = 0;
+    for (size_t i = 0; i < mRetired.size(); ++i)
+    {
+        const Retired& lRetired = mRetired[i];
+        if (lRetired.mFrame + mSettings.mFramesInFlight <= mFrame)
+        {
+            if (lRetired.mImage.isValid())
+                mDevice->destroyImage(lRetired.mImage);
+            if (lRetired.mStaging.mSize > 0)
+                mStagingRing.free(lRetired.mStaging);
+        }
+        else
+        {
+            mRetired[lKept++] = lRetired;
+        }
+    }
+    mRetired.resize(lKept);
+
+    readFeedback(pFrameIndex);
+
+    // Levels loaded by the workers, the new images are usable by the draws recorded after this
+    {
+        std::lock_guard<std::mutex> lLock(mCompletedMutex);
+        mRecording.swap(mCompleted);
+    }
+    for (Request* lRequest : mRecording)
+    {
+        recordRequest(pCmd, *lRequest);
+        mFreeRequests.push_back(lRequest);
+    }
+    mRecording.clear();
+
+    mHandles.forEach([this](uint32_t pIndex)
+    {
+        Texture& lTexture = mTextures[pIndex];
+        lTexture.mMinLod = std::max(0.0f, lTexture.mMinLod - cFadeSpeed);
+    });
+
+    schedule();
+}
+
+/******************************************************************************/
+VkBuffer TextureStreamer::getFeedbackBuffer(uint32_t pFrameIndex) const
+{
+    return mDevice->getBuffer(mFeedbackBuffers[pFrameIndex]);
+}
+
+/******************************************************************************/
+bool TextureStreamer::isResident(StreamedTextureHandle pHandle) const
+{
+    return mHandles.isAlive(pHandle) && mTextures[pHandle.index()].mImage.isValid();
+}
+
+/******************************************************************************/
+VkImageView TextureStreamer::getImageView(StreamedTextureHandle pHandle) const
+{
+    if (!isResident(pHandle))
+        return VK_NULL_HANDLE;
+    return mDevice->getImageView(mTextures[pHandle.index()].mImage);
+}
+
+/******************************************************************************/
+VkSampler TextureStreamer::getSampler(StreamedTextureHandle pHandle)
+{
+    // Round up, a level is never shown before its fade in
+    uint32_t lStep = (uint32_t)ceilf(getMinLod(pHandle) * cMinLodSteps);
+    lStep = std::min(lStep, (uint32_t)mSamplers.size() - 1);
+
+    if (mSamplers[lStep] == VK_NULL_HANDLE)
+        mSamplers[lStep] = vkh::createTextureSampler(*mDevice, mSettings.mMaxAnisotropy, (float)lStep / cMinLodSteps);
+    return mSamplers[lStep];
+}
+
+/******************************************************************************/
+float TextureStreamer::getMinLod(StreamedTextureHandle pHandle) const
+{
+    if (!mHandles.isAlive(pHandle))
+        return 0.0f;
+    return mTextures[pHandle.index()].mMinLod;
+}
+
+/******************************************************************************/
+uint32_t TextureStreamer::getResidentMip(StreamedTextureHandle pHandle) const
+{
+    if (!mHandles.isAlive(pHandle))
+        return 0;
+    return mTextures[pHandle.index()].mResidentMip;
+}
+
+/******************************************************************************/
+TextureStreamer::Stats TextureStreamer::getStats() const
+{
+    Stats lStats = mStats;
+    lStats.mResidentBytes = mResidentBytes;
+    lStats.mBudgetBytes = mSettings.mMemoryBudget;
+    lStats.mTextureCount = mHandles.count();
+    lStats.mPendingRequests = cMaxRequestsInFlight - (uint32_t)mFreeRequests.size();
+    return lStats;
+}
+
+/******************************************************************************/
+/******************************************************************************/
+/******************************************************************************/
+void TextureStreamer::readFeedback(uint32_t pFrameIndex)
+{
+    // The frame pFrameIndex has completed, its feedback is complete
+    BufferHandle lBuffer = mFeedbackBuffers[pFrameIndex];
+    mDevice->invalidateBuffer(lBuffer);
+    uint32_t* lFeedback = static_cast<uint32_t*>(mDevice->getBufferMappedData(lBuffer));
+
+    mHandles.forEach([&](uint32_t pIndex)
+    {
+        uint32_t lValue = lFeedback[pIndex];
+        Texture& lTexture = mTextures[pIndex];
+        if (lValue == cNoFeedback || !lTexture.mImage.isValid())
+            return;
+
+        // The shader lod is relative to the image, which start at mResidentMip (one frame late at worst),
+        // negative for the levels finer than the resident ones
+        const int32_t lLod = (int32_t)lTexture.mResidentMip + (int32_t)lValue - (int32_t)cFeedbackLodBias;
+        uint32_t lMip = (uint32_t)std::max(0, std::min(lLod, (int32_t)lTexture.mTailMip));
+        lTexture.mLastUsedFrame = mFrame;
+
+        // The min lod clamp of the fade in also clamp the reported lod, don't let it look coarser
+        if (lTexture.mMinLod > 0.0f)
+            lTexture.mDesiredMip = std::min(lTexture.mDesiredMip, lMip);
+        else
+            lTexture.mDesiredMip = lMip;
+    });
+
+    memset(lFeedback, 0xFF, mHandles.highWater() * sizeof(uint32_t));
+    mDevice->flushBuffer(lBuffer, 0, mHandles.highWater() * sizeof(uint32_t));
+}
+
+/******************************************************************************/
+void TextureStreamer::schedule()
+{
+    if (mFreeRequests.empty())
+        return;
+
+    mCandidates.clear();
+    mEvictable.clear();
+    mHandles.forEach([this](uint32_t pIndex)
+    {
+        const Texture& lTexture = mTextures[pIndex];
+        if (lTexture.mRequestPending || lTexture.mRemoved)
+            return;
+
+        const bool lUsed = mFrame - lTexture.mLastUsedFrame <= cEvictFrames;
+        const uint32_t lWanted = lUsed ? lTexture.mDesiredMip : lTexture.mTailMip;
+        if (lWanted < lTexture.mResidentMip)
+            mCandidates.push_back(pIndex);
+        else if (!lUsed && lTexture.mResidentMip < lTexture.mTailMip)
+            mEvictable.push_back(pIndex);
+    });
+
+    // Missing tails first, then the biggest gap between resident and wanted, then the most recently used
+    std::sort(mCandidates.begin(), mCandidates.end(), [this](uint32_t pA, uint32_t pB)
+    {
+        const Texture& lA = mTextures[pA];
+        const Texture& lB = mTextures[pB];
+        const bool lMissingA = !lA.mImage.isValid();
+        const bool lMissingB = !lB.mImage.isValid();
+        if (lMissingA != lMissingB)
+            return lMissingA;
+
+        const uint32_t lGapA = lA.mResidentMip - lA.mDesiredMip;
+        const uint32_t lGapB = lB.mResidentMip - lB.mDesiredMip;
+        if (lGapA != lGapB)
+            return lGapA > lGapB;
+        return lA.mLastUsedFrame > lB.mLastUsedFrame;
+    });
+
+    // Least recently used evicted first
+    std::sort(mEvictable.begin(), mEvictable.end(), [this](uint32_t pA, uint32_t pB)
+    {
+        return mTextures[pA].mLastUsedFrame < mTextures[pB].mLastUsedFrame;
+    });
+
+    size_t lNextEvictable = 0;
+    for (uint32_t lIndex : mCandidates)
+    {
+        if (mFreeRequests.empty())
+            break;
+
+        Texture& lTexture = mTextures[lIndex];
+        if (!lTexture.mImage.isValid())
+        {
+            // The tails are always resident, out of the budget
+            submitRequest(lIndex, lTexture.mTailMip);
+            continue;
+        }
+
+        // Finest level that fit in the budget, evict to make room if needed
+        const bool lUsed = mFrame - lTexture.mLastUsedFrame <= cEvictFrames;
+        uint32_t lTarget = lUsed ? lTexture.mDesiredMip : lTexture.mTailMip;
+        while (lTarget < lTexture.mResidentMip)
+        {
+            VkDeviceSize lNewBytes = mResidentBytes - residentSize(lTexture, lTexture.mResidentMip) + residentSize(lTexture, lTarget);
+            if (lNewBytes <= mSettings.mMemoryBudget)
+                break;
+
+            if (lNextEvictable < mEvictable.size() && mFreeRequests.size() > 1)
+            {
+                uint32_t lEvicted = mEvictable[lNextEvictable++];
+                submitRequest(lEvicted, mTextures[lEvicted].mTailMip);
+                continue;
+            }
+            ++lTarget;
+        }
+
+        if (lTarget < lTexture.mResidentMip)
+            submitRequest(lIndex, lTarget);
+    }
+}
+
+/******************************************************************************/
+void TextureStreamer::submitRequest(uint32_t pTexture, uint32_t pTargetMip)
+{
+    assert(!mFreeRequests.empty());
+    Request* lRequest = mFreeRequests.back();
+    mFreeRequests.pop_back();
+
+    Texture& lTexture = mTextures[pTexture];
+    lTexture.mRequestPending = true;
+
+    // Account the target size now, the next requests of this frame see the budget already used
+    mResidentBytes = mResidentBytes - residentSize(lTexture, lTexture.mResidentMip) + residentSize(lTexture, pTargetMip);
+
+    *lRequest = Request();
+    lRequest->mTexture = pTexture;
+    lRequest->mTargetMip = pTargetMip;
+    lRequest->mStartTime = std::chrono::steady_clock::now();
+
+    mWorkers.enqueue([this, lRequest]()
+    {
+        loadLevels(*lRequest);
+        std::lock_guard<std::mutex> lLock(mCompletedMutex);
+        mCompleted.push_back(lRequest);
+    });
+}
+
+/******************************************************************************/
+void TextureStreamer::loadLevels(Request& pRequest)
+{
+    // Worker thread, the texture file is not modified while a request is pending
+    const TextureFile& lFile = mTextures[pRequest.mTexture].mFile;
+
+    VkDeviceSize lSize = 0;
+    for (uint32_t i = pRequest.mTargetMip; i < lFile.mMipLevels; ++i)
+        lSize = alignUp(lSize + lFile.mLevels[i].mSize, cLevelAlignment);
+
+    if (!mStagingRing.allocate(lSize, cLevelAlignment, pRequest.mStaging))
+    {
+        if (lSize > mStagingRing.getSize())
+            printf("TextureStreamer : %s level %u doesn't fit in the staging ring\n", mTextures[pRequest.mTexture].mFilename.c_str(), pRequest.mTargetMip);
+        pRequest.mFailed = true;
+        return;
+    }
+
+    VkDeviceSize lOffset = 0;
+    for (uint32_t i = pRequest.mTargetMip; i < lFile.mMipLevels; ++i)
+    {
+        memcpy(pRequest.mStaging.mData + lOffset, lFile.mLevels[i].mData, (size_t)lFile.mLevels[i].mSize);
+
+        VkBufferImageCopy& lRegion = pRequest.mRegions[pRequest.mRegionCount++];
+        lRegion = {};
+        lRegion.bufferOffset = pRequest.mStaging.mOffset + lOffset;
+        lRegion.imageSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, i - pRequest.mTargetMip, 0, 1 };
+        lRegion.imageExtent = { std::max(lFile.mExtent.width >> i, 1u), std::max(lFile.mExtent.height >> i, 1u), 1 };
+
+        lOffset = alignUp(lOffset + lFile.mLevels[i].mSize, cLevelAlignment);
+    }
+    mStagingRing.flush(pRequest.mStaging);
+}
+
+/******************************************************************************/
+void TextureStreamer::recordRequest(VkCommandBuffer pCmd, Request& pRequest)
+{
+    Texture& lTexture = mTextures[pRequest.mTexture];
+    lTexture.mRequestPending = false;
+
+    // Used by pCmd, released with the frame
+    if (pRequest.mStaging.mSize > 0)
+        mRetired.push_back({ mFrame, ImageHandle(), pRequest.mStaging });
+
+    ImageHandle lImage;
+    if (!pRequest.mFailed && !lTexture.mRemoved)
+    {
+        const TextureFile& lFile = lTexture.mFile;
+        VkExtent3D lExtent = { std::max(lFile.mExtent.width >> pRequest.mTargetMip, 1u), std::max(lFile.mExtent.height >> pRequest.mTargetMip, 1u), 1 };
+        VkImageCreateInfo lImageInfo = vkh::imageCreateInfo(lFile.mFormat, VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT, lExtent, lFile.mMipLevels - pRequest.mTargetMip);
+        lImage = mDevice->createImage(lImageInfo, VK_IMAGE_ASPECT_COLOR_BIT);
+    }
+
+    if (!lImage.isValid())
+    {
+        // Back to the residency before the request
+        mResidentBytes = mResidentBytes - residentSize(lTexture, pRequest.mTargetMip) + residentSize(lTexture, lTexture.mResidentMip);
+        if (lTexture.mRemoved)
+            destroyTexture(pRequest.mTexture);
+        return;
+    }
+
+    VkImage lVkImage = mDevice->getImage(lImage);
+    vkh::transitionImage(pCmd, lVkImage, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
+    vkCmdCopyBufferToImage(pCmd, mStagingRing.getBuffer(), lVkImage, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, pRequest.mRegionCount, pRequest.mRegions);
+    vkh::transitionImage(pCmd, lVkImage, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+
+    // The frames in flight may still sample the previous image
+    const uint32_t lPreviousMip = lTexture.mResidentMip;
+    if (lTexture.mImage.isValid())
+        mRetired.push_back({ mFrame, lTexture.mImage, StagingRing::Allocation() });
+
+    lTexture.mImage = lImage;
+    lTexture.mResidentMip = pRequest.mTargetMip;
+
+    if (pRequest.mTargetMip < lPreviousMip && lPreviousMip < lTexture.mFile.mMipLevels)
+    {
+        lTexture.mMinLod = (float)(lPreviousMip - pRequest.mTargetMip);
+        mStats.mStreamedIn++;
+    }
+    else
+    {
+        lTexture.mMinLod = 0.0f;
+        if (pRequest.mTargetMip > lPreviousMip)
+            mStats.mEvicted++;
+    }
+
+    float lLatencyMs = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - pRequest.mStartTime).count();
+    mStats.mAverageLatencyMs = mStats.mAverageLatencyMs == 0.0f ? lLatencyMs : mStats.mAverageLatencyMs * 0.9f + lLatencyMs * 0.1f;
+    mStats.mMaxLatencyMs = std::max(mStats.mMaxLatencyMs, lLatencyMs);
+}
+
+/******************************************************************************/
+void TextureStreamer::destroyTexture(uint32_t pIndex)
+{
+    Texture& lTexture = mTextures[pIndex];
+    mResidentBytes -= residentSize(lTexture, lTexture.mResidentMip);
+
+    // The frames in flight may still sample it (on shutdown the retired list is flushed right after)
+    if (lTexture.mImage.isValid())
+        mRetired.push_back({ mFrame, lTexture.mImage, StagingRing::Allocation() });
+
+    lTexture.mImage = ImageHandle();
+    lTexture.mFile.close();
+    lTexture.mFilename.clear();
+    lTexture.mRequestPending = false;
+    lTexture.mRemoved = false;
+    mHandles.release(pIndex);
+}
+
+/******************************************************************************/
+VkDeviceSize TextureStreamer::residentSize(const Texture& pTexture, uint32_t pMip) const
+{
+    VkDeviceSize lSize = 0;
+    for (uint32_t i = pMip; i < pTexture.mFile.mMipLevels; ++i)
+        lSize += pTexture.mFile.mLevels[i].mSize;
+    return lSize;
+}
@@ -0,0 +1,151 @@
+#pragma once
+
+#include "vk_common.h"
+#include "VulkanHandle.h"
+#include "ThreadPool.h"
+#include "StagingRing.h"
+#include "TextureFile.h"
+
+#include <string>
+#include <vector>
+#include <mutex>
+#include <chrono>
+
+struct VulkanDevice;
+
+using StreamedTextureHandle = Handle<struct StreamedTextureTag>;
+
+// Mip streaming of precompressed textures (.ktx2/.dds, the mip chain must be in the file)
+// A texture starts with only its tail levels (<= cTailSize) resident. The fragment shaders write
+// the finest level they sample in a feedback buffer (Shaders/texture_streaming.h), and the finer levels
+// are streamed in, most wanted first, while the resident memory stays under the budget.
+// When the budget is reached, the textures not sampled for a while are shrunk back to their tail.
+//
+// There is no sparse residency: a residency change creates a new image holding the levels [resident, last]
+// and the old one is destroyed once the frames using it have completed. The levels are read from the
+// memory mapped file by worker threads into a StagingRing, the copies are recorded in the frame command buffer.
+// When finer levels arrive, the sampler min lod starts at the old resident level and fades to 0 so they
+// don't pop in.
+struct TextureStreamer
+{
+    struct Settings
+    {
+        VkDeviceSize mMemoryBudget = 256ull * 1024 * 1024;
+        VkDeviceSize mStagingSize = 32ull * 1024 * 1024;
+        uint32_t mFramesInFlight = 2;
+        uint32_t mThreadCount = 2;
+        float mMaxAnisotropy = 0.0f;
+    };
+
+    struct Stats
+    {
+        VkDeviceSize mResidentBytes = 0;
+        VkDeviceSize mBudgetBytes = 0;
+        uint32_t mTextureCount = 0;
+        uint32_t mPendingRequests = 0;
+        uint32_t mStreamedIn = 0;       // Residency increases completed
+        uint32_t mEvicted = 0;          // Residency decreases
+        float mAverageLatencyMs = 0.0f; // Request -> copy recorded, moving average
+        float mMaxLatencyMs = 0.0f;
+    };
+
+    static const uint32_t cMaxTextures = 4096;          // Size of the feedback buffer
+    static const uint32_t cTailSize = 64;               // Levels of this size and smaller are always resident
+    static const uint32_t cEvictFrames = 120;           // Not sampled for this long = can be evicted
+    static const uint32_t cMaxRequestsInFlight = 8;
+    static const uint32_t cMinLodSteps = 4;             // Sampler min lod granularity (1/4 level)
+    static const uint32_t cFeedbackLodBias = 16;        // Added to the signed lod by the shaders (STREAMING_LOD_BIAS)
+
+    void init(VulkanDevice* pDevice, const Settings& pSettings);
+    void shutdown();
+
+    // Open the file and request its tail levels, VK_NULL_HANDLE view until they are uploaded
+    StreamedTextureHandle add(const std::string& pFilename);
+    void remove(StreamedTextureHandle pHandle);
+
+    // Once per frame on the render thread, after the fence wait of pFrameIndex:
+    // read the feedback of that frame, record the pending copies in pCmd before the draws, schedule new requests
+    void update(VkCommandBuffer pCmd, uint32_t pFrameIndex);
+
+    // Storage buffer to bind for the fragment shaders of the frame pFrameIndex, indexed by handle index
+    VkBuffer getFeedbackBuffer(uint32_t pFrameIndex) const;
+    inline uint32_t getFeedbackId(StreamedTextureHandle pHandle) const { return pHandle.index(); }
+
+    bool isResident(StreamedTextureHandle pHandle) const;
+    VkImageView getImageView(StreamedTextureHandle pHandle) const;
+    VkSampler getSampler(StreamedTextureHandle pHandle);       // Sampler with the min lod clamp of the texture
+    float getMinLod(StreamedTextureHandle pHandle) const;
+    uint32_t getResidentMip(StreamedTextureHandle pHandle) const;   // In the file chain
+
+    Stats getStats() const;
+
+    struct Texture
+    {
+        std::string mFilename;
+        TextureFile mFile;              // Kept mapped, the levels are read on demand
+        ImageHandle mImage;
+        uint32_t mResidentMip = 0;      // First level of mImage in the file chain, mFile.mMipLevels = nothing resident
+        uint32_t mTailMip = 0;
+        uint32_t mDesiredMip = 0;       // From the feedback
+        uint64_t mLastUsedFrame = 0;
+        float mMinLod = 0.0f;           // Fade in of the new levels, relative to mImage
+        bool mRequestPending = false;
+        bool mRemoved = false;          // Released once the pending request completes
+    };
+
+    struct Request
+    {
+        uint32_t mTexture;
+        uint32_t mTargetMip;
+        std::chrono::steady_clock::time_point mStartTime;
+
+        // Filled by the worker
+        bool mFailed = false;
+        StagingRing::Allocation mStaging;
+        uint32_t mRegionCount = 0;
+        VkBufferImageCopy mRegions[TextureFile::cMaxLevels] = {};
+    };
+
+    // Released when the frame that last used it has completed
+    struct Retired
+    {
+        uint64_t mFrame;
+        ImageHandle mImage;
+        StagingRing::Allocation mStaging;
+    };
+
+    void readFeedback(uint32_t pFrameIndex);
+    void schedule();
+    void submitRequest(uint32_t pTexture, uint32_t pTargetMip);
+    void loadLevels(Request& pRequest);
+    void recordRequest(VkCommandBuffer pCmd, Request& pRequest);
+    void destroyTexture(uint32_t pIndex);
+    VkDeviceSize residentSize(const Texture& pTexture, uint32_t pMip) const;
+
+    VulkanDevice* mDevice = nullptr;
+    Settings mSettings;
+
+    ThreadPool mWorkers;
+    StagingRing mStagingRing;
+
+    HandleAllocator mHandles;
+    std::vector<Texture> mTextures;         // Indexed by the handle index, never reallocated
+
+    std::vector<BufferHandle> mFeedbackBuffers;     // One per frame in flight, host visible
+
+    std::mutex mCompletedMutex;
+    std::vector<Request*> mCompleted;       // Loaded by the workers, waiting to be recorded
+    std::vector<Request*> mRecording;
+    std::vector<Request*> mFreeRequests;
+    std::vector<Request> mRequestStorage;
+
+    std::vector<Retired> mRetired;
+    std::vector<uint32_t> mCandidates;      // schedule() scratch
+    std::vector<uint32_t> mEvictable;
+
+    std::vector<VkSampler> mSamplers;       // Indexed by the min lod in 1/cMinLodSteps steps, created on demand
+
+    uint64_t mFrame = 0;
+    VkDeviceSize mResidentBytes = 0;        // Including the requests in flight (at their target size)
+    Stats mStats;
+};
@@ -0,0 +1,111 @@
+#include "ThreadPool.h"
+
+#include <assert.h>
+#include <stdio.h>
+#include <string>
+
+#ifdef _WIN32
+#   include <windows.h>
+#else
+#   include <pthread.h>
+#endif
+
+namespace
+{
+    // Name of the calling thread, shown by the debuggers and profilers
+    void setThreadName(const char* pName)
+    {
+#if defined(_WIN32)
+        wchar_t lName[64];
+        MultiByteToWideChar(CP_UTF8, 0, pName, -1, lName, 64);
+        lName[63] = 0;
+        SetThreadDescription(GetCurrentThread(), lName);
+#elif defined(__APPLE__)
+        pthread_setname_np(pName);
+#else
+        // 15 characters max on Linux
+        char lName[16];
+        snprintf(lName, sizeof(lName), "%s", pName);
+        pthread_setname_np(pthread_self(), lName);
+#endif
+    }
+}
+
+/******************************************************************************/
+void ThreadPool::init(uint32_t pThreadCount, const char* pName)
+{
+    assert(mThreads.empty() && "ThreadPool : already initialized");
+
+    if (pThreadCount == 0)
+    {
+        uint32_t lHardwareThreads = std::thread::hardware_concurrency();
+        pThreadCount = lHardwareThreads > 1 ? lHardwareThreads - 1 : 1;
+    }
+
+    mStop = false;
+    mThreads.reserve(pThreadCount);
+    for (uint32_t i = 0; i < pThreadCount; ++i)
+    {
+        // Keep the index at the end, the Linux names are truncated
+        const std::string lName = std::string(pName).substr(0, 11) + " " + std::to_string(i);
+        mThreads.emplace_back([this, lName]()
+        {
+            setThreadName(lName.c_str());
+            for (;;)
+            {
+                std::function<void()> lJob;
+                {
+                    std::unique_lock<std::mutex> lLock(mMutex);
+                    mJobAvailable.wait(lLock, [this]() { return mStop || !mJobs.empty(); });
+                    if (mJobs.empty())
+                        return;     // mStop and nothing left to do
+
+                    lJob = std::move(mJobs.front());
+                    mJobs.pop_front();
+                    ++mRunningJobs;
+                }
+
+                lJob();
+
+                {
+                    std::lock_guard<std::mutex> lLock(mMutex);
+                    --mRunningJobs;
+                    if (mRunningJobs == 0 && mJobs.empty())
+                        mIdle.notify_all();
+                }
+            }
+        });
+    }
+}
+
+/******************************************************************************/
+void ThreadPool::shutdown()
+{
+    {
+        std::lock_guard<std::mutex> lLock(mMutex);
+        mStop = true;
+    }
+    mJobAvailable.notify_all();
+
+    for (std::thread& lThread : mThreads)
+        lThread.join();
+    mThreads.clear();
+}
+
+/******************************************************************************/
+void ThreadPool::enqueue(std::function<void()>&& pJob)
+{
+    assert(!mThreads.empty() && "ThreadPool : init() not called");
+    {
+        std::lock_guard<std::mutex> lLock(mMutex);
+        mJobs.push_back(std::move(pJob));
+    }
+    mJobAvailable.notify_one();
+}
+
+/******************************************************************************/
+void ThreadPool::waitIdle()
+{
+    std::unique_lock<std::mutex> lLock(mMutex);
+    mIdle.wait(lLock, [this]() { return mJobs.empty() && mRunningJobs == 0; });
+}
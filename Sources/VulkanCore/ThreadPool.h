@@ -0,0 +1,55 @@
+#pragma once
+
+#include <stdint.h>
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <memory>
+
+// Fixed size pool of worker threads consuming a FIFO of jobs
+// Meant for load time / background work (texture decode, pipeline and shader compilation),
+// not for the per frame jobs.
+struct ThreadPool
+{
+    ThreadPool() = default;
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+    ~ThreadPool() { shutdown(); }
+
+    // pThreadCount = 0 use the hardware concurrency minus one (the main thread)
+    // The threads are named "<pName> <index>" for the debuggers
+    void init(uint32_t pThreadCount = 0, const char* pName = "Worker");
+
+    // Finish the queued jobs and join the threads
+    void shutdown();
+
+    void enqueue(std::function<void()>&& pJob);
+
+    // Enqueue a job and get its result through a future
+    template<typename Function>
+    auto submit(Function&& pFunction) -> std::future<decltype(pFunction())>
+    {
+        using Result = decltype(pFunction());
+        auto lTask = std::make_shared<std::packaged_task<Result()>>(std::forward<Function>(pFunction));
+        std::future<Result> lFuture = lTask->get_future();
+        enqueue([lTask]() { (*lTask)(); });
+        return lFuture;
+    }
+
+    // Block until the queue is empty and no job is running
+    void waitIdle();
+
+    inline uint32_t threadCount() const { return (uint32_t)mThreads.size(); }
+
+    std::vector<std::thread> mThreads;
+    std::deque<std::function<void()>> mJobs;
+    std::mutex mMutex;
+    std::condition_variable mJobAvailable;
+    std::condition_variable mIdle;
+    uint32_t mRunningJobs = 0;
+    bool mStop = false;
+};
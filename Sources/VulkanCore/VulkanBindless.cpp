@@ -0,0 +1,247 @@
+#include "VulkanBindless.h"
+#include "VulkanDevice.h"
+
+#include <assert.h>
+#include <stdio.h>
+#include <algorithm>
+
+static const VkDescriptorType cBindingTypes[BindlessHeap::BindingCount] =
+{
+    VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE,
+    VK_DESCRIPTOR_TYPE_SAMPLER,
+    VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+};
+
+/******************************************************************************/
+bool BindlessHeap::isSupported(const VulkanDevice& pDevice)
+{
+    const VkPhysicalDeviceVulkan12Features& lFeatures = pDevice.mEnabledFeatures12;
+    return lFeatures.runtimeDescriptorArray
+        && lFeatures.descriptorBindingPartiallyBound
+        && lFeatures.descriptorBindingUpdateUnusedWhilePending
+        && lFeatures.descriptorBindingSampledImageUpdateAfterBind
+        && lFeatures.descriptorBindingStorageBufferUpdateAfterBind
+        && lFeatures.shaderSampledImageArrayNonUniformIndexing
+        && lFeatures.shaderStorageBufferArrayNonUniformIndexing;
+}
+
+/******************************************************************************/
+void BindlessHeap::init(VulkanDevice* pDevice, const Settings& pSettings)
+{
+    assert(mDevice == nullptr && "BindlessHeap : already initialized");
+    assert(isSupported(*pDevice) && "BindlessHeap : descriptor indexing features not enabled");
+
+    mDevice = pDevice;
+    mSettings = pSettings;
+    mFrame = 0;
+
+    // Clamp to the update after bind limits of the device
+    VkPhysicalDeviceVulkan12Properties lProperties12 = { VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_PROPERTIES };
+    VkPhysicalDeviceProperties2 lProperties = { VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2 };
+    lProperties.pNext = &lProperties12;
+    vkGetPhysicalDeviceProperties2(pDevice->mPhysicalDevice, &lProperties);
+
+    const uint32_t lStageLimit = lProperties12.maxPerStageUpdateAfterBindResources;
+    uint32_t lCounts[BindingCount] =
+    {
+        std::min({ pSettings.mMaxSampledImages, lProperties12.maxDescriptorSetUpdateAfterBindSampledImages, lProperties12.maxPerStageDescriptorUpdateAfterBindSampledImages }),
+        std::min({ pSettings.mMaxSamplers, lProperties12.maxDescriptorSetUpdateAfterBindSamplers, lProperties12.maxPerStageDescriptorUpdateAfterBindSamplers }),
+        std::min({ pSettings.mMaxStorageBuffers, lProperties12.maxDescriptorSetUpdateAfterBindStorageBuffers, lProperties12.maxPerStageDescriptorUpdateAfterBindStorageBuffers }),
+    };
+    if (lCounts[0] + lCounts[1] + lCounts[2] > lStageLimit)
+    {
+        printf("BindlessHeap : heap size reduced to fit maxPerStageUpdateAfterBindResources (%u)\n", lStageLimit);
+        // Half for the images, the other half shared by the samplers and the buffers
+        lCounts[0] = std::min(lCounts[0], lStageLimit / 2);
+        lCounts[1] = std::min(lCounts[1], lStageLimit / 2);
+        lCounts[2] = std::min(lCounts[2], lStageLimit / 2 - lCounts[1]);
+    }
+
+    VkDescriptorSetLayoutBinding lBindings[BindingCount] = {};
+    VkDescriptorBindingFlags lBindingFlags[BindingCount] = {};
+    VkDescriptorPoolSize lPoolSizes[BindingCount] = {};
+    for (uint32_t i = 0; i < BindingCount; ++i)
+    {
+        lBindings[i].binding = i;
+        lBindings[i].descriptorType = cBindingTypes[i];
+        lBindings[i].descriptorCount = lCounts[i];
+        lBindings[i].stageFlags = VK_SHADER_STAGE_ALL;
+        lBindingFlags[i] = VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT | VK_DESCRIPTOR_BINDING_UPDATE_AFTER_BIND_BIT | VK_DESCRIPTOR_BINDING_UPDATE_UNUSED_WHILE_PENDING_BIT;
+        lPoolSizes[i] = { cBindingTypes[i], lCounts[i] };
+
+        mSlots[i] = SlotArray();
+        mSlots[i].mCapacity = lCounts[i];
+    }
+
+    VkDescriptorSetLayoutBindingFlagsCreateInfo lBindingFlagsInfo = { VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_BINDING_FLAGS_CREATE_INFO };
+    lBindingFlagsInfo.bindingCount = BindingCount;
+    lBindingFlagsInfo.pBindingFlags = lBindingFlags;
+
+    VkDescriptorSetLayoutCreateInfo lLayoutInfo = { VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO };
+    lLayoutInfo.pNext = &lBindingFlagsInfo;
+    lLayoutInfo.flags = VK_DESCRIPTOR_SET_LAYOUT_CREATE_UPDATE_AFTER_BIND_POOL_BIT;
+    lLayoutInfo.bindingCount = BindingCount;
+    lLayoutInfo.pBindings = lBindings;
+    VK_CHECK(vkCreateDescriptorSetLayout(*pDevice, &lLayoutInfo, nullptr, &mLayout));
+
+    VkDescriptorPoolCreateInfo lPoolInfo = { VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO };
+    lPoolInfo.flags = VK_DESCRIPTOR_POOL_CREATE_UPDATE_AFTER_BIND_BIT;
+    lPoolInfo.maxSets = 1;
+    lPoolInfo.poolSizeCount = BindingCount;
+    lPoolInfo.pPoolSizes = lPoolSizes;
+    VK_CHECK(vkCreateDescriptorPool(*pDevice, &lPoolInfo, nullptr, &mPool));
+
+    VkDescriptorSetAllocateInfo lAllocInfo = { VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO };
+    lAllocInfo.descriptorPool = mPool;
+    lAllocInfo.descriptorSetCount = 1;
+    lAllocInfo.pSetLayouts = &mLayout;
+    VK_CHECK(vkAllocateDescriptorSets(*pDevice, &lAllocInfo, &mSet));
+}
+
+/******************************************************************************/
+void BindlessHeap::destroy()
+{
+    if (mDevice == nullptr)
+        return;
+
+    vkDestroyDescriptorPool(*mDevice, mPool, nullptr);
+    vkDestroyDescriptorSetLayout(*mDevice, mLayout, nullptr);
+    mPool = VK_NULL_HANDLE;
+    mLayout = VK_NULL_HANDLE;
+    mSet = VK_NULL_HANDLE;
+    mDevice = nullptr;
+}
+
+/******************************************************************************/
+uint32_t BindlessHeap::addImage(VkImageView pView, VkImageLayout pLayout)
+{
+    uint32_t lSlot = allocate(SampledImages);
+    if (lSlot != cInvalidSlot)
+    {
+        VkDescriptorImageInfo lImageInfo = { VK_NULL_HANDLE, pView, pLayout };
+        write(SampledImages, lSlot, &lImageInfo, nullptr);
+    }
+    return lSlot;
+}
+
+/******************************************************************************/
+uint32_t BindlessHeap::addImage(ImageHandle pImage, VkImageLayout pLayout)
+{
+    return addImage(mDevice->getImageView(pImage), pLayout);
+}
+
+/******************************************************************************/
+uint32_t BindlessHeap::addSampler(VkSampler pSampler)
+{
+    uint32_t lSlot = allocate(Samplers);
+    if (lSlot != cInvalidSlot)
+    {
+        VkDescriptorImageInfo lImageInfo = { pSampler, VK_NULL_HANDLE, VK_IMAGE_LAYOUT_UNDEFINED };
+        write(Samplers, lSlot, &lImageInfo, nullptr);
+    }
+    return lSlot;
+}
+
+/******************************************************************************/
+uint32_t BindlessHeap::addStorageBuffer(VkBuffer pBuffer, VkDeviceSize pOffset, VkDeviceSize pRange)
+{
+    uint32_t lSlot = allocate(StorageBuffers);
+    if (lSlot != cInvalidSlot)
+    {
+        VkDescriptorBufferInfo lBufferInfo = { pBuffer, pOffset, pRange };
+        write(StorageBuffers, lSlot, nullptr, &lBufferInfo);
+    }
+    return lSlot;
+}
+
+/******************************************************************************/
+uint32_t BindlessHeap::addStorageBuffer(BufferHandle pBuffer)
+{
+    return addStorageBuffer(mDevice->getBuffer(pBuffer), 0, VK_WHOLE_SIZE);
+}
+
+/******************************************************************************/
+void BindlessHeap::beginFrame()
+{
+    std::lock_guard<std::mutex> lLock(mMutex);
+    ++mFrame;
+
+    for (SlotArray& lSlots : mSlots)
+    {
+        size_t lKept = 0;
+        for (size_t i = 0; i < lSlots.mRetiredSlots.size(); ++i)
+        {
+            if (lSlots.mRetiredSlots[i].first + mSettings.mFramesInFlight <= mFrame)
+                lSlots.mFreeSlots.push_back(lSlots.mRetiredSlots[i].second);
+            else
+                lSlots.mRetiredSlots[lKept++] = lSlots.mRetiredSlots[i];
+        }
+        lSlots.mRetiredSlots.resize(lKept);
+    }
+}
+
+/******************************************************************************/
+void BindlessHeap::bind(VkCommandBuffer pCmd, VkPipelineBindPoint pBindPoint, VkPipelineLayout pLayout, uint32_t pSet) const
+{
+    vkCmdBindDescriptorSets(pCmd, pBindPoint, pLayout, pSet, 1, &mSet, 0, nullptr);
+}
+
+/******************************************************************************/
+uint32_t BindlessHeap::getUsedCount(Binding pBinding) const
+{
+    std::lock_guard<std::mutex> lLock(mMutex);
+    const SlotArray& lSlots = mSlots[pBinding];
+    return lSlots.mHighWater - (uint32_t)lSlots.mFreeSlots.size() - (uint32_t)lSlots.mRetiredSlots.size();
+}
+
+/******************************************************************************/
+/******************************************************************************/
+/******************************************************************************/
+uint32_t BindlessHeap::allocate(Binding pBinding)
+{
+    std::lock_guard<std::mutex> lLock(mMutex);
+    SlotArray& lSlots = mSlots[pBinding];
+
+    if (!lSlots.mFreeSlots.empty())
+    {
+        uint32_t lSlot = lSlots.mFreeSlots.back();
+        lSlots.mFreeSlots.pop_back();
+        return lSlot;
+    }
+
+    if (lSlots.mHighWater < lSlots.mCapacity)
+        return lSlots.mHighWater++;
+
+    printf("BindlessHeap : binding %u is full (%u descriptors)\n", (uint32_t)pBinding, lSlots.mCapacity);
+    assert(!"BindlessHeap : heap is full, increase the Settings");
+    return cInvalidSlot;
+}
+
+/******************************************************************************/
+void BindlessHeap::remove(Binding pBinding, uint32_t pSlot)
+{
+    if (pSlot == cInvalidSlot)
+        return;
+
+    // The slot stays written (partially bound doesn't require to clear it), it's only reused later
+    std::lock_guard<std::mutex> lLock(mMutex);
+    assert(pSlot < mSlots[pBinding].mHighWater);
+    mSlots[pBinding].mRetiredSlots.push_back({ mFrame, pSlot });
+}
+
+/******************************************************************************/
+void BindlessHeap::write(Binding pBinding, uint32_t pSlot, const VkDescriptorImageInfo* pImageInfo, const VkDescriptorBufferInfo* pBufferInfo)
+{
+    VkWriteDescriptorSet lWrite = { VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET };
+    lWrite.dstSet = mSet;
+    lWrite.dstBinding = pBinding;
+    lWrite.dstArrayElement = pSlot;
+    lWrite.descriptorCount = 1;
+    lWrite.descriptorType = cBindingTypes[pBinding];
+    lWrite.pImageInfo = pImageInfo;
+    lWrite.pBufferInfo = pBufferInfo;
+
+    // Writes of different slots of the same set must be externally synchronized too
+    std::lock_guard<std::mutex> lLock(mMutex);
+    vkUpdateDescriptorSets(*mDevice, 1, &lWrite, 0, nullptr);
+}
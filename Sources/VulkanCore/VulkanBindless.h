@@ -0,0 +1,91 @@
+#pragma once
+
+#include "vk_common.h"
+#include "VulkanHandle.h"
+
+#include <vector>
+#include <mutex>
+
+struct VulkanDevice;
+
+// Global descriptor heap (descriptor indexing)
+// One set holding large partially bound, update after bind arrays, bound once per frame:
+//   binding 0 : VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE  texture2D uTextures[]
+//   binding 1 : VK_DESCRIPTOR_TYPE_SAMPLER        sampler uSamplers[]
+//   binding 2 : VK_DESCRIPTOR_TYPE_STORAGE_BUFFER buffer uBuffers[]
+// Resources get a slot when added and the shaders index the arrays with integers given
+// through push constants (Shaders/bindless.h), so a draw or a material switch doesn't bind anything.
+//
+// A slot is written once, when it's added. Removed slots are recycled after Settings::mFramesInFlight
+// beginFrame() calls, so a pending command buffer never sees its descriptors rewritten
+// (descriptorBindingUpdateUnusedWhilePending). To change the resource of a slot, add a new one and remove the old.
+struct BindlessHeap
+{
+    enum Binding : uint32_t
+    {
+        SampledImages = 0,
+        Samplers = 1,
+        StorageBuffers = 2,
+        BindingCount
+    };
+
+    struct Settings
+    {
+        uint32_t mMaxSampledImages = 16 * 1024;
+        uint32_t mMaxSamplers = 256;
+        uint32_t mMaxStorageBuffers = 16 * 1024;
+        uint32_t mFramesInFlight = 2;
+    };
+
+    static const uint32_t cInvalidSlot = ~0u;
+
+    // Return false if the device doesn't support the descriptor indexing features needed
+    static bool isSupported(const VulkanDevice& pDevice);
+
+    void init(VulkanDevice* pDevice, const Settings& pSettings);
+    void destroy();
+
+    // Thread safe, return cInvalidSlot when the array is full
+    uint32_t addImage(VkImageView pView, VkImageLayout pLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+    uint32_t addImage(ImageHandle pImage, VkImageLayout pLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+    uint32_t addSampler(VkSampler pSampler);
+    uint32_t addStorageBuffer(VkBuffer pBuffer, VkDeviceSize pOffset = 0, VkDeviceSize pRange = VK_WHOLE_SIZE);
+    uint32_t addStorageBuffer(BufferHandle pBuffer);
+
+    void removeImage(uint32_t pSlot) { remove(SampledImages, pSlot); }
+    void removeSampler(uint32_t pSlot) { remove(Samplers, pSlot); }
+    void removeStorageBuffer(uint32_t pSlot) { remove(StorageBuffers, pSlot); }
+
+    // Once per frame, after the fence wait of the frame, recycle the slots removed mFramesInFlight frames ago
+    void beginFrame();
+
+    // Bind the heap at pSet, once per command buffer and bind point (the pipeline layouts must be compatible up to pSet)
+    void bind(VkCommandBuffer pCmd, VkPipelineBindPoint pBindPoint, VkPipelineLayout pLayout, uint32_t pSet = 0) const;
+
+    inline VkDescriptorSetLayout getLayout() const { return mLayout; }
+    inline VkDescriptorSet getSet() const { return mSet; }
+    uint32_t getUsedCount(Binding pBinding) const;
+
+    struct SlotArray
+    {
+        uint32_t mCapacity = 0;
+        uint32_t mHighWater = 0;
+        std::vector<uint32_t> mFreeSlots;
+        std::vector<std::pair<uint64_t, uint32_t>> mRetiredSlots;   // Frame of the removal, slot
+    };
+
+    uint32_t allocate(Binding pBinding);
+    void remove(Binding pBinding, uint32_t pSlot);
+    void write(Binding pBinding, uint32_t pSlot, const VkDescriptorImageInfo* pImageInfo, const VkDescriptorBufferInfo* pBufferInfo);
+
+    VulkanDevice* mDevice = nullptr;
+    Settings mSettings;
+
+    VkDescriptorSetLayout mLayout = VK_NULL_HANDLE;
+    VkDescriptorPool mPool = VK_NULL_HANDLE;
+    VkDescriptorSet mSet = VK_NULL_HANDLE;
+
+    mutable std::mutex mMutex;
+    SlotArray mSlots[BindingCount];
+    uint64_t mFrame = 0;
+};
@@ -1,33 +1,91 @@
 #include <VulkanDescriptor.h>
 #include <VulkanHelper.h>
 
+#include <assert.h>
+#include <math.h>
+#include <algorithm>
+#include <mutex>
+#include <unordered_map>
+
 /******************************************************************************/
-void DescriptorLayoutBuilder::addBinding(uint32_t pBinding, VkDescriptorType pType)
+void DescriptorLayoutBuilder::addBinding(uint32_t pBinding, VkDescriptorType pType, uint32_t pCount, VkShaderStageFlags pStageFlags)
 {
     VkDescriptorSetLayoutBinding lBinding = {};
     lBinding.binding = pBinding;
     lBinding.descriptorType = pType;
-    lBinding.descriptorCount = 1;
-    //lBinding.stageFlags = pStageFlags;   // fill during build
+    lBinding.descriptorCount = pCount;
+    lBinding.stageFlags = pStageFlags;     // 0 : filled during build
     mBindings.push_back(lBinding);
 }
 
 /******************************************************************************/
-VkDescriptorSetLayout DescriptorLayoutBuilder::build(VkDevice pDevice, VkShaderStageFlags pStageFlags)
+// Descriptor counts of the layouts registered by DescriptorLayoutBuilder,
+// used by DescriptorAllocator to learn the pool ratios and to size a pool for the layout it failed to allocate.
+// Erased by DescriptorLayoutBuilder::destroy, a reused handle never gets the counts of a destroyed layout.
+struct LayoutDescriptorCounts
+{
+    uint32_t mCounts[DescriptorAllocator::cTypeCount] = {};
+};
+
+static std::mutex sLayoutCountsMutex;
+static std::unordered_map<VkDescriptorSetLayout, LayoutDescriptorCounts> sLayoutCounts;
+
+/******************************************************************************/
+// Copy, the entry can be erased by an other thread
+static bool findLayoutCounts(VkDescriptorSetLayout pLayout, LayoutDescriptorCounts& pCounts)
+{
+    std::lock_guard<std::mutex> lLock(sLayoutCountsMutex);
+    auto lIt = sLayoutCounts.find(pLayout);
+    if (lIt == sLayoutCounts.end())
+        return false;
+    pCounts = lIt->second;
+    return true;
+}
+
+/******************************************************************************/
+void DescriptorLayoutBuilder::registerLayout(VkDescriptorSetLayout pLayout, const VkDescriptorSetLayoutBinding* pBindings, uint32_t pBindingCount)
 {
-    for (auto& b : mBindings)
+    LayoutDescriptorCounts lCounts;
+    for (uint32_t i = 0; i < pBindingCount; ++i)
     {
-        b.stageFlags = pStageFlags;
+        if (pBindings[i].descriptorType < DescriptorAllocator::cTypeCount)
+            lCounts.mCounts[pBindings[i].descriptorType] += pBindings[i].descriptorCount;
+    }
+
+    std::lock_guard<std::mutex> lLock(sLayoutCountsMutex);
+    sLayoutCounts[pLayout] = lCounts;
+}
+
+/******************************************************************************/
+void DescriptorLayoutBuilder::destroy(VkDevice pDevice, VkDescriptorSetLayout pLayout)
+{
+    {
+        std::lock_guard<std::mutex> lLock(sLayoutCountsMutex);
+        sLayoutCounts.erase(pLayout);
+    }
+    vkDestroyDescriptorSetLayout(pDevice, pLayout, nullptr);
+}
+
+/******************************************************************************/
+VkDescriptorSetLayout DescriptorLayoutBuilder::build(VkDevice pDevice, VkShaderStageFlags pStageFlags, VkDescriptorSetLayoutCreateFlags pFlags)
+{
+    // Copy, the builder can be reused with other stages
+    std::vector<VkDescriptorSetLayoutBinding> lBindings = mBindings;
+    for (auto& b : lBindings)
+    {
+        if (b.stageFlags == 0)
+            b.stageFlags = pStageFlags;
     }
 
     VkDescriptorSetLayoutCreateInfo lLayoutInfo = {};
     lLayoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
-    //lLayoutInfo.flags
-    lLayoutInfo.bindingCount = (uint32_t)mBindings.size();
-    lLayoutInfo.pBindings = mBindings.data();
+    lLayoutInfo.flags = pFlags;
+    lLayoutInfo.bindingCount = (uint32_t)lBindings.size();
+    lLayoutInfo.pBindings = lBindings.data();
 
     VkDescriptorSetLayout lLayout;
     VK_CHECK(vkCreateDescriptorSetLayout(pDevice, &lLayoutInfo, nullptr, &lLayout));
+    registerLayout(lLayout, lBindings.data(), (uint32_t)lBindings.size());
     return lLayout;
 }
 
@@ -43,31 +101,52 @@ void DescriptorLayoutBuilder::clear()
 
 void DescriptorAllocator::initPool(VkDevice pDevice, uint32_t pMaxSets, const std::vector<PoolSize>& pPoolSizes)
 {
-    std::vector<VkDescriptorPoolSize> lPoolSizes;
+    for (float& lRatio : mRatios)
+        lRatio = 0.0f;
     for (auto& p : pPoolSizes)
     {
-        lPoolSizes.push_back({ p.mType, p.mCount * pMaxSets });
+        assert(p.mType < cTypeCount && "DescriptorAllocator : extension descriptor types are not supported");
+        mRatios[p.mType] = (float)p.mCount;
     }
 
-    VkDescriptorPoolCreateInfo lPoolInfo = {};
-    lPoolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
-    lPoolInfo.poolSizeCount = (uint32_t)lPoolSizes.size();
-    lPoolInfo.pPoolSizes = lPoolSizes.data();
-    lPoolInfo.maxSets = pMaxSets;
-
-    VK_CHECK(vkCreateDescriptorPool(pDevice, &lPoolInfo, nullptr, &mPool));
+    mSetsPerPool = std::max(pMaxSets, 1u);
+    mReadyPools.push_back(createPool(pDevice, mSetsPerPool));
 }
 
 /******************************************************************************/
 void DescriptorAllocator::clearDescriptors(VkDevice pDevice)
 {
-    VK_CHECK(vkResetDescriptorPool(pDevice, mPool, 0));
+    for (VkDescriptorPool lPool : mReadyPools)
+        VK_CHECK(vkResetDescriptorPool(pDevice, lPool, 0));
+    for (VkDescriptorPool lPool : mFullPools)
+    {
+        VK_CHECK(vkResetDescriptorPool(pDevice, lPool, 0));
+        mReadyPools.push_back(lPool);
+    }
+    mFullPools.clear();
+
+    // Learn the ratios from the previous usage, the new pools will match it
+    if (mAllocatedSets > 0)
+    {
+        for (uint32_t i = 0; i < cTypeCount; ++i)
+        {
+            float lUsed = (float)mAllocatedDescriptors[i] / mAllocatedSets;
+            mRatios[i] = std::max(mRatios[i] * 0.5f, lUsed);   // Decay slowly the types no more used
+            mAllocatedDescriptors[i] = 0;
+        }
+        mAllocatedSets = 0;
+    }
 }
 
 /******************************************************************************/
 void DescriptorAllocator::destroyPool(VkDevice pDevice)
 {
-    vkDestroyDescriptorPool(pDevice, mPool, nullptr);
+    for (VkDescriptorPool lPool : mReadyPools)
+        vkDestroyDescriptorPool(pDevice, lPool, nullptr);
+    for (VkDescriptorPool lPool : mFullPools)
+        vkDestroyDescriptorPool(pDevice, lPool, nullptr);
+    mReadyPools.clear();
+    mFullPools.clear();
 }
 
 /******************************************************************************/
@@ -75,11 +154,136 @@ VkDescriptorSet DescriptorAllocator::allocate(VkDevice pDevice, VkDescriptorSetL
 {
     VkDescriptorSetAllocateInfo lAllocInfo = {};
     lAllocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
-    lAllocInfo.descriptorPool = mPool;
+    lAllocInfo.descriptorPool = getPool(pDevice);
     lAllocInfo.descriptorSetCount = 1;
     lAllocInfo.pSetLayouts = &pLayout;
 
     VkDescriptorSet lSet;
-    VK_CHECK(vkAllocateDescriptorSets(pDevice, &lAllocInfo, &lSet));
+    VkResult lResult = vkAllocateDescriptorSets(pDevice, &lAllocInfo, &lSet);
+    LayoutDescriptorCounts lCounts;
+    const bool lKnownLayout = findLayoutCounts(pLayout, lCounts);
+    if (lResult == VK_ERROR_OUT_OF_POOL_MEMORY || lResult == VK_ERROR_FRAGMENTED_POOL)
+    {
+        // The layout may use a type missing from the ratios or more descriptors than a pool holds:
+        // a new pool has room for at least one set of it
+        assert(lKnownLayout && "DescriptorAllocator : layout not registered, see DescriptorLayoutBuilder::registerLayout");
+        for (uint32_t i = 0; i < cTypeCount; ++i)
+            mRatios[i] = std::max(mRatios[i], (float)lCounts.mCounts[i]);
+    }
+    while (lResult == VK_ERROR_OUT_OF_POOL_MEMORY || lResult == VK_ERROR_FRAGMENTED_POOL)
+    {
+        // Retire the exhausted pool and retry in the next one, until a new pool is created
+        mFullPools.push_back(mReadyPools.back());
+        mReadyPools.pop_back();
+        const bool lNewPool = mReadyPools.empty();
+
+        lAllocInfo.descriptorPool = getPool(pDevice);
+        lResult = vkAllocateDescriptorSets(pDevice, &lAllocInfo, &lSet);
+        if (lNewPool)
+            break;
+    }
+    VK_CHECK(lResult);
+
+    mAllocatedSets++;
+    for (uint32_t i = 0; i < cTypeCount; ++i)
+        mAllocatedDescriptors[i] += lCounts.mCounts[i];
     return lSet;
-}
\ No newline at end of file
+}
+
+/******************************************************************************/
+void DescriptorAllocator::write(VkDevice pDevice, DescriptorWriter& pWriter, VkDescriptorSet pSet) const
+{
+    pWriter.updateSet(pDevice, pSet);
+}
+
+/******************************************************************************/
+void DescriptorAllocator::bind(VkCommandBuffer pCmd, VkPipelineBindPoint pBindPoint, VkPipelineLayout pLayout, uint32_t pFirstSet, VkDescriptorSet pSet) const
+{
+    vkCmdBindDescriptorSets(pCmd, pBindPoint, pLayout, pFirstSet, 1, &pSet, 0, nullptr);
+}
+
+/******************************************************************************/
+VkDescriptorPool DescriptorAllocator::createPool(VkDevice pDevice, uint32_t pSetCount)
+{
+    std::vector<VkDescriptorPoolSize> lPoolSizes;
+    for (uint32_t i = 0; i < cTypeCount; ++i)
+    {
+        if (mRatios[i] > 0.0f)
+            lPoolSizes.push_back({ (VkDescriptorType)i, std::max(1u, (uint32_t)ceilf(mRatios[i] * pSetCount)) });
+    }
+
+    VkDescriptorPoolCreateInfo lPoolInfo = {};
+    lPoolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+    lPoolInfo.poolSizeCount = (uint32_t)lPoolSizes.size();
+    lPoolInfo.pPoolSizes = lPoolSizes.data();
+    lPoolInfo.maxSets = pSetCount;
+
+    VkDescriptorPool lPool;
+    VK_CHECK(vkCreateDescriptorPool(pDevice, &lPoolInfo, nullptr, &lPool));
+    return lPool;
+}
+
+/******************************************************************************/
+VkDescriptorPool DescriptorAllocator::getPool(VkDevice pDevice)
+{
+    if (!mReadyPools.empty())
+        return mReadyPools.back();
+
+    // Grow, the next pools are bigger so a long frame ends with a few pools
+    mSetsPerPool = std::min(mSetsPerPool + mSetsPerPool / 2, cMaxSetsPerPool);
+
+    // The usage since the last clear is the best guess for the new pool
+    if (mAllocatedSets > 0)
+    {
+        for (uint32_t i = 0; i < cTypeCount; ++i)
+            mRatios[i] = std::max(mRatios[i], (float)mAllocatedDescriptors[i] / mAllocatedSets);
+    }
+
+    mReadyPools.push_back(createPool(pDevice, mSetsPerPool));
+    return mReadyPools.back();
+}
+
+/******************************************************************************/
+/******************************************************************************/
+/******************************************************************************/
+void DescriptorWriter::writeImage(uint32_t pBinding, VkImageView pView, VkSampler pSampler, VkImageLayout pLayout, VkDescriptorType pType)
+{
+    VkDescriptorImageInfo& lInfo = mImageInfos.emplace_back(VkDescriptorImageInfo{ pSampler, pView, pLayout });
+
+    VkWriteDescriptorSet lWrite = { VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET };
+    lWrite.dstBinding = pBinding;
+    lWrite.descriptorCount = 1;
+    lWrite.descriptorType = pType;
+    lWrite.pImageInfo = &lInfo;
+    mWrites.push_back(lWrite);
+}
+
+/******************************************************************************/
+void DescriptorWriter::writeBuffer(uint32_t pBinding, VkBuffer pBuffer, VkDeviceSize pSize, VkDeviceSize pOffset, VkDescriptorType pType)
+{
+    VkDescriptorBufferInfo& lInfo = mBufferInfos.emplace_back(VkDescriptorBufferInfo{ pBuffer, pOffset, pSize });
+
+    VkWriteDescriptorSet lWrite = { VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET };
+    lWrite.dstBinding = pBinding;
+    lWrite.descriptorCount = 1;
+    lWrite.descriptorType = pType;
+    lWrite.pBufferInfo = &lInfo;
+    mWrites.push_back(lWrite);
+}
+
+/******************************************************************************/
+void DescriptorWriter::clear()
+{
+    mImageInfos.clear();
+    mBufferInfos.clear();
+    mWrites.clear();
+}
+
+/******************************************************************************/
+void DescriptorWriter::updateSet(VkDevice pDevice, VkDescriptorSet pSet)
+{
+    for (VkWriteDescriptorSet& lWrite : mWrites)
+        lWrite.dstSet = pSet;
+
+    vkUpdateDescriptorSets(pDevice, (uint32_t)mWrites.size(), mWrites.data(), 0, nullptr);
+}
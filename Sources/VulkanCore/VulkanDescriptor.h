@@ -2,29 +2,105 @@
 
 #include "vk_common.h"
 #include <vector>
+#include <deque>
+
+struct DescriptorWriter;
 
 // Helper to create a descriptor layout
+// The bindings added without stages get the pStageFlags of build()
 struct DescriptorLayoutBuilder
 {
     std::vector<VkDescriptorSetLayoutBinding> mBindings;
-    void addBinding(uint32_t pBinding, VkDescriptorType pType);
-    VkDescriptorSetLayout build(VkDevice pDevice, VkShaderStageFlags pStageFlags);
+    void addBinding(uint32_t pBinding, VkDescriptorType pType, uint32_t pCount = 1, VkShaderStageFlags pStageFlags = 0);
+    VkDescriptorSetLayout build(VkDevice pDevice, VkShaderStageFlags pStageFlags, VkDescriptorSetLayoutCreateFlags pFlags = 0);
     void clear();
+
+    // The descriptor counts of the layouts are kept for DescriptorAllocator, until destroy()
+    // A layout created with vkCreateDescriptorSetLayout and allocated by a DescriptorAllocator must be registered
+    static void registerLayout(VkDescriptorSetLayout pLayout, const VkDescriptorSetLayoutBinding* pBindings, uint32_t pBindingCount);
+    static void destroy(VkDevice pDevice, VkDescriptorSetLayout pLayout);
 };
 
-// Helper to create allocate descriptor set
+// Helper to allocate descriptor sets
+// Growable: when the current pool is exhausted (VK_ERROR_OUT_OF_POOL_MEMORY / VK_ERROR_FRAGMENTED_POOL)
+// a new bigger pool is chained. The descriptors per set of each type are learned from the layouts
+// allocated (see DescriptorLayoutBuilder::registerLayout), so the next pools match the real usage.
+// For the transient sets keep one allocator per frame in flight and call clearDescriptors() once the
+// fence of the frame has signaled: all the pools are reset and reused, nothing grows after the first frames.
+// DescriptorBufferAllocator has the same interface (Set, initPool ... bind), the code recording the sets
+// can be written once for both backends.
 struct DescriptorAllocator
 {
     struct PoolSize
     {
         VkDescriptorType mType;
-        uint32_t mCount;
+        uint32_t mCount;    // Descriptors per set
     };
 
-    VkDescriptorPool mPool;
+    using Set = VkDescriptorSet;
+
+    static const uint32_t cMaxSetsPerPool = 4096;
+    static const uint32_t cTypeCount = VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT + 1;    // The core types, used to index mRatios
+
+    std::vector<VkDescriptorPool> mReadyPools;  // mReadyPools.back() is the current one
+    std::vector<VkDescriptorPool> mFullPools;
+    uint32_t mSetsPerPool = 0;
+    float mRatios[cTypeCount] = {};             // Descriptors per set, initial or learned
+
+    // Usage since the last clear, used to learn the ratios
+    uint32_t mAllocatedSets = 0;
+    uint32_t mAllocatedDescriptors[cTypeCount] = {};
 
     void initPool(VkDevice pDevice, uint32_t pMaxSets, const std::vector<PoolSize>& pPoolSizes);
     void clearDescriptors(VkDevice pDevice);
     void destroyPool(VkDevice pDevice);
     VkDescriptorSet allocate(VkDevice pDevice, VkDescriptorSetLayout pLayout);
-};
\ No newline at end of file
+    void write(VkDevice pDevice, DescriptorWriter& pWriter, VkDescriptorSet pSet) const;
+
+    // Nothing to bind per command buffer, see DescriptorBufferAllocator::bindBuffer
+    void bindBuffer(VkCommandBuffer pCmd) const {}
+    void bind(VkCommandBuffer pCmd, VkPipelineBindPoint pBindPoint, VkPipelineLayout pLayout, uint32_t pFirstSet, VkDescriptorSet pSet) const;
+
+    uint32_t poolCount() const { return (uint32_t)(mReadyPools.size() + mFullPools.size()); }
+
+    VkDescriptorPool createPool(VkDevice pDevice, uint32_t pSetCount);
+    VkDescriptorPool getPool(VkDevice pDevice);
+};
+
+// Helper to record the descriptors of a set, then write them in a VkDescriptorSet (updateSet)
+// or in a descriptor buffer (DescriptorBufferAllocator::write)
+// The size of the buffers must be given, VK_WHOLE_SIZE is not allowed with the descriptor buffers
+struct DescriptorWriter
+{
+    std::deque<VkDescriptorImageInfo> mImageInfos;      // deque: the pointers in mWrites stay valid
+    std::deque<VkDescriptorBufferInfo> mBufferInfos;
+    std::vector<VkWriteDescriptorSet> mWrites;
+
+    void writeImage(uint32_t pBinding, VkImageView pView, VkSampler pSampler, VkImageLayout pLayout, VkDescriptorType pType);
+    void writeBuffer(uint32_t pBinding, VkBuffer pBuffer, VkDeviceSize pSize, VkDeviceSize pOffset, VkDescriptorType pType);
+    void clear();
+    void updateSet(VkDevice pDevice, VkDescriptorSet pSet);
+};
+
+// Data layout of the descriptor update templates (see PipelineLayoutCache):
+// one DescriptorInfo per descriptor, in the binding order of the set
+struct DescriptorInfo
+{
+    union
+    {
+        VkDescriptorImageInfo mImage;
+        VkDescriptorBufferInfo mBuffer;
+    };
+
+    DescriptorInfo() : mBuffer{ VK_NULL_HANDLE, 0, 0 } {}
+
+    DescriptorInfo(VkSampler pSampler, VkImageView pImageView, VkImageLayout pImageLayout)
+    {
+        mImage = { pSampler, pImageView, pImageLayout };
+    }
+
+    DescriptorInfo(VkBuffer pBuffer, VkDeviceSize pOffset = 0, VkDeviceSize pRange = VK_WHOLE_SIZE)
+    {
+        mBuffer = { pBuffer, pOffset, pRange };
+    }
+};
@@ -0,0 +1,207 @@
+#include "VulkanDescriptorBuffer.h"
+#include "VulkanDescriptor.h"
+#include "VulkanDevice.h"
+
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+
+static const VkBufferUsageFlags cDescriptorBufferUsage = VK_BUFFER_USAGE_RESOURCE_DESCRIPTOR_BUFFER_BIT_EXT | VK_BUFFER_USAGE_SAMPLER_DESCRIPTOR_BUFFER_BIT_EXT;
+
+/******************************************************************************/
+static inline VkDeviceSize alignUp(VkDeviceSize pValue, VkDeviceSize pAlignment)
+{
+    return (pValue + pAlignment - 1) / pAlignment * pAlignment;
+}
+
+/******************************************************************************/
+bool DescriptorBufferAllocator::isSupported(const VulkanDevice& pDevice)
+{
+    return pDevice.mDescriptorBackend == VulkanDevice::DescriptorBackend::DescriptorBuffer;
+}
+
+/******************************************************************************/
+void DescriptorBufferAllocator::initPool(VulkanDevice& pDevice, uint32_t pMaxSets, const std::vector<PoolSize>& pPoolSizes)
+{
+    assert(mDevice == nullptr && "DescriptorBufferAllocator : already initialized");
+    assert(isSupported(pDevice) && "DescriptorBufferAllocator : VK_EXT_descriptor_buffer not enabled");
+
+    const VkPhysicalDeviceDescriptorBufferPropertiesEXT& lProperties = pDevice.mDescriptorBufferProperties;
+    mDevice = &pDevice;
+    mOffset = 0;
+    mFull = false;
+
+    // A set of the layout takes at least its descriptors, a binding can be padded up to the offset alignment
+    VkDeviceSize lSetSize = 0;
+    for (const PoolSize& lPoolSize : pPoolSizes)
+        lSetSize += lPoolSize.mCount * alignUp(descriptorSize(lPoolSize.mType), lProperties.descriptorBufferOffsetAlignment);
+    lSetSize = alignUp(std::max<VkDeviceSize>(lSetSize, 1), lProperties.descriptorBufferOffsetAlignment);
+    mSize = std::min(lSetSize * std::max(pMaxSets, 1u), std::min(lProperties.maxResourceDescriptorBufferRange, lProperties.maxSamplerDescriptorBufferRange));
+
+    mBuffer = pDevice.createBuffer(mSize, cDescriptorBufferUsage | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT,
+        VMA_MEMORY_USAGE_AUTO, VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT | VMA_ALLOCATION_CREATE_MAPPED_BIT);
+    mAddress = pDevice.getBufferAddress(mBuffer);
+    mData = (uint8_t*)pDevice.getBufferMappedData(mBuffer);
+    assert(mData != nullptr);
+}
+
+/******************************************************************************/
+void DescriptorBufferAllocator::clearDescriptors(VkDevice pDevice)
+{
+    assert(mDevice == nullptr || pDevice == mDevice->mLogicalDevice);
+    mOffset = 0;
+    mFull = false;
+}
+
+/******************************************************************************/
+void DescriptorBufferAllocator::destroyPool(VkDevice pDevice)
+{
+    if (mDevice == nullptr)
+        return;
+    assert(pDevice == mDevice->mLogicalDevice);
+
+    mDevice->destroyBuffer(mBuffer);
+    mBuffer = BufferHandle();
+    mData = nullptr;
+    mLayoutSizes.clear();
+    mDevice = nullptr;
+}
+
+/******************************************************************************/
+DescriptorBufferSet DescriptorBufferAllocator::allocate(VkDevice pDevice, VkDescriptorSetLayout pLayout)
+{
+    assert(pDevice == mDevice->mLogicalDevice);
+    DescriptorBufferSet lSet;
+    const VkDeviceSize lOffset = alignUp(mOffset, mDevice->mDescriptorBufferProperties.descriptorBufferOffsetAlignment);
+
+    VkDeviceSize lEnd = lOffset + layoutSize(pLayout);
+    if (lEnd > mSize)
+    {
+        // Invalid set, the descriptors of the live sets are not overwritten
+        if (!mFull)
+            printf("DescriptorBufferAllocator : buffer full (%llu bytes), increase the sets of initPool()\n", (unsigned long long)mSize);
+        mFull = true;
+        return lSet;
+    }
+    lSet.mLayout = pLayout;
+    lSet.mOffset = lOffset;
+    mOffset = lEnd;
+    return lSet;
+}
+
+/******************************************************************************/
+void DescriptorBufferAllocator::write(VkDevice pDevice, const DescriptorWriter& pWriter, const DescriptorBufferSet& pSet)
+{
+    assert(pDevice == mDevice->mLogicalDevice);
+    assert(pSet.isValid() && "DescriptorBufferAllocator : write to an invalid set");
+    if (!pSet.isValid())
+        return;
+
+    for (const VkWriteDescriptorSet& lWrite : pWriter.mWrites)
+    {
+        VkDeviceSize lBindingOffset = 0;
+        vkGetDescriptorSetLayoutBindingOffsetEXT(*mDevice, pSet.mLayout, lWrite.dstBinding, &lBindingOffset);
+
+        const size_t lSize = descriptorSize(lWrite.descriptorType);
+        for (uint32_t i = 0; i < lWrite.descriptorCount; ++i)
+        {
+            VkDescriptorGetInfoEXT lInfo = { VK_STRUCTURE_TYPE_DESCRIPTOR_GET_INFO_EXT };
+            lInfo.type = lWrite.descriptorType;
+
+            VkDescriptorAddressInfoEXT lAddressInfo = { VK_STRUCTURE_TYPE_DESCRIPTOR_ADDRESS_INFO_EXT };
+            switch (lWrite.descriptorType)
+            {
+            case VK_DESCRIPTOR_TYPE_SAMPLER:
+                lInfo.data.pSampler = &lWrite.pImageInfo[i].sampler;
+                break;
+            case VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER:
+                lInfo.data.pCombinedImageSampler = &lWrite.pImageInfo[i];
+                break;
+            case VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE:
+                lInfo.data.pSampledImage = &lWrite.pImageInfo[i];
+                break;
+            case VK_DESCRIPTOR_TYPE_STORAGE_IMAGE:
+                lInfo.data.pStorageImage = &lWrite.pImageInfo[i];
+                break;
+            case VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT:
+                lInfo.data.pInputAttachmentImage = &lWrite.pImageInfo[i];
+                break;
+            case VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER:
+            case VK_DESCRIPTOR_TYPE_STORAGE_BUFFER:
+            {
+                const VkDescriptorBufferInfo& lBufferInfo = lWrite.pBufferInfo[i];
+                assert(lBufferInfo.range != VK_WHOLE_SIZE && "DescriptorBufferAllocator : the range of the buffers must be given");
+
+                VkBufferDeviceAddressInfo lBufferAddressInfo = { VK_STRUCTURE_TYPE_BUFFER_DEVICE_ADDRESS_INFO };
+                lBufferAddressInfo.buffer = lBufferInfo.buffer;
+                lAddressInfo.address = vkGetBufferDeviceAddress(*mDevice, &lBufferAddressInfo) + lBufferInfo.offset;
+                lAddressInfo.range = lBufferInfo.range;
+                if (lWrite.descriptorType == VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER)
+                    lInfo.data.pUniformBuffer = &lAddressInfo;
+                else
+                    lInfo.data.pStorageBuffer = &lAddressInfo;
+                break;
+            }
+            default:
+                assert(!"DescriptorBufferAllocator : descriptor type not supported");
+                continue;
+            }
+
+            VkDeviceSize lOffset = pSet.mOffset + lBindingOffset + (lWrite.dstArrayElement + i) * lSize;
+            vkGetDescriptorEXT(*mDevice, &lInfo, lSize, mData + lOffset);
+        }
+    }
+
+    // No-op on host coherent memory
+    mDevice->flushBuffer(mBuffer, pSet.mOffset, layoutSize(pSet.mLayout));
+}
+
+/******************************************************************************/
+void DescriptorBufferAllocator::bindBuffer(VkCommandBuffer pCmd) const
+{
+    VkDescriptorBufferBindingInfoEXT lBindingInfo = { VK_STRUCTURE_TYPE_DESCRIPTOR_BUFFER_BINDING_INFO_EXT };
+    lBindingInfo.address = mAddress;
+    lBindingInfo.usage = cDescriptorBufferUsage;
+    vkCmdBindDescriptorBuffersEXT(pCmd, 1, &lBindingInfo);
+}
+
+/******************************************************************************/
+void DescriptorBufferAllocator::bind(VkCommandBuffer pCmd, VkPipelineBindPoint pBindPoint, VkPipelineLayout pLayout, uint32_t pFirstSet, const DescriptorBufferSet& pSet) const
+{
+    assert(pSet.isValid() && "DescriptorBufferAllocator : bind of an invalid set");
+    const uint32_t lBufferIndex = 0;
+    vkCmdSetDescriptorBufferOffsetsEXT(pCmd, pBindPoint, pLayout, pFirstSet, 1, &lBufferIndex, &pSet.mOffset);
+}
+
+/******************************************************************************/
+/******************************************************************************/
+/******************************************************************************/
+size_t DescriptorBufferAllocator::descriptorSize(VkDescriptorType pType) const
+{
+    const VkPhysicalDeviceDescriptorBufferPropertiesEXT& lProperties = mDevice->mDescriptorBufferProperties;
+    switch (pType)
+    {
+    case VK_DESCRIPTOR_TYPE_SAMPLER:                return lProperties.samplerDescriptorSize;
+    case VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER: return lProperties.combinedImageSamplerDescriptorSize;
+    case VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE:          return lProperties.sampledImageDescriptorSize;
+    case VK_DESCRIPTOR_TYPE_STORAGE_IMAGE:          return lProperties.storageImageDescriptorSize;
+    case VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT:       return lProperties.inputAttachmentDescriptorSize;
+    case VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER:         return lProperties.uniformBufferDescriptorSize;
+    case VK_DESCRIPTOR_TYPE_STORAGE_BUFFER:         return lProperties.storageBufferDescriptorSize;
+    default:                                        return 0;
+    }
+}
+
+/******************************************************************************/
+VkDeviceSize DescriptorBufferAllocator::layoutSize(VkDescriptorSetLayout pLayout)
+{
+    auto lIt = mLayoutSizes.find(pLayout);
+    if (lIt != mLayoutSizes.end())
+        return lIt->second;
+
+    VkDeviceSize lSize = 0;
+    vkGetDescriptorSetLayoutSizeEXT(*mDevice, pLayout, &lSize);
+    mLayoutSizes[pLayout] = lSize;
+    return lSize;
+}
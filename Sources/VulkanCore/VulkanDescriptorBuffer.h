@@ -0,0 +1,67 @@
+#pragma once
+
+#include "vk_common.h"
+#include "VulkanHandle.h"
+#include "VulkanDescriptor.h"
+
+#include <unordered_map>
+
+struct VulkanDevice;
+
+// A set stored in a descriptor buffer, used in place of a VkDescriptorSet
+// Invalid (no layout) when the buffer was full
+struct DescriptorBufferSet
+{
+    VkDescriptorSetLayout mLayout = VK_NULL_HANDLE;
+    VkDeviceSize mOffset = 0;
+
+    inline bool isValid() const { return mLayout != VK_NULL_HANDLE; }
+};
+
+// Descriptor buffer backend (VK_EXT_descriptor_buffer, VulkanDevice::DescriptorBackend::DescriptorBuffer)
+// Same interface as DescriptorAllocator, the recording code is shared: the layouts are built by
+// DescriptorLayoutBuilder with cLayoutFlags, allocate() gives a Set, write() fills it from a DescriptorWriter,
+// bind() binds it and clearDescriptors() recycles everything once the fence of the frame has signaled
+// (one allocator per frame in flight).
+// The buffer is sized by initPool() for pMaxSets sets of pPoolSizes, it doesn't grow: allocate() returns an
+// invalid set when it is full.
+// There is no pool and no vkUpdateDescriptorSets: a set is a range of a host visible buffer,
+// the descriptors are written in it with vkGetDescriptorEXT and bound with vkCmdSetDescriptorBufferOffsetsEXT.
+// The pipelines must be created with VK_PIPELINE_CREATE_DESCRIPTOR_BUFFER_BIT_EXT.
+struct DescriptorBufferAllocator
+{
+    using Set = DescriptorBufferSet;
+    using PoolSize = DescriptorAllocator::PoolSize;
+
+    static const VkDescriptorSetLayoutCreateFlags cLayoutFlags = VK_DESCRIPTOR_SET_LAYOUT_CREATE_DESCRIPTOR_BUFFER_BIT_EXT;
+
+    static bool isSupported(const VulkanDevice& pDevice);
+
+    // The pDevice of the other calls must be the device of initPool(), it creates the buffer
+    void initPool(VulkanDevice& pDevice, uint32_t pMaxSets, const std::vector<PoolSize>& pPoolSizes);
+    void clearDescriptors(VkDevice pDevice);
+    void destroyPool(VkDevice pDevice);
+
+    // Invalid set when the buffer is full, to check before write()/bind()
+    DescriptorBufferSet allocate(VkDevice pDevice, VkDescriptorSetLayout pLayout);
+    void write(VkDevice pDevice, const DescriptorWriter& pWriter, const DescriptorBufferSet& pSet);
+
+    // Once per command buffer, before the first bind (binding a descriptor buffer is expensive on some hardware)
+    void bindBuffer(VkCommandBuffer pCmd) const;
+    void bind(VkCommandBuffer pCmd, VkPipelineBindPoint pBindPoint, VkPipelineLayout pLayout, uint32_t pFirstSet, const DescriptorBufferSet& pSet) const;
+
+    inline VkDeviceSize getUsedSize() const { return mOffset; }
+
+    size_t descriptorSize(VkDescriptorType pType) const;
+    VkDeviceSize layoutSize(VkDescriptorSetLayout pLayout);
+
+    VulkanDevice* mDevice = nullptr;
+    BufferHandle mBuffer;
+    VkDeviceAddress mAddress = 0;
+    uint8_t* mData = nullptr;
+    VkDeviceSize mSize = 0;
+    VkDeviceSize mOffset = 0;
+    bool mFull = false;             // Reported once per clear
+
+    std::unordered_map<VkDescriptorSetLayout, VkDeviceSize> mLayoutSizes;
+};
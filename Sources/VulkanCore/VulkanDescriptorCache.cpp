@@ -0,0 +1,361 @@
+#include "VulkanDescriptorCache.h"
+#include "VulkanDevice.h"
+
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+
+/******************************************************************************/
+DescriptorSetKey& DescriptorSetKey::buffer(uint32_t pBinding, VkDescriptorType pType, VkBuffer pBuffer, VkDeviceSize pOffset, VkDeviceSize pRange, uint32_t pArrayElement)
+{
+    Descriptor& lDescriptor = add(pBinding, pArrayElement);
+    lDescriptor.mType = pType;
+    lDescriptor.mResource = (uint64_t)pBuffer;
+    lDescriptor.mOffset = pOffset;
+    lDescriptor.mRange = pRange;
+    return *this;
+}
+
+/******************************************************************************/
+DescriptorSetKey& DescriptorSetKey::image(uint32_t pBinding, VkDescriptorType pType, VkImageView pView, VkImageLayout pLayout, VkSampler pSampler, uint32_t pArrayElement)
+{
+    Descriptor& lDescriptor = add(pBinding, pArrayElement);
+    lDescriptor.mType = pType;
+    lDescriptor.mImageLayout = pLayout;
+    lDescriptor.mResource = (uint64_t)pView;
+    lDescriptor.mSampler = (uint64_t)pSampler;
+    return *this;
+}
+
+/******************************************************************************/
+DescriptorSetKey& DescriptorSetKey::sampler(uint32_t pBinding, VkSampler pSampler, uint32_t pArrayElement)
+{
+    Descriptor& lDescriptor = add(pBinding, pArrayElement);
+    lDescriptor.mType = VK_DESCRIPTOR_TYPE_SAMPLER;
+    lDescriptor.mSampler = (uint64_t)pSampler;
+    return *this;
+}
+
+/******************************************************************************/
+uint64_t DescriptorSetKey::hash() const
+{
+    // FNV-1a, the descriptors are zero initialized (padding included) in add()
+    uint64_t lHash = 14695981039346656037ull;
+    auto lMix = [&lHash](const void* pData, size_t pSize)
+    {
+        const uint8_t* lBytes = (const uint8_t*)pData;
+        for (size_t i = 0; i < pSize; ++i)
+            lHash = (lHash ^ lBytes[i]) * 1099511628211ull;
+    };
+    lMix(&mLayout, sizeof(mLayout));
+    lMix(mDescriptors, mCount * sizeof(Descriptor));
+    return lHash;
+}
+
+/******************************************************************************/
+bool DescriptorSetKey::operator==(const DescriptorSetKey& pOther) const
+{
+    return mLayout == pOther.mLayout
+        && mCount == pOther.mCount
+        && memcmp(mDescriptors, pOther.mDescriptors, mCount * sizeof(Descriptor)) == 0;
+}
+
+/******************************************************************************/
+DescriptorSetKey::Descriptor& DescriptorSetKey::add(uint32_t pBinding, uint32_t pArrayElement)
+{
+    assert(mCount < cMaxDescriptors && "DescriptorSetKey : too many descriptors");
+
+    // Insertion sort, a few descriptors per set
+    uint32_t lIndex = mCount;
+    while (lIndex > 0)
+    {
+        const Descriptor& lPrev = mDescriptors[lIndex - 1];
+        if (lPrev.mBinding < pBinding || (lPrev.mBinding == pBinding && lPrev.mArrayElement < pArrayElement))
+            break;
+        assert((lPrev.mBinding != pBinding || lPrev.mArrayElement != pArrayElement) && "DescriptorSetKey : descriptor set twice");
+        mDescriptors[lIndex] = lPrev;
+        --lIndex;
+    }
+    ++mCount;
+
+    Descriptor& lDescriptor = mDescriptors[lIndex];
+    memset(&lDescriptor, 0, sizeof(Descriptor));
+    lDescriptor.mBinding = pBinding;
+    lDescriptor.mArrayElement = pArrayElement;
+    return lDescriptor;
+}
+
+/******************************************************************************/
+/******************************************************************************/
+/******************************************************************************/
+void DescriptorSetCache::init(VulkanDevice* pDevice, const Settings& pSettings)
+{
+    assert(mDevice == nullptr && "DescriptorSetCache : already initialized");
+    mDevice = pDevice;
+    mSettings = pSettings;
+    mFrame = 0;
+
+    // Only a first guess, the allocator learns the ratios from the layouts
+    mAllocator.initPool(*pDevice, 256,
+    {
+        { VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 2 },
+        { VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE, 1 },
+        { VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1 },
+        { VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1 },
+        { VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1 },
+    });
+
+    mEntries.reserve(mSettings.mMaxSets);
+    mLookup.reserve(mSettings.mMaxSets);
+}
+
+/******************************************************************************/
+void DescriptorSetCache::destroy()
+{
+    if (mDevice == nullptr)
+        return;
+
+    // The sets are freed with their pools
+    mAllocator.destroyPool(*mDevice);
+    mEntries.clear();
+    mFreeEntries.clear();
+    mLookup.clear();
+    mResourceEntries.clear();
+    mFreeSets.clear();
+    mRetired.clear();
+    mLruHead = mLruTail = cInvalidEntry;
+    mDevice = nullptr;
+}
+
+/******************************************************************************/
+void DescriptorSetCache::beginFrame()
+{
+    std::lock_guard<std::mutex> lLock(mMutex);
+    ++mFrame;
+
+    size_t lKept = 0;
+    for (size_t i = 0; i < mRetired.size(); ++i)
+    {
+        if (mRetired[i].mFrame + mSettings.mFramesInFlight <= mFrame)
+            mFreeSets[mRetired[i].mLayout].push_back(mRetired[i].mSet);
+        else
+            mRetired[lKept++] = mRetired[i];
+    }
+    mRetired.resize(lKept);
+
+    mFrameStats.mSetCount = (uint32_t)mLookup.size();
+    mStats = mFrameStats;
+    mFrameStats.mHits = 0;
+    mFrameStats.mMisses = 0;
+    mFrameStats.mWrites = 0;
+}
+
+/******************************************************************************/
+VkDescriptorSet DescriptorSetCache::get(const DescriptorSetKey& pKey)
+{
+    std::lock_guard<std::mutex> lLock(mMutex);
+
+    auto lIt = mLookup.find(pKey);
+    if (lIt != mLookup.end())
+    {
+        Entry& lEntry = mEntries[lIt->second];
+        if (lEntry.mLastUsedFrame != mFrame)
+        {
+            lEntry.mLastUsedFrame = mFrame;
+            unlink(lIt->second);
+            linkFront(lIt->second);
+        }
+        mFrameStats.mHits++;
+        return lEntry.mSet;
+    }
+    mFrameStats.mMisses++;
+
+    // Full: recycle the least recently used set if no frame in flight can use it
+    if (mLookup.size() >= mSettings.mMaxSets && mLruTail != cInvalidEntry
+        && mEntries[mLruTail].mLastUsedFrame + mSettings.mFramesInFlight <= mFrame)
+    {
+        removeEntry(mLruTail, true);
+        mFrameStats.mEvictions++;
+    }
+
+    VkDescriptorSet lSet = VK_NULL_HANDLE;
+    auto lFree = mFreeSets.find(pKey.mLayout);
+    if (lFree != mFreeSets.end() && !lFree->second.empty())
+    {
+        lSet = lFree->second.back();
+        lFree->second.pop_back();
+    }
+    else
+    {
+        lSet = mAllocator.allocate(*mDevice, pKey.mLayout);
+    }
+    write(lSet, pKey);
+
+    uint32_t lIndex;
+    if (!mFreeEntries.empty())
+    {
+        lIndex = mFreeEntries.back();
+        mFreeEntries.pop_back();
+    }
+    else
+    {
+        lIndex = (uint32_t)mEntries.size();
+        mEntries.emplace_back();
+    }
+
+    Entry& lEntry = mEntries[lIndex];
+    lEntry.mKey = pKey;
+    lEntry.mSet = lSet;
+    lEntry.mLastUsedFrame = mFrame;
+    linkFront(lIndex);
+    mLookup.emplace(pKey, lIndex);
+
+    for (uint32_t i = 0; i < pKey.mCount; ++i)
+    {
+        const DescriptorSetKey::Descriptor& lDescriptor = pKey.mDescriptors[i];
+        if (lDescriptor.mResource != 0)
+            mResourceEntries.emplace(lDescriptor.mResource, lIndex);
+        if (lDescriptor.mSampler != 0)
+            mResourceEntries.emplace(lDescriptor.mSampler, lIndex);
+    }
+    return lSet;
+}
+
+/******************************************************************************/
+DescriptorSetCache::Stats DescriptorSetCache::getStats() const
+{
+    std::lock_guard<std::mutex> lLock(mMutex);
+    return mStats;
+}
+
+/******************************************************************************/
+/******************************************************************************/
+/******************************************************************************/
+void DescriptorSetCache::invalidate(uint64_t pResource)
+{
+    std::lock_guard<std::mutex> lLock(mMutex);
+
+    auto lRange = mResourceEntries.equal_range(pResource);
+    if (lRange.first == lRange.second)
+        return;
+
+    mScratch.clear();
+    for (auto lIt = lRange.first; lIt != lRange.second; ++lIt)
+        mScratch.push_back(lIt->second);
+
+    // An entry can reference the resource more than once
+    for (uint32_t lEntry : mScratch)
+    {
+        if (mEntries[lEntry].mSet != VK_NULL_HANDLE)
+        {
+            removeEntry(lEntry, false);
+            mFrameStats.mInvalidations++;
+        }
+    }
+}
+
+/******************************************************************************/
+void DescriptorSetCache::removeEntry(uint32_t pEntry, bool pRecycleNow)
+{
+    Entry& lEntry = mEntries[pEntry];
+
+    for (uint32_t i = 0; i < lEntry.mKey.mCount; ++i)
+    {
+        const DescriptorSetKey::Descriptor& lDescriptor = lEntry.mKey.mDescriptors[i];
+        for (uint64_t lResource : { lDescriptor.mResource, lDescriptor.mSampler })
+        {
+            auto lRange = mResourceEntries.equal_range(lResource);
+            for (auto lIt = lRange.first; lIt != lRange.second; ++lIt)
+            {
+                if (lIt->second == pEntry)
+                {
+                    mResourceEntries.erase(lIt);
+                    break;
+                }
+            }
+        }
+    }
+
+    // Not used for mFramesInFlight frames (LRU) the set can be rewritten at once, else it's retired
+    if (pRecycleNow)
+        mFreeSets[lEntry.mKey.mLayout].push_back(lEntry.mSet);
+    else
+        mRetired.push_back({ mFrame, lEntry.mKey.mLayout, lEntry.mSet });
+
+    mLookup.erase(lEntry.mKey);
+    unlink(pEntry);
+    lEntry.mSet = VK_NULL_HANDLE;
+    lEntry.mKey.mCount = 0;
+    mFreeEntries.push_back(pEntry);
+}
+
+/******************************************************************************/
+void DescriptorSetCache::linkFront(uint32_t pEntry)
+{
+    Entry& lEntry = mEntries[pEntry];
+    lEntry.mPrev = cInvalidEntry;
+    lEntry.mNext = mLruHead;
+    if (mLruHead != cInvalidEntry)
+        mEntries[mLruHead].mPrev = pEntry;
+    mLruHead = pEntry;
+    if (mLruTail == cInvalidEntry)
+        mLruTail = pEntry;
+}
+
+/******************************************************************************/
+void DescriptorSetCache::unlink(uint32_t pEntry)
+{
+    Entry& lEntry = mEntries[pEntry];
+    if (lEntry.mPrev != cInvalidEntry)
+        mEntries[lEntry.mPrev].mNext = lEntry.mNext;
+    else
+        mLruHead = lEntry.mNext;
+    if (lEntry.mNext != cInvalidEntry)
+        mEntries[lEntry.mNext].mPrev = lEntry.mPrev;
+    else
+        mLruTail = lEntry.mPrev;
+    lEntry.mPrev = lEntry.mNext = cInvalidEntry;
+}
+
+/******************************************************************************/
+void DescriptorSetCache::write(VkDescriptorSet pSet, const DescriptorSetKey& pKey)
+{
+    VkWriteDescriptorSet lWrites[DescriptorSetKey::cMaxDescriptors];
+    VkDescriptorImageInfo lImageInfos[DescriptorSetKey::cMaxDescriptors];
+    VkDescriptorBufferInfo lBufferInfos[DescriptorSetKey::cMaxDescriptors];
+
+    for (uint32_t i = 0; i < pKey.mCount; ++i)
+    {
+        const DescriptorSetKey::Descriptor& lDescriptor = pKey.mDescriptors[i];
+
+        VkWriteDescriptorSet& lWrite = lWrites[i];
+        lWrite = { VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET };
+        lWrite.dstSet = pSet;
+        lWrite.dstBinding = lDescriptor.mBinding;
+        lWrite.dstArrayElement = lDescriptor.mArrayElement;
+        lWrite.descriptorCount = 1;
+        lWrite.descriptorType = lDescriptor.mType;
+
+        switch (lDescriptor.mType)
+        {
+        case VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER:
+        case VK_DESCRIPTOR_TYPE_STORAGE_BUFFER:
+        case VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC:
+        case VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC:
+            lBufferInfos[i] = { (VkBuffer)lDescriptor.mResource, lDescriptor.mOffset, lDescriptor.mRange };
+            lWrite.pBufferInfo = &lBufferInfos[i];
+            break;
+        case VK_DESCRIPTOR_TYPE_UNIFORM_TEXEL_BUFFER:
+        case VK_DESCRIPTOR_TYPE_STORAGE_TEXEL_BUFFER:
+            assert(!"DescriptorSetCache : texel buffers are not supported");
+            break;
+        default:
+            lImageInfos[i] = { (VkSampler)lDescriptor.mSampler, (VkImageView)lDescriptor.mResource, lDescriptor.mImageLayout };
+            lWrite.pImageInfo = &lImageInfos[i];
+            break;
+        }
+    }
+
+    vkUpdateDescriptorSets(*mDevice, pKey.mCount, lWrites, 0, nullptr);
+    mFrameStats.mWrites += pKey.mCount;
+}
@@ -0,0 +1,137 @@
+#pragma once
+
+#include "vk_common.h"
+#include "VulkanDescriptor.h"
+
+#include <vector>
+#include <mutex>
+#include <unordered_map>
+
+struct VulkanDevice;
+
+// Contents of a descriptor set: the layout and the resource bound to each binding
+// One entry per descriptor, kept sorted by (binding, array element) so the order of the calls doesn't matter
+struct DescriptorSetKey
+{
+    static const uint32_t cMaxDescriptors = 16;
+
+    struct Descriptor
+    {
+        uint32_t mBinding;
+        uint32_t mArrayElement;
+        VkDescriptorType mType;
+        VkImageLayout mImageLayout;
+        uint64_t mResource;         // VkBuffer or VkImageView
+        uint64_t mSampler;
+        VkDeviceSize mOffset;
+        VkDeviceSize mRange;
+    };
+
+    explicit DescriptorSetKey(VkDescriptorSetLayout pLayout) : mLayout(pLayout) {}
+
+    DescriptorSetKey& buffer(uint32_t pBinding, VkDescriptorType pType, VkBuffer pBuffer, VkDeviceSize pOffset = 0, VkDeviceSize pRange = VK_WHOLE_SIZE, uint32_t pArrayElement = 0);
+    DescriptorSetKey& image(uint32_t pBinding, VkDescriptorType pType, VkImageView pView, VkImageLayout pLayout, VkSampler pSampler = VK_NULL_HANDLE, uint32_t pArrayElement = 0);
+    DescriptorSetKey& sampler(uint32_t pBinding, VkSampler pSampler, uint32_t pArrayElement = 0);
+
+    uint64_t hash() const;
+    bool operator==(const DescriptorSetKey& pOther) const;
+
+    Descriptor& add(uint32_t pBinding, uint32_t pArrayElement);
+
+    VkDescriptorSetLayout mLayout;
+    uint32_t mCount = 0;
+    Descriptor mDescriptors[cMaxDescriptors];
+};
+
+// Cache of descriptor sets keyed by their contents
+// get() returns the set already written with the same contents, or writes one (recycled or newly allocated).
+// The sets are never written while a command buffer can use them:
+//  - When the cache is full, the least recently used set is recycled, only if it was not used during
+//    the last Settings::mFramesInFlight frames (else the cache grows over mMaxSets).
+//  - The sets referencing a destroyed resource are dropped at once (VulkanDevice::destroyBuffer/destroyImage
+//    call invalidate*()) and recycled after mFramesInFlight frames.
+// Thread safe.
+struct DescriptorSetCache
+{
+    struct Settings
+    {
+        uint32_t mMaxSets = 4096;
+        uint32_t mFramesInFlight = 2;
+    };
+
+    struct Stats
+    {
+        uint32_t mSetCount = 0;         // Sets holding a valid key
+        uint32_t mHits = 0;             // Of the last frame
+        uint32_t mMisses = 0;
+        uint32_t mWrites = 0;           // Descriptors written during the last frame
+        uint32_t mEvictions = 0;        // Total, LRU recycling
+        uint32_t mInvalidations = 0;    // Total, destroyed resources
+        float hitRate() const { return mHits + mMisses > 0 ? (float)mHits / (mHits + mMisses) : 1.0f; }
+    };
+
+    void init(VulkanDevice* pDevice, const Settings& pSettings);
+    void destroy();
+
+    // Once per frame, after the fence wait of the frame
+    void beginFrame();
+
+    VkDescriptorSet get(const DescriptorSetKey& pKey);
+
+    // Drop the sets referencing the resource, call before its destruction
+    void invalidateBuffer(VkBuffer pBuffer) { invalidate((uint64_t)pBuffer); }
+    void invalidateImageView(VkImageView pView) { invalidate((uint64_t)pView); }
+    void invalidateSampler(VkSampler pSampler) { invalidate((uint64_t)pSampler); }
+
+    Stats getStats() const;
+
+    static const uint32_t cInvalidEntry = ~0u;
+
+    struct Entry
+    {
+        DescriptorSetKey mKey = DescriptorSetKey(VK_NULL_HANDLE);
+        VkDescriptorSet mSet = VK_NULL_HANDLE;
+        uint64_t mLastUsedFrame = 0;
+        uint32_t mPrev = cInvalidEntry;     // LRU list, mPrev is more recent
+        uint32_t mNext = cInvalidEntry;
+    };
+
+    struct KeyHash
+    {
+        size_t operator()(const DescriptorSetKey& pKey) const { return (size_t)pKey.hash(); }
+    };
+
+    struct Retired
+    {
+        uint64_t mFrame;
+        VkDescriptorSetLayout mLayout;
+        VkDescriptorSet mSet;
+    };
+
+    void invalidate(uint64_t pResource);
+    void removeEntry(uint32_t pEntry, bool pRecycleNow);
+    void linkFront(uint32_t pEntry);
+    void unlink(uint32_t pEntry);
+    void write(VkDescriptorSet pSet, const DescriptorSetKey& pKey);
+
+    VulkanDevice* mDevice = nullptr;
+    Settings mSettings;
+
+    mutable std::mutex mMutex;
+    DescriptorAllocator mAllocator;     // Never cleared, the sets are recycled individually
+
+    std::vector<Entry> mEntries;
+    std::vector<uint32_t> mFreeEntries;
+    std::unordered_map<DescriptorSetKey, uint32_t, KeyHash> mLookup;
+    std::unordered_multimap<uint64_t, uint32_t> mResourceEntries;  // Resource -> entries referencing it
+    uint32_t mLruHead = cInvalidEntry;
+    uint32_t mLruTail = cInvalidEntry;
+
+    std::unordered_map<VkDescriptorSetLayout, std::vector<VkDescriptorSet>> mFreeSets;
+    std::vector<Retired> mRetired;
+    std::vector<uint32_t> mScratch;
+
+    uint64_t mFrame = 0;
+    Stats mStats;           // Last frame
+    Stats mFrameStats;      // Current frame
+};
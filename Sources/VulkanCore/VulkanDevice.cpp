@@ -1,4 +1,6 @@
 #include "VulkanDevice.h"
+#include "VulkanDescriptorCache.h"
+#include "VulkanPipelineCache.h"
 
 #define VMA_IMPLEMENTATION
 #define VMA_STATIC_VULKAN_FUNCTIONS 1
@@ -6,6 +8,8 @@
 #include "vk_mem_alloc.h"
 
 #include <assert.h>
+#include <stdio.h>
+#include <string.h>
 
 
 /******************************************************************************/
@@ -102,46 +106,158 @@ void VulkanDevice::createLogicalDevice(VkQueueFlags pRequestedQueueTypes, VkInst
 	lDeviceCreateInfo.pQueueCreateInfos = lQueueCreateInfos.data();
 	lDeviceCreateInfo.queueCreateInfoCount = (uint32_t)lQueueCreateInfos.size();
 
-	const char* lDeviceExtensions[] =
+	uint32_t lExtensionCount = 0;
+	vkEnumerateDeviceExtensionProperties(mPhysicalDevice, nullptr, &lExtensionCount, nullptr);
+	mAvailableExtensions.resize(lExtensionCount);
+	vkEnumerateDeviceExtensionProperties(mPhysicalDevice, nullptr, &lExtensionCount, mAvailableExtensions.data());
+
+	mEnabledExtensions =
 	{
 		VK_KHR_SWAPCHAIN_EXTENSION_NAME,
-		VK_KHR_PUSH_DESCRIPTOR_EXTENSION_NAME,
 	};
-	lDeviceCreateInfo.enabledExtensionCount = ARRAY_COUNT(lDeviceExtensions);
-	lDeviceCreateInfo.ppEnabledExtensionNames = lDeviceExtensions;
+
+	// Optional, per draw descriptors pushed in the command buffer (see PipelineLayoutCache::bindDescriptors)
+	if (isExtensionAvailable(VK_KHR_PUSH_DESCRIPTOR_EXTENSION_NAME))
+		mEnabledExtensions.push_back(VK_KHR_PUSH_DESCRIPTOR_EXTENSION_NAME);
 
 	// Query available features
+	VkPhysicalDeviceDescriptorBufferFeaturesEXT featuresDescriptorBuffer = { VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_BUFFER_FEATURES_EXT };
+	VkPhysicalDeviceGraphicsPipelineLibraryFeaturesEXT featuresPipelineLibrary = { VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_GRAPHICS_PIPELINE_LIBRARY_FEATURES_EXT };
+	VkPhysicalDeviceShaderObjectFeaturesEXT featuresShaderObject = { VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SHADER_OBJECT_FEATURES_EXT };
+	VkPhysicalDeviceExtendedDynamicState3FeaturesEXT featuresDynamicState3 = { VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_EXTENDED_DYNAMIC_STATE_3_FEATURES_EXT };
 	VkPhysicalDeviceVulkan11Features features11 = { VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_1_FEATURES };
 	VkPhysicalDeviceVulkan12Features features12 = { VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES };
 	VkPhysicalDeviceVulkan13Features features13 = { VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_3_FEATURES };
 	features13.pNext = &features12;
 	features12.pNext = &features11;
+	void** lQueryNext = &features11.pNext;
+	if (isExtensionAvailable(VK_EXT_DESCRIPTOR_BUFFER_EXTENSION_NAME))
+	{
+		*lQueryNext = &featuresDescriptorBuffer;
+		lQueryNext = &featuresDescriptorBuffer.pNext;
+	}
+	const bool lPipelineLibraryAvailable = isExtensionAvailable(VK_KHR_PIPELINE_LIBRARY_EXTENSION_NAME) && isExtensionAvailable(VK_EXT_GRAPHICS_PIPELINE_LIBRARY_EXTENSION_NAME);
+	if (lPipelineLibraryAvailable)
+	{
+		*lQueryNext = &featuresPipelineLibrary;
+		lQueryNext = &featuresPipelineLibrary.pNext;
+	}
+	if (isExtensionAvailable(VK_EXT_SHADER_OBJECT_EXTENSION_NAME))
+	{
+		*lQueryNext = &featuresShaderObject;
+		lQueryNext = &featuresShaderObject.pNext;
+	}
+	if (isExtensionAvailable(VK_EXT_EXTENDED_DYNAMIC_STATE_3_EXTENSION_NAME))
+	{
+		*lQueryNext = &featuresDynamicState3;
+		lQueryNext = &featuresDynamicState3.pNext;
+	}
 	VkPhysicalDeviceFeatures2 physical_features2 = { VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2 };
 	physical_features2.pNext = &features13;
 
-	// Try to get rid of the Validation error at Swapchain creation VUID-VkSamplerCreateInfo-anisotropyEnable-01070 
-	// Error: [VUID - VkSamplerCreateInfo - anisotropyEnable - 01070] | MessageID = 0x56f192bc | vkCreateSampler() : pCreateInfo->anisotropyEnable is VK_TRUE but the samplerAnisotropy feature was not enabled.The Vulkan spec states : If the samplerAnisotropy feature is not enabled, anisotropyEnable must be VK_FALSE(https ://vulkan.lunarg.com/doc/view/1.3.275.0/windows/1.3-extensions/vkspec.html#VUID-VkSamplerCreateInfo-anisotropyEnable-01070)
-	physical_features2.features.samplerAnisotropy = true;
 	vkGetPhysicalDeviceFeatures2(mPhysicalDevice, &physical_features2);
 
 	// Enable features
 
+	// vulkan 1.0 features, only the supported ones
+	// samplerAnisotropy avoid VUID-VkSamplerCreateInfo-anisotropyEnable-01070 when a sampler use anisotropic filtering
+	// shaderStorageImageWriteWithoutFormat is used by the compute mipmap generator
+	// textureCompression* allow to create images in the BC/ETC2/ASTC formats (see TextureFile)
+	VkPhysicalDeviceFeatures2 lRequestFeatures = { VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2 };
+	lRequestFeatures.features.samplerAnisotropy = physical_features2.features.samplerAnisotropy;
+	lRequestFeatures.features.shaderStorageImageWriteWithoutFormat = physical_features2.features.shaderStorageImageWriteWithoutFormat;
+	lRequestFeatures.features.textureCompressionBC = physical_features2.features.textureCompressionBC;
+	lRequestFeatures.features.textureCompressionETC2 = physical_features2.features.textureCompressionETC2;
+	lRequestFeatures.features.textureCompressionASTC_LDR = physical_features2.features.textureCompressionASTC_LDR;
+
 	// vulkan 1.1 features
-	VkPhysicalDeviceVulkan12Features lRequestFeatures11 = { VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_1_FEATURES };
+	VkPhysicalDeviceVulkan11Features lRequestFeatures11 = { VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_1_FEATURES };
 	
 	// vulkan 1.2 features
 	VkPhysicalDeviceVulkan12Features lRequestFeatures12 = { VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES };
 	lRequestFeatures12.bufferDeviceAddress = true;
 	lRequestFeatures12.descriptorIndexing = true;
 
+	// Bindless heap (see BindlessHeap), partially bound update after bind arrays indexed with non uniform indices
+	lRequestFeatures12.runtimeDescriptorArray = features12.runtimeDescriptorArray;
+	lRequestFeatures12.descriptorBindingPartiallyBound = features12.descriptorBindingPartiallyBound;
+	lRequestFeatures12.descriptorBindingUpdateUnusedWhilePending = features12.descriptorBindingUpdateUnusedWhilePending;
+	lRequestFeatures12.descriptorBindingSampledImageUpdateAfterBind = features12.descriptorBindingSampledImageUpdateAfterBind;
+	lRequestFeatures12.descriptorBindingStorageBufferUpdateAfterBind = features12.descriptorBindingStorageBufferUpdateAfterBind;
+	lRequestFeatures12.shaderSampledImageArrayNonUniformIndexing = features12.shaderSampledImageArrayNonUniformIndexing;
+	lRequestFeatures12.shaderStorageBufferArrayNonUniformIndexing = features12.shaderStorageBufferArrayNonUniformIndexing;
+
 	// vulkan 1.3 features
 	VkPhysicalDeviceVulkan13Features lRequestFeatures13 = {VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_3_FEATURES};
 	lRequestFeatures13.dynamicRendering = true;
 	lRequestFeatures13.synchronization2 = true;
+	// Compute kernels compiled for a given subgroup size (see WorkgroupTuner)
+	lRequestFeatures13.subgroupSizeControl = features13.subgroupSizeControl;
 
+	lRequestFeatures.pNext = &lRequestFeatures13;
 	lRequestFeatures13.pNext = &lRequestFeatures12;
 	lRequestFeatures12.pNext = &lRequestFeatures11;
-	lDeviceCreateInfo.pNext = &lRequestFeatures13;
+
+	// Descriptor backend: descriptors written straight in buffers (see DescriptorBufferAllocator) when available,
+	// else the classic pools and sets
+	void** lRequestNext = &lRequestFeatures11.pNext;
+	VkPhysicalDeviceDescriptorBufferFeaturesEXT lRequestDescriptorBuffer = { VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_BUFFER_FEATURES_EXT };
+	mDescriptorBackend = DescriptorBackend::Sets;
+	if (featuresDescriptorBuffer.descriptorBuffer && features12.bufferDeviceAddress)
+	{
+		lRequestDescriptorBuffer.descriptorBuffer = true;
+		*lRequestNext = &lRequestDescriptorBuffer;
+		lRequestNext = &lRequestDescriptorBuffer.pNext;
+		mEnabledExtensions.push_back(VK_EXT_DESCRIPTOR_BUFFER_EXTENSION_NAME);
+		mDescriptorBackend = DescriptorBackend::DescriptorBuffer;
+	}
+
+	// Graphics pipelines linked from separately compiled parts (see PipelineLibraryCache)
+	VkPhysicalDeviceGraphicsPipelineLibraryFeaturesEXT lRequestPipelineLibrary = { VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_GRAPHICS_PIPELINE_LIBRARY_FEATURES_EXT };
+	mGraphicsPipelineLibrary = lPipelineLibraryAvailable && featuresPipelineLibrary.graphicsPipelineLibrary;
+	if (mGraphicsPipelineLibrary)
+	{
+		lRequestPipelineLibrary.graphicsPipelineLibrary = true;
+		*lRequestNext = &lRequestPipelineLibrary;
+		lRequestNext = &lRequestPipelineLibrary.pNext;
+		mEnabledExtensions.push_back(VK_KHR_PIPELINE_LIBRARY_EXTENSION_NAME);
+		mEnabledExtensions.push_back(VK_EXT_GRAPHICS_PIPELINE_LIBRARY_EXTENSION_NAME);
+	}
+
+	// Shader backend: shaders bound without pipelines (see ShaderObjects) when available, else the pipelines
+	VkPhysicalDeviceShaderObjectFeaturesEXT lRequestShaderObject = { VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SHADER_OBJECT_FEATURES_EXT };
+	mShaderBackend = ShaderBackend::Pipelines;
+	if (featuresShaderObject.shaderObject)
+	{
+		lRequestShaderObject.shaderObject = true;
+		*lRequestNext = &lRequestShaderObject;
+		lRequestNext = &lRequestShaderObject.pNext;
+		mEnabledExtensions.push_back(VK_EXT_SHADER_OBJECT_EXTENSION_NAME);
+		mShaderBackend = ShaderBackend::ShaderObjects;
+	}
+
+	// Pipeline state set at draw time (see PipelineBuilder::enableDynamicState), extended dynamic state 1 and 2 are core
+	VkPhysicalDeviceExtendedDynamicState3FeaturesEXT lRequestDynamicState3 = { VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_EXTENDED_DYNAMIC_STATE_3_FEATURES_EXT };
+	lRequestDynamicState3.extendedDynamicState3PolygonMode = featuresDynamicState3.extendedDynamicState3PolygonMode;
+	lRequestDynamicState3.extendedDynamicState3ColorBlendEnable = featuresDynamicState3.extendedDynamicState3ColorBlendEnable;
+	lRequestDynamicState3.extendedDynamicState3ColorBlendEquation = featuresDynamicState3.extendedDynamicState3ColorBlendEquation;
+	lRequestDynamicState3.extendedDynamicState3ColorWriteMask = featuresDynamicState3.extendedDynamicState3ColorWriteMask;
+	if (lRequestDynamicState3.extendedDynamicState3PolygonMode || lRequestDynamicState3.extendedDynamicState3ColorBlendEnable
+		|| lRequestDynamicState3.extendedDynamicState3ColorBlendEquation || lRequestDynamicState3.extendedDynamicState3ColorWriteMask)
+	{
+		*lRequestNext = &lRequestDynamicState3;
+		lRequestNext = &lRequestDynamicState3.pNext;
+		mEnabledExtensions.push_back(VK_EXT_EXTENDED_DYNAMIC_STATE_3_EXTENSION_NAME);
+	}
+
+	lDeviceCreateInfo.enabledExtensionCount = (uint32_t)mEnabledExtensions.size();
+	lDeviceCreateInfo.ppEnabledExtensionNames = mEnabledExtensions.data();
+	lDeviceCreateInfo.pNext = &lRequestFeatures;	// pEnabledFeatures must stay null when VkPhysicalDeviceFeatures2 is chained
+	mEnabledDeviceFeatures = lRequestFeatures.features;
+	mEnabledFeatures12 = lRequestFeatures12;
+	mEnabledFeatures12.pNext = nullptr;
+	mEnabledDynamicState3 = lRequestDynamicState3;
+	mEnabledDynamicState3.pNext = nullptr;
 	
 
 	// Previous implementations of Vulkan made a distinction between instance and device specific validation layers,
@@ -165,6 +281,64 @@ void VulkanDevice::createLogicalDevice(VkQueueFlags pRequestedQueueTypes, VkInst
 	lAllocatorInfo.instance = pVkInstance;
 	lAllocatorInfo.flags = VMA_ALLOCATOR_CREATE_BUFFER_DEVICE_ADDRESS_BIT;
 	vmaCreateAllocator(&lAllocatorInfo, &mAllocator);
+
+	mDescriptorBufferProperties = { VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_BUFFER_PROPERTIES_EXT };
+	VkPhysicalDevicePushDescriptorPropertiesKHR lPushDescriptorProperties = { VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PUSH_DESCRIPTOR_PROPERTIES_KHR };
+	VkPhysicalDeviceGraphicsPipelineLibraryPropertiesEXT lPipelineLibraryProperties = { VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_GRAPHICS_PIPELINE_LIBRARY_PROPERTIES_EXT };
+	VkPhysicalDeviceVulkan13Properties lProperties13 = { VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_3_PROPERTIES };
+	{
+		VkPhysicalDeviceProperties2 lProperties = { VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2 };
+		lProperties.pNext = &lProperties13;
+		lProperties13.pNext = &lPushDescriptorProperties;
+		void** lPropertiesNext = &lPushDescriptorProperties.pNext;
+		if (mDescriptorBackend == DescriptorBackend::DescriptorBuffer)
+		{
+			*lPropertiesNext = &mDescriptorBufferProperties;
+			lPropertiesNext = &mDescriptorBufferProperties.pNext;
+		}
+		if (mGraphicsPipelineLibrary)
+			*lPropertiesNext = &lPipelineLibraryProperties;
+		vkGetPhysicalDeviceProperties2(mPhysicalDevice, &lProperties);
+		mDescriptorBufferProperties.pNext = nullptr;
+	}
+	mGraphicsPipelineLibraryFastLinking = mGraphicsPipelineLibrary && lPipelineLibraryProperties.graphicsPipelineLibraryFastLinking;
+	if (lRequestFeatures13.subgroupSizeControl && (lProperties13.requiredSubgroupSizeStages & VK_SHADER_STAGE_COMPUTE_BIT))
+	{
+		mMinSubgroupSize = lProperties13.minSubgroupSize;
+		mMaxSubgroupSize = lProperties13.maxSubgroupSize;
+		mMaxComputeWorkgroupSubgroups = lProperties13.maxComputeWorkgroupSubgroups;
+	}
+	mMaxPushDescriptors = isExtensionEnabled(VK_KHR_PUSH_DESCRIPTOR_EXTENSION_NAME) ? lPushDescriptorProperties.maxPushDescriptors : 0;
+	printf("VulkanDevice : descriptor backend %s, push descriptors %s\n", mDescriptorBackend == DescriptorBackend::DescriptorBuffer ? "VK_EXT_descriptor_buffer" : "descriptor sets",
+		mMaxPushDescriptors > 0 ? "supported" : "not supported");
+	printf("VulkanDevice : shader backend %s\n", mShaderBackend == ShaderBackend::ShaderObjects ? "VK_EXT_shader_object" : "pipelines");
+	printf("VulkanDevice : graphics pipeline library %s\n", !mGraphicsPipelineLibrary ? "not supported" : mGraphicsPipelineLibraryFastLinking ? "supported (fast linking)" : "supported");
+
+	mBufferPool.init(cMaxBuffers);
+	mImagePool.init(cMaxImages);
+	mPipelinePool.init(cMaxPipelines);
+}
+
+/******************************************************************************/
+bool VulkanDevice::isExtensionAvailable(const char* pName) const
+{
+	for (const VkExtensionProperties& lExtension : mAvailableExtensions)
+	{
+		if (strcmp(lExtension.extensionName, pName) == 0)
+			return true;
+	}
+	return false;
+}
+
+/******************************************************************************/
+bool VulkanDevice::isExtensionEnabled(const char* pName) const
+{
+	for (const char* lExtension : mEnabledExtensions)
+	{
+		if (strcmp(lExtension, pName) == 0)
+			return true;
+	}
+	return false;
 }
 
 /******************************************************************************/
@@ -226,4 +400,114 @@ uint32_t VulkanDevice::selectMemoryType(uint32_t pMemoryTypeFilter, VkMemoryProp
 
 	assert(memoryTypeIndex != ~0u && "give optional flag and try to be less restrictive on memory type");
 	return memoryTypeIndex;
+}
+
+/******************************************************************************/
+float VulkanDevice::getMaxSamplerAnisotropy() const
+{
+	return mEnabledDeviceFeatures.samplerAnisotropy ? mPhysicalDeviceProperties.limits.maxSamplerAnisotropy : 0.0f;
+}
+
+/******************************************************************************/
+bool VulkanDevice::isFormatSupported(VkFormat pFormat, VkFormatFeatureFlags pFeatures) const
+{
+	VkFormatProperties lProperties;
+	vkGetPhysicalDeviceFormatProperties(mPhysicalDevice, pFormat, &lProperties);
+	return (lProperties.optimalTilingFeatures & pFeatures) == pFeatures;
+}
+
+/******************************************************************************/
+BufferHandle VulkanDevice::createBuffer(VkDeviceSize pSize, VkBufferUsageFlags pUsage, VmaMemoryUsage pMemoryUsage, VmaAllocationCreateFlags pAllocationFlags)
+{
+	return mBufferPool.create(mLogicalDevice, mAllocator, pSize, pUsage, pMemoryUsage, pAllocationFlags);
+}
+
+/******************************************************************************/
+void VulkanDevice::destroyBuffer(BufferHandle pHandle)
+{
+	if (mDescriptorSetCache != nullptr)
+		mDescriptorSetCache->invalidateBuffer(getBuffer(pHandle));
+	mBufferPool.destroy(mAllocator, pHandle);
+}
+
+/******************************************************************************/
+void VulkanDevice::flushBuffer(BufferHandle pHandle, VkDeviceSize pOffset, VkDeviceSize pSize)
+{
+	mBufferPool.flush(mAllocator, pHandle, pOffset, pSize);
+}
+
+/******************************************************************************/
+void VulkanDevice::invalidateBuffer(BufferHandle pHandle, VkDeviceSize pOffset, VkDeviceSize pSize)
+{
+	mBufferPool.invalidate(mAllocator, pHandle, pOffset, pSize);
+}
+
+/******************************************************************************/
+ImageHandle VulkanDevice::createImage(const VkImageCreateInfo& pCreateInfo, VkImageAspectFlags pAspectFlags)
+{
+	return mImagePool.create(mLogicalDevice, mAllocator, pCreateInfo, pAspectFlags);
+}
+
+/******************************************************************************/
+void VulkanDevice::destroyImage(ImageHandle pHandle)
+{
+	if (mDescriptorSetCache != nullptr)
+		mDescriptorSetCache->invalidateImageView(getImageView(pHandle));
+	mImagePool.destroy(mLogicalDevice, mAllocator, pHandle);
+}
+
+/******************************************************************************/
+void VulkanDevice::destroySampler(VkSampler pSampler)
+{
+	if (mDescriptorSetCache != nullptr)
+		mDescriptorSetCache->invalidateSampler(pSampler);
+	vkDestroySampler(mLogicalDevice, pSampler, nullptr);
+}
+
+/******************************************************************************/
+VkPipeline VulkanDevice::createComputePipeline(const VkComputePipelineCreateInfo& pCreateInfo)
+{
+	if (mPipelineCache != nullptr)
+		return mPipelineCache->createComputePipeline(pCreateInfo);
+
+	VkPipeline lPipeline = VK_NULL_HANDLE;
+	VK_CHECK(vkCreateComputePipelines(mLogicalDevice, VK_NULL_HANDLE, 1, &pCreateInfo, nullptr, &lPipeline));
+	return lPipeline;
+}
+
+/******************************************************************************/
+VkPipeline VulkanDevice::createGraphicsPipeline(const VkGraphicsPipelineCreateInfo& pCreateInfo)
+{
+	if (mPipelineCache != nullptr)
+		return mPipelineCache->createGraphicsPipeline(pCreateInfo);
+
+	VkPipeline lPipeline = VK_NULL_HANDLE;
+	VK_CHECK(vkCreateGraphicsPipelines(mLogicalDevice, VK_NULL_HANDLE, 1, &pCreateInfo, nullptr, &lPipeline));
+	return lPipeline;
+}
+
+/******************************************************************************/
+PipelineHandle VulkanDevice::addPipeline(VkPipeline pPipeline, VkPipelineLayout pLayout, VkPipelineBindPoint pBindPoint)
+{
+	return mPipelinePool.add(pPipeline, pLayout, pBindPoint);
+}
+
+/******************************************************************************/
+void VulkanDevice::destroyPipeline(PipelineHandle pHandle)
+{
+	mPipelinePool.destroy(mLogicalDevice, pHandle);
+}
+
+/******************************************************************************/
+VkPipeline VulkanDevice::replacePipeline(PipelineHandle pHandle, VkPipeline pPipeline)
+{
+	return mPipelinePool.replace(pHandle, pPipeline);
+}
+
+/******************************************************************************/
+void VulkanDevice::destroyResources()
+{
+	mPipelinePool.destroyAll(mLogicalDevice);
+	mImagePool.destroyAll(mLogicalDevice, mAllocator);
+	mBufferPool.destroyAll(mAllocator);
 }
\ No newline at end of file
@@ -1,18 +1,40 @@
 #pragma once
 #include "vk_common.h"
 #include "vk_mem_alloc.h"
+#include "VulkanResourcePool.h"
 
 #include <vector>
 
+struct DescriptorSetCache;
+struct PipelineCache;
+
 // Helper class to create/access logical device from a physical device
 struct VulkanDevice
 {
     explicit VulkanDevice(VkPhysicalDevice pPhysical);
     operator VkDevice() const { return mLogicalDevice; }
 
+    // How the descriptors are bound, chosen by createLogicalDevice
+    enum class DescriptorBackend
+    {
+        Sets,               // DescriptorAllocator, vkUpdateDescriptorSets/vkCmdBindDescriptorSets
+        DescriptorBuffer,   // DescriptorBufferAllocator, VK_EXT_descriptor_buffer
+    };
+
+    // How the shaders are bound, chosen by createLogicalDevice
+    enum class ShaderBackend
+    {
+        Pipelines,          // PipelineBuilder, state baked in the pipelines
+        ShaderObjects,      // ShaderObjects, VK_EXT_shader_object, all the state is dynamic
+    };
+
     // Create the logical device
     void createLogicalDevice(VkQueueFlags pRequestedQueueTypes, VkInstance pVkInstance);
 
+    // Extensions of the physical device / enabled on the logical device
+    bool isExtensionAvailable(const char* pName) const;
+    bool isExtensionEnabled(const char* pName) const;
+
     // Convenient function to get device queue
     // LogicalDevice must be created
     // return VK_NULL_HANDLE if not exist
@@ -29,6 +51,48 @@ struct VulkanDevice
     uint32_t findQueueFamilyIndex(VkQueueFlagBits pQueueFlags);
     uint32_t selectMemoryType(uint32_t pMemoryTypeFilter, VkMemoryPropertyFlags pProperties);
 
+    // Value to give to vkh::createTextureSampler(), 0 when samplerAnisotropy is not enabled
+    float getMaxSamplerAnisotropy() const;
+
+    // Check the optimal tiling features of a format (ex: VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT for a texture)
+    bool isFormatSupported(VkFormat pFormat, VkFormatFeatureFlags pFeatures) const;
+
+    // Resources, owned by the device pools and accessed through handles
+    BufferHandle createBuffer(VkDeviceSize pSize, VkBufferUsageFlags pUsage, VmaMemoryUsage pMemoryUsage = VMA_MEMORY_USAGE_AUTO, VmaAllocationCreateFlags pAllocationFlags = 0);
+    void destroyBuffer(BufferHandle pHandle);
+    void flushBuffer(BufferHandle pHandle, VkDeviceSize pOffset = 0, VkDeviceSize pSize = VK_WHOLE_SIZE);
+    void invalidateBuffer(BufferHandle pHandle, VkDeviceSize pOffset = 0, VkDeviceSize pSize = VK_WHOLE_SIZE);
+    inline VkBuffer getBuffer(BufferHandle pHandle) const { return mBufferPool.getBuffer(pHandle); }
+    inline VkDeviceAddress getBufferAddress(BufferHandle pHandle) const { return mBufferPool.getAddress(pHandle); }
+    inline VkDeviceSize getBufferSize(BufferHandle pHandle) const { return mBufferPool.getSize(pHandle); }
+    inline void* getBufferMappedData(BufferHandle pHandle) const { return mBufferPool.getMappedData(pHandle); }
+
+    ImageHandle createImage(const VkImageCreateInfo& pCreateInfo, VkImageAspectFlags pAspectFlags = VK_IMAGE_ASPECT_COLOR_BIT);
+    void destroyImage(ImageHandle pHandle);
+    inline VkImage getImage(ImageHandle pHandle) const { return mImagePool.getImage(pHandle); }
+    inline VkImageView getImageView(ImageHandle pHandle) const { return mImagePool.getView(pHandle); }
+    inline VkExtent3D getImageExtent(ImageHandle pHandle) const { return mImagePool.getExtent(pHandle); }
+    inline VkFormat getImageFormat(ImageHandle pHandle) const { return mImagePool.getFormat(pHandle); }
+    inline uint32_t getImageMipLevels(ImageHandle pHandle) const { return mImagePool.getMipLevels(pHandle); }
+
+    // Samplers are not pooled, destroyed through the device to drop the descriptor sets using them
+    void destroySampler(VkSampler pSampler);
+
+    // Create a pipeline through mPipelineCache when there is one
+    VkPipeline createComputePipeline(const VkComputePipelineCreateInfo& pCreateInfo);
+    VkPipeline createGraphicsPipeline(const VkGraphicsPipelineCreateInfo& pCreateInfo);
+
+    // Take the ownership of an already created pipeline
+    PipelineHandle addPipeline(VkPipeline pPipeline, VkPipelineLayout pLayout, VkPipelineBindPoint pBindPoint);
+    void destroyPipeline(PipelineHandle pHandle);
+    VkPipeline replacePipeline(PipelineHandle pHandle, VkPipeline pPipeline);   // See PipelinePool::replace
+    inline VkPipeline getPipeline(PipelineHandle pHandle) const { return mPipelinePool.getPipeline(pHandle); }
+    inline VkPipelineLayout getPipelineLayout(PipelineHandle pHandle) const { return mPipelinePool.getLayout(pHandle); }
+    inline VkPipelineBindPoint getPipelineBindPoint(PipelineHandle pHandle) const { return mPipelinePool.getBindPoint(pHandle); }
+
+    // Destroy every resource still alive in the pools (call before vkDestroyDevice)
+    void destroyResources();
+
     VkDevice mLogicalDevice;
     VkPhysicalDevice mPhysicalDevice;
 
@@ -39,8 +103,38 @@ struct VulkanDevice
 
     VkPhysicalDeviceProperties mPhysicalDeviceProperties;
     VkPhysicalDeviceFeatures mPhysicalDeviceFeatures;
-    VkPhysicalDeviceFeatures mEnabledDeviceFeatures;
+    VkPhysicalDeviceFeatures mEnabledDeviceFeatures;     // Filled by createLogicalDevice
+    VkPhysicalDeviceVulkan12Features mEnabledFeatures12; // Filled by createLogicalDevice (pNext is null)
+    VkPhysicalDeviceExtendedDynamicState3FeaturesEXT mEnabledDynamicState3;  // Filled by createLogicalDevice (pNext is null), see PipelineBuilder::enableDynamicState
     VkPhysicalDeviceMemoryProperties mPhysicalDeviceMemoryProperties;
 
+    std::vector<VkExtensionProperties> mAvailableExtensions;
+    std::vector<const char*> mEnabledExtensions;
+
+    DescriptorBackend mDescriptorBackend = DescriptorBackend::Sets;
+    VkPhysicalDeviceDescriptorBufferPropertiesEXT mDescriptorBufferProperties;  // Valid with DescriptorBackend::DescriptorBuffer (pNext is null)
+    uint32_t mMaxPushDescriptors = 0;   // 0 when VK_KHR_push_descriptor is not enabled
+    uint32_t mMinSubgroupSize = 0;      // Range of VkPipelineShaderStageRequiredSubgroupSizeCreateInfo for the compute shaders,
+    uint32_t mMaxSubgroupSize = 0;      // 0 when subgroupSizeControl is not supported
+    uint32_t mMaxComputeWorkgroupSubgroups = 0;
+    ShaderBackend mShaderBackend = ShaderBackend::Pipelines;
+    bool mGraphicsPipelineLibrary = false;              // VK_EXT_graphics_pipeline_library enabled
+    bool mGraphicsPipelineLibraryFastLinking = false;   // Linking without optimization is cheap (else prefer the monolithic pipelines)
+
     VmaAllocator mAllocator;
+
+    // Pools capacity, fixed at logical device creation
+    static const uint32_t cMaxBuffers = 16 * 1024;
+    static const uint32_t cMaxImages = 16 * 1024;
+    static const uint32_t cMaxPipelines = 4 * 1024;
+
+    BufferPool mBufferPool;
+    ImagePool mImagePool;
+    PipelinePool mPipelinePool;
+
+    // Notified before a buffer or an image is destroyed, to drop the descriptor sets referencing it
+    DescriptorSetCache* mDescriptorSetCache = nullptr;
+
+    // Set by PipelineCache::init, used by createComputePipeline/createGraphicsPipeline
+    PipelineCache* mPipelineCache = nullptr;
 };
\ No newline at end of file
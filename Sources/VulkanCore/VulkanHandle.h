@@ -0,0 +1,141 @@
+#pragma once
+
+#include <stdint.h>
+#include <assert.h>
+#include <vector>
+#include <mutex>
+#include <atomic>
+
+// Typed 32 bits generational handle
+// Layout : [ generation : 12 bits | slot index : 20 bits ]
+// The generation is bumped each time a slot is released, so an handle kept after
+// the resource destruction no longer match its slot (use after free detection).
+// A value of 0 is never produced by the allocator and is used as the invalid handle.
+// Handles are plain values, they can be copied and sent to other threads freely.
+template<typename Tag>
+struct Handle
+{
+    static const uint32_t cIndexBits = 20;
+    static const uint32_t cIndexMask = (1u << cIndexBits) - 1;
+    static const uint32_t cGenerationMask = (1u << (32 - cIndexBits)) - 1;
+
+    uint32_t mValue = 0;
+
+    Handle() = default;
+    Handle(uint32_t pIndex, uint32_t pGeneration) : mValue(((pGeneration & cGenerationMask) << cIndexBits) | (pIndex & cIndexMask)) {}
+
+    inline uint32_t index() const { return mValue & cIndexMask; }
+    inline uint32_t generation() const { return mValue >> cIndexBits; }
+    inline bool isValid() const { return mValue != 0; }
+
+    inline bool operator==(const Handle& pOther) const { return mValue == pOther.mValue; }
+    inline bool operator!=(const Handle& pOther) const { return mValue != pOther.mValue; }
+};
+
+using BufferHandle = Handle<struct BufferTag>;
+using ImageHandle = Handle<struct ImageTag>;
+using PipelineHandle = Handle<struct PipelineTag>;
+
+// Slot allocator shared by all the resource pools
+// Storage is sized once in init() and never reallocated, so the SoA arrays of a pool
+// can be read from any thread while an other thread create/destroy other slots.
+// Only allocate/release take the lock.
+struct HandleAllocator
+{
+    void init(uint32_t pCapacity)
+    {
+        assert(pCapacity > 0 && pCapacity <= Handle<void>::cIndexMask);
+        mGenerations = std::vector<std::atomic<uint32_t>>(pCapacity);
+        for (auto& lGeneration : mGenerations)
+            lGeneration.store(1, std::memory_order_relaxed);
+        mAlive.assign(pCapacity, 0);
+        mFreeList.clear();
+        mFreeList.reserve(pCapacity);
+        mHighWater.store(0, std::memory_order_relaxed);
+        mCount.store(0, std::memory_order_relaxed);
+    }
+
+    // Return the slot index, or ~0u when the pool is full
+    uint32_t allocate()
+    {
+        std::lock_guard<std::mutex> lLock(mMutex);
+        uint32_t lIndex = ~0u;
+        if (!mFreeList.empty())
+        {
+            lIndex = mFreeList.back();
+            mFreeList.pop_back();
+        }
+        else if (mHighWater.load(std::memory_order_relaxed) < capacity())
+        {
+            lIndex = mHighWater.fetch_add(1, std::memory_order_release);
+        }
+        else
+        {
+            assert(!"HandleAllocator : pool is full, increase the capacity");
+            return ~0u;
+        }
+        mAlive[lIndex] = 1;
+        ++mCount;
+        return lIndex;
+    }
+
+    void release(uint32_t pIndex)
+    {
+        std::lock_guard<std::mutex> lLock(mMutex);
+        assert(mAlive[pIndex] && "double free");
+        mAlive[pIndex] = 0;
+
+        // Skip generation 0 to never build a null handle
+        uint32_t lGeneration = (mGenerations[pIndex].load(std::memory_order_relaxed) + 1) & Handle<void>::cGenerationMask;
+        mGenerations[pIndex].store(lGeneration == 0 ? 1 : lGeneration, std::memory_order_release);
+
+        mFreeList.push_back(pIndex);
+        --mCount;
+    }
+
+    template<typename Tag>
+    inline Handle<Tag> makeHandle(uint32_t pIndex) const
+    {
+        return Handle<Tag>(pIndex, mGenerations[pIndex].load(std::memory_order_acquire));
+    }
+
+    template<typename Tag>
+    inline bool isAlive(Handle<Tag> pHandle) const
+    {
+        return pHandle.isValid()
+            && pHandle.index() < mHighWater.load(std::memory_order_acquire)
+            && mGenerations[pHandle.index()].load(std::memory_order_acquire) == pHandle.generation();
+    }
+
+    // Iterate on the live slots, the callback receive the slot index
+    // Slots are visited in memory order to keep the SoA access linear
+    // Not safe against a concurrent allocate/release
+    template<typename Func>
+    void forEach(Func&& pFunc) const
+    {
+        const uint32_t lHighWater = highWater();
+        for (uint32_t i = 0; i < lHighWater; ++i)
+        {
+            if (mAlive[i])
+                pFunc(i);
+        }
+    }
+
+    inline uint32_t capacity() const { return (uint32_t)mAlive.size(); }
+    inline uint32_t count() const { return mCount.load(std::memory_order_relaxed); }
+    inline uint32_t highWater() const { return mHighWater.load(std::memory_order_acquire); }
+
+    std::vector<std::atomic<uint32_t>> mGenerations;
+    std::vector<uint8_t> mAlive;
+    std::vector<uint32_t> mFreeList;
+    std::atomic<uint32_t> mHighWater{ 0 };  // Slots above this index were never used
+    std::atomic<uint32_t> mCount{ 0 };      // Live slots, read without the lock
+    std::mutex mMutex;
+};
+
+// In debug, every pool lookup validate the handle generation
+#ifdef NDEBUG
+#   define HANDLE_CHECK(allocator_, handle_) ((void)0)
+#else
+#   define HANDLE_CHECK(allocator_, handle_) assert((allocator_).isAlive(handle_) && "invalid handle or use after free")
+#endif
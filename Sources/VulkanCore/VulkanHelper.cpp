@@ -46,6 +46,167 @@ void copyImageToImage(VkCommandBuffer cmd, VkImage source, VkImage destination,
 	vkCmdBlitImage2(cmd, &blitInfo);
 }
 
+/******************************************************************************/
+bool formatBlock(VkFormat format, FormatBlock& block)
+{
+	switch (format)
+	{
+	// Uncompressed
+	case VK_FORMAT_R8_UNORM:
+	case VK_FORMAT_R8_SRGB:
+		block = { 1, 1, 1 }; return true;
+	case VK_FORMAT_R8G8_UNORM:
+	case VK_FORMAT_R8G8_SRGB:
+	case VK_FORMAT_R16_SFLOAT:
+		block = { 1, 1, 2 }; return true;
+	case VK_FORMAT_R8G8B8A8_UNORM:
+	case VK_FORMAT_R8G8B8A8_SRGB:
+	case VK_FORMAT_B8G8R8A8_UNORM:
+	case VK_FORMAT_B8G8R8A8_SRGB:
+	case VK_FORMAT_A2B10G10R10_UNORM_PACK32:
+	case VK_FORMAT_B10G11R11_UFLOAT_PACK32:
+	case VK_FORMAT_E5B9G9R9_UFLOAT_PACK32:
+	case VK_FORMAT_R16G16_SFLOAT:
+	case VK_FORMAT_R32_SFLOAT:
+		block = { 1, 1, 4 }; return true;
+	case VK_FORMAT_R16G16B16A16_SFLOAT:
+	case VK_FORMAT_R32G32_SFLOAT:
+		block = { 1, 1, 8 }; return true;
+	case VK_FORMAT_R32G32B32A32_SFLOAT:
+		block = { 1, 1, 16 }; return true;
+
+	// BC
+	case VK_FORMAT_BC1_RGB_UNORM_BLOCK:
+	case VK_FORMAT_BC1_RGB_SRGB_BLOCK:
+	case VK_FORMAT_BC1_RGBA_UNORM_BLOCK:
+	case VK_FORMAT_BC1_RGBA_SRGB_BLOCK:
+	case VK_FORMAT_BC4_UNORM_BLOCK:
+	case VK_FORMAT_BC4_SNORM_BLOCK:
+		block = { 4, 4, 8 }; return true;
+	case VK_FORMAT_BC2_UNORM_BLOCK:
+	case VK_FORMAT_BC2_SRGB_BLOCK:
+	case VK_FORMAT_BC3_UNORM_BLOCK:
+	case VK_FORMAT_BC3_SRGB_BLOCK:
+	case VK_FORMAT_BC5_UNORM_BLOCK:
+	case VK_FORMAT_BC5_SNORM_BLOCK:
+	case VK_FORMAT_BC6H_UFLOAT_BLOCK:
+	case VK_FORMAT_BC6H_SFLOAT_BLOCK:
+	case VK_FORMAT_BC7_UNORM_BLOCK:
+	case VK_FORMAT_BC7_SRGB_BLOCK:
+		block = { 4, 4, 16 }; return true;
+
+	// ETC2 / EAC
+	case VK_FORMAT_ETC2_R8G8B8_UNORM_BLOCK:
+	case VK_FORMAT_ETC2_R8G8B8_SRGB_BLOCK:
+	case VK_FORMAT_ETC2_R8G8B8A1_UNORM_BLOCK:
+	case VK_FORMAT_ETC2_R8G8B8A1_SRGB_BLOCK:
+	case VK_FORMAT_EAC_R11_UNORM_BLOCK:
+	case VK_FORMAT_EAC_R11_SNORM_BLOCK:
+		block = { 4, 4, 8 }; return true;
+	case VK_FORMAT_ETC2_R8G8B8A8_UNORM_BLOCK:
+	case VK_FORMAT_ETC2_R8G8B8A8_SRGB_BLOCK:
+	case VK_FORMAT_EAC_R11G11_UNORM_BLOCK:
+	case VK_FORMAT_EAC_R11G11_SNORM_BLOCK:
+		block = { 4, 4, 16 }; return true;
+
+	// ASTC LDR, always 16 bytes per block
+	case VK_FORMAT_ASTC_4x4_UNORM_BLOCK:	case VK_FORMAT_ASTC_4x4_SRGB_BLOCK:		block = { 4, 4, 16 }; return true;
+	case VK_FORMAT_ASTC_5x4_UNORM_BLOCK:	case VK_FORMAT_ASTC_5x4_SRGB_BLOCK:		block = { 5, 4, 16 }; return true;
+	case VK_FORMAT_ASTC_5x5_UNORM_BLOCK:	case VK_FORMAT_ASTC_5x5_SRGB_BLOCK:		block = { 5, 5, 16 }; return true;
+	case VK_FORMAT_ASTC_6x5_UNORM_BLOCK:	case VK_FORMAT_ASTC_6x5_SRGB_BLOCK:		block = { 6, 5, 16 }; return true;
+	case VK_FORMAT_ASTC_6x6_UNORM_BLOCK:	case VK_FORMAT_ASTC_6x6_SRGB_BLOCK:		block = { 6, 6, 16 }; return true;
+	case VK_FORMAT_ASTC_8x5_UNORM_BLOCK:	case VK_FORMAT_ASTC_8x5_SRGB_BLOCK:		block = { 8, 5, 16 }; return true;
+	case VK_FORMAT_ASTC_8x6_UNORM_BLOCK:	case VK_FORMAT_ASTC_8x6_SRGB_BLOCK:		block = { 8, 6, 16 }; return true;
+	case VK_FORMAT_ASTC_8x8_UNORM_BLOCK:	case VK_FORMAT_ASTC_8x8_SRGB_BLOCK:		block = { 8, 8, 16 }; return true;
+	case VK_FORMAT_ASTC_10x5_UNORM_BLOCK:	case VK_FORMAT_ASTC_10x5_SRGB_BLOCK:	block = { 10, 5, 16 }; return true;
+	case VK_FORMAT_ASTC_10x6_UNORM_BLOCK:	case VK_FORMAT_ASTC_10x6_SRGB_BLOCK:	block = { 10, 6, 16 }; return true;
+	case VK_FORMAT_ASTC_10x8_UNORM_BLOCK:	case VK_FORMAT_ASTC_10x8_SRGB_BLOCK:	block = { 10, 8, 16 }; return true;
+	case VK_FORMAT_ASTC_10x10_UNORM_BLOCK:	case VK_FORMAT_ASTC_10x10_SRGB_BLOCK:	block = { 10, 10, 16 }; return true;
+	case VK_FORMAT_ASTC_12x10_UNORM_BLOCK:	case VK_FORMAT_ASTC_12x10_SRGB_BLOCK:	block = { 12, 10, 16 }; return true;
+	case VK_FORMAT_ASTC_12x12_UNORM_BLOCK:	case VK_FORMAT_ASTC_12x12_SRGB_BLOCK:	block = { 12, 12, 16 }; return true;
+
+	default:
+		block = { 1, 1, 0 };
+		return false;
+	}
+}
+
+/******************************************************************************/
+bool isCompressedFormat(VkFormat format)
+{
+	FormatBlock lBlock;
+	return formatBlock(format, lBlock) && (lBlock.mWidth > 1 || lBlock.mHeight > 1);
+}
+
+/******************************************************************************/
+VkDeviceSize levelSize(VkFormat format, VkExtent3D extent, uint32_t mipLevel)
+{
+	FormatBlock lBlock;
+	if (!formatBlock(format, lBlock))
+		return 0;
+
+	uint32_t lWidth = (extent.width >> mipLevel) > 0 ? (extent.width >> mipLevel) : 1;
+	uint32_t lHeight = (extent.height >> mipLevel) > 0 ? (extent.height >> mipLevel) : 1;
+	uint32_t lDepth = (extent.depth >> mipLevel) > 0 ? (extent.depth >> mipLevel) : 1;
+	VkDeviceSize lBlocksX = (lWidth + lBlock.mWidth - 1) / lBlock.mWidth;
+	VkDeviceSize lBlocksY = (lHeight + lBlock.mHeight - 1) / lBlock.mHeight;
+	return lBlocksX * lBlocksY * lDepth * lBlock.mBytes;
+}
+
+/******************************************************************************/
+uint32_t mipLevelCount(VkExtent2D extent)
+{
+	uint32_t lMaxSize = extent.width > extent.height ? extent.width : extent.height;
+	uint32_t lLevels = 1;
+	while (lMaxSize > 1)
+	{
+		lMaxSize >>= 1;
+		++lLevels;
+	}
+	return lLevels;
+}
+
+/******************************************************************************/
+void generateMipmapsBlit(VkCommandBuffer cmd, VkImage image, VkExtent2D extent, uint32_t mipLevels, VkImageLayout finalLayout)
+{
+	int32_t lWidth = (int32_t)extent.width;
+	int32_t lHeight = (int32_t)extent.height;
+
+	for (uint32_t i = 1; i < mipLevels; ++i)
+	{
+		// The previous level become the source of the blit
+		transitionImage(cmd, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, i - 1, 1);
+		transitionImage(cmd, image, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, i, 1);
+
+		int32_t lMipWidth = lWidth > 1 ? lWidth / 2 : 1;
+		int32_t lMipHeight = lHeight > 1 ? lHeight / 2 : 1;
+
+		VkImageBlit2 blitRegion = { VK_STRUCTURE_TYPE_IMAGE_BLIT_2 };
+		blitRegion.srcOffsets[1] = { lWidth, lHeight, 1 };
+		blitRegion.dstOffsets[1] = { lMipWidth, lMipHeight, 1 };
+		blitRegion.srcSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, i - 1, 0, 1 };
+		blitRegion.dstSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, i, 0, 1 };
+
+		VkBlitImageInfo2 blitInfo = { VK_STRUCTURE_TYPE_BLIT_IMAGE_INFO_2 };
+		blitInfo.srcImage = image;
+		blitInfo.srcImageLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+		blitInfo.dstImage = image;
+		blitInfo.dstImageLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+		blitInfo.filter = VK_FILTER_LINEAR;
+		blitInfo.regionCount = 1;
+		blitInfo.pRegions = &blitRegion;
+		vkCmdBlitImage2(cmd, &blitInfo);
+
+		lWidth = lMipWidth;
+		lHeight = lMipHeight;
+	}
+
+	// All levels but the last one are in TRANSFER_SRC
+	if (mipLevels > 1)
+		transitionImage(cmd, image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, finalLayout, 0, mipLevels - 1);
+	transitionImage(cmd, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, finalLayout, mipLevels - 1, 1);
+}
+
 /******************************************************************************/
 VkImageSubresourceRange imageSubresourceRange(VkImageAspectFlags aspectMask)
 {
@@ -59,7 +220,14 @@ VkImageSubresourceRange imageSubresourceRange(VkImageAspectFlags aspectMask)
 }
 
 /******************************************************************************/
-void transitionImage(VkCommandBuffer cmd, VkImage image, VkImageLayout currentLayout, VkImageLayout newLayout)
+void transitionImage(VkCommandBuffer cmd, VkImage image, VkImageLayout currentLayout, VkImageLayout newLayout, uint32_t baseMipLevel, uint32_t levelCount)
+{
+	VkImageMemoryBarrier2 imageBarrier = imageTransitionBarrier(image, currentLayout, newLayout, baseMipLevel, levelCount);
+	pipelineBarrier(cmd, &imageBarrier, 1);
+}
+
+/******************************************************************************/
+VkImageMemoryBarrier2 imageTransitionBarrier(VkImage image, VkImageLayout currentLayout, VkImageLayout newLayout, uint32_t baseMipLevel, uint32_t levelCount)
 {
 	VkImageMemoryBarrier2 imageBarrier{ VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2 };
 	imageBarrier.pNext = nullptr;
@@ -74,14 +242,21 @@ void transitionImage(VkCommandBuffer cmd, VkImage image, VkImageLayout currentLa
 
 	VkImageAspectFlags aspectMask = (newLayout == VK_IMAGE_LAYOUT_DEPTH_ATTACHMENT_OPTIMAL) ? VK_IMAGE_ASPECT_DEPTH_BIT : VK_IMAGE_ASPECT_COLOR_BIT;
 	imageBarrier.subresourceRange = imageSubresourceRange(aspectMask);
+	imageBarrier.subresourceRange.baseMipLevel = baseMipLevel;
+	imageBarrier.subresourceRange.levelCount = levelCount;
 	imageBarrier.image = image;
+	return imageBarrier;
+}
 
+/******************************************************************************/
+void pipelineBarrier(VkCommandBuffer cmd, const VkImageMemoryBarrier2* pBarriers, uint32_t pBarrierCount)
+{
 	VkDependencyInfo depInfo = {};
 	depInfo.sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO;
 	depInfo.pNext = nullptr;
 
-	depInfo.imageMemoryBarrierCount = 1;
-	depInfo.pImageMemoryBarriers = &imageBarrier;
+	depInfo.imageMemoryBarrierCount = pBarrierCount;
+	depInfo.pImageMemoryBarriers = pBarriers;
 
 	vkCmdPipelineBarrier2(cmd, &depInfo);
 }
@@ -141,14 +316,14 @@ VkPipelineLayoutCreateInfo pipelineLayoutCreateInfo(const VkDescriptorSetLayout*
 }
 
 /******************************************************************************/
-VkPipelineShaderStageCreateInfo pipelineShaderStageCreateInfo(VkShaderStageFlagBits stage, VkShaderModule shaderModule, const char* pEntryName)
+VkPipelineShaderStageCreateInfo pipelineShaderStageCreateInfo(VkShaderStageFlagBits stage, VkShaderModule shaderModule, const char* pEntryName, const VkSpecializationInfo* pSpecializationInfo)
 {
 	VkPipelineShaderStageCreateInfo lInfo = { VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO };
 //	VkPipelineShaderStageCreateFlags    flags;
 	lInfo.stage = stage;
 	lInfo.module = shaderModule;
 	lInfo.pName = pEntryName;
-	//const VkSpecializationInfo* pSpecializationInfo; // What is it?
+	lInfo.pSpecializationInfo = pSpecializationInfo;	// Values of the specialization constants (constant_id), must outlive the pipeline creation
 
 	return lInfo;
 }
@@ -208,7 +383,7 @@ VkSubmitInfo2 submitInfo(VkCommandBufferSubmitInfo* cmd, VkSemaphoreSubmitInfo*
 }
 
 /******************************************************************************/
-VkImageCreateInfo imageCreateInfo(VkFormat format, VkImageUsageFlags usageFlags, VkExtent3D extent)
+VkImageCreateInfo imageCreateInfo(VkFormat format, VkImageUsageFlags usageFlags, VkExtent3D extent, uint32_t mipLevels)
 {
 	VkImageCreateInfo info = {};
 	info.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
@@ -219,7 +394,7 @@ VkImageCreateInfo imageCreateInfo(VkFormat format, VkImageUsageFlags usageFlags,
 	info.format = format;
 	info.extent = extent;
 
-	info.mipLevels = 1;
+	info.mipLevels = mipLevels;		// See mipLevelCount() for a full chain
 	info.arrayLayers = 1;
 
 	//for MSAA. we will not be using it by default, so default it to 1 sample per pixel.
@@ -482,7 +657,7 @@ VkFramebuffer createFramebuffer(VkDevice pDevice, VkRenderPass pRenderPass, cons
 }
 
 /******************************************************************************/
-VkSampler createTextureSampler(VkDevice pDevice)
+VkSampler createTextureSampler(VkDevice pDevice, float pMaxAnisotropy, float pMinLod)
 {
 	VkSamplerCreateInfo createInfo = { VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO };
 	//VkStructureType         sType;
@@ -490,17 +665,17 @@ VkSampler createTextureSampler(VkDevice pDevice)
 	//VkSamplerCreateFlags    flags = 0; // osef? VK_SAMPLER_CREATE_SUBSAMPLED_BIT_EXT if image was create with this flag (dunno what is it)
 	createInfo.magFilter = VK_FILTER_LINEAR;
 	createInfo.minFilter = VK_FILTER_LINEAR;
-	createInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST; // have to generate it manually
+	createInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_LINEAR; // trilinear, the mip chain is generated at upload (see MipmapGenerator)
 	createInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_REPEAT;
 	createInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_REPEAT;
 	createInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_REPEAT;
 	createInfo.mipLodBias = 0.0f;
-	createInfo.anisotropyEnable = VK_FALSE; // to use this need to enable the feature on the logical device
-	createInfo.maxAnisotropy = 0.0f;
+	createInfo.anisotropyEnable = pMaxAnisotropy > 1.0f ? VK_TRUE : VK_FALSE; // samplerAnisotropy must be enabled, see VulkanDevice::getMaxSamplerAnisotropy()
+	createInfo.maxAnisotropy = pMaxAnisotropy;
 	createInfo.compareEnable = VK_FALSE; // Depth compare for depth map test i suppose
 	createInfo.compareOp = VK_COMPARE_OP_NEVER;
-	createInfo.minLod = 0.0f;
-	createInfo.maxLod = 0.0f;
+	createInfo.minLod = pMinLod;	// > 0 hide the finest levels (texture streaming fade in)
+	createInfo.maxLod = VK_LOD_CLAMP_NONE;	// Use the whole chain of the view
 	createInfo.borderColor = VK_BORDER_COLOR_INT_TRANSPARENT_BLACK; // INT/FLOAT? maybe should be a good idea to pass VK_FORMAT of the image to auto this
 	createInfo.unnormalizedCoordinates = VK_FALSE;
 
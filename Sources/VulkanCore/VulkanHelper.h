@@ -27,16 +27,29 @@ namespace vkh
 	// Pipeline helpers
 	VkPushConstantRange pushConstantRange(VkShaderStageFlags pShaderStageFlags, uint32_t pSize, uint32_t pOffset = 0);
 	VkPipelineLayoutCreateInfo pipelineLayoutCreateInfo(const VkDescriptorSetLayout* pSetLayouts, uint32_t pSetLayoutCount, const VkPushConstantRange* pPushConstantRanges = nullptr, uint32_t pPushConstantRangeCount = 0);
-	VkPipelineShaderStageCreateInfo pipelineShaderStageCreateInfo(VkShaderStageFlagBits stage, VkShaderModule shaderModule, const char* pEntryName = "main");
+	VkPipelineShaderStageCreateInfo pipelineShaderStageCreateInfo(VkShaderStageFlagBits stage, VkShaderModule shaderModule, const char* pEntryName = "main", const VkSpecializationInfo* pSpecializationInfo = nullptr);
 	VkComputePipelineCreateInfo computePipelineCreateInfo(VkPipelineLayout layout, VkPipelineShaderStageCreateInfo shaderStageInfo);
 
 	// Image helpers
 	VkImageSubresourceRange imageSubresourceRange(VkImageAspectFlags aspectMask);
-	VkImageCreateInfo imageCreateInfo(VkFormat format, VkImageUsageFlags usageFlags, VkExtent3D extent);
+	VkImageCreateInfo imageCreateInfo(VkFormat format, VkImageUsageFlags usageFlags, VkExtent3D extent, uint32_t mipLevels = 1);
 	VkImageViewCreateInfo imageViewCreateInfo(VkImage image, VkFormat format, VkImageAspectFlags aspectFlags = VK_IMAGE_ASPECT_COLOR_BIT);
 
 	void copyImageToImage(VkCommandBuffer cmd, VkImage source, VkImage destination, VkExtent2D srcSize, VkExtent2D dstSize);
 
+	// Texel block of a format (1x1 for the uncompressed ones), return false for unknown formats
+	struct FormatBlock { uint32_t mWidth, mHeight, mBytes; };
+	bool formatBlock(VkFormat format, FormatBlock& block);
+	bool isCompressedFormat(VkFormat format);
+	// Size in bytes of a tightly packed level
+	VkDeviceSize levelSize(VkFormat format, VkExtent3D extent, uint32_t mipLevel);
+
+	// Number of levels of a full mip chain (down to 1x1)
+	uint32_t mipLevelCount(VkExtent2D extent);
+	// Build the mip chain with a vkCmdBlitImage2 per level, the format must support BLIT_SRC/BLIT_DST and linear filtering
+	// Level 0 is expected in VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, all levels end in finalLayout
+	void generateMipmapsBlit(VkCommandBuffer cmd, VkImage image, VkExtent2D extent, uint32_t mipLevels, VkImageLayout finalLayout);
+
 
 	// Some create helpers
 	VkSemaphore createSemaphore(VkDevice pDevice);
@@ -45,13 +58,16 @@ namespace vkh
 	VkImageView createImageView(VkDevice pDevice, VkImage pImage, VkFormat pFormat, VkImageAspectFlags pAspectFlags = VK_IMAGE_ASPECT_COLOR_BIT);
 	VkRenderPass createRenderPass(VkDevice pDevice, VkFormat pFormat);
 	VkFramebuffer createFramebuffer(VkDevice pDevice, VkRenderPass pRenderPass, VkImageView* imageViews, uint32_t imageViewCount, uint32_t pWidth, uint32_t pHeight);
-	VkSampler createTextureSampler(VkDevice pDevice);
+	VkSampler createTextureSampler(VkDevice pDevice, float pMaxAnisotropy = 0.0f, float pMinLod = 0.0f);	// pMaxAnisotropy <= 1 disable anisotropic filtering
 	std::vector<VkFramebuffer> createSwapchainFramebuffer(VkDevice pDevice, VkRenderPass pRenderPass, const VulkanSwapchain& pSwapchain);	// No more used with Vulkan 1.3
 
 	
 	// Barrier helpers
 	// https://www.khronos.org/blog/vulkan-sdk-offers-developers-a-smooth-transition-path-to-synchronization2
 	// VK_KHR_synchronization2 : https://github.com/KhronosGroup/Vulkan-Docs/wiki/Synchronization-Examples
-	void transitionImage(VkCommandBuffer cmd, VkImage pImage, VkImageLayout oldLayout, VkImageLayout newLayout);
+	void transitionImage(VkCommandBuffer cmd, VkImage pImage, VkImageLayout oldLayout, VkImageLayout newLayout, uint32_t baseMipLevel = 0, uint32_t levelCount = VK_REMAINING_MIP_LEVELS);
+	// Barrier of transitionImage, to batch several transitions in one vkCmdPipelineBarrier2
+	VkImageMemoryBarrier2 imageTransitionBarrier(VkImage pImage, VkImageLayout oldLayout, VkImageLayout newLayout, uint32_t baseMipLevel = 0, uint32_t levelCount = VK_REMAINING_MIP_LEVELS);
+	void pipelineBarrier(VkCommandBuffer cmd, const VkImageMemoryBarrier2* pBarriers, uint32_t pBarrierCount);
     //VkBufferMemoryBarrier bufferBarrier(VkBuffer pBuffer, VkAccessFlags pSrcAccessMask, VkAccessFlags pDstAccessMask);
 }
\ No newline at end of file
@@ -1,5 +1,25 @@
 #include <VulkanPipeline.h>
 #include <VulkanHelper.h>
+#include <VulkanDevice.h>
+
+#include <string.h>
+
+/*****************************************************************************/
+template<typename T>
+static void appendKey(std::vector<uint8_t>& pKey, const T& pValue)
+{
+    const uint8_t* lBytes = (const uint8_t*)&pValue;
+    pKey.insert(pKey.end(), lBytes, lBytes + sizeof(T));
+}
+
+/*****************************************************************************/
+// Contiguous 32 bits members [pFirst, pLast] of a structure, no padding in between
+template<typename T>
+static void appendKeyRange(std::vector<uint8_t>& pKey, const T& pFirst, const void* pLast)
+{
+    const uint8_t* lBytes = (const uint8_t*)&pFirst;
+    pKey.insert(pKey.end(), lBytes, (const uint8_t*)pLast + sizeof(uint32_t));
+}
 
 /*****************************************************************************/
 void PipelineBuilder::clear()
@@ -13,10 +33,79 @@ void PipelineBuilder::clear()
 	mDepthStencil = { VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO };
 	mRenderInfo = { VK_STRUCTURE_TYPE_PIPELINE_RENDERING_CREATE_INFO };
 	mShaderStages.clear();
+	mFlags = 0;
+	mDynamicState = 0;
+}
+
+/*****************************************************************************/
+uint32_t PipelineBuilder::getSupportedDynamicState(const VulkanDevice& pDevice)
+{
+    // Extended dynamic state 1 and 2 are core in Vulkan 1.3
+    uint32_t lGroups = cDynamicRasterizer | cDynamicDepthStencil | cDynamicTopology;
+
+    const VkPhysicalDeviceExtendedDynamicState3FeaturesEXT& lState3 = pDevice.mEnabledDynamicState3;
+    if (lState3.extendedDynamicState3PolygonMode)
+        lGroups |= cDynamicPolygonMode;
+    if (lState3.extendedDynamicState3ColorBlendEnable && lState3.extendedDynamicState3ColorBlendEquation && lState3.extendedDynamicState3ColorWriteMask)
+        lGroups |= cDynamicBlend;
+    return lGroups;
+}
+
+/*****************************************************************************/
+void PipelineBuilder::enableDynamicState(const VulkanDevice& pDevice, uint32_t pGroups)
+{
+    mDynamicState = pGroups & getSupportedDynamicState(pDevice);
+}
+
+/*****************************************************************************/
+// Topologies that can replace each other with a dynamic topology
+static uint32_t getTopologyClass(VkPrimitiveTopology pTopology)
+{
+    switch (pTopology)
+    {
+    case VK_PRIMITIVE_TOPOLOGY_POINT_LIST:
+        return 0;
+    case VK_PRIMITIVE_TOPOLOGY_LINE_LIST:
+    case VK_PRIMITIVE_TOPOLOGY_LINE_STRIP:
+    case VK_PRIMITIVE_TOPOLOGY_LINE_LIST_WITH_ADJACENCY:
+    case VK_PRIMITIVE_TOPOLOGY_LINE_STRIP_WITH_ADJACENCY:
+        return 1;
+    case VK_PRIMITIVE_TOPOLOGY_PATCH_LIST:
+        return 3;
+    default:
+        return 2;
+    }
+}
+
+/*****************************************************************************/
+VkPipeline PipelineBuilder::buildPipeline(VulkanDevice* pDevice)
+{
+    return build(pDevice, cAllParts);
 }
 
 /*****************************************************************************/
-VkPipeline PipelineBuilder::buildPipeline(VkDevice pDevice)
+VkPipeline PipelineBuilder::buildLibrary(VulkanDevice* pDevice, VkGraphicsPipelineLibraryFlagsEXT pParts)
+{
+    // Kept in the library so the optimized link can use it (see linkLibraries)
+    return build(pDevice, pParts, VK_PIPELINE_CREATE_LIBRARY_BIT_KHR | VK_PIPELINE_CREATE_RETAIN_LINK_TIME_OPTIMIZATION_INFO_BIT_EXT);
+}
+
+/*****************************************************************************/
+VkPipeline PipelineBuilder::linkLibraries(VulkanDevice* pDevice, const VkPipeline* pLibraries, uint32_t pLibraryCount, bool pOptimize) const
+{
+    VkPipelineLibraryCreateInfoKHR lLibraryInfo = { VK_STRUCTURE_TYPE_PIPELINE_LIBRARY_CREATE_INFO_KHR };
+    lLibraryInfo.libraryCount = pLibraryCount;
+    lLibraryInfo.pLibraries = pLibraries;
+
+    VkGraphicsPipelineCreateInfo lPipelineInfo = { VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO };
+    lPipelineInfo.pNext = &lLibraryInfo;
+    lPipelineInfo.flags = mFlags | (pOptimize ? VK_PIPELINE_CREATE_LINK_TIME_OPTIMIZATION_BIT_EXT : 0);
+    lPipelineInfo.layout = mPipelineLayout;
+    return pDevice->createGraphicsPipeline(lPipelineInfo);
+}
+
+/*****************************************************************************/
+VkPipeline PipelineBuilder::build(VulkanDevice* pDevice, VkGraphicsPipelineLibraryFlagsEXT pParts, VkPipelineCreateFlags pFlags)
 {
     // make viewport state from our stored viewport and scissor.
     // at the moment we wont support multiple viewports or scissors
@@ -35,36 +124,181 @@ VkPipeline PipelineBuilder::buildPipeline(VkDevice pDevice)
     // completely clear VertexInputStateCreateInfo, as we have no need for it
     VkPipelineVertexInputStateCreateInfo lVertexInputInfo = { VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO };
 
+    // Only the part of the state of the libraries built
+    VkGraphicsPipelineLibraryCreateInfoEXT lLibraryInfo = { VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_LIBRARY_CREATE_INFO_EXT };
+    lLibraryInfo.flags = pParts;
+    lLibraryInfo.pNext = &mRenderInfo;
+
     // build the actual pipeline
     // we now use all of the info structs we have been writing into into this one
     // to create the pipeline
     VkGraphicsPipelineCreateInfo lPipelineInfo = { VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO };
     //connect the renderInfo to the pNext extension mechanism
-    lPipelineInfo.pNext = &mRenderInfo;
-
-    lPipelineInfo.stageCount = (uint32_t)mShaderStages.size();
-    lPipelineInfo.pStages = mShaderStages.data();
-    lPipelineInfo.pVertexInputState = &lVertexInputInfo;
-    lPipelineInfo.pInputAssemblyState = &mInputAssembly;
-    lPipelineInfo.pViewportState = &lViewportState;
-    lPipelineInfo.pRasterizationState = &mRasterizer;
-    lPipelineInfo.pMultisampleState = &mMultisampling;
-    lPipelineInfo.pColorBlendState = &lColorBlending;
-    lPipelineInfo.pDepthStencilState = &mDepthStencil;
-    lPipelineInfo.layout = mPipelineLayout;
+    lPipelineInfo.pNext = pParts == cAllParts ? (const void*)&mRenderInfo : (const void*)&lLibraryInfo;
+    lPipelineInfo.flags = mFlags | pFlags;
+
+    std::vector<VkPipelineShaderStageCreateInfo> lStages;
+    lStages.reserve(mShaderStages.size());
+    for (const VkPipelineShaderStageCreateInfo& lStage : mShaderStages)
+    {
+        const VkGraphicsPipelineLibraryFlagsEXT lPart = lStage.stage == VK_SHADER_STAGE_FRAGMENT_BIT ?
+            VK_GRAPHICS_PIPELINE_LIBRARY_FRAGMENT_SHADER_BIT_EXT : VK_GRAPHICS_PIPELINE_LIBRARY_PRE_RASTERIZATION_SHADERS_BIT_EXT;
+        if (pParts & lPart)
+            lStages.push_back(lStage);
+    }
+    lPipelineInfo.stageCount = (uint32_t)lStages.size();
+    lPipelineInfo.pStages = lStages.data();
+
+    if (pParts & VK_GRAPHICS_PIPELINE_LIBRARY_VERTEX_INPUT_INTERFACE_BIT_EXT)
+    {
+        lPipelineInfo.pVertexInputState = &lVertexInputInfo;
+        lPipelineInfo.pInputAssemblyState = &mInputAssembly;
+    }
+    if (pParts & VK_GRAPHICS_PIPELINE_LIBRARY_PRE_RASTERIZATION_SHADERS_BIT_EXT)
+    {
+        lPipelineInfo.pViewportState = &lViewportState;
+        lPipelineInfo.pRasterizationState = &mRasterizer;
+    }
+    if (pParts & VK_GRAPHICS_PIPELINE_LIBRARY_FRAGMENT_SHADER_BIT_EXT)
+        lPipelineInfo.pDepthStencilState = &mDepthStencil;
+    if (pParts & VK_GRAPHICS_PIPELINE_LIBRARY_FRAGMENT_OUTPUT_INTERFACE_BIT_EXT)
+        lPipelineInfo.pColorBlendState = &lColorBlending;
+    if (pParts & (VK_GRAPHICS_PIPELINE_LIBRARY_FRAGMENT_SHADER_BIT_EXT | VK_GRAPHICS_PIPELINE_LIBRARY_FRAGMENT_OUTPUT_INTERFACE_BIT_EXT))
+        lPipelineInfo.pMultisampleState = &mMultisampling;
+    if (pParts & (VK_GRAPHICS_PIPELINE_LIBRARY_PRE_RASTERIZATION_SHADERS_BIT_EXT | VK_GRAPHICS_PIPELINE_LIBRARY_FRAGMENT_SHADER_BIT_EXT))
+        lPipelineInfo.layout = mPipelineLayout;
 
     // Commonly supported (todo check)
-    VkDynamicState lDynamicState[] = { VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR };
+    VkDynamicState lDynamicState[32] = { VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR };
+    uint32_t lDynamicCount = 2;
+    auto lAddDynamic = [&](std::initializer_list<VkDynamicState> pStates)
+    {
+        for (VkDynamicState lState : pStates)
+            lDynamicState[lDynamicCount++] = lState;
+    };
+    if (mDynamicState & cDynamicRasterizer)
+        lAddDynamic({ VK_DYNAMIC_STATE_CULL_MODE, VK_DYNAMIC_STATE_FRONT_FACE, VK_DYNAMIC_STATE_DEPTH_BIAS_ENABLE, VK_DYNAMIC_STATE_DEPTH_BIAS });
+    if (mDynamicState & cDynamicDepthStencil)
+        lAddDynamic({ VK_DYNAMIC_STATE_DEPTH_TEST_ENABLE, VK_DYNAMIC_STATE_DEPTH_WRITE_ENABLE, VK_DYNAMIC_STATE_DEPTH_COMPARE_OP,
+            VK_DYNAMIC_STATE_DEPTH_BOUNDS_TEST_ENABLE, VK_DYNAMIC_STATE_DEPTH_BOUNDS, VK_DYNAMIC_STATE_STENCIL_TEST_ENABLE, VK_DYNAMIC_STATE_STENCIL_OP,
+            VK_DYNAMIC_STATE_STENCIL_COMPARE_MASK, VK_DYNAMIC_STATE_STENCIL_WRITE_MASK, VK_DYNAMIC_STATE_STENCIL_REFERENCE });
+    if (mDynamicState & cDynamicTopology)
+        lAddDynamic({ VK_DYNAMIC_STATE_PRIMITIVE_TOPOLOGY, VK_DYNAMIC_STATE_PRIMITIVE_RESTART_ENABLE });
+    if (mDynamicState & cDynamicPolygonMode)
+        lAddDynamic({ VK_DYNAMIC_STATE_POLYGON_MODE_EXT });
+    if (mDynamicState & cDynamicBlend)
+        lAddDynamic({ VK_DYNAMIC_STATE_COLOR_BLEND_ENABLE_EXT, VK_DYNAMIC_STATE_COLOR_BLEND_EQUATION_EXT, VK_DYNAMIC_STATE_COLOR_WRITE_MASK_EXT });
 
     VkPipelineDynamicStateCreateInfo lDynamicInfo = { VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO };
     lDynamicInfo.pDynamicStates = &lDynamicState[0];
-    lDynamicInfo.dynamicStateCount = 2;
+    lDynamicInfo.dynamicStateCount = lDynamicCount;
 
     lPipelineInfo.pDynamicState = &lDynamicInfo;
 
-    // its easy to error out on create graphics pipeline, so we handle it a bit
-    // better than the common VK_CHECK case
-    VkPipeline lPipeline = VK_NULL_HANDLE;
-    VK_CHECK(vkCreateGraphicsPipelines(pDevice, VK_NULL_HANDLE, 1, &lPipelineInfo, nullptr, &lPipeline));
-    return lPipeline;
+    return pDevice->createGraphicsPipeline(lPipelineInfo);
+}
+
+/*****************************************************************************/
+void PipelineBuilder::getKey(std::vector<uint8_t>& pKey, VkGraphicsPipelineLibraryFlagsEXT pParts) const
+{
+    pKey.clear();
+    appendKey(pKey, pParts);
+    appendKey(pKey, mFlags);
+    appendKey(pKey, mDynamicState);
+
+    if (pParts & (VK_GRAPHICS_PIPELINE_LIBRARY_PRE_RASTERIZATION_SHADERS_BIT_EXT | VK_GRAPHICS_PIPELINE_LIBRARY_FRAGMENT_SHADER_BIT_EXT))
+        appendKey(pKey, (uint64_t)mPipelineLayout);
+
+    for (const VkPipelineShaderStageCreateInfo& lStage : mShaderStages)
+    {
+        const VkGraphicsPipelineLibraryFlagsEXT lPart = lStage.stage == VK_SHADER_STAGE_FRAGMENT_BIT ?
+            VK_GRAPHICS_PIPELINE_LIBRARY_FRAGMENT_SHADER_BIT_EXT : VK_GRAPHICS_PIPELINE_LIBRARY_PRE_RASTERIZATION_SHADERS_BIT_EXT;
+        if ((pParts & lPart) == 0)
+            continue;
+
+        appendKey(pKey, lStage.flags);
+        appendKey(pKey, lStage.stage);
+        appendKey(pKey, (uint64_t)lStage.module);
+        const char* lName = lStage.pName != nullptr ? lStage.pName : "";
+        pKey.insert(pKey.end(), lName, lName + strlen(lName) + 1);
+
+        const VkSpecializationInfo* lSpecialization = lStage.pSpecializationInfo;
+        appendKey(pKey, lSpecialization != nullptr ? lSpecialization->mapEntryCount : 0u);
+        if (lSpecialization == nullptr)
+            continue;
+        for (uint32_t i = 0; i < lSpecialization->mapEntryCount; ++i)
+        {
+            const VkSpecializationMapEntry& lEntry = lSpecialization->pMapEntries[i];
+            appendKey(pKey, lEntry.constantID);
+            appendKey(pKey, lEntry.offset);
+            appendKey(pKey, (uint64_t)lEntry.size);
+        }
+        appendKey(pKey, (uint64_t)lSpecialization->dataSize);
+        const uint8_t* lData = (const uint8_t*)lSpecialization->pData;
+        pKey.insert(pKey.end(), lData, lData + lSpecialization->dataSize);
+    }
+
+    // The dynamic state is not part of the key, replaced by a fixed value
+    if (pParts & VK_GRAPHICS_PIPELINE_LIBRARY_VERTEX_INPUT_INTERFACE_BIT_EXT)
+    {
+        VkPipelineInputAssemblyStateCreateInfo lInputAssembly = mInputAssembly;
+        if (mDynamicState & cDynamicTopology)
+        {
+            lInputAssembly.topology = (VkPrimitiveTopology)getTopologyClass(mInputAssembly.topology);
+            lInputAssembly.primitiveRestartEnable = VK_FALSE;
+        }
+        appendKeyRange(pKey, lInputAssembly.flags, &lInputAssembly.primitiveRestartEnable);
+    }
+    if (pParts & VK_GRAPHICS_PIPELINE_LIBRARY_PRE_RASTERIZATION_SHADERS_BIT_EXT)
+    {
+        VkPipelineRasterizationStateCreateInfo lRasterizer = mRasterizer;
+        if (mDynamicState & cDynamicRasterizer)
+        {
+            lRasterizer.cullMode = VK_CULL_MODE_NONE;
+            lRasterizer.frontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE;
+            lRasterizer.depthBiasEnable = VK_FALSE;
+            lRasterizer.depthBiasConstantFactor = 0.0f;
+            lRasterizer.depthBiasClamp = 0.0f;
+            lRasterizer.depthBiasSlopeFactor = 0.0f;
+        }
+        if (mDynamicState & cDynamicPolygonMode)
+            lRasterizer.polygonMode = VK_POLYGON_MODE_FILL;
+        appendKeyRange(pKey, lRasterizer.flags, &lRasterizer.lineWidth);
+    }
+    if (pParts & VK_GRAPHICS_PIPELINE_LIBRARY_FRAGMENT_SHADER_BIT_EXT)
+    {
+        VkPipelineDepthStencilStateCreateInfo lDepthStencil = mDepthStencil;
+        if (mDynamicState & cDynamicDepthStencil)
+        {
+            const VkPipelineDepthStencilStateCreateInfo lDefault = { VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO };
+            lDepthStencil = lDefault;
+            lDepthStencil.flags = mDepthStencil.flags;
+        }
+        appendKeyRange(pKey, lDepthStencil.flags, &lDepthStencil.maxDepthBounds);
+    }
+    if (pParts & VK_GRAPHICS_PIPELINE_LIBRARY_FRAGMENT_OUTPUT_INTERFACE_BIT_EXT)
+    {
+        VkPipelineColorBlendAttachmentState lColorBlendAttachment = {};
+        if ((mDynamicState & cDynamicBlend) == 0)
+            lColorBlendAttachment = mColorBlendAttachment;
+        appendKey(pKey, lColorBlendAttachment);
+    }
+
+    if (pParts & (VK_GRAPHICS_PIPELINE_LIBRARY_FRAGMENT_SHADER_BIT_EXT | VK_GRAPHICS_PIPELINE_LIBRARY_FRAGMENT_OUTPUT_INTERFACE_BIT_EXT))
+    {
+        appendKeyRange(pKey, mMultisampling.flags, &mMultisampling.minSampleShading);
+        appendKey(pKey, mMultisampling.pSampleMask != nullptr ? *mMultisampling.pSampleMask : ~0u);
+        appendKeyRange(pKey, mMultisampling.alphaToCoverageEnable, &mMultisampling.alphaToOneEnable);
+    }
+
+    // Used by all the parts except the vertex input
+    if (pParts & ~VK_GRAPHICS_PIPELINE_LIBRARY_VERTEX_INPUT_INTERFACE_BIT_EXT)
+    {
+        appendKey(pKey, mRenderInfo.viewMask);
+        appendKey(pKey, mRenderInfo.colorAttachmentCount);
+        for (uint32_t i = 0; i < mRenderInfo.colorAttachmentCount; ++i)
+            appendKey(pKey, mRenderInfo.pColorAttachmentFormats[i]);
+        appendKey(pKey, mRenderInfo.depthAttachmentFormat);
+        appendKey(pKey, mRenderInfo.stencilAttachmentFormat);
+    }
 }
@@ -4,6 +4,8 @@
 
 #include <vector>
 
+struct VulkanDevice;
+
 struct PipelineBuilder
 {
     std::vector<VkPipelineShaderStageCreateInfo> mShaderStages;
@@ -16,9 +18,44 @@ struct PipelineBuilder
     VkPipelineDepthStencilStateCreateInfo mDepthStencil;
     VkPipelineRenderingCreateInfo mRenderInfo;
     VkFormat mColorAttachmentformat;
+    VkPipelineCreateFlags mFlags;       // ex: VK_PIPELINE_CREATE_DESCRIPTOR_BUFFER_BIT_EXT with the descriptor buffer backend
+    uint32_t mDynamicState;             // cDynamic* groups, see enableDynamicState
+
+    // Groups of state that can be set at draw time instead of baked in the pipeline
+    static const uint32_t cDynamicRasterizer = 1 << 0;      // Cull mode, front face, depth bias (Vulkan 1.3)
+    static const uint32_t cDynamicDepthStencil = 1 << 1;    // Depth test/write/compare/bounds, stencil test/op/masks (Vulkan 1.3)
+    static const uint32_t cDynamicTopology = 1 << 2;        // Topology within its class (point/line/triangle/patch), primitive restart (Vulkan 1.3)
+    static const uint32_t cDynamicPolygonMode = 1 << 3;     // VK_EXT_extended_dynamic_state3
+    static const uint32_t cDynamicBlend = 1 << 4;           // Blend enable/equation, color write mask (VK_EXT_extended_dynamic_state3)
+    static const uint32_t cDynamicAll = (1 << 5) - 1;
 
     PipelineBuilder() { clear(); }
     void clear();
 
-    VkPipeline buildPipeline(VkDevice device);
+    // Groups supported by the device (see VulkanDevice::mEnabledDynamicState3)
+    static uint32_t getSupportedDynamicState(const VulkanDevice& pDevice);
+
+    // Make the supported groups of pGroups dynamic: the builders differing only by this state have the same key
+    // and share a pipeline (PipelineRegistry), the state is set when drawing (see RenderStateTracker)
+    void enableDynamicState(const VulkanDevice& pDevice, uint32_t pGroups = cDynamicAll);
+
+    // The 4 parts of a graphics pipeline (VkGraphicsPipelineLibraryFlagBitsEXT)
+    static const VkGraphicsPipelineLibraryFlagsEXT cAllParts = VK_GRAPHICS_PIPELINE_LIBRARY_VERTEX_INPUT_INTERFACE_BIT_EXT
+        | VK_GRAPHICS_PIPELINE_LIBRARY_PRE_RASTERIZATION_SHADERS_BIT_EXT | VK_GRAPHICS_PIPELINE_LIBRARY_FRAGMENT_SHADER_BIT_EXT
+        | VK_GRAPHICS_PIPELINE_LIBRARY_FRAGMENT_OUTPUT_INTERFACE_BIT_EXT;
+
+    // Created through the device pipeline cache (see PipelineCache)
+    VkPipeline buildPipeline(VulkanDevice* pDevice);
+
+    // VK_EXT_graphics_pipeline_library: a library with only pParts of the state,
+    // and a pipeline linked from libraries covering all the parts (see PipelineLibraryCache)
+    VkPipeline buildLibrary(VulkanDevice* pDevice, VkGraphicsPipelineLibraryFlagsEXT pParts);
+    VkPipeline linkLibraries(VulkanDevice* pDevice, const VkPipeline* pLibraries, uint32_t pLibraryCount, bool pOptimize) const;
+
+    // Canonical form of the state (values only, no pointer nor padding): builders creating
+    // the same pipeline give the same key, used by the PipelineRegistry.
+    // Restricted to pParts, builders sharing a library give the same key.
+    void getKey(std::vector<uint8_t>& pKey, VkGraphicsPipelineLibraryFlagsEXT pParts = cAllParts) const;
+
+    VkPipeline build(VulkanDevice* pDevice, VkGraphicsPipelineLibraryFlagsEXT pParts, VkPipelineCreateFlags pFlags = 0);
 };
\ No newline at end of file
@@ -0,0 +1,239 @@
+#include "VulkanPipelineCache.h"
+#include "VulkanDevice.h"
+#include "MappedFile.h"
+
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+#include <filesystem>
+
+/******************************************************************************/
+static uint64_t hashData(const uint8_t* pData, size_t pSize)
+{
+    // FNV-1a
+    uint64_t lHash = 14695981039346656037ull;
+    for (size_t i = 0; i < pSize; ++i)
+        lHash = (lHash ^ pData[i]) * 1099511628211ull;
+    return lHash;
+}
+
+/******************************************************************************/
+void PipelineCache::init(VulkanDevice* pDevice, const Settings& pSettings)
+{
+    assert(mDevice == nullptr && "PipelineCache : already initialized");
+    mDevice = pDevice;
+    mSettings = pSettings;
+
+    std::vector<uint8_t> lData;
+    mWarm = load(lData);
+
+    VkPipelineCacheCreateInfo lCreateInfo = { VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO };
+    lCreateInfo.initialDataSize = lData.size();
+    lCreateInfo.pInitialData = lData.empty() ? nullptr : lData.data();
+    VkResult lResult = vkCreatePipelineCache(*mDevice, &lCreateInfo, nullptr, &mCache);
+    if (lResult != VK_SUCCESS && mWarm)
+    {
+        // The driver may still refuse a blob that passed the checks
+        printf("PipelineCache : %s rejected by the driver, start with an empty cache\n", mSettings.mFilename.c_str());
+        lCreateInfo.initialDataSize = 0;
+        lCreateInfo.pInitialData = nullptr;
+        lResult = vkCreatePipelineCache(*mDevice, &lCreateInfo, nullptr, &mCache);
+        mWarm = false;
+    }
+    VK_CHECK(lResult);
+
+    if (mWarm)
+        printf("PipelineCache : %s loaded (%llu bytes)\n", mSettings.mFilename.c_str(), (unsigned long long)lData.size());
+
+    mPipelineCount = 0;
+    mCreationNs = 0;
+    mPipelinesSinceSave = 0;
+    mLastSave = std::chrono::steady_clock::now();
+    mDevice->mPipelineCache = this;
+}
+
+/******************************************************************************/
+void PipelineCache::shutdown()
+{
+    if (mDevice == nullptr)
+        return;
+
+    if (!mWarm)
+    {
+        // This run is the new cold start reference
+        mColdPipelineCount = mPipelineCount;
+        mColdCreationMs = getCreationMs();
+    }
+    save();
+
+    if (mColdPipelineCount > 0)
+        printf("PipelineCache : %u pipelines created in %.2f ms (%s start), cold start %u pipelines in %.2f ms\n",
+            mPipelineCount.load(), getCreationMs(), mWarm ? "warm" : "cold", mColdPipelineCount, mColdCreationMs);
+
+    mDevice->mPipelineCache = nullptr;
+    vkDestroyPipelineCache(*mDevice, mCache, nullptr);
+    mCache = VK_NULL_HANDLE;
+    mDevice = nullptr;
+}
+
+/******************************************************************************/
+void PipelineCache::update()
+{
+    if (mSettings.mSaveInterval <= 0.0 || mPipelinesSinceSave.load() == 0)
+        return;
+
+    std::chrono::steady_clock::time_point lNow = std::chrono::steady_clock::now();
+    if (std::chrono::duration<double>(lNow - mLastSave).count() >= mSettings.mSaveInterval)
+        save();
+}
+
+/******************************************************************************/
+bool PipelineCache::save()
+{
+    mLastSave = std::chrono::steady_clock::now();
+    mPipelinesSinceSave = 0;
+
+    size_t lSize = 0;
+    VK_CHECK(vkGetPipelineCacheData(*mDevice, mCache, &lSize, nullptr));
+    std::vector<uint8_t> lData(lSize);
+    VkResult lResult = vkGetPipelineCacheData(*mDevice, mCache, &lSize, lData.data());
+    if (lResult != VK_SUCCESS || lSize == 0)
+        return false;
+
+    const VkPhysicalDeviceProperties& lProperties = mDevice->mPhysicalDeviceProperties;
+    FileHeader lHeader = {};
+    lHeader.mMagic = FileHeader::cMagic;
+    lHeader.mVersion = FileHeader::cVersion;
+    lHeader.mVendorID = lProperties.vendorID;
+    lHeader.mDeviceID = lProperties.deviceID;
+    lHeader.mDriverVersion = lProperties.driverVersion;
+    memcpy(lHeader.mPipelineCacheUUID, lProperties.pipelineCacheUUID, VK_UUID_SIZE);
+    lHeader.mColdPipelineCount = mColdPipelineCount;
+    lHeader.mColdCreationMs = mColdCreationMs;
+    lHeader.mDataSize = lSize;
+    lHeader.mDataHash = hashData(lData.data(), lSize);
+
+    // Write aside then replace, the previous file stays valid until the rename
+    const std::string lTempFilename = mSettings.mFilename + ".tmp";
+    FILE* lFile = fopen(lTempFilename.c_str(), "wb");
+    if (lFile == nullptr)
+    {
+        printf("PipelineCache : can't write %s\n", lTempFilename.c_str());
+        return false;
+    }
+    bool lWritten = fwrite(&lHeader, sizeof(lHeader), 1, lFile) == 1 && fwrite(lData.data(), lSize, 1, lFile) == 1;
+    lWritten = fflush(lFile) == 0 && lWritten;
+    lWritten = fclose(lFile) == 0 && lWritten;
+
+    std::error_code lError;
+    if (lWritten)
+        std::filesystem::rename(lTempFilename, mSettings.mFilename, lError);
+    if (!lWritten || lError)
+    {
+        printf("PipelineCache : failed to save %s\n", mSettings.mFilename.c_str());
+        std::filesystem::remove(lTempFilename, lError);
+        return false;
+    }
+    return true;
+}
+
+/******************************************************************************/
+VkPipeline PipelineCache::createComputePipeline(const VkComputePipelineCreateInfo& pCreateInfo)
+{
+    std::chrono::steady_clock::time_point lStart = std::chrono::steady_clock::now();
+    VkPipeline lPipeline = VK_NULL_HANDLE;
+    VK_CHECK(vkCreateComputePipelines(*mDevice, mCache, 1, &pCreateInfo, nullptr, &lPipeline));
+    addCreationTime(lStart);
+    return lPipeline;
+}
+
+/******************************************************************************/
+VkPipeline PipelineCache::createGraphicsPipeline(const VkGraphicsPipelineCreateInfo& pCreateInfo)
+{
+    std::chrono::steady_clock::time_point lStart = std::chrono::steady_clock::now();
+    VkPipeline lPipeline = VK_NULL_HANDLE;
+    VK_CHECK(vkCreateGraphicsPipelines(*mDevice, mCache, 1, &pCreateInfo, nullptr, &lPipeline));
+    addCreationTime(lStart);
+    return lPipeline;
+}
+
+/******************************************************************************/
+double PipelineCache::getCreationMs() const
+{
+    return mCreationNs.load() / 1e6;
+}
+
+/******************************************************************************/
+/******************************************************************************/
+/******************************************************************************/
+bool PipelineCache::load(std::vector<uint8_t>& pData)
+{
+    MappedFile lFile;
+    if (!lFile.open(mSettings.mFilename.c_str()))
+        return false;
+
+    FileHeader lHeader;
+    if (lFile.mSize < sizeof(lHeader))
+    {
+        printf("PipelineCache : %s truncated, ignored\n", mSettings.mFilename.c_str());
+        return false;
+    }
+    memcpy(&lHeader, lFile.mData, sizeof(lHeader));
+
+    const uint8_t* lData = lFile.mData + sizeof(lHeader);
+    const size_t lSize = lFile.mSize - sizeof(lHeader);
+    if (!isHeaderValid(lHeader, lData, lSize))
+        return false;
+
+    // Keep the cold start reference of the file
+    mColdPipelineCount = lHeader.mColdPipelineCount;
+    mColdCreationMs = lHeader.mColdCreationMs;
+    pData.assign(lData, lData + lSize);
+    return true;
+}
+
+/******************************************************************************/
+bool PipelineCache::isHeaderValid(const FileHeader& pHeader, const uint8_t* pData, size_t pSize) const
+{
+    const char* lFilename = mSettings.mFilename.c_str();
+    const VkPhysicalDeviceProperties& lProperties = mDevice->mPhysicalDeviceProperties;
+    if (pHeader.mMagic != FileHeader::cMagic || pHeader.mVersion != FileHeader::cVersion)
+    {
+        printf("PipelineCache : %s unknown format, ignored\n", lFilename);
+        return false;
+    }
+    if (pHeader.mVendorID != lProperties.vendorID || pHeader.mDeviceID != lProperties.deviceID)
+    {
+        printf("PipelineCache : %s written by another device, ignored\n", lFilename);
+        return false;
+    }
+    if (pHeader.mDriverVersion != lProperties.driverVersion || memcmp(pHeader.mPipelineCacheUUID, lProperties.pipelineCacheUUID, VK_UUID_SIZE) != 0)
+    {
+        printf("PipelineCache : %s written by another driver, ignored\n", lFilename);
+        return false;
+    }
+    if (pHeader.mDataSize != pSize || pHeader.mDataHash != hashData(pData, pSize))
+    {
+        printf("PipelineCache : %s corrupted, ignored\n", lFilename);
+        return false;
+    }
+
+    // The blob has its own header (VkPipelineCacheHeaderVersionOne), checked again in case the driver doesn't
+    VkPipelineCacheHeaderVersionOne lBlobHeader;
+    if (pSize < sizeof(lBlobHeader))
+        return false;
+    memcpy(&lBlobHeader, pData, sizeof(lBlobHeader));
+    return lBlobHeader.headerVersion == VK_PIPELINE_CACHE_HEADER_VERSION_ONE
+        && lBlobHeader.vendorID == lProperties.vendorID
+        && lBlobHeader.deviceID == lProperties.deviceID
+        && memcmp(lBlobHeader.pipelineCacheUUID, lProperties.pipelineCacheUUID, VK_UUID_SIZE) == 0;
+}
+
+/******************************************************************************/
+void PipelineCache::addCreationTime(std::chrono::steady_clock::time_point pStart)
+{
+    std::chrono::steady_clock::duration lDuration = std::chrono::steady_clock::now() - pStart;
+    mCreationNs += (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(lDuration).count();
+    ++mPipelineCount;
+    ++mPipelinesSinceSave;
+}
@@ -0,0 +1,78 @@
+#pragma once
+
+#include "vk_common.h"
+
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <vector>
+
+struct VulkanDevice;
+
+// Persistent VkPipelineCache
+// The file written by save() starts with a FileHeader: the blob is only given to the driver if it was written
+// by the same device and driver (vendor id, device id, driver version, pipelineCacheUUID) and is not corrupted,
+// else the cache starts empty. The file is written in a temporary file then renamed, a crash during
+// the save never leaves a truncated cache. Saved on shutdown and every Settings::mSaveInterval seconds
+// when new pipelines have been created.
+// All the pipelines should be created with createComputePipeline/createGraphicsPipeline (or VulkanDevice ones),
+// they use the cache and measure the creation time, logged on shutdown next to the time of the last cold start.
+// Thread safe, except init/shutdown/update.
+struct PipelineCache
+{
+    struct Settings
+    {
+        std::string mFilename = "pipeline_cache.bin";
+        double mSaveInterval = 60.0;    // Seconds, 0 = only on shutdown
+    };
+
+    void init(VulkanDevice* pDevice, const Settings& pSettings);
+    void shutdown();
+
+    // Periodic save, call once per frame
+    void update();
+    bool save();
+
+    VkPipeline createComputePipeline(const VkComputePipelineCreateInfo& pCreateInfo);
+    VkPipeline createGraphicsPipeline(const VkGraphicsPipelineCreateInfo& pCreateInfo);
+
+    // True if a valid cache was loaded by init
+    inline bool isWarm() const { return mWarm; }
+    double getCreationMs() const;
+    inline uint32_t getPipelineCount() const { return mPipelineCount.load(); }
+
+    struct FileHeader
+    {
+        static const uint32_t cMagic = 0x43504b56;     // VKPC
+        static const uint32_t cVersion = 1;
+
+        uint32_t mMagic;
+        uint32_t mVersion;
+        uint32_t mVendorID;
+        uint32_t mDeviceID;
+        uint32_t mDriverVersion;
+        uint8_t mPipelineCacheUUID[VK_UUID_SIZE];
+        uint32_t mColdPipelineCount;    // Pipelines created by the last run started without cache
+        double mColdCreationMs;         // and their creation time
+        uint64_t mDataSize;             // vkGetPipelineCacheData blob following the header
+        uint64_t mDataHash;
+    };
+
+    bool load(std::vector<uint8_t>& pData);
+    bool isHeaderValid(const FileHeader& pHeader, const uint8_t* pData, size_t pSize) const;
+    void addCreationTime(std::chrono::steady_clock::time_point pStart);
+
+    VulkanDevice* mDevice = nullptr;
+    Settings mSettings;
+    VkPipelineCache mCache = VK_NULL_HANDLE;
+    bool mWarm = false;
+
+    // Cold start reference, from the file or from this run
+    uint32_t mColdPipelineCount = 0;
+    double mColdCreationMs = 0.0;
+
+    std::atomic<uint32_t> mPipelineCount{ 0 };
+    std::atomic<uint64_t> mCreationNs{ 0 };
+    std::atomic<uint32_t> mPipelinesSinceSave{ 0 };
+    std::chrono::steady_clock::time_point mLastSave;
+};
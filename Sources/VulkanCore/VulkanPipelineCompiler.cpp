@@ -0,0 +1,138 @@
+#include "VulkanPipelineCompiler.h"
+#include "VulkanDevice.h"
+
+#include <assert.h>
+#include <stdio.h>
+
+/******************************************************************************/
+bool AsyncPipeline::isReady() const
+{
+    return mFuture.valid() && mFuture.wait_for(std::chrono::seconds(0)) == std::future_status::ready;
+}
+
+/******************************************************************************/
+VkPipeline AsyncPipeline::get() const
+{
+    return isReady() ? mFuture.get() : mFallback;
+}
+
+/******************************************************************************/
+VkPipeline AsyncPipeline::wait() const
+{
+    return mFuture.valid() ? mFuture.get() : mFallback;
+}
+
+/******************************************************************************/
+/******************************************************************************/
+/******************************************************************************/
+void PipelineCompiler::init(VulkanDevice* pDevice, uint32_t pThreadCount)
+{
+    assert(mDevice == nullptr && "PipelineCompiler : already initialized");
+    mDevice = pDevice;
+    mWorkers.init(pThreadCount, "PipelineCompiler");
+}
+
+/******************************************************************************/
+void PipelineCompiler::shutdown()
+{
+    if (mDevice == nullptr)
+        return;
+
+    // The pending pipelines are still compiled, their futures stay valid
+    mWorkers.shutdown();
+    mDevice = nullptr;
+}
+
+/******************************************************************************/
+AsyncPipeline PipelineCompiler::compile(const PipelineBuilder& pBuilder, VkPipeline pFallback)
+{
+    std::shared_ptr<std::promise<VkPipeline>> lPromise = std::make_shared<std::promise<VkPipeline>>();
+    AsyncPipeline lPipeline;
+    lPipeline.mFallback = pFallback;
+    lPipeline.mFuture = lPromise->get_future().share();
+    compile(pBuilder, [lPromise](VkPipeline pPipeline) { lPromise->set_value(pPipeline); });
+    return lPipeline;
+}
+
+/******************************************************************************/
+AsyncPipeline PipelineCompiler::compile(const VkComputePipelineCreateInfo& pCreateInfo, VkPipeline pFallback)
+{
+    assert(pCreateInfo.pNext == nullptr && pCreateInfo.stage.pNext == nullptr && "PipelineCompiler : pNext chains are not copied");
+
+    beginJob();
+    AsyncPipeline lPipeline;
+    lPipeline.mFallback = pFallback;
+    lPipeline.mFuture = mWorkers.submit([this, pCreateInfo]()
+    {
+        VkPipeline lResult = mDevice->createComputePipeline(pCreateInfo);
+        endJob();
+        return lResult;
+    }).share();
+    return lPipeline;
+}
+
+/******************************************************************************/
+void PipelineCompiler::compile(const PipelineBuilder& pBuilder, std::function<void(VkPipeline)>&& pOnCompiled)
+{
+    std::shared_ptr<PipelineBuilder> lBuilder = std::make_shared<PipelineBuilder>(pBuilder);
+
+    // The rendering info may point to the color format of the builder, follow the copy
+    if (pBuilder.mRenderInfo.pColorAttachmentFormats == &pBuilder.mColorAttachmentformat)
+        lBuilder->mRenderInfo.pColorAttachmentFormats = &lBuilder->mColorAttachmentformat;
+
+    beginJob();
+    mWorkers.enqueue([this, lBuilder, lOnCompiled = std::move(pOnCompiled)]()
+    {
+        lOnCompiled(lBuilder->buildPipeline(mDevice));
+        endJob();
+    });
+}
+
+/******************************************************************************/
+AsyncPipeline PipelineCompiler::submit(std::function<VkPipeline()>&& pCreate, VkPipeline pFallback)
+{
+    beginJob();
+    AsyncPipeline lPipeline;
+    lPipeline.mFallback = pFallback;
+    lPipeline.mFuture = mWorkers.submit([this, lCreate = std::move(pCreate)]()
+    {
+        VkPipeline lResult = lCreate();
+        endJob();
+        return lResult;
+    }).share();
+    return lPipeline;
+}
+
+/******************************************************************************/
+void PipelineCompiler::waitIdle()
+{
+    mWorkers.waitIdle();
+
+    std::lock_guard<std::mutex> lLock(mMutex);
+    if (mCompiledCount == 0)
+        return;
+
+    printf("PipelineCompiler : %u pipelines compiled in %.2f ms on %u threads\n", mCompiledCount,
+        std::chrono::duration<double, std::milli>(mBatchEnd - mBatchStart).count(), mWorkers.threadCount());
+    mCompiledCount = 0;
+}
+
+/******************************************************************************/
+/******************************************************************************/
+/******************************************************************************/
+void PipelineCompiler::beginJob()
+{
+    std::lock_guard<std::mutex> lLock(mMutex);
+    if (mPendingCount == 0 && mCompiledCount == 0)
+        mBatchStart = std::chrono::steady_clock::now();
+    ++mPendingCount;
+}
+
+/******************************************************************************/
+void PipelineCompiler::endJob()
+{
+    std::lock_guard<std::mutex> lLock(mMutex);
+    --mPendingCount;
+    ++mCompiledCount;
+    mBatchEnd = std::chrono::steady_clock::now();
+}
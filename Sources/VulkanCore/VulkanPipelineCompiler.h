@@ -0,0 +1,65 @@
+#pragma once
+
+#include "vk_common.h"
+#include "VulkanPipeline.h"
+#include "ThreadPool.h"
+
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <future>
+#include <mutex>
+
+struct VulkanDevice;
+
+// Pipeline being compiled by the PipelineCompiler
+// get() never blocks: it returns the fallback pipeline (can be null) until the compiled one is ready.
+// The compiled pipeline is owned by the caller (ex: VulkanDevice::addPipeline once ready).
+struct AsyncPipeline
+{
+    std::shared_future<VkPipeline> mFuture;
+    VkPipeline mFallback = VK_NULL_HANDLE;
+
+    inline bool isValid() const { return mFuture.valid(); }
+    bool isReady() const;
+    VkPipeline get() const;
+    VkPipeline wait() const;
+};
+
+// Compile the pipelines on worker threads, against the device pipeline cache (see PipelineCache)
+// The descriptions are copied, the shader modules, layouts and specialization infos they point to
+// must stay alive until the pipeline is ready.
+// The compilation of a batch of pipelines scales with the number of workers,
+// waitIdle() logs the wall time of the pipelines compiled since the previous call.
+struct PipelineCompiler
+{
+    // pThreadCount = 0 use the hardware concurrency minus one (see ThreadPool)
+    void init(VulkanDevice* pDevice, uint32_t pThreadCount = 0);
+    void shutdown();
+
+    AsyncPipeline compile(const PipelineBuilder& pBuilder, VkPipeline pFallback = VK_NULL_HANDLE);
+    AsyncPipeline compile(const VkComputePipelineCreateInfo& pCreateInfo, VkPipeline pFallback = VK_NULL_HANDLE);
+
+    // pOnCompiled is called by the worker thread with the new pipeline
+    void compile(const PipelineBuilder& pBuilder, std::function<void(VkPipeline)>&& pOnCompiled);
+
+    // Any pipeline creation (ex: PipelineBuilder::linkLibraries)
+    AsyncPipeline submit(std::function<VkPipeline()>&& pCreate, VkPipeline pFallback = VK_NULL_HANDLE);
+
+    // Block until all the submitted pipelines are compiled
+    void waitIdle();
+
+    inline uint32_t threadCount() const { return mWorkers.threadCount(); }
+
+    void beginJob();
+    void endJob();
+
+    VulkanDevice* mDevice = nullptr;
+    ThreadPool mWorkers;
+
+    std::mutex mMutex;
+    uint32_t mPendingCount = 0;             // Submitted, not compiled
+    uint32_t mCompiledCount = 0;            // Since the last waitIdle
+    std::chrono::steady_clock::time_point mBatchStart;
+    std::chrono::steady_clock::time_point mBatchEnd;
+};
@@ -0,0 +1,256 @@
+#include "VulkanPipelineLayout.h"
+#include "VulkanDescriptor.h"
+#include "VulkanDevice.h"
+
+#include <assert.h>
+#include <algorithm>
+
+/******************************************************************************/
+size_t PipelineLayoutCache::KeyHash::operator()(const Key& pKey) const
+{
+    // FNV-1a
+    uint64_t lHash = 14695981039346656037ull;
+    for (uint64_t lValue : pKey)
+        lHash = (lHash ^ lValue) * 1099511628211ull;
+    return (size_t)lHash;
+}
+
+/******************************************************************************/
+void PipelineLayoutCache::init(VkDevice pDevice)
+{
+    mDevice = pDevice;
+}
+
+/******************************************************************************/
+void PipelineLayoutCache::destroy()
+{
+    std::lock_guard<std::mutex> lLock(mMutex);
+    for (auto& lIt : mLayouts)
+    {
+        const Layout& lLayout = *lIt.second;
+        for (uint32_t i = 0; i < lLayout.mSetCount; ++i)
+        {
+            if (lLayout.mTemplates[i] != VK_NULL_HANDLE)
+                vkDestroyDescriptorUpdateTemplate(mDevice, lLayout.mTemplates[i], nullptr);
+        }
+        vkDestroyPipelineLayout(mDevice, lLayout.mPipelineLayout, nullptr);
+    }
+    for (auto& lIt : mSetLayouts)
+        DescriptorLayoutBuilder::destroy(mDevice, lIt.second);
+
+    mLayouts.clear();
+    mSetLayouts.clear();
+}
+
+/******************************************************************************/
+const PipelineLayoutCache::Layout* PipelineLayoutCache::getLayout(const VulkanShader* const* pShaders, uint32_t pShaderCount, VkPipelineBindPoint pBindPoint,
+    VkDescriptorSetLayoutCreateFlags pSetFlags, const VkDescriptorSetLayout* pExternalSets)
+{
+    // Merge the stages
+    std::vector<ShaderReflection::Binding> lBindings;
+    VkPushConstantRange lPushConstants = {};
+    for (uint32_t s = 0; s < pShaderCount; ++s)
+    {
+        const ShaderReflection& lReflection = pShaders[s]->mReflection;
+        for (const ShaderReflection::Binding& lBinding : lReflection.mBindings)
+        {
+            auto lIt = std::find_if(lBindings.begin(), lBindings.end(), [&lBinding](const ShaderReflection::Binding& b)
+            {
+                return b.mSet == lBinding.mSet && b.mBinding == lBinding.mBinding;
+            });
+            if (lIt == lBindings.end())
+            {
+                lBindings.push_back(lBinding);
+                continue;
+            }
+            assert(lIt->mType == lBinding.mType && "PipelineLayoutCache : binding with different types in the stages");
+            lIt->mStages |= lBinding.mStages;
+            lIt->mCount = std::max(lIt->mCount, lBinding.mCount);
+        }
+
+        if (lReflection.mPushConstantSize > 0)
+        {
+            lPushConstants.stageFlags |= pShaders[s]->mStage;
+            lPushConstants.size = std::max(lPushConstants.size, lReflection.mPushConstantSize);
+        }
+    }
+    std::sort(lBindings.begin(), lBindings.end(), [](const ShaderReflection::Binding& a, const ShaderReflection::Binding& b)
+    {
+        return a.mSet != b.mSet ? a.mSet < b.mSet : a.mBinding < b.mBinding;
+    });
+
+    uint32_t lSetCount = lBindings.empty() ? 0 : lBindings.back().mSet + 1;
+    for (uint32_t i = 0; pExternalSets != nullptr && i < cMaxSets; ++i)
+    {
+        if (pExternalSets[i] != VK_NULL_HANDLE)
+            lSetCount = std::max(lSetCount, i + 1);
+    }
+    assert(lSetCount <= cMaxSets && "PipelineLayoutCache : too many sets");
+
+    // Everything that makes the layout
+    Key lKey;
+    lKey.reserve(lBindings.size() * 3 + 8);
+    lKey.push_back(pBindPoint);
+    lKey.push_back(pSetFlags);
+    lKey.push_back(((uint64_t)lPushConstants.stageFlags << 32) | lPushConstants.size);
+    for (const ShaderReflection::Binding& b : lBindings)
+    {
+        lKey.push_back(((uint64_t)b.mSet << 32) | b.mBinding);
+        lKey.push_back(((uint64_t)b.mType << 32) | b.mCount);
+        lKey.push_back(b.mStages);
+    }
+    for (uint32_t i = 0; pExternalSets != nullptr && i < cMaxSets; ++i)
+        lKey.push_back((uint64_t)pExternalSets[i]);
+
+    std::lock_guard<std::mutex> lLock(mMutex);
+    auto lFound = mLayouts.find(lKey);
+    if (lFound != mLayouts.end())
+        return lFound->second.get();
+
+    std::unique_ptr<Layout> lLayout(new Layout);
+    lLayout->mBindPoint = pBindPoint;
+    lLayout->mSetCount = lSetCount;
+    lLayout->mPushConstants = lPushConstants;
+    lLayout->mBindings = lBindings;
+
+    const bool lPushDescriptors = (pSetFlags & VK_DESCRIPTOR_SET_LAYOUT_CREATE_PUSH_DESCRIPTOR_BIT_KHR) != 0;
+    assert((!lPushDescriptors || lSetCount == 1) && "PipelineLayoutCache : only one push descriptor set per layout");
+    lLayout->mPushDescriptors = lPushDescriptors;
+    for (uint32_t lSet = 0; lSet < lSetCount; ++lSet)
+    {
+        if (pExternalSets != nullptr && pExternalSets[lSet] != VK_NULL_HANDLE)
+        {
+            lLayout->mSetLayouts[lSet] = pExternalSets[lSet];
+            continue;
+        }
+
+        std::vector<VkDescriptorSetLayoutBinding> lSetBindings;
+        for (const ShaderReflection::Binding& b : lBindings)
+        {
+            if (b.mSet != lSet)
+                continue;
+            assert(b.mCount > 0 && "PipelineLayoutCache : runtime arrays need an external set layout");
+
+            VkDescriptorSetLayoutBinding lBinding = {};
+            lBinding.binding = b.mBinding;
+            lBinding.descriptorType = b.mType;
+            lBinding.descriptorCount = b.mCount;
+            lBinding.stageFlags = b.mStages;
+            lSetBindings.push_back(lBinding);
+            lLayout->mDescriptorCounts[lSet] += b.mCount;
+        }
+        lLayout->mSetLayouts[lSet] = findSetLayout(lSetBindings, lSetBindings.empty() ? 0 : pSetFlags);
+    }
+
+    VkPipelineLayoutCreateInfo lLayoutInfo = { VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO };
+    lLayoutInfo.setLayoutCount = lSetCount;
+    lLayoutInfo.pSetLayouts = lLayout->mSetLayouts;
+    lLayoutInfo.pushConstantRangeCount = lPushConstants.size > 0 ? 1 : 0;
+    lLayoutInfo.pPushConstantRanges = &lLayout->mPushConstants;
+    VK_CHECK(vkCreatePipelineLayout(mDevice, &lLayoutInfo, nullptr, &lLayout->mPipelineLayout));
+
+    // No template with the descriptor buffers, DescriptorBufferAllocator writes the descriptors
+    const bool lTemplates = (pSetFlags & VK_DESCRIPTOR_SET_LAYOUT_CREATE_DESCRIPTOR_BUFFER_BIT_EXT) == 0;
+    for (uint32_t lSet = 0; lSet < lSetCount && lTemplates; ++lSet)
+    {
+        if (lLayout->mDescriptorCounts[lSet] > 0)
+            lLayout->mTemplates[lSet] = createTemplate(*lLayout, lSet, lPushDescriptors);
+    }
+
+    const Layout* lResult = lLayout.get();
+    mLayouts.emplace(std::move(lKey), std::move(lLayout));
+    return lResult;
+}
+
+/******************************************************************************/
+const PipelineLayoutCache::Layout* PipelineLayoutCache::getPushLayout(const VulkanDevice& pDevice, const VulkanShader* const* pShaders, uint32_t pShaderCount, VkPipelineBindPoint pBindPoint)
+{
+    // Both are cached, the set layout is only checked once
+    const Layout* lLayout = getLayout(pShaders, pShaderCount, pBindPoint);
+    if (lLayout->mSetCount != 1 || lLayout->mDescriptorCounts[0] == 0 || lLayout->mDescriptorCounts[0] > pDevice.mMaxPushDescriptors)
+        return lLayout;
+    return getLayout(pShaders, pShaderCount, pBindPoint, VK_DESCRIPTOR_SET_LAYOUT_CREATE_PUSH_DESCRIPTOR_BIT_KHR);
+}
+
+/******************************************************************************/
+void PipelineLayoutCache::bindDescriptors(VkDevice pDevice, VkCommandBuffer pCmd, const Layout& pLayout, uint32_t pSet, const DescriptorInfo* pDescriptors, DescriptorAllocator& pAllocator)
+{
+    assert(pLayout.mTemplates[pSet] != VK_NULL_HANDLE && "PipelineLayoutCache : no template for this set");
+    if (pLayout.mPushDescriptors)
+    {
+        vkCmdPushDescriptorSetWithTemplateKHR(pCmd, pLayout.mTemplates[pSet], pLayout.mPipelineLayout, pSet, pDescriptors);
+        return;
+    }
+
+    VkDescriptorSet lSet = pAllocator.allocate(pDevice, pLayout.mSetLayouts[pSet]);
+    vkUpdateDescriptorSetWithTemplate(pDevice, lSet, pLayout.mTemplates[pSet], pDescriptors);
+    vkCmdBindDescriptorSets(pCmd, pLayout.mBindPoint, pLayout.mPipelineLayout, pSet, 1, &lSet, 0, nullptr);
+}
+
+/******************************************************************************/
+VkDescriptorSetLayout PipelineLayoutCache::getSetLayout(const std::vector<VkDescriptorSetLayoutBinding>& pBindings, VkDescriptorSetLayoutCreateFlags pFlags)
+{
+    std::lock_guard<std::mutex> lLock(mMutex);
+    return findSetLayout(pBindings, pFlags);
+}
+
+/******************************************************************************/
+/******************************************************************************/
+/******************************************************************************/
+VkDescriptorSetLayout PipelineLayoutCache::findSetLayout(const std::vector<VkDescriptorSetLayoutBinding>& pBindings, VkDescriptorSetLayoutCreateFlags pFlags)
+{
+    Key lKey;
+    lKey.reserve(pBindings.size() * 2 + 1);
+    lKey.push_back(pFlags);
+    for (const VkDescriptorSetLayoutBinding& b : pBindings)
+    {
+        assert(b.pImmutableSamplers == nullptr && "PipelineLayoutCache : immutable samplers are not supported");
+        lKey.push_back(((uint64_t)b.binding << 32) | b.descriptorType);
+        lKey.push_back(((uint64_t)b.descriptorCount << 32) | b.stageFlags);
+    }
+
+    auto lFound = mSetLayouts.find(lKey);
+    if (lFound != mSetLayouts.end())
+        return lFound->second;
+
+    DescriptorLayoutBuilder lBuilder;
+    lBuilder.mBindings = pBindings;
+    VkDescriptorSetLayout lSetLayout = lBuilder.build(mDevice, 0, pFlags);
+    mSetLayouts.emplace(std::move(lKey), lSetLayout);
+    return lSetLayout;
+}
+
+/******************************************************************************/
+VkDescriptorUpdateTemplate PipelineLayoutCache::createTemplate(const Layout& pLayout, uint32_t pSet, bool pPushDescriptors)
+{
+    std::vector<VkDescriptorUpdateTemplateEntry> lEntries;
+    size_t lOffset = 0;
+    for (const ShaderReflection::Binding& b : pLayout.mBindings)
+    {
+        if (b.mSet != pSet)
+            continue;
+
+        VkDescriptorUpdateTemplateEntry lEntry = {};
+        lEntry.dstBinding = b.mBinding;
+        lEntry.dstArrayElement = 0;
+        lEntry.descriptorCount = b.mCount;
+        lEntry.descriptorType = b.mType;
+        lEntry.offset = lOffset;
+        lEntry.stride = sizeof(DescriptorInfo);
+        lEntries.push_back(lEntry);
+        lOffset += b.mCount * sizeof(DescriptorInfo);
+    }
+
+    VkDescriptorUpdateTemplateCreateInfo lCreateInfo = { VK_STRUCTURE_TYPE_DESCRIPTOR_UPDATE_TEMPLATE_CREATE_INFO };
+    lCreateInfo.descriptorUpdateEntryCount = (uint32_t)lEntries.size();
+    lCreateInfo.pDescriptorUpdateEntries = lEntries.data();
+    lCreateInfo.templateType = pPushDescriptors ? VK_DESCRIPTOR_UPDATE_TEMPLATE_TYPE_PUSH_DESCRIPTORS_KHR : VK_DESCRIPTOR_UPDATE_TEMPLATE_TYPE_DESCRIPTOR_SET;
+    lCreateInfo.descriptorSetLayout = pLayout.mSetLayouts[pSet];    // Ignored for the push descriptors
+    lCreateInfo.pipelineBindPoint = pLayout.mBindPoint;
+    lCreateInfo.pipelineLayout = pLayout.mPipelineLayout;
+    lCreateInfo.set = pSet;
+
+    VkDescriptorUpdateTemplate lTemplate = VK_NULL_HANDLE;
+    VK_CHECK(vkCreateDescriptorUpdateTemplate(mDevice, &lCreateInfo, nullptr, &lTemplate));
+    return lTemplate;
+}
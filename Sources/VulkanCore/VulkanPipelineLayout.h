@@ -0,0 +1,72 @@
+#pragma once
+
+#include "vk_common.h"
+#include "VulkanShader.h"
+
+#include <vector>
+#include <mutex>
+#include <memory>
+#include <unordered_map>
+
+struct VulkanDevice;
+struct DescriptorAllocator;
+struct DescriptorInfo;
+
+// Layouts built from the shader reflection (see parseSpirv)
+// The bindings of all the stages are merged (stage flags or-ed), so each binding is only visible
+// to the stages using it. The set layouts, pipeline layouts and update templates are deduplicated:
+// shaders with the same resources share the same objects, the returned pointers stay valid until destroy().
+// Thread safe.
+struct PipelineLayoutCache
+{
+    static const uint32_t cMaxSets = 4;
+
+    struct Layout
+    {
+        VkPipelineLayout mPipelineLayout = VK_NULL_HANDLE;
+        VkPipelineBindPoint mBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+        uint32_t mSetCount = 0;
+        VkDescriptorSetLayout mSetLayouts[cMaxSets] = {};
+        // Write a whole set from an array of DescriptorInfo (binding order) with vkUpdateDescriptorSetWithTemplate,
+        // or vkCmdPushDescriptorSetWithTemplateKHR for the push descriptor sets. Null for the external sets.
+        VkDescriptorUpdateTemplate mTemplates[cMaxSets] = {};
+        uint32_t mDescriptorCounts[cMaxSets] = {};     // Number of DescriptorInfo of each template
+        VkPushConstantRange mPushConstants = {};        // size 0 if none
+        bool mPushDescriptors = false;                  // Set layouts created with VK_DESCRIPTOR_SET_LAYOUT_CREATE_PUSH_DESCRIPTOR_BIT_KHR
+        std::vector<ShaderReflection::Binding> mBindings;   // Merged
+    };
+
+    void init(VkDevice pDevice);
+    void destroy();
+
+    // pSetFlags apply to all the reflected sets (VK_DESCRIPTOR_SET_LAYOUT_CREATE_PUSH_DESCRIPTOR_BIT_KHR needs a single set).
+    // pExternalSets (optional, cMaxSets entries, null = reflected) replace some sets,
+    // ex: BindlessHeap::getLayout() for the sets with runtime arrays.
+    const Layout* getLayout(const VulkanShader* const* pShaders, uint32_t pShaderCount, VkPipelineBindPoint pBindPoint,
+        VkDescriptorSetLayoutCreateFlags pSetFlags = 0, const VkDescriptorSetLayout* pExternalSets = nullptr);
+
+    // Push descriptor layout when VK_KHR_push_descriptor is enabled and the shaders use a single set
+    // within maxPushDescriptors, else the same layout as getLayout (allocated sets)
+    const Layout* getPushLayout(const VulkanDevice& pDevice, const VulkanShader* const* pShaders, uint32_t pShaderCount, VkPipelineBindPoint pBindPoint);
+
+    // Bind the set pSet from pDescriptors (mDescriptorCounts[pSet] entries, binding order) with its template:
+    // vkCmdPushDescriptorSetWithTemplateKHR for the push descriptor layouts,
+    // else a set allocated from pAllocator, vkUpdateDescriptorSetWithTemplate and vkCmdBindDescriptorSets
+    static void bindDescriptors(VkDevice pDevice, VkCommandBuffer pCmd, const Layout& pLayout, uint32_t pSet, const DescriptorInfo* pDescriptors, DescriptorAllocator& pAllocator);
+
+    VkDescriptorSetLayout getSetLayout(const std::vector<VkDescriptorSetLayoutBinding>& pBindings, VkDescriptorSetLayoutCreateFlags pFlags);
+
+    using Key = std::vector<uint64_t>;
+    struct KeyHash
+    {
+        size_t operator()(const Key& pKey) const;
+    };
+
+    VkDescriptorSetLayout findSetLayout(const std::vector<VkDescriptorSetLayoutBinding>& pBindings, VkDescriptorSetLayoutCreateFlags pFlags);   // mMutex locked
+    VkDescriptorUpdateTemplate createTemplate(const Layout& pLayout, uint32_t pSet, bool pPushDescriptors);
+
+    VkDevice mDevice = VK_NULL_HANDLE;
+    std::mutex mMutex;
+    std::unordered_map<Key, VkDescriptorSetLayout, KeyHash> mSetLayouts;
+    std::unordered_map<Key, std::unique_ptr<Layout>, KeyHash> mLayouts;
+};
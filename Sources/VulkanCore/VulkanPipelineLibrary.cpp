@@ -0,0 +1,169 @@
+#include "VulkanPipelineLibrary.h"
+#include "VulkanDevice.h"
+
+#include <assert.h>
+#include <array>
+
+static const VkGraphicsPipelineLibraryFlagsEXT cParts[PipelineLibraryCache::cPartCount] =
+{
+    VK_GRAPHICS_PIPELINE_LIBRARY_VERTEX_INPUT_INTERFACE_BIT_EXT,
+    VK_GRAPHICS_PIPELINE_LIBRARY_PRE_RASTERIZATION_SHADERS_BIT_EXT,
+    VK_GRAPHICS_PIPELINE_LIBRARY_FRAGMENT_SHADER_BIT_EXT,
+    VK_GRAPHICS_PIPELINE_LIBRARY_FRAGMENT_OUTPUT_INTERFACE_BIT_EXT,
+};
+
+/******************************************************************************/
+size_t PipelineLibraryCache::KeyHash::operator()(const Key& pKey) const
+{
+    // FNV-1a
+    uint64_t lHash = 14695981039346656037ull;
+    for (uint8_t lByte : pKey)
+        lHash = (lHash ^ lByte) * 1099511628211ull;
+    return (size_t)lHash;
+}
+
+/******************************************************************************/
+bool PipelineLibraryCache::isSupported(const VulkanDevice& pDevice)
+{
+    // Without fast linking, linking can cost as much as a monolithic compilation
+    return pDevice.mGraphicsPipelineLibrary && pDevice.mGraphicsPipelineLibraryFastLinking;
+}
+
+/******************************************************************************/
+void PipelineLibraryCache::init(VulkanDevice* pDevice, PipelineCompiler* pCompiler)
+{
+    assert(mDevice == nullptr && "PipelineLibraryCache : already initialized");
+    mDevice = pDevice;
+    mCompiler = pCompiler;
+    mUseLibraries = isSupported(*pDevice);
+}
+
+/******************************************************************************/
+void PipelineLibraryCache::destroy()
+{
+    if (mDevice == nullptr)
+        return;
+
+    std::lock_guard<std::mutex> lLock(mMutex);
+    for (auto& lIt : mPipelines)
+        mDropped.push_back(lIt.second);
+    for (LinkedPipeline& lPipeline : mDropped)
+    {
+        if (lPipeline.mFast != VK_NULL_HANDLE)
+            vkDestroyPipeline(*mDevice, lPipeline.mFast, nullptr);
+        VkPipeline lOptimized = lPipeline.mOptimized.get();
+        if (lOptimized != VK_NULL_HANDLE)
+            vkDestroyPipeline(*mDevice, lOptimized, nullptr);
+    }
+    for (auto& lIt : mLibraries)
+        vkDestroyPipeline(*mDevice, lIt.second, nullptr);
+
+    mPipelines.clear();
+    mDropped.clear();
+    mLibraries.clear();
+    mDevice = nullptr;
+}
+
+/******************************************************************************/
+AsyncPipeline PipelineLibraryCache::get(const PipelineBuilder& pBuilder)
+{
+    thread_local Key tKey;
+    pBuilder.getKey(tKey);
+    {
+        std::lock_guard<std::mutex> lLock(mMutex);
+        auto lIt = mPipelines.find(tKey);
+        if (lIt != mPipelines.end())
+        {
+            ++mPipelineHits;
+            AsyncPipeline lResult;
+            lResult.mFallback = lIt->second.mFast;
+            lResult.mFuture = lIt->second.mOptimized;
+            return lResult;
+        }
+    }
+
+    LinkedPipeline lPipeline;
+    if (!mUseLibraries)
+    {
+        // Monolithic fallback
+        lPipeline.mOptimized = mCompiler->compile(pBuilder).mFuture;
+    }
+    else
+    {
+        std::array<VkPipeline, cPartCount> lLibraries;
+        for (uint32_t i = 0; i < cPartCount; ++i)
+            lLibraries[i] = getLibrary(pBuilder, i);
+
+        lPipeline.mFast = pBuilder.linkLibraries(mDevice, lLibraries.data(), cPartCount, false);
+        ++mFastLinks;
+
+        // Only the libraries, the layout and the flags are needed, the builder can go away
+        PipelineBuilder lLinkInfo;
+        lLinkInfo.mPipelineLayout = pBuilder.mPipelineLayout;
+        lLinkInfo.mFlags = pBuilder.mFlags;
+        VulkanDevice* lDevice = mDevice;
+        lPipeline.mOptimized = mCompiler->submit([lDevice, lLinkInfo, lLibraries]()
+        {
+            return lLinkInfo.linkLibraries(lDevice, lLibraries.data(), cPartCount, true);
+        }).mFuture;
+    }
+
+    std::lock_guard<std::mutex> lLock(mMutex);
+    auto lInserted = mPipelines.emplace(tKey, lPipeline);
+    if (!lInserted.second)
+    {
+        // Another thread linked the same state meanwhile, this one is destroyed with the cache
+        mDropped.push_back(lPipeline);
+    }
+
+    AsyncPipeline lResult;
+    lResult.mFallback = lInserted.first->second.mFast;
+    lResult.mFuture = lInserted.first->second.mOptimized;
+    return lResult;
+}
+
+/******************************************************************************/
+PipelineLibraryCache::Stats PipelineLibraryCache::getStats()
+{
+    Stats lStats;
+    lStats.mLibraryHits = mLibraryHits;
+    lStats.mLibraryMisses = mLibraryMisses;
+    lStats.mPipelineHits = mPipelineHits;
+    lStats.mFastLinks = mFastLinks;
+
+    std::lock_guard<std::mutex> lLock(mMutex);
+    lStats.mLibraryCount = (uint32_t)mLibraries.size();
+    return lStats;
+}
+
+/******************************************************************************/
+/******************************************************************************/
+/******************************************************************************/
+VkPipeline PipelineLibraryCache::getLibrary(const PipelineBuilder& pBuilder, uint32_t pPart)
+{
+    Key lKey;
+    pBuilder.getKey(lKey, cParts[pPart]);
+    {
+        std::lock_guard<std::mutex> lLock(mMutex);
+        auto lIt = mLibraries.find(lKey);
+        if (lIt != mLibraries.end())
+        {
+            ++mLibraryHits;
+            return lIt->second;
+        }
+    }
+
+    // Compiled outside the lock, the vertex input and fragment output libraries are cheap,
+    // the shader ones are the real work
+    ++mLibraryMisses;
+    PipelineBuilder lBuilder = pBuilder;
+    if (pBuilder.mRenderInfo.pColorAttachmentFormats == &pBuilder.mColorAttachmentformat)
+        lBuilder.mRenderInfo.pColorAttachmentFormats = &lBuilder.mColorAttachmentformat;
+    VkPipeline lLibrary = lBuilder.buildLibrary(mDevice, cParts[pPart]);
+
+    std::lock_guard<std::mutex> lLock(mMutex);
+    auto lInserted = mLibraries.emplace(std::move(lKey), lLibrary);
+    if (!lInserted.second)
+        vkDestroyPipeline(*mDevice, lLibrary, nullptr);
+    return lInserted.first->second;
+}
@@ -0,0 +1,73 @@
+#pragma once
+
+#include "vk_common.h"
+#include "VulkanPipeline.h"
+#include "VulkanPipelineCompiler.h"
+
+#include <atomic>
+#include <future>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+struct VulkanDevice;
+
+// Graphics pipelines linked from libraries (VK_EXT_graphics_pipeline_library)
+// The 4 parts of a pipeline (vertex input, pre-rasterization shaders, fragment shader, fragment output) are
+// compiled as separate libraries, cached by the key of their part of the state (PipelineBuilder::getKey):
+// permutations sharing the vertex input and the fragment output only compile their shaders.
+// get() returns at once a fast linked pipeline (no optimization), the link time optimized pipeline
+// is compiled in the background by the PipelineCompiler and replaces it (AsyncPipeline::get).
+// Without the extension (or without fast linking), the monolithic pipeline is compiled by the PipelineCompiler.
+// The cache owns all the pipelines, destroyed by destroy() (wait for the compiler first).
+// Thread safe.
+struct PipelineLibraryCache
+{
+    struct Stats
+    {
+        uint64_t mLibraryHits = 0;
+        uint64_t mLibraryMisses = 0;
+        uint64_t mPipelineHits = 0;
+        uint64_t mFastLinks = 0;
+        uint32_t mLibraryCount = 0;
+    };
+
+    static const uint32_t cPartCount = 4;
+
+    static bool isSupported(const VulkanDevice& pDevice);
+
+    void init(VulkanDevice* pDevice, PipelineCompiler* pCompiler);
+    void destroy();
+
+    AsyncPipeline get(const PipelineBuilder& pBuilder);
+
+    Stats getStats();
+
+    using Key = std::vector<uint8_t>;
+    struct KeyHash
+    {
+        size_t operator()(const Key& pKey) const;
+    };
+
+    struct LinkedPipeline
+    {
+        VkPipeline mFast = VK_NULL_HANDLE;      // Fast linked, or null for the monolithic pipelines
+        std::shared_future<VkPipeline> mOptimized;
+    };
+
+    VkPipeline getLibrary(const PipelineBuilder& pBuilder, uint32_t pPart);
+
+    VulkanDevice* mDevice = nullptr;
+    PipelineCompiler* mCompiler = nullptr;
+    bool mUseLibraries = false;
+
+    std::mutex mMutex;
+    std::unordered_map<Key, VkPipeline, KeyHash> mLibraries;
+    std::unordered_map<Key, LinkedPipeline, KeyHash> mPipelines;
+    std::vector<LinkedPipeline> mDropped;      // Duplicates created by concurrent get()
+
+    std::atomic<uint64_t> mLibraryHits{ 0 };
+    std::atomic<uint64_t> mLibraryMisses{ 0 };
+    std::atomic<uint64_t> mPipelineHits{ 0 };
+    std::atomic<uint64_t> mFastLinks{ 0 };
+};
@@ -0,0 +1,410 @@
+#include "VulkanPipelineManifest.h"
+#include "VulkanPipelineRegistry.h"
+#include "VulkanPipelineCompiler.h"
+#include "MappedFile.h"
+#include "VulkanDevice.h"
+
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+#include <filesystem>
+
+namespace
+{
+    struct Writer
+    {
+        std::vector<uint8_t>& mData;
+
+        void bytes(const void* pData, size_t pSize)
+        {
+            const uint8_t* lBytes = (const uint8_t*)pData;
+            mData.insert(mData.end(), lBytes, lBytes + pSize);
+        }
+        void u32(uint32_t pValue) { bytes(&pValue, sizeof(pValue)); }
+        void string(const std::string& pValue)
+        {
+            u32((uint32_t)pValue.size());
+            bytes(pValue.data(), pValue.size());
+        }
+        // Contiguous 32 bits members [pFirst, pLast] of a structure
+        template<typename T>
+        void range(const T& pFirst, const void* pLast) { bytes(&pFirst, (const uint8_t*)pLast + sizeof(uint32_t) - (const uint8_t*)&pFirst); }
+    };
+
+    struct Reader
+    {
+        const uint8_t* mData;
+        const uint8_t* mEnd;
+
+        bool bytes(void* pData, size_t pSize)
+        {
+            if ((size_t)(mEnd - mData) < pSize)
+                return false;
+            memcpy(pData, mData, pSize);
+            mData += pSize;
+            return true;
+        }
+        // Any 32 bits value (flags, enums)
+        template<typename T>
+        bool u32(T& pValue)
+        {
+            uint32_t lValue = 0;
+            if (!bytes(&lValue, sizeof(lValue)))
+                return false;
+            pValue = (T)lValue;
+            return true;
+        }
+        bool string(std::string& pValue)
+        {
+            uint32_t lSize = 0;
+            if (!u32(lSize) || (size_t)(mEnd - mData) < lSize)
+                return false;
+            pValue.assign((const char*)mData, lSize);
+            mData += lSize;
+            return true;
+        }
+        template<typename T>
+        bool range(T& pFirst, const void* pLast) { return bytes(&pFirst, (const uint8_t*)pLast + sizeof(uint32_t) - (const uint8_t*)&pFirst); }
+    };
+}
+
+/******************************************************************************/
+void PipelineManifest::init(const std::string& pFilename)
+{
+    mFilename = pFilename;
+    load();
+}
+
+/******************************************************************************/
+void PipelineManifest::destroy()
+{
+    if (mDirty)
+        save();
+
+    mEntries.clear();
+    mKnown.clear();
+    mShaderNames.clear();
+    mLayoutNames.clear();
+    mShaders.clear();
+    mLayouts.clear();
+}
+
+/******************************************************************************/
+void PipelineManifest::nameShader(VkShaderModule pModule, const std::string& pName)
+{
+    std::lock_guard<std::mutex> lLock(mMutex);
+    mShaderNames[(uint64_t)pModule] = pName;
+    mShaders[pName] = pModule;
+}
+
+/******************************************************************************/
+void PipelineManifest::nameLayout(VkPipelineLayout pLayout, const std::string& pName)
+{
+    std::lock_guard<std::mutex> lLock(mMutex);
+    mLayoutNames[(uint64_t)pLayout] = pName;
+    mLayouts[pName] = pLayout;
+}
+
+/******************************************************************************/
+uint32_t PipelineManifest::replay(PipelineRegistry& pRegistry, PipelineCompiler& pCompiler)
+{
+    // By index, pRegistry.request records the states it doesn't know (pushed to mEntries)
+    uint32_t lEntryCount;
+    {
+        std::lock_guard<std::mutex> lLock(mMutex);
+        lEntryCount = (uint32_t)mEntries.size();
+    }
+
+    const uint32_t lSupportedDynamicState = PipelineBuilder::getSupportedDynamicState(*pRegistry.mDevice);
+    std::vector<uint8_t> lData;
+    uint32_t lCount = 0;
+    for (uint32_t i = 0; i < lEntryCount; ++i)
+    {
+        Entry* lEntry;
+        {
+            std::lock_guard<std::mutex> lLock(mMutex);
+            lEntry = mEntries[i].get();
+        }
+        // Shader or layout not named by this run
+        if (!deserialize(*lEntry))
+            continue;
+
+        // Recorded on another device, keep the dynamic state this one supports (as PipelineBuilder::enableDynamicState)
+        // The entry is rewritten with the masked state, the request finds it instead of recording a copy
+        if ((lEntry->mBuilder.mDynamicState & ~lSupportedDynamicState) != 0)
+        {
+            lEntry->mBuilder.mDynamicState &= lSupportedDynamicState;
+
+            std::lock_guard<std::mutex> lLock(mMutex);
+            lData.clear();
+            if (serialize(lEntry->mBuilder, lData))
+            {
+                mKnown.erase(std::string((const char*)lEntry->mData.data(), lEntry->mData.size()));
+                mDirty = true;
+                if (!mKnown.insert(std::string((const char*)lData.data(), lData.size())).second)
+                {
+                    // Same state as another entry once masked, not saved (the builder data is kept until destroy)
+                    lEntry->mData.clear();
+                    continue;
+                }
+                lEntry->mData = lData;
+            }
+        }
+        pRegistry.request(lEntry->mBuilder, pCompiler);
+        ++lCount;
+    }
+    printf("PipelineManifest : %u/%u pipelines replayed\n", lCount, lEntryCount);
+    return lCount;
+}
+
+/******************************************************************************/
+void PipelineManifest::record(const PipelineBuilder& pBuilder)
+{
+    thread_local std::vector<uint8_t> tData;
+    tData.clear();
+
+    std::lock_guard<std::mutex> lLock(mMutex);
+    if (!serialize(pBuilder, tData))
+        return;
+
+    std::string lKey((const char*)tData.data(), tData.size());
+    if (!mKnown.insert(std::move(lKey)).second)
+        return;
+
+    std::unique_ptr<Entry> lEntry(new Entry);
+    lEntry->mData = tData;
+    mEntries.push_back(std::move(lEntry));
+    mDirty = true;
+}
+
+/******************************************************************************/
+bool PipelineManifest::save()
+{
+    std::vector<uint8_t> lData;
+    Writer lWriter = { lData };
+    {
+        std::lock_guard<std::mutex> lLock(mMutex);
+        lWriter.u32(cMagic);
+        lWriter.u32(cVersion);
+        uint32_t lCount = 0;
+        for (const std::unique_ptr<Entry>& lEntry : mEntries)
+            lCount += lEntry->mData.empty() ? 0 : 1;
+        lWriter.u32(lCount);
+        for (const std::unique_ptr<Entry>& lEntry : mEntries)
+        {
+            // Merged with another entry by replay()
+            if (lEntry->mData.empty())
+                continue;
+            lWriter.u32((uint32_t)lEntry->mData.size());
+            lWriter.bytes(lEntry->mData.data(), lEntry->mData.size());
+        }
+        mDirty = false;
+    }
+
+    // Write aside then replace, the previous file stays valid until the rename
+    const std::string lTempFilename = mFilename + ".tmp";
+    FILE* lFile = fopen(lTempFilename.c_str(), "wb");
+    if (lFile == nullptr)
+    {
+        printf("PipelineManifest : can't write %s\n", lTempFilename.c_str());
+        return false;
+    }
+    bool lWritten = fwrite(lData.data(), lData.size(), 1, lFile) == 1;
+    lWritten = fclose(lFile) == 0 && lWritten;
+
+    std::error_code lError;
+    if (lWritten)
+        std::filesystem::rename(lTempFilename, mFilename, lError);
+    if (!lWritten || lError)
+    {
+        printf("PipelineManifest : failed to save %s\n", mFilename.c_str());
+        std::filesystem::remove(lTempFilename, lError);
+        return false;
+    }
+    return true;
+}
+
+/******************************************************************************/
+/******************************************************************************/
+/******************************************************************************/
+bool PipelineManifest::serialize(const PipelineBuilder& pBuilder, std::vector<uint8_t>& pData)
+{
+    auto lLayout = mLayoutNames.find((uint64_t)pBuilder.mPipelineLayout);
+    if (lLayout == mLayoutNames.end())
+        return false;
+
+    Writer lWriter = { pData };
+    lWriter.u32(pBuilder.mFlags);
+    lWriter.u32(pBuilder.mDynamicState);
+    lWriter.string(lLayout->second);
+
+    lWriter.u32((uint32_t)pBuilder.mShaderStages.size());
+    for (const VkPipelineShaderStageCreateInfo& lStage : pBuilder.mShaderStages)
+    {
+        auto lShader = mShaderNames.find((uint64_t)lStage.module);
+        if (lShader == mShaderNames.end())
+            return false;
+
+        lWriter.u32(lStage.flags);
+        lWriter.u32(lStage.stage);
+        lWriter.string(lShader->second);
+        lWriter.string(lStage.pName != nullptr ? lStage.pName : "main");
+
+        const VkSpecializationInfo* lSpecialization = lStage.pSpecializationInfo;
+        lWriter.u32(lSpecialization != nullptr ? lSpecialization->mapEntryCount : 0);
+        if (lSpecialization == nullptr)
+        {
+            lWriter.u32(0);
+            continue;
+        }
+        for (uint32_t i = 0; i < lSpecialization->mapEntryCount; ++i)
+        {
+            const VkSpecializationMapEntry& lEntry = lSpecialization->pMapEntries[i];
+            lWriter.u32(lEntry.constantID);
+            lWriter.u32(lEntry.offset);
+            lWriter.u32((uint32_t)lEntry.size);
+        }
+        lWriter.u32((uint32_t)lSpecialization->dataSize);
+        lWriter.bytes(lSpecialization->pData, lSpecialization->dataSize);
+    }
+
+    lWriter.range(pBuilder.mInputAssembly.flags, &pBuilder.mInputAssembly.primitiveRestartEnable);
+    lWriter.range(pBuilder.mRasterizer.flags, &pBuilder.mRasterizer.lineWidth);
+    lWriter.bytes(&pBuilder.mColorBlendAttachment, sizeof(pBuilder.mColorBlendAttachment));
+    lWriter.range(pBuilder.mMultisampling.flags, &pBuilder.mMultisampling.minSampleShading);
+    lWriter.u32(pBuilder.mMultisampling.pSampleMask != nullptr ? *pBuilder.mMultisampling.pSampleMask : ~0u);
+    lWriter.range(pBuilder.mMultisampling.alphaToCoverageEnable, &pBuilder.mMultisampling.alphaToOneEnable);
+    lWriter.range(pBuilder.mDepthStencil.flags, &pBuilder.mDepthStencil.maxDepthBounds);
+
+    lWriter.u32(pBuilder.mRenderInfo.viewMask);
+    lWriter.u32(pBuilder.mRenderInfo.colorAttachmentCount);
+    for (uint32_t i = 0; i < pBuilder.mRenderInfo.colorAttachmentCount; ++i)
+        lWriter.u32(pBuilder.mRenderInfo.pColorAttachmentFormats[i]);
+    lWriter.u32(pBuilder.mRenderInfo.depthAttachmentFormat);
+    lWriter.u32(pBuilder.mRenderInfo.stencilAttachmentFormat);
+    return true;
+}
+
+/******************************************************************************/
+bool PipelineManifest::deserialize(Entry& pEntry)
+{
+    Reader lReader = { pEntry.mData.data(), pEntry.mData.data() + pEntry.mData.size() };
+    PipelineBuilder& lBuilder = pEntry.mBuilder;
+    lBuilder.clear();
+
+    std::string lName;
+    uint32_t lValue = 0;
+    if (!lReader.u32(lBuilder.mFlags) || !lReader.u32(lBuilder.mDynamicState) || !lReader.string(lName))
+        return false;
+    auto lLayout = mLayouts.find(lName);
+    if (lLayout == mLayouts.end())
+        return false;
+    lBuilder.mPipelineLayout = lLayout->second;
+
+    uint32_t lStageCount = 0;
+    if (!lReader.u32(lStageCount))
+        return false;
+    pEntry.mStages.resize(lStageCount);
+    lBuilder.mShaderStages.resize(lStageCount);
+    for (uint32_t s = 0; s < lStageCount; ++s)
+    {
+        Entry::Stage& lStorage = pEntry.mStages[s];
+        VkPipelineShaderStageCreateInfo& lStage = lBuilder.mShaderStages[s];
+        lStage = { VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO };
+        if (!lReader.u32(lStage.flags) || !lReader.u32(lValue) || !lReader.string(lName) || !lReader.string(lStorage.mEntryPoint))
+            return false;
+        lStage.stage = (VkShaderStageFlagBits)lValue;
+        lStage.pName = lStorage.mEntryPoint.c_str();
+
+        auto lShader = mShaders.find(lName);
+        if (lShader == mShaders.end())
+            return false;
+        lStage.module = lShader->second;
+
+        uint32_t lEntryCount = 0;
+        if (!lReader.u32(lEntryCount))
+            return false;
+        lStorage.mMapEntries.resize(lEntryCount);
+        for (VkSpecializationMapEntry& lEntry : lStorage.mMapEntries)
+        {
+            if (!lReader.u32(lEntry.constantID) || !lReader.u32(lEntry.offset) || !lReader.u32(lValue))
+                return false;
+            lEntry.size = lValue;
+        }
+        if (!lReader.u32(lValue))
+            return false;
+        lStorage.mSpecializationData.resize(lValue);
+        if (!lReader.bytes(lStorage.mSpecializationData.data(), lValue))
+            return false;
+        if (lEntryCount == 0)
+            continue;
+
+        lStorage.mSpecialization.mapEntryCount = lEntryCount;
+        lStorage.mSpecialization.pMapEntries = lStorage.mMapEntries.data();
+        lStorage.mSpecialization.dataSize = lStorage.mSpecializationData.size();
+        lStorage.mSpecialization.pData = lStorage.mSpecializationData.data();
+        lStage.pSpecializationInfo = &lStorage.mSpecialization;
+    }
+
+    bool lValid = lReader.range(lBuilder.mInputAssembly.flags, &lBuilder.mInputAssembly.primitiveRestartEnable)
+        && lReader.range(lBuilder.mRasterizer.flags, &lBuilder.mRasterizer.lineWidth)
+        && lReader.bytes(&lBuilder.mColorBlendAttachment, sizeof(lBuilder.mColorBlendAttachment))
+        && lReader.range(lBuilder.mMultisampling.flags, &lBuilder.mMultisampling.minSampleShading)
+        && lReader.u32(lValue)
+        && lReader.range(lBuilder.mMultisampling.alphaToCoverageEnable, &lBuilder.mMultisampling.alphaToOneEnable)
+        && lReader.range(lBuilder.mDepthStencil.flags, &lBuilder.mDepthStencil.maxDepthBounds);
+    // The default mask (all samples) is the same as no mask
+    if (!lValid || lValue != ~0u)
+        return false;
+
+    uint32_t lColorCount = 0;
+    if (!lReader.u32(lBuilder.mRenderInfo.viewMask) || !lReader.u32(lColorCount))
+        return false;
+    pEntry.mColorFormats.resize(lColorCount);
+    for (VkFormat& lFormat : pEntry.mColorFormats)
+    {
+        if (!lReader.u32(lValue))
+            return false;
+        lFormat = (VkFormat)lValue;
+    }
+    lBuilder.mRenderInfo.colorAttachmentCount = lColorCount;
+    lBuilder.mRenderInfo.pColorAttachmentFormats = pEntry.mColorFormats.data();
+    if (!lReader.u32(lValue))
+        return false;
+    lBuilder.mRenderInfo.depthAttachmentFormat = (VkFormat)lValue;
+    if (!lReader.u32(lValue))
+        return false;
+    lBuilder.mRenderInfo.stencilAttachmentFormat = (VkFormat)lValue;
+    return lReader.mData == lReader.mEnd;
+}
+
+/******************************************************************************/
+bool PipelineManifest::load()
+{
+    MappedFile lFile;
+    if (!lFile.open(mFilename.c_str()))
+        return false;
+
+    Reader lReader = { lFile.mData, lFile.mData + lFile.mSize };
+    uint32_t lMagic = 0, lVersion = 0, lCount = 0;
+    if (!lReader.u32(lMagic) || !lReader.u32(lVersion) || !lReader.u32(lCount) || lMagic != cMagic || lVersion != cVersion)
+    {
+        printf("PipelineManifest : %s unknown format, ignored\n", mFilename.c_str());
+        return false;
+    }
+
+    for (uint32_t i = 0; i < lCount; ++i)
+    {
+        uint32_t lSize = 0;
+        std::unique_ptr<Entry> lEntry(new Entry);
+        lEntry->mData.resize(lReader.u32(lSize) ? lSize : 0);
+        if (lSize == 0 || !lReader.bytes(lEntry->mData.data(), lSize))
+        {
+            printf("PipelineManifest : %s truncated, %u/%u entries loaded\n", mFilename.c_str(), i, lCount);
+            break;
+        }
+        mKnown.insert(std::string((const char*)lEntry->mData.data(), lSize));
+        mEntries.push_back(std::move(lEntry));
+    }
+    return true;
+}
@@ -0,0 +1,78 @@
+#pragma once
+
+#include "vk_common.h"
+#include "VulkanPipeline.h"
+
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+struct PipelineRegistry;
+struct PipelineCompiler;
+
+// Pipelines used by the previous sessions, replayed at startup so they are compiled before they are needed
+// The registry records every new pipeline state (PipelineRegistry::mManifest), serialized with stable names
+// instead of the handles: the application names its shader modules and pipeline layouts (the file name of
+// the shader, ex: "gradient.comp.glsl") before the pipelines are requested, and again on the next run
+// before replay(). Entries using an unnamed handle are not recorded, entries using a name not known
+// by this run are not replayed but kept in the file.
+// The file is written in a temporary file then renamed (see PipelineCache).
+// Thread safe, except load/replay/save/destroy.
+struct PipelineManifest
+{
+    void init(const std::string& pFilename);
+    void destroy();
+
+    void nameShader(VkShaderModule pModule, const std::string& pName);
+    void nameLayout(VkPipelineLayout pLayout, const std::string& pName);
+
+    // Compile all the known entries of the file in the background (PipelineRegistry::request),
+    // the later PipelineRegistry::get/request of the same states are hits.
+    // The entries own the data pointed by the builders, destroy() after PipelineCompiler::waitIdle.
+    uint32_t replay(PipelineRegistry& pRegistry, PipelineCompiler& pCompiler);
+
+    // Called by the registry on a miss
+    void record(const PipelineBuilder& pBuilder);
+
+    bool save();
+    inline uint32_t entryCount() const { return (uint32_t)mEntries.size(); }
+
+    static const uint32_t cMagic = 0x4d504b56;  // VKPM
+    static const uint32_t cVersion = 2;
+
+    // A pipeline state, serialized, and the storage of the builder rebuilt by replay()
+    struct Entry
+    {
+        std::vector<uint8_t> mData;
+
+        struct Stage
+        {
+            std::string mEntryPoint;
+            std::vector<VkSpecializationMapEntry> mMapEntries;
+            std::vector<uint8_t> mSpecializationData;
+            VkSpecializationInfo mSpecialization;
+        };
+        std::vector<Stage> mStages;
+        std::vector<VkFormat> mColorFormats;
+        PipelineBuilder mBuilder;
+    };
+
+    bool serialize(const PipelineBuilder& pBuilder, std::vector<uint8_t>& pData);
+    bool deserialize(Entry& pEntry);
+    bool load();
+
+    std::string mFilename;
+
+    std::mutex mMutex;
+    std::unordered_map<uint64_t, std::string> mShaderNames;
+    std::unordered_map<uint64_t, std::string> mLayoutNames;
+    std::unordered_map<std::string, VkShaderModule> mShaders;
+    std::unordered_map<std::string, VkPipelineLayout> mLayouts;
+
+    std::vector<std::unique_ptr<Entry>> mEntries;
+    std::unordered_set<std::string> mKnown;    // Serialized states of mEntries
+    bool mDirty = false;
+};
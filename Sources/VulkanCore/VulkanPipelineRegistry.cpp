@@ -0,0 +1,110 @@
+#include "VulkanPipelineRegistry.h"
+#include "VulkanDevice.h"
+#include "VulkanPipelineManifest.h"
+
+#include <assert.h>
+
+/******************************************************************************/
+size_t PipelineRegistry::KeyHash::operator()(const Key& pKey) const
+{
+    // FNV-1a
+    uint64_t lHash = 14695981039346656037ull;
+    for (uint8_t lByte : pKey)
+        lHash = (lHash ^ lByte) * 1099511628211ull;
+    return (size_t)lHash;
+}
+
+/******************************************************************************/
+void PipelineRegistry::init(VulkanDevice* pDevice)
+{
+    assert(mDevice == nullptr && "PipelineRegistry : already initialized");
+    mDevice = pDevice;
+    mHits = 0;
+    mMisses = 0;
+}
+
+/******************************************************************************/
+void PipelineRegistry::destroy()
+{
+    if (mDevice == nullptr)
+        return;
+
+    std::lock_guard<std::mutex> lLock(mMutex);
+    for (auto& lIt : mPipelines)
+    {
+        // Wait for the pipelines still being compiled
+        VkPipeline lPipeline = lIt.second.get();
+        if (lPipeline != VK_NULL_HANDLE)
+            vkDestroyPipeline(*mDevice, lPipeline, nullptr);
+    }
+    mPipelines.clear();
+    mDevice = nullptr;
+}
+
+/******************************************************************************/
+VkPipeline PipelineRegistry::get(const PipelineBuilder& pBuilder)
+{
+    std::shared_future<VkPipeline> lFuture;
+    std::promise<VkPipeline> lPromise;
+    if (find(pBuilder, lFuture, lPromise))
+        return lFuture.get();
+
+    // Created outside the lock, the other misses don't wait for this one
+    PipelineBuilder lBuilder = pBuilder;
+    VkPipeline lPipeline = lBuilder.buildPipeline(mDevice);
+    lPromise.set_value(lPipeline);
+    return lPipeline;
+}
+
+/******************************************************************************/
+AsyncPipeline PipelineRegistry::request(const PipelineBuilder& pBuilder, PipelineCompiler& pCompiler, VkPipeline pFallback)
+{
+    AsyncPipeline lResult;
+    lResult.mFallback = pFallback;
+
+    std::promise<VkPipeline> lPromise;
+    if (find(pBuilder, lResult.mFuture, lPromise))
+        return lResult;
+
+    std::shared_ptr<std::promise<VkPipeline>> lShared = std::make_shared<std::promise<VkPipeline>>(std::move(lPromise));
+    pCompiler.compile(pBuilder, [lShared](VkPipeline pPipeline) { lShared->set_value(pPipeline); });
+    return lResult;
+}
+
+/******************************************************************************/
+PipelineRegistry::Stats PipelineRegistry::getStats()
+{
+    Stats lStats;
+    lStats.mHits = mHits;
+    lStats.mMisses = mMisses;
+
+    std::lock_guard<std::mutex> lLock(mMutex);
+    lStats.mPipelineCount = (uint32_t)mPipelines.size();
+    return lStats;
+}
+
+/******************************************************************************/
+/******************************************************************************/
+/******************************************************************************/
+bool PipelineRegistry::find(const PipelineBuilder& pBuilder, std::shared_future<VkPipeline>& pFuture, std::promise<VkPipeline>& pPromise)
+{
+    // Per thread to avoid an allocation per call
+    thread_local Key tKey;
+    pBuilder.getKey(tKey);
+
+    std::lock_guard<std::mutex> lLock(mMutex);
+    auto lIt = mPipelines.find(tKey);
+    if (lIt != mPipelines.end())
+    {
+        ++mHits;
+        pFuture = lIt->second;
+        return true;
+    }
+
+    ++mMisses;
+    pFuture = pPromise.get_future().share();
+    mPipelines.emplace(tKey, pFuture);
+    if (mManifest != nullptr)
+        mManifest->record(pBuilder);
+    return false;
+}
@@ -0,0 +1,57 @@
+#pragma once
+
+#include "vk_common.h"
+#include "VulkanPipeline.h"
+#include "VulkanPipelineCompiler.h"
+
+#include <atomic>
+#include <future>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+struct VulkanDevice;
+struct PipelineManifest;
+
+// Pipelines deduplicated by state (see PipelineBuilder::getKey)
+// get() can be called per draw: a hit is a hash lookup, a miss creates the pipeline once,
+// the other threads asking for the same state wait for it instead of creating a duplicate.
+// request() never blocks on a miss, the pipeline is compiled by the PipelineCompiler and the fallback
+// is used meanwhile. The registry owns the pipelines, destroyed by destroy() (wait for the compiler first).
+// Thread safe.
+struct PipelineRegistry
+{
+    struct Stats
+    {
+        uint64_t mHits = 0;
+        uint64_t mMisses = 0;
+        uint32_t mPipelineCount = 0;
+
+        inline double hitRate() const { return mHits + mMisses > 0 ? (double)mHits / (mHits + mMisses) : 0.0; }
+    };
+
+    void init(VulkanDevice* pDevice);
+    void destroy();
+
+    VkPipeline get(const PipelineBuilder& pBuilder);
+    AsyncPipeline request(const PipelineBuilder& pBuilder, PipelineCompiler& pCompiler, VkPipeline pFallback = VK_NULL_HANDLE);
+
+    Stats getStats();
+
+    using Key = std::vector<uint8_t>;
+    struct KeyHash
+    {
+        size_t operator()(const Key& pKey) const;
+    };
+
+    // Return true on a hit, else the caller must provide the pipeline with pPromise
+    bool find(const PipelineBuilder& pBuilder, std::shared_future<VkPipeline>& pFuture, std::promise<VkPipeline>& pPromise);
+
+    VulkanDevice* mDevice = nullptr;
+    PipelineManifest* mManifest = nullptr;     // Optional, records the misses
+
+    std::mutex mMutex;
+    std::unordered_map<Key, std::shared_future<VkPipeline>, KeyHash> mPipelines;
+    std::atomic<uint64_t> mHits{ 0 };
+    std::atomic<uint64_t> mMisses{ 0 };
+};
@@ -0,0 +1,131 @@
+#include "VulkanRenderState.h"
+#include "VulkanPipeline.h"
+
+#include <assert.h>
+#include <string.h>
+
+/******************************************************************************/
+template<typename T>
+bool RenderStateTracker::update(bool pForce, T& pCurrent, const T& pValue)
+{
+    if (!pForce && memcmp(&pCurrent, &pValue, sizeof(T)) == 0)
+    {
+        ++mStats.mSkipped;
+        return false;
+    }
+    memcpy(&pCurrent, &pValue, sizeof(T));
+    ++mStats.mCalls;
+    return true;
+}
+
+/******************************************************************************/
+void RenderStateTracker::begin(VkCommandBuffer pCmd)
+{
+    // Nothing is inherited from a previous recording
+    mCmd = pCmd;
+    mPipeline = VK_NULL_HANDLE;
+    mValid = 0;
+}
+
+/******************************************************************************/
+void RenderStateTracker::bindPipeline(VkPipeline pPipeline, VkPipelineBindPoint pBindPoint, uint32_t pDynamicState)
+{
+    assert(mCmd != VK_NULL_HANDLE && "RenderStateTracker : begin() not called");
+    if (pPipeline == mPipeline)
+        return;
+
+    vkCmdBindPipeline(mCmd, pBindPoint, pPipeline);
+    if (pBindPoint == VK_PIPELINE_BIND_POINT_GRAPHICS)
+    {
+        mPipeline = pPipeline;
+        mValid &= pDynamicState;
+    }
+}
+
+/******************************************************************************/
+void RenderStateTracker::setState(const PipelineBuilder& pState, uint32_t pGroups)
+{
+    assert(mCmd != VK_NULL_HANDLE && "RenderStateTracker : begin() not called");
+
+    if (pGroups & PipelineBuilder::cDynamicRasterizer)
+    {
+        const bool lForce = (mValid & PipelineBuilder::cDynamicRasterizer) == 0;
+        const VkPipelineRasterizationStateCreateInfo& lRasterizer = pState.mRasterizer;
+        if (update(lForce, mCullMode, lRasterizer.cullMode))
+            vkCmdSetCullMode(mCmd, mCullMode);
+        if (update(lForce, mFrontFace, lRasterizer.frontFace))
+            vkCmdSetFrontFace(mCmd, mFrontFace);
+        if (update(lForce, mDepthBiasEnable, lRasterizer.depthBiasEnable))
+            vkCmdSetDepthBiasEnable(mCmd, mDepthBiasEnable);
+        const float lDepthBias[3] = { lRasterizer.depthBiasConstantFactor, lRasterizer.depthBiasClamp, lRasterizer.depthBiasSlopeFactor };
+        if (update(lForce, mDepthBias, lDepthBias))
+            vkCmdSetDepthBias(mCmd, mDepthBias[0], mDepthBias[1], mDepthBias[2]);
+    }
+
+    if (pGroups & PipelineBuilder::cDynamicDepthStencil)
+    {
+        const bool lForce = (mValid & PipelineBuilder::cDynamicDepthStencil) == 0;
+        const VkPipelineDepthStencilStateCreateInfo& lDepthStencil = pState.mDepthStencil;
+        if (update(lForce, mDepthTestEnable, lDepthStencil.depthTestEnable))
+            vkCmdSetDepthTestEnable(mCmd, mDepthTestEnable);
+        if (update(lForce, mDepthWriteEnable, lDepthStencil.depthWriteEnable))
+            vkCmdSetDepthWriteEnable(mCmd, mDepthWriteEnable);
+        if (update(lForce, mDepthCompareOp, lDepthStencil.depthCompareOp))
+            vkCmdSetDepthCompareOp(mCmd, mDepthCompareOp);
+        if (update(lForce, mDepthBoundsTestEnable, lDepthStencil.depthBoundsTestEnable))
+            vkCmdSetDepthBoundsTestEnable(mCmd, mDepthBoundsTestEnable);
+        const float lDepthBounds[2] = { lDepthStencil.minDepthBounds, lDepthStencil.maxDepthBounds };
+        if (update(lForce, mDepthBounds, lDepthBounds))
+            vkCmdSetDepthBounds(mCmd, mDepthBounds[0], mDepthBounds[1]);
+        if (update(lForce, mStencilTestEnable, lDepthStencil.stencilTestEnable))
+            vkCmdSetStencilTestEnable(mCmd, mStencilTestEnable);
+
+        const VkStencilOpState* lFaces[2] = { &lDepthStencil.front, &lDepthStencil.back };
+        const VkStencilFaceFlags cFaceFlags[2] = { VK_STENCIL_FACE_FRONT_BIT, VK_STENCIL_FACE_BACK_BIT };
+        for (uint32_t i = 0; i < 2; ++i)
+        {
+            const VkStencilOpState& lFace = *lFaces[i];
+            const uint32_t lOps[4] = { (uint32_t)lFace.failOp, (uint32_t)lFace.passOp, (uint32_t)lFace.depthFailOp, (uint32_t)lFace.compareOp };
+            if (update(lForce, mStencilOps[i], lOps))
+                vkCmdSetStencilOp(mCmd, cFaceFlags[i], lFace.failOp, lFace.passOp, lFace.depthFailOp, lFace.compareOp);
+            if (update(lForce, mStencilCompareMask[i], lFace.compareMask))
+                vkCmdSetStencilCompareMask(mCmd, cFaceFlags[i], lFace.compareMask);
+            if (update(lForce, mStencilWriteMask[i], lFace.writeMask))
+                vkCmdSetStencilWriteMask(mCmd, cFaceFlags[i], lFace.writeMask);
+            if (update(lForce, mStencilReference[i], lFace.reference))
+                vkCmdSetStencilReference(mCmd, cFaceFlags[i], lFace.reference);
+        }
+    }
+
+    if (pGroups & PipelineBuilder::cDynamicTopology)
+    {
+        const bool lForce = (mValid & PipelineBuilder::cDynamicTopology) == 0;
+        if (update(lForce, mTopology, pState.mInputAssembly.topology))
+            vkCmdSetPrimitiveTopology(mCmd, mTopology);
+        if (update(lForce, mPrimitiveRestartEnable, pState.mInputAssembly.primitiveRestartEnable))
+            vkCmdSetPrimitiveRestartEnable(mCmd, mPrimitiveRestartEnable);
+    }
+
+    if (pGroups & PipelineBuilder::cDynamicPolygonMode)
+    {
+        const bool lForce = (mValid & PipelineBuilder::cDynamicPolygonMode) == 0;
+        if (update(lForce, mPolygonMode, pState.mRasterizer.polygonMode))
+            vkCmdSetPolygonModeEXT(mCmd, mPolygonMode);
+    }
+
+    if (pGroups & PipelineBuilder::cDynamicBlend)
+    {
+        const bool lForce = (mValid & PipelineBuilder::cDynamicBlend) == 0;
+        const VkPipelineColorBlendAttachmentState& lBlend = pState.mColorBlendAttachment;
+        if (update(lForce, mBlendEnable, lBlend.blendEnable))
+            vkCmdSetColorBlendEnableEXT(mCmd, 0, 1, &mBlendEnable);
+        const VkColorBlendEquationEXT lEquation = { lBlend.srcColorBlendFactor, lBlend.dstColorBlendFactor, lBlend.colorBlendOp,
+            lBlend.srcAlphaBlendFactor, lBlend.dstAlphaBlendFactor, lBlend.alphaBlendOp };
+        if (update(lForce, mBlendEquation, lEquation))
+            vkCmdSetColorBlendEquationEXT(mCmd, 0, 1, &mBlendEquation);
+        if (update(lForce, mColorWriteMask, lBlend.colorWriteMask))
+            vkCmdSetColorWriteMaskEXT(mCmd, 0, 1, &mColorWriteMask);
+    }
+
+    mValid |= pGroups;
+}
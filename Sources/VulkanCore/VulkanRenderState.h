@@ -0,0 +1,69 @@
+#pragma once
+
+#include "vk_common.h"
+
+struct PipelineBuilder;
+
+// Dynamic state recorded in a command buffer, without the calls setting the current value again
+// setState() records the dynamic groups of a state description (PipelineBuilder::cDynamic*), only the values that changed.
+// Binding a pipeline invalidates the groups it bakes (a static state leaves the dynamic value undefined),
+// binding shader objects invalidates nothing (see ShaderObjects, all the groups are dynamic).
+// One tracker per command buffer being recorded, begin() when the recording starts.
+struct RenderStateTracker
+{
+    struct Stats
+    {
+        uint64_t mCalls = 0;        // vkCmdSet* recorded
+        uint64_t mSkipped = 0;      // vkCmdSet* skipped, the value was already set
+    };
+
+    void begin(VkCommandBuffer pCmd);
+
+    // pDynamicState: PipelineBuilder::mDynamicState of the pipeline, the bind is skipped if already bound
+    void bindPipeline(VkPipeline pPipeline, VkPipelineBindPoint pBindPoint, uint32_t pDynamicState);
+
+    // pGroups: the mDynamicState of the pipeline bound, PipelineBuilder::cDynamicAll with shader objects
+    void setState(const PipelineBuilder& pState, uint32_t pGroups);
+
+    inline const Stats& getStats() const { return mStats; }
+
+    // Assign pValue and return true when different from pCurrent or pForce
+    template<typename T>
+    bool update(bool pForce, T& pCurrent, const T& pValue);
+
+    VkCommandBuffer mCmd = VK_NULL_HANDLE;
+    VkPipeline mPipeline = VK_NULL_HANDLE;
+    uint32_t mValid = 0;            // Groups with known values
+
+    // cDynamicRasterizer
+    VkCullModeFlags mCullMode;
+    VkFrontFace mFrontFace;
+    VkBool32 mDepthBiasEnable;
+    float mDepthBias[3];            // Constant factor, clamp, slope factor
+
+    // cDynamicDepthStencil
+    VkBool32 mDepthTestEnable;
+    VkBool32 mDepthWriteEnable;
+    VkCompareOp mDepthCompareOp;
+    VkBool32 mDepthBoundsTestEnable;
+    float mDepthBounds[2];
+    VkBool32 mStencilTestEnable;
+    uint32_t mStencilOps[2][4];     // Front/back fail, pass, depth fail, compare
+    uint32_t mStencilCompareMask[2];
+    uint32_t mStencilWriteMask[2];
+    uint32_t mStencilReference[2];
+
+    // cDynamicTopology
+    VkPrimitiveTopology mTopology;
+    VkBool32 mPrimitiveRestartEnable;
+
+    // cDynamicPolygonMode
+    VkPolygonMode mPolygonMode;
+
+    // cDynamicBlend, attachment 0
+    VkBool32 mBlendEnable;
+    VkColorBlendEquationEXT mBlendEquation;
+    VkColorComponentFlags mColorWriteMask;
+
+    Stats mStats;
+};
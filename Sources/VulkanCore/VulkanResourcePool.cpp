@@ -0,0 +1,235 @@
+#include "VulkanResourcePool.h"
+#include "VulkanHelper.h"
+
+#include <assert.h>
+
+/******************************************************************************/
+void BufferPool::init(uint32_t pCapacity)
+{
+    mSlots.init(pCapacity);
+    mBuffers.assign(pCapacity, VK_NULL_HANDLE);
+    mAddresses.assign(pCapacity, 0);
+    mSizes.assign(pCapacity, 0);
+    mMappedData.assign(pCapacity, nullptr);
+    mAllocations.assign(pCapacity, VK_NULL_HANDLE);
+    mUsages.assign(pCapacity, 0);
+}
+
+/******************************************************************************/
+BufferHandle BufferPool::create(VkDevice pDevice, VmaAllocator pAllocator, VkDeviceSize pSize, VkBufferUsageFlags pUsage, VmaMemoryUsage pMemoryUsage, VmaAllocationCreateFlags pAllocationFlags)
+{
+    VkBufferCreateInfo lBufferInfo = { VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO };
+    lBufferInfo.size = pSize;
+    lBufferInfo.usage = pUsage;
+    lBufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+    VmaAllocationCreateInfo lAllocInfo = {};
+    lAllocInfo.usage = pMemoryUsage;
+    lAllocInfo.flags = pAllocationFlags;
+
+    VkBuffer lBuffer = VK_NULL_HANDLE;
+    VmaAllocation lAllocation = VK_NULL_HANDLE;
+    VmaAllocationInfo lAllocationInfo = {};
+    VK_CHECK(vmaCreateBuffer(pAllocator, &lBufferInfo, &lAllocInfo, &lBuffer, &lAllocation, &lAllocationInfo));
+
+    uint32_t lIndex = mSlots.allocate();
+    if (lIndex == ~0u)
+    {
+        vmaDestroyBuffer(pAllocator, lBuffer, lAllocation);
+        return BufferHandle();
+    }
+
+    VkDeviceAddress lAddress = 0;
+    if (pUsage & VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT)
+    {
+        VkBufferDeviceAddressInfo lAddressInfo = { VK_STRUCTURE_TYPE_BUFFER_DEVICE_ADDRESS_INFO };
+        lAddressInfo.buffer = lBuffer;
+        lAddress = vkGetBufferDeviceAddress(pDevice, &lAddressInfo);
+    }
+
+    mBuffers[lIndex] = lBuffer;
+    mAddresses[lIndex] = lAddress;
+    mSizes[lIndex] = pSize;
+    mMappedData[lIndex] = lAllocationInfo.pMappedData;
+    mAllocations[lIndex] = lAllocation;
+    mUsages[lIndex] = pUsage;
+
+    return mSlots.makeHandle<BufferTag>(lIndex);
+}
+
+/******************************************************************************/
+void BufferPool::destroy(VmaAllocator pAllocator, BufferHandle pHandle)
+{
+    HANDLE_CHECK(mSlots, pHandle);
+    uint32_t lIndex = pHandle.index();
+
+    vmaDestroyBuffer(pAllocator, mBuffers[lIndex], mAllocations[lIndex]);
+    mBuffers[lIndex] = VK_NULL_HANDLE;
+    mAddresses[lIndex] = 0;
+    mSizes[lIndex] = 0;
+    mMappedData[lIndex] = nullptr;
+    mAllocations[lIndex] = VK_NULL_HANDLE;
+    mUsages[lIndex] = 0;
+
+    mSlots.release(lIndex);
+}
+
+/******************************************************************************/
+void BufferPool::destroyAll(VmaAllocator pAllocator)
+{
+    mSlots.forEach([&](uint32_t pIndex)
+    {
+        destroy(pAllocator, mSlots.makeHandle<BufferTag>(pIndex));
+    });
+}
+
+/******************************************************************************/
+void BufferPool::flush(VmaAllocator pAllocator, BufferHandle pHandle, VkDeviceSize pOffset, VkDeviceSize pSize)
+{
+    HANDLE_CHECK(mSlots, pHandle);
+    VK_CHECK(vmaFlushAllocation(pAllocator, mAllocations[pHandle.index()], pOffset, pSize));
+}
+
+/******************************************************************************/
+void BufferPool::invalidate(VmaAllocator pAllocator, BufferHandle pHandle, VkDeviceSize pOffset, VkDeviceSize pSize)
+{
+    HANDLE_CHECK(mSlots, pHandle);
+    VK_CHECK(vmaInvalidateAllocation(pAllocator, mAllocations[pHandle.index()], pOffset, pSize));
+}
+
+/******************************************************************************/
+/******************************************************************************/
+/******************************************************************************/
+void ImagePool::init(uint32_t pCapacity)
+{
+    mSlots.init(pCapacity);
+    mImages.assign(pCapacity, VK_NULL_HANDLE);
+    mViews.assign(pCapacity, VK_NULL_HANDLE);
+    mExtents.assign(pCapacity, VkExtent3D{ 0, 0, 0 });
+    mFormats.assign(pCapacity, VK_FORMAT_UNDEFINED);
+    mAllocations.assign(pCapacity, VK_NULL_HANDLE);
+    mMipLevels.assign(pCapacity, 0);
+    mUsages.assign(pCapacity, 0);
+}
+
+/******************************************************************************/
+ImageHandle ImagePool::create(VkDevice pDevice, VmaAllocator pAllocator, const VkImageCreateInfo& pCreateInfo, VkImageAspectFlags pAspectFlags)
+{
+    // Images are always allocated in gpu local memory
+    VmaAllocationCreateInfo lAllocInfo = {};
+    lAllocInfo.usage = VMA_MEMORY_USAGE_GPU_ONLY;
+    lAllocInfo.requiredFlags = VkMemoryPropertyFlags(VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+
+    VkImage lImage = VK_NULL_HANDLE;
+    VmaAllocation lAllocation = VK_NULL_HANDLE;
+    VK_CHECK(vmaCreateImage(pAllocator, &pCreateInfo, &lAllocInfo, &lImage, &lAllocation, nullptr));
+
+    uint32_t lIndex = mSlots.allocate();
+    if (lIndex == ~0u)
+    {
+        vmaDestroyImage(pAllocator, lImage, lAllocation);
+        return ImageHandle();
+    }
+
+    // The view cover the whole mip chain
+    VkImageViewCreateInfo lViewInfo = vkh::imageViewCreateInfo(lImage, pCreateInfo.format, pAspectFlags);
+    lViewInfo.subresourceRange.levelCount = pCreateInfo.mipLevels;
+    VkImageView lView = VK_NULL_HANDLE;
+    VK_CHECK(vkCreateImageView(pDevice, &lViewInfo, nullptr, &lView));
+
+    mImages[lIndex] = lImage;
+    mViews[lIndex] = lView;
+    mExtents[lIndex] = pCreateInfo.extent;
+    mFormats[lIndex] = pCreateInfo.format;
+    mAllocations[lIndex] = lAllocation;
+    mMipLevels[lIndex] = pCreateInfo.mipLevels;
+    mUsages[lIndex] = pCreateInfo.usage;
+
+    return mSlots.makeHandle<ImageTag>(lIndex);
+}
+
+/******************************************************************************/
+void ImagePool::destroy(VkDevice pDevice, VmaAllocator pAllocator, ImageHandle pHandle)
+{
+    HANDLE_CHECK(mSlots, pHandle);
+    uint32_t lIndex = pHandle.index();
+
+    vkDestroyImageView(pDevice, mViews[lIndex], nullptr);
+    vmaDestroyImage(pAllocator, mImages[lIndex], mAllocations[lIndex]);
+    mImages[lIndex] = VK_NULL_HANDLE;
+    mViews[lIndex] = VK_NULL_HANDLE;
+    mExtents[lIndex] = { 0, 0, 0 };
+    mFormats[lIndex] = VK_FORMAT_UNDEFINED;
+    mAllocations[lIndex] = VK_NULL_HANDLE;
+    mMipLevels[lIndex] = 0;
+    mUsages[lIndex] = 0;
+
+    mSlots.release(lIndex);
+}
+
+/******************************************************************************/
+void ImagePool::destroyAll(VkDevice pDevice, VmaAllocator pAllocator)
+{
+    mSlots.forEach([&](uint32_t pIndex)
+    {
+        destroy(pDevice, pAllocator, mSlots.makeHandle<ImageTag>(pIndex));
+    });
+}
+
+/******************************************************************************/
+/******************************************************************************/
+/******************************************************************************/
+void PipelinePool::init(uint32_t pCapacity)
+{
+    mSlots.init(pCapacity);
+    mPipelines.assign(pCapacity, VK_NULL_HANDLE);
+    mLayouts.assign(pCapacity, VK_NULL_HANDLE);
+    mBindPoints.assign(pCapacity, VK_PIPELINE_BIND_POINT_GRAPHICS);
+}
+
+/******************************************************************************/
+PipelineHandle PipelinePool::add(VkPipeline pPipeline, VkPipelineLayout pLayout, VkPipelineBindPoint pBindPoint)
+{
+    assert(pPipeline != VK_NULL_HANDLE);
+    uint32_t lIndex = mSlots.allocate();
+    if (lIndex == ~0u)
+        return PipelineHandle();
+
+    mPipelines[lIndex] = pPipeline;
+    mLayouts[lIndex] = pLayout;
+    mBindPoints[lIndex] = pBindPoint;
+
+    return mSlots.makeHandle<PipelineTag>(lIndex);
+}
+
+/******************************************************************************/
+void PipelinePool::destroy(VkDevice pDevice, PipelineHandle pHandle)
+{
+    HANDLE_CHECK(mSlots, pHandle);
+    uint32_t lIndex = pHandle.index();
+
+    vkDestroyPipeline(pDevice, mPipelines[lIndex], nullptr);
+    mPipelines[lIndex] = VK_NULL_HANDLE;
+    mLayouts[lIndex] = VK_NULL_HANDLE;
+
+    mSlots.release(lIndex);
+}
+
+/******************************************************************************/
+VkPipeline PipelinePool::replace(PipelineHandle pHandle, VkPipeline pPipeline)
+{
+    HANDLE_CHECK(mSlots, pHandle);
+    assert(pPipeline != VK_NULL_HANDLE);
+    VkPipeline lPrevious = mPipelines[pHandle.index()];
+    mPipelines[pHandle.index()] = pPipeline;
+    return lPrevious;
+}
+
+/******************************************************************************/
+void PipelinePool::destroyAll(VkDevice pDevice)
+{
+    mSlots.forEach([&](uint32_t pIndex)
+    {
+        destroy(pDevice, mSlots.makeHandle<PipelineTag>(pIndex));
+    });
+}
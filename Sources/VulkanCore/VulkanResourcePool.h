@@ -0,0 +1,96 @@
+#pragma once
+
+#include "vk_common.h"
+#include "VulkanHandle.h"
+#include <vk_mem_alloc.h>
+
+#include <vector>
+
+// Resource pools, stored as SoA indexed by the handle slot.
+// Hot fields (the ones read while recording commands) are kept in their own
+// contiguous arrays, cold fields (allocation, creation flags) are apart.
+
+struct BufferPool
+{
+    void init(uint32_t pCapacity);
+
+    BufferHandle create(VkDevice pDevice, VmaAllocator pAllocator, VkDeviceSize pSize, VkBufferUsageFlags pUsage, VmaMemoryUsage pMemoryUsage, VmaAllocationCreateFlags pAllocationFlags);
+    void destroy(VmaAllocator pAllocator, BufferHandle pHandle);
+    void destroyAll(VmaAllocator pAllocator);
+
+    // Make the cpu writes visible to the gpu (no-op on host coherent memory)
+    void flush(VmaAllocator pAllocator, BufferHandle pHandle, VkDeviceSize pOffset, VkDeviceSize pSize);
+    // Make the gpu writes visible to the cpu (no-op on host coherent memory)
+    void invalidate(VmaAllocator pAllocator, BufferHandle pHandle, VkDeviceSize pOffset, VkDeviceSize pSize);
+
+    inline VkBuffer getBuffer(BufferHandle pHandle) const { HANDLE_CHECK(mSlots, pHandle); return mBuffers[pHandle.index()]; }
+    inline VkDeviceAddress getAddress(BufferHandle pHandle) const { HANDLE_CHECK(mSlots, pHandle); return mAddresses[pHandle.index()]; }
+    inline VkDeviceSize getSize(BufferHandle pHandle) const { HANDLE_CHECK(mSlots, pHandle); return mSizes[pHandle.index()]; }
+    inline void* getMappedData(BufferHandle pHandle) const { HANDLE_CHECK(mSlots, pHandle); return mMappedData[pHandle.index()]; }
+    inline bool isAlive(BufferHandle pHandle) const { return mSlots.isAlive(pHandle); }
+
+    HandleAllocator mSlots;
+
+    // Hot
+    std::vector<VkBuffer> mBuffers;
+    std::vector<VkDeviceAddress> mAddresses;    // 0 if created without VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT
+    std::vector<VkDeviceSize> mSizes;
+    std::vector<void*> mMappedData;             // Persistent mapping (VMA_ALLOCATION_CREATE_MAPPED_BIT) or nullptr
+
+    // Cold
+    std::vector<VmaAllocation> mAllocations;
+    std::vector<VkBufferUsageFlags> mUsages;
+};
+
+struct ImagePool
+{
+    void init(uint32_t pCapacity);
+
+    ImageHandle create(VkDevice pDevice, VmaAllocator pAllocator, const VkImageCreateInfo& pCreateInfo, VkImageAspectFlags pAspectFlags);
+    void destroy(VkDevice pDevice, VmaAllocator pAllocator, ImageHandle pHandle);
+    void destroyAll(VkDevice pDevice, VmaAllocator pAllocator);
+
+    inline VkImage getImage(ImageHandle pHandle) const { HANDLE_CHECK(mSlots, pHandle); return mImages[pHandle.index()]; }
+    inline VkImageView getView(ImageHandle pHandle) const { HANDLE_CHECK(mSlots, pHandle); return mViews[pHandle.index()]; }
+    inline VkExtent3D getExtent(ImageHandle pHandle) const { HANDLE_CHECK(mSlots, pHandle); return mExtents[pHandle.index()]; }
+    inline VkFormat getFormat(ImageHandle pHandle) const { HANDLE_CHECK(mSlots, pHandle); return mFormats[pHandle.index()]; }
+    inline uint32_t getMipLevels(ImageHandle pHandle) const { HANDLE_CHECK(mSlots, pHandle); return mMipLevels[pHandle.index()]; }
+    inline bool isAlive(ImageHandle pHandle) const { return mSlots.isAlive(pHandle); }
+
+    HandleAllocator mSlots;
+
+    // Hot
+    std::vector<VkImage> mImages;
+    std::vector<VkImageView> mViews;
+    std::vector<VkExtent3D> mExtents;
+    std::vector<VkFormat> mFormats;
+
+    // Cold
+    std::vector<VmaAllocation> mAllocations;
+    std::vector<uint32_t> mMipLevels;
+    std::vector<VkImageUsageFlags> mUsages;
+};
+
+struct PipelinePool
+{
+    void init(uint32_t pCapacity);
+
+    // The pool take the ownership of the pipeline (not of the layout, it can be shared)
+    PipelineHandle add(VkPipeline pPipeline, VkPipelineLayout pLayout, VkPipelineBindPoint pBindPoint);
+    void destroy(VkDevice pDevice, PipelineHandle pHandle);
+    void destroyAll(VkDevice pDevice);
+    // The handle keeps its slot and gets pPipeline, the previous pipeline is returned to the caller (may be in use)
+    VkPipeline replace(PipelineHandle pHandle, VkPipeline pPipeline);
+
+    inline VkPipeline getPipeline(PipelineHandle pHandle) const { HANDLE_CHECK(mSlots, pHandle); return mPipelines[pHandle.index()]; }
+    inline VkPipelineLayout getLayout(PipelineHandle pHandle) const { HANDLE_CHECK(mSlots, pHandle); return mLayouts[pHandle.index()]; }
+    inline VkPipelineBindPoint getBindPoint(PipelineHandle pHandle) const { HANDLE_CHECK(mSlots, pHandle); return mBindPoints[pHandle.index()]; }
+    inline bool isAlive(PipelineHandle pHandle) const { return mSlots.isAlive(pHandle); }
+
+    HandleAllocator mSlots;
+
+    // Hot
+    std::vector<VkPipeline> mPipelines;
+    std::vector<VkPipelineLayout> mLayouts;
+    std::vector<VkPipelineBindPoint> mBindPoints;
+};
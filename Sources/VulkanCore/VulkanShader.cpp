@@ -1,8 +1,14 @@
 #include <VulkanShader.h>
 #include <VulkanHelper.h>
+#include "MappedFile.h"
 
+// SpvHasResultAndType
+#define SPV_ENABLE_UTILITY_CODE
 #include <spirv-headers/spirv.h>
 
+#include <algorithm>
+#include <vector>
+
 /*****************************************************************************/
 VkShaderStageFlagBits getShaderStage(SpvExecutionModel model)
 {
@@ -11,6 +17,9 @@ VkShaderStageFlagBits getShaderStage(SpvExecutionModel model)
 	case SpvExecutionModelGLCompute:	return VK_SHADER_STAGE_COMPUTE_BIT;
 	case SpvExecutionModelVertex:	return VK_SHADER_STAGE_VERTEX_BIT;
 	case SpvExecutionModelFragment:	return VK_SHADER_STAGE_FRAGMENT_BIT;
+	case SpvExecutionModelGeometry:	return VK_SHADER_STAGE_GEOMETRY_BIT;
+	case SpvExecutionModelTessellationControl:	return VK_SHADER_STAGE_TESSELLATION_CONTROL_BIT;
+	case SpvExecutionModelTessellationEvaluation:	return VK_SHADER_STAGE_TESSELLATION_EVALUATION_BIT;
 	default:
 		assert(!"unsupported model");
 	};
@@ -18,6 +27,96 @@ VkShaderStageFlagBits getShaderStage(SpvExecutionModel model)
 	return VkShaderStageFlagBits(0);
 }
 
+/*****************************************************************************/
+// What we need to know about each spirv id
+struct SpirvId
+{
+	uint32_t opcode = 0;
+	uint32_t typeId = 0;			// OpVariable/OpConstant result type, OpTypePointer/OpTypeArray/OpTypeSampledImage element type
+	uint32_t storageClass = 0;
+	uint32_t set = ~0u;
+	uint32_t binding = ~0u;
+	uint32_t constant = 0;			// OpConstant/OpSpecConstant value (default value for the specialization constants)
+	uint32_t specId = ~0u;			// SpecId decoration of the specialization constants
+	uint32_t width = 0;				// OpTypeInt/OpTypeFloat bits, OpTypeVector/OpTypeMatrix count
+	uint32_t lengthId = 0;			// OpTypeArray
+	uint32_t arrayStride = 0;
+	uint32_t dim = 0;				// OpTypeImage
+	uint32_t sampled = 0;
+	bool block = false;
+	bool bufferBlock = false;
+	bool workgroupSize = false;
+	std::vector<uint32_t> members;	// OpTypeStruct member types, OpConstantComposite constituents
+	std::vector<uint32_t> memberOffsets;
+	std::vector<uint32_t> memberMatrixStrides;
+};
+
+/*****************************************************************************/
+// Size of a type in a block (offsets/strides are explicit in the spirv)
+static uint32_t getTypeSize(const std::vector<SpirvId>& ids, uint32_t typeId, uint32_t matrixStride = 0)
+{
+	const SpirvId& type = ids[typeId];
+	switch (type.opcode)
+	{
+	case SpvOpTypeInt:
+	case SpvOpTypeFloat:
+		return type.width / 8;
+	case SpvOpTypeBool:
+		return 4;
+	case SpvOpTypeVector:
+		return type.width * getTypeSize(ids, type.typeId);
+	case SpvOpTypeMatrix:
+		return type.width * (matrixStride ? matrixStride : getTypeSize(ids, type.typeId));
+	case SpvOpTypeArray:
+	{
+		uint32_t length = ids[type.lengthId].constant;
+		return length * (type.arrayStride ? type.arrayStride : getTypeSize(ids, type.typeId));
+	}
+	case SpvOpTypeStruct:
+	{
+		uint32_t size = 0;
+		for (size_t i = 0; i < type.members.size(); ++i)
+		{
+			uint32_t memberEnd = type.memberOffsets[i] + getTypeSize(ids, type.members[i], type.memberMatrixStrides[i]);
+			size = std::max(size, memberEnd);
+		}
+		return size;
+	}
+	default:
+		return 0;
+	}
+}
+
+/*****************************************************************************/
+static VkDescriptorType getDescriptorType(const std::vector<SpirvId>& ids, uint32_t storageClass, uint32_t typeId)
+{
+	const SpirvId& type = ids[typeId];
+	switch (storageClass)
+	{
+	case SpvStorageClassStorageBuffer:
+		return VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	case SpvStorageClassUniform:
+		// Before spirv 1.3 the storage buffers are Uniform + BufferBlock
+		return type.bufferBlock ? VK_DESCRIPTOR_TYPE_STORAGE_BUFFER : VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+	case SpvStorageClassUniformConstant:
+		switch (type.opcode)
+		{
+		case SpvOpTypeSampler:			return VK_DESCRIPTOR_TYPE_SAMPLER;
+		case SpvOpTypeSampledImage:		return VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+		case SpvOpTypeAccelerationStructureKHR:	return VK_DESCRIPTOR_TYPE_ACCELERATION_STRUCTURE_KHR;
+		case SpvOpTypeImage:
+			if (type.dim == SpvDimSubpassData)
+				return VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT;
+			if (type.dim == SpvDimBuffer)
+				return type.sampled == 2 ? VK_DESCRIPTOR_TYPE_STORAGE_TEXEL_BUFFER : VK_DESCRIPTOR_TYPE_UNIFORM_TEXEL_BUFFER;
+			return type.sampled == 2 ? VK_DESCRIPTOR_TYPE_STORAGE_IMAGE : VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE;
+		}
+		break;
+	}
+
+	return VK_DESCRIPTOR_TYPE_MAX_ENUM;
+}
+
 /*****************************************************************************/
 // https://www.khronos.org/registry/spir-v/specs/1.0/SPIRV.pdf
 void parseSpirv(VulkanShader& pShader, const uint32_t* code, uint32_t codeSize)
@@ -32,6 +131,10 @@ void parseSpirv(VulkanShader& pShader, const uint32_t* code, uint32_t codeSize)
 	version.raw = code[1];
 
 	uint32_t idBound = code[3];
+	std::vector<SpirvId> ids(idBound);
+	uint32_t localSizeIds[3] = {};
+	ShaderReflection& reflection = pShader.mReflection;
+	reflection = ShaderReflection();
 
 	// Instruction stream
 	const uint32_t* stream = code + 5;
@@ -43,6 +146,7 @@ void parseSpirv(VulkanShader& pShader, const uint32_t* code, uint32_t codeSize)
 			struct { uint16_t opcode, wordCount; };
 		} opcode;
 		opcode.raw = *stream;
+		assert(opcode.wordCount > 0 && stream + opcode.wordCount <= code + codeSize);
 
 		switch (opcode.opcode)
 		{
@@ -50,46 +154,361 @@ void parseSpirv(VulkanShader& pShader, const uint32_t* code, uint32_t codeSize)
 		{
 			assert(opcode.wordCount >= 2);
 			pShader.mStage = getShaderStage(SpvExecutionModel(stream[1]));
-			return; // stop parsing
 		}
 		break;
+		case SpvOpExecutionMode:
+		case SpvOpExecutionModeId:
+		{
+			assert(opcode.wordCount >= 3);
+			if (stream[2] == SpvExecutionModeLocalSize)
+			{
+				for (int i = 0; i < 3; ++i)
+					reflection.mLocalSize[i] = stream[3 + i];
+			}
+			else if (stream[2] == SpvExecutionModeLocalSizeId)
+			{
+				for (int i = 0; i < 3; ++i)
+					localSizeIds[i] = stream[3 + i];
+			}
+		}
+		break;
+		case SpvOpDecorate:
+		{
+			assert(opcode.wordCount >= 3);
+			SpirvId& id = ids[stream[1]];
+			switch (stream[2])
+			{
+			case SpvDecorationDescriptorSet:	id.set = stream[3]; break;
+			case SpvDecorationBinding:			id.binding = stream[3]; break;
+			case SpvDecorationBlock:			id.block = true; break;
+			case SpvDecorationBufferBlock:		id.bufferBlock = true; break;
+			case SpvDecorationArrayStride:		id.arrayStride = stream[3]; break;
+			case SpvDecorationBuiltIn:			id.workgroupSize = (stream[3] == SpvBuiltInWorkgroupSize); break;
+			case SpvDecorationSpecId:			id.specId = stream[3]; break;
+			}
+		}
+		break;
+		case SpvOpMemberDecorate:
+		{
+			assert(opcode.wordCount >= 4);
+			SpirvId& id = ids[stream[1]];
+			uint32_t member = stream[2];
+			if (id.memberOffsets.size() <= member)
+			{
+				id.memberOffsets.resize(member + 1, 0);
+				id.memberMatrixStrides.resize(member + 1, 0);
+			}
+			if (stream[3] == SpvDecorationOffset)
+				id.memberOffsets[member] = stream[4];
+			else if (stream[3] == SpvDecorationMatrixStride)
+				id.memberMatrixStrides[member] = stream[4];
+		}
+		break;
+		case SpvOpTypeBool:
+		case SpvOpTypeSampler:
+		case SpvOpTypeAccelerationStructureKHR:
+			ids[stream[1]].opcode = opcode.opcode;
+			break;
+		case SpvOpTypeInt:
+		case SpvOpTypeFloat:
+			ids[stream[1]].opcode = opcode.opcode;
+			ids[stream[1]].width = stream[2];
+			break;
+		case SpvOpTypeVector:
+		case SpvOpTypeMatrix:
+			ids[stream[1]].opcode = opcode.opcode;
+			ids[stream[1]].typeId = stream[2];
+			ids[stream[1]].width = stream[3];
+			break;
+		case SpvOpTypeImage:
+			ids[stream[1]].opcode = opcode.opcode;
+			ids[stream[1]].dim = stream[3];
+			ids[stream[1]].sampled = stream[7];
+			break;
+		case SpvOpTypeSampledImage:
+		case SpvOpTypeRuntimeArray:
+			ids[stream[1]].opcode = opcode.opcode;
+			ids[stream[1]].typeId = stream[2];
+			break;
+		case SpvOpTypeArray:
+			ids[stream[1]].opcode = opcode.opcode;
+			ids[stream[1]].typeId = stream[2];
+			ids[stream[1]].lengthId = stream[3];
+			break;
+		case SpvOpTypeStruct:
+		{
+			SpirvId& id = ids[stream[1]];
+			id.opcode = opcode.opcode;
+			id.members.assign(stream + 2, stream + opcode.wordCount);
+			id.memberOffsets.resize(id.members.size(), 0);
+			id.memberMatrixStrides.resize(id.members.size(), 0);
+		}
+		break;
+		case SpvOpTypePointer:
+			ids[stream[1]].opcode = opcode.opcode;
+			ids[stream[1]].storageClass = stream[2];
+			ids[stream[1]].typeId = stream[3];
+			break;
+		case SpvOpConstant:
+		case SpvOpSpecConstant:
+			ids[stream[2]].opcode = opcode.opcode;
+			ids[stream[2]].typeId = stream[1];
+			ids[stream[2]].constant = stream[3];	// Only the low 32 bits, enough for the sizes
+			break;
+		case SpvOpConstantComposite:
+		case SpvOpSpecConstantComposite:
+			ids[stream[2]].opcode = opcode.opcode;
+			ids[stream[2]].typeId = stream[1];
+			ids[stream[2]].members.assign(stream + 3, stream + opcode.wordCount);
+			break;
+		case SpvOpVariable:
+			ids[stream[2]].opcode = opcode.opcode;
+			ids[stream[2]].typeId = stream[1];
+			ids[stream[2]].storageClass = stream[3];
+			break;
 		}
 
 		stream += opcode.wordCount;
 	}
+
+	// Compute local size given with constants (LocalSizeId or the WorkgroupSize builtin, used by the specialization constants)
+	if (localSizeIds[0] != 0)
+	{
+		for (int i = 0; i < 3; ++i)
+		{
+			reflection.mLocalSize[i] = ids[localSizeIds[i]].constant;
+			reflection.mLocalSizeSpecIds[i] = ids[localSizeIds[i]].specId;
+		}
+	}
+	for (const SpirvId& id : ids)
+	{
+		if (id.workgroupSize && id.members.size() == 3)
+		{
+			for (int i = 0; i < 3; ++i)
+			{
+				reflection.mLocalSize[i] = ids[id.members[i]].constant;
+				reflection.mLocalSizeSpecIds[i] = ids[id.members[i]].specId;
+			}
+		}
+	}
+
+	// Resources
+	for (const SpirvId& id : ids)
+	{
+		if (id.opcode != SpvOpVariable)
+			continue;
+
+		const SpirvId& pointer = ids[id.typeId];
+		assert(pointer.opcode == SpvOpTypePointer);
+
+		if (id.storageClass == SpvStorageClassPushConstant)
+		{
+			reflection.mPushConstantSize = std::max(reflection.mPushConstantSize, getTypeSize(ids, pointer.typeId));
+			continue;
+		}
+
+		if (id.storageClass != SpvStorageClassUniform && id.storageClass != SpvStorageClassUniformConstant && id.storageClass != SpvStorageClassStorageBuffer)
+			continue;
+		assert(id.set != ~0u && id.binding != ~0u && "parseSpirv : resource without set/binding");
+
+		// Arrays of resources
+		uint32_t typeId = pointer.typeId;
+		uint32_t count = 1;
+		if (ids[typeId].opcode == SpvOpTypeArray)
+		{
+			count = ids[ids[typeId].lengthId].constant;
+			typeId = ids[typeId].typeId;
+		}
+		else if (ids[typeId].opcode == SpvOpTypeRuntimeArray)
+		{
+			count = 0;
+			typeId = ids[typeId].typeId;
+		}
+
+		ShaderReflection::Binding binding;
+		binding.mSet = id.set;
+		binding.mBinding = id.binding;
+		binding.mType = getDescriptorType(ids, id.storageClass, typeId);
+		binding.mCount = count;
+		binding.mStages = pShader.mStage;
+		assert(binding.mType != VK_DESCRIPTOR_TYPE_MAX_ENUM && "parseSpirv : unknown resource type");
+		reflection.mBindings.push_back(binding);
+	}
+
+	std::sort(reflection.mBindings.begin(), reflection.mBindings.end(), [](const ShaderReflection::Binding& a, const ShaderReflection::Binding& b)
+	{
+		return a.mSet != b.mSet ? a.mSet < b.mSet : a.mBinding < b.mBinding;
+	});
 }
 
 /*****************************************************************************/
 VulkanShader VulkanShader::loadFromFile(VkDevice pDevice, const std::string& pFilename)
 {
 	VulkanShader lShader = {};
-	FILE* file = fopen(pFilename.c_str(), "rb");
-	if (file)
-	{
-		fseek(file, 0, SEEK_END);
-		long bytesSize = ftell(file);
-		assert(bytesSize);
-		fseek(file, 0, SEEK_SET);
-
-		char* code = (char*)malloc(bytesSize);
-		assert(code);
-		size_t bytesRead = fread(code, 1, bytesSize, file);
-		assert(bytesRead == bytesSize);
-		assert(bytesRead % 4 == 0);
-
-		// Extract information directly from spirv
-		parseSpirv(lShader, (const uint32_t*)code, bytesSize / 4);
-
-		VkShaderModuleCreateInfo lCreateInfo = { VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO };
-		//VkShaderModuleCreateFlags    flags;
-		lCreateInfo.codeSize = bytesSize;			// size in bytes
-		lCreateInfo.pCode = (const uint32_t*)code;	// must be an array of codeSize/4
-
-		VkShaderModule lShaderModule = {};
-		VK_CHECK(vkCreateShaderModule(pDevice, &lCreateInfo, nullptr, &lShaderModule));
-		lShader.mShaderModule = lShaderModule;
-		free(code);
+	// Mapped: no read in a temporary buffer, the mapping is closed on return so the spirv is copied in mCode
+	MappedFile file;
+	if (file.open(pFilename.c_str()))
+	{
+		assert(file.mSize % 4 == 0);
+		lShader = loadFromCode(pDevice, (const uint32_t*)file.mData, file.mSize / 4);
 	}
 
 	return lShader;
+}
+
+/*****************************************************************************/
+VulkanShader VulkanShader::loadFromCode(VkDevice pDevice, const uint32_t* pCode, size_t pCodeSize)
+{
+	VulkanShader lShader = {};
+
+	// Extract information directly from spirv
+	parseSpirv(lShader, pCode, (uint32_t)pCodeSize);
+
+	VkShaderModuleCreateInfo lCreateInfo = { VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO };
+	//VkShaderModuleCreateFlags    flags;
+	lCreateInfo.codeSize = pCodeSize * sizeof(uint32_t);	// size in bytes
+	lCreateInfo.pCode = pCode;								// must be an array of codeSize/4
+
+	VkShaderModule lShaderModule = {};
+	VK_CHECK(vkCreateShaderModule(pDevice, &lCreateInfo, nullptr, &lShaderModule));
+	lShader.mShaderModule = lShaderModule;
+	lShader.mCode.assign(pCode, pCode + pCodeSize);
+
+	return lShader;
+}
+
+/*****************************************************************************/
+// Registers of a value of the type: 32 bits components
+static uint32_t getComponentCount(const std::vector<uint32_t>& components, const uint32_t* instruction, uint32_t opcode)
+{
+	switch (opcode)
+	{
+	case SpvOpTypeBool:		return 1;
+	case SpvOpTypeInt:
+	case SpvOpTypeFloat:	return instruction[2] > 32 ? 2 : 1;
+	case SpvOpTypeVector:
+	case SpvOpTypeMatrix:	return instruction[3] * components[instruction[2]];
+	default:				return 1;	// Pointers and handles, the aggregates are rarely loaded as a whole
+	}
+}
+
+/*****************************************************************************/
+// Peak of the registers used by the values of a function
+// The intervals follow the order of the instructions, not of the execution:
+// the values live across a loop back edge are underestimated.
+static uint32_t getRegisterPeak(const std::vector<uint32_t>& values, const std::vector<uint32_t>& components,
+	const std::vector<uint32_t>& definition, const std::vector<uint32_t>& lastUse)
+{
+	std::vector<std::pair<uint32_t, int32_t>> events;
+	events.reserve(values.size() * 2);
+	for (uint32_t id : values)
+	{
+		events.push_back({ definition[id], (int32_t)components[id] });
+		events.push_back({ lastUse[id] + 1, -(int32_t)components[id] });
+	}
+	// Ends before starts at the same instruction
+	std::sort(events.begin(), events.end());
+
+	int32_t live = 0;
+	int32_t peak = 0;
+	for (const std::pair<uint32_t, int32_t>& event : events)
+	{
+		live += event.second;
+		peak = std::max(peak, live);
+	}
+	return (uint32_t)peak;
+}
+
+/*****************************************************************************/
+ShaderStats analyzeSpirv(const uint32_t* code, uint32_t codeSize)
+{
+	assert(code[0] == SpvMagicNumber);
+
+	ShaderStats stats;
+	stats.mSize = codeSize * sizeof(uint32_t);
+
+	const uint32_t idBound = code[3];
+	std::vector<uint32_t> components(idBound, 1);		// Of the types and of the values
+	std::vector<uint32_t> definition(idBound, ~0u);		// Instruction index in the current function
+	std::vector<uint32_t> lastUse(idBound, 0);
+	std::vector<uint32_t> values;						// Of the current function
+	bool inFunction = false;
+	uint32_t index = 0;
+
+	const uint32_t* stream = code + 5;
+	while (stream < code + codeSize)
+	{
+		const uint32_t opcode = *stream & 0xffff;
+		const uint32_t wordCount = *stream >> 16;
+		assert(wordCount > 0 && stream + wordCount <= code + codeSize);
+
+		switch (opcode)
+		{
+		case SpvOpTypeBool:
+		case SpvOpTypeInt:
+		case SpvOpTypeFloat:
+		case SpvOpTypeVector:
+		case SpvOpTypeMatrix:
+			components[stream[1]] = getComponentCount(components, stream, opcode);
+			break;
+		case SpvOpFunction:
+			inFunction = true;
+			values.clear();
+			index = 0;
+			break;
+		case SpvOpFunctionEnd:
+			stats.mRegisterEstimate = std::max(stats.mRegisterEstimate, getRegisterPeak(values, components, definition, lastUse));
+			for (uint32_t id : values)
+				definition[id] = ~0u;
+			inFunction = false;
+			break;
+		case SpvOpLoopMerge:
+			++stats.mLoopCount;
+			break;
+		case SpvOpImageSampleImplicitLod: case SpvOpImageSampleExplicitLod:
+		case SpvOpImageSampleDrefImplicitLod: case SpvOpImageSampleDrefExplicitLod:
+		case SpvOpImageSampleProjImplicitLod: case SpvOpImageSampleProjExplicitLod:
+		case SpvOpImageSampleProjDrefImplicitLod: case SpvOpImageSampleProjDrefExplicitLod:
+		case SpvOpImageFetch: case SpvOpImageGather: case SpvOpImageDrefGather:
+		case SpvOpImageSparseSampleImplicitLod: case SpvOpImageSparseSampleExplicitLod:
+		case SpvOpImageSparseSampleDrefImplicitLod: case SpvOpImageSparseSampleDrefExplicitLod:
+		case SpvOpImageSparseFetch: case SpvOpImageSparseGather: case SpvOpImageSparseDrefGather:
+			++stats.mTextureSampleCount;
+			break;
+		}
+
+		if (inFunction && opcode != SpvOpFunction)
+		{
+			++index;
+			if (opcode != SpvOpFunctionParameter && opcode != SpvOpLabel && opcode != SpvOpVariable && opcode != SpvOpLine && opcode != SpvOpNoLine)
+				++stats.mInstructionCount;
+
+			bool hasResult = false;
+			bool hasResultType = false;
+			SpvHasResultAndType(SpvOp(opcode), &hasResult, &hasResultType);
+			uint32_t operand = 1 + (hasResult ? 1 : 0) + (hasResultType ? 1 : 0);
+
+			// The values (typed results), the function variables are memory
+			if (hasResult && hasResultType && opcode != SpvOpVariable)
+			{
+				const uint32_t id = stream[2];
+				definition[id] = index;
+				lastUse[id] = index;
+				components[id] = components[stream[1]];
+				values.push_back(id);
+			}
+
+			// Any operand matching a value of the function is a use (a literal may be taken for an id)
+			for (; operand < wordCount; ++operand)
+			{
+				const uint32_t id = stream[operand];
+				if (id < idBound && definition[id] != ~0u)
+					lastUse[id] = std::max(lastUse[id], index);
+			}
+		}
+
+		stream += wordCount;
+	}
+
+	return stats;
 }
\ No newline at end of file
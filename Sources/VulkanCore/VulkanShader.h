@@ -2,14 +2,59 @@
 
 #include "vk_common.h"
 #include <string>
+#include <vector>
+
+// Resources used by a shader, extracted from its spirv (OpDecorate/OpVariable)
+struct ShaderReflection
+{
+    struct Binding
+    {
+        uint32_t mSet;
+        uint32_t mBinding;
+        VkDescriptorType mType;
+        uint32_t mCount;                // Array size, 0 for a runtime array (unbounded)
+        VkShaderStageFlags mStages;
+    };
+
+    std::vector<Binding> mBindings;     // Sorted by set/binding
+    uint32_t mPushConstantSize = 0;     // Size of the push constant block, 0 if none
+    uint32_t mLocalSize[3] = { 0, 0, 0 };   // Compute LocalSize (default values of the specialization constants)
+    uint32_t mLocalSizeSpecIds[3] = { ~0u, ~0u, ~0u };    // constant_id of the local_size_*_id, ~0u for the fixed sizes
+
+    inline bool hasSpecializedLocalSize() const { return mLocalSizeSpecIds[0] != ~0u; }
+};
 
 struct VulkanShader
 {
     // Load a shader from a file (Spirv file)
     static VulkanShader loadFromFile(VkDevice pDevice, const std::string& pFilename);
+    // Create a shader from spirv in memory (ex: ShaderCompiler), pCodeSize in uint32_t
+    static VulkanShader loadFromCode(VkDevice pDevice, const uint32_t* pCode, size_t pCodeSize);
 
     VkShaderModule mShaderModule;
     VkShaderStageFlagBits mStage;
+    ShaderReflection mReflection;
+    std::vector<uint32_t> mCode;        // Spirv copied for the shader objects, empty when mMappedCode is used
+    const uint32_t* mMappedCode = nullptr;  // Spirv not owned (ShaderArchive mapping), valid while its owner lives
+    uint32_t mMappedCodeSize = 0;           // In uint32_t
 
     inline bool isValid() const { return mShaderModule != VK_NULL_HANDLE; }
-};
\ No newline at end of file
+    // Spirv of the shader, for the shader objects (see ShaderObjects)
+    inline const uint32_t* code() const { return mCode.empty() ? mMappedCode : mCode.data(); }
+    inline size_t codeSize() const { return mCode.empty() ? mMappedCodeSize : mCode.size(); }
+};
+
+// Fill the stage and the reflection of the shader from its spirv
+void parseSpirv(VulkanShader& pShader, const uint32_t* pCode, uint32_t pCodeSize);
+
+// Static cost of a shader, measured on its spirv (not on the driver compilation)
+struct ShaderStats
+{
+    uint32_t mSize = 0;                 // Bytes
+    uint32_t mInstructionCount = 0;     // In the functions
+    uint32_t mLoopCount = 0;
+    uint32_t mTextureSampleCount = 0;   // Samples, fetches and gathers
+    uint32_t mRegisterEstimate = 0;     // Peak of the 32 bits components alive at once
+};
+
+ShaderStats analyzeSpirv(const uint32_t* pCode, uint32_t pCodeSize);
@@ -0,0 +1,373 @@
+#include "VulkanShaderArchive.h"
+
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
+#include <type_traits>
+
+namespace
+{
+    const uint32_t cSpirvMagic = 0x07230203;
+
+    static_assert(sizeof(ShaderArchive::Header) == 24 && sizeof(ShaderArchive::Entry) == 32, "ShaderArchive : the file layout changed, bump cVersion");
+    static_assert(std::is_trivially_copyable<ShaderReflection::Binding>::value, "ShaderArchive : the bindings are copied from the file");
+
+    // FNV-1a
+    uint64_t hashBytes(const void* pData, size_t pSize)
+    {
+        uint64_t lHash = 14695981039346656037ull;
+        const uint8_t* lBytes = (const uint8_t*)pData;
+        for (size_t i = 0; i < pSize; ++i)
+            lHash = (lHash ^ lBytes[i]) * 1099511628211ull;
+        return lHash;
+    }
+
+    void append(std::vector<uint8_t>& pData, const void* pValue, size_t pSize)
+    {
+        const uint8_t* lBytes = (const uint8_t*)pValue;
+        pData.insert(pData.end(), lBytes, lBytes + pSize);
+    }
+}
+
+/******************************************************************************/
+bool ShaderArchive::init(VkDevice pDevice, const std::string& pFilename)
+{
+    assert(mDevice == VK_NULL_HANDLE && "ShaderArchive : already initialized");
+    const auto lStart = std::chrono::steady_clock::now();
+
+    if (!mFile.open(pFilename.c_str()))
+    {
+        printf("ShaderArchive : can't open %s\n", pFilename.c_str());
+        return false;
+    }
+
+    // Only the index and the reflection pages are touched, the spirv is paged in by get()
+    const uint64_t lSize = mFile.mSize;
+    const Header* lHeader = (const Header*)mFile.mData;
+    bool lValid = lSize >= sizeof(Header) && lHeader->mMagic == cMagic && lHeader->mVersion == cVersion && lHeader->mSize == lSize
+        && lHeader->mBucketCount > lHeader->mShaderCount && (lHeader->mBucketCount & (lHeader->mBucketCount - 1)) == 0
+        && sizeof(Header) + (uint64_t)lHeader->mShaderCount * sizeof(Entry) + (uint64_t)lHeader->mBucketCount * sizeof(uint32_t) <= lSize;
+
+    const Entry* lEntries = (const Entry*)(mFile.mData + sizeof(Header));
+    const uint32_t* lBuckets = lValid ? (const uint32_t*)(lEntries + lHeader->mShaderCount) : nullptr;
+    for (uint32_t i = 0; lValid && i < lHeader->mBucketCount; ++i)
+        lValid = lBuckets[i] == ~0u || lBuckets[i] < lHeader->mShaderCount;
+    for (uint32_t i = 0; lValid && i < lHeader->mShaderCount; ++i)
+    {
+        const Entry& lEntry = lEntries[i];
+        lValid = (uint64_t)lEntry.mNameOffset + lEntry.mNameLength <= lSize
+            && lEntry.mCodeOffset % sizeof(uint32_t) == 0 && lEntry.mCodeSize > 0 && (uint64_t)lEntry.mCodeOffset + (uint64_t)lEntry.mCodeSize * sizeof(uint32_t) <= lSize
+            && lEntry.mReflectionOffset % sizeof(uint32_t) == 0 && (uint64_t)lEntry.mReflectionOffset + sizeof(Reflection) <= lSize;
+        if (lValid)
+        {
+            const Reflection* lReflection = (const Reflection*)(mFile.mData + lEntry.mReflectionOffset);
+            lValid = (uint64_t)lEntry.mReflectionOffset + sizeof(Reflection) + (uint64_t)lReflection->mBindingCount * sizeof(ShaderReflection::Binding) <= lSize;
+        }
+    }
+    if (!lValid)
+    {
+        printf("ShaderArchive : %s is not a valid archive (version %u expected)\n", pFilename.c_str(), cVersion);
+        mFile.close();
+        return false;
+    }
+
+    mDevice = pDevice;
+    mFilename = pFilename;
+    mHeader = lHeader;
+    mEntries = lEntries;
+    mBuckets = lBuckets;
+    mShaders.assign(lHeader->mShaderCount, nullptr);
+    mOpenMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - lStart).count();
+    mModuleMs = 0.0;
+    return true;
+}
+
+/******************************************************************************/
+void ShaderArchive::destroy()
+{
+    for (const VulkanShader& lModule : mModules)
+        vkDestroyShaderModule(mDevice, lModule.mShaderModule, nullptr);
+    mModules.clear();
+    mModuleByCode.clear();
+    mShaders.clear();
+
+    mHeader = nullptr;
+    mEntries = nullptr;
+    mBuckets = nullptr;
+    mFile.close();
+    mDevice = VK_NULL_HANDLE;
+}
+
+/******************************************************************************/
+const VulkanShader& ShaderArchive::get(const std::string& pName)
+{
+    const uint32_t lIndex = find(pName);
+    if (lIndex == ~0u)
+    {
+        printf("ShaderArchive : %s is not in %s\n", pName.c_str(), mFilename.c_str());
+        return mInvalid;
+    }
+
+    std::lock_guard<std::mutex> lLock(mMutex);
+    if (mShaders[lIndex] != nullptr)
+        return *mShaders[lIndex];
+
+    // The identical spirv was packed once, its offset identifies the module
+    const Entry& lEntry = mEntries[lIndex];
+    auto lModule = mModuleByCode.find(lEntry.mCodeOffset);
+    if (lModule == mModuleByCode.end())
+    {
+        const auto lStart = std::chrono::steady_clock::now();
+        mModules.push_back(createShader(lEntry));
+        mModuleMs += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - lStart).count();
+        lModule = mModuleByCode.insert({ lEntry.mCodeOffset, (uint32_t)mModules.size() - 1 }).first;
+    }
+    mShaders[lIndex] = &mModules[lModule->second];
+    return *mShaders[lIndex];
+}
+
+/******************************************************************************/
+ShaderArchive::Stats ShaderArchive::getStats() const
+{
+    std::lock_guard<std::mutex> lLock(mMutex);
+    Stats lStats;
+    lStats.mShaders = mHeader != nullptr ? mHeader->mShaderCount : 0;
+    lStats.mModules = (uint32_t)mModules.size();
+    lStats.mOpenMs = mOpenMs;
+    lStats.mModuleMs = mModuleMs;
+    return lStats;
+}
+
+/******************************************************************************/
+bool ShaderArchive::write(const std::string& pFilename, const std::vector<Input>& pInputs)
+{
+    // Sections built apart, their offsets are made absolute once the sizes are known
+    std::vector<Entry> lEntries;
+    std::vector<uint8_t> lReflections;
+    std::vector<uint8_t> lNames;
+    std::vector<uint32_t> lCode;
+    std::unordered_map<std::string, uint32_t> lNameIndices;
+    std::unordered_multimap<uint64_t, uint32_t> lCodeByHash;   // Hash of the spirv -> lCode offset
+
+    for (const Input& lInput : pInputs)
+    {
+        if (lInput.mCode == nullptr || lInput.mCodeSize < 5 || lInput.mCode[0] != cSpirvMagic)
+        {
+            printf("ShaderArchive : %s is not spirv, not packed\n", lInput.mName.c_str());
+            continue;
+        }
+        if (!lNameIndices.insert({ lInput.mName, (uint32_t)lEntries.size() }).second)
+        {
+            printf("ShaderArchive : %s packed twice, the first one is kept\n", lInput.mName.c_str());
+            continue;
+        }
+
+        VulkanShader lShader = {};
+        parseSpirv(lShader, lInput.mCode, lInput.mCodeSize);
+        const ShaderReflection& lReflection = lShader.mReflection;
+
+        Entry lEntry = {};
+        lEntry.mNameHash = hashBytes(lInput.mName.data(), lInput.mName.size());
+        lEntry.mNameOffset = (uint32_t)lNames.size();
+        lEntry.mNameLength = (uint32_t)lInput.mName.size();
+        append(lNames, lInput.mName.data(), lInput.mName.size());
+        lEntry.mStage = (uint32_t)lShader.mStage;
+
+        Reflection lHeader = {};
+        lHeader.mPushConstantSize = lReflection.mPushConstantSize;
+        memcpy(lHeader.mLocalSize, lReflection.mLocalSize, sizeof(lHeader.mLocalSize));
+        memcpy(lHeader.mLocalSizeSpecIds, lReflection.mLocalSizeSpecIds, sizeof(lHeader.mLocalSizeSpecIds));
+        lHeader.mBindingCount = (uint32_t)lReflection.mBindings.size();
+        lEntry.mReflectionOffset = (uint32_t)lReflections.size();
+        append(lReflections, &lHeader, sizeof(lHeader));
+        append(lReflections, lReflection.mBindings.data(), lReflection.mBindings.size() * sizeof(ShaderReflection::Binding));
+
+        const size_t lCodeBytes = lInput.mCodeSize * sizeof(uint32_t);
+        const uint64_t lCodeHash = hashBytes(lInput.mCode, lCodeBytes);
+        uint32_t lCodeOffset = ~0u;
+        auto lRange = lCodeByHash.equal_range(lCodeHash);
+        for (auto lIt = lRange.first; lIt != lRange.second && lCodeOffset == ~0u; ++lIt)
+        {
+            if (lEntries[lIt->second].mCodeSize == lInput.mCodeSize && memcmp(&lCode[lEntries[lIt->second].mCodeOffset], lInput.mCode, lCodeBytes) == 0)
+                lCodeOffset = lEntries[lIt->second].mCodeOffset;
+        }
+        if (lCodeOffset == ~0u)
+        {
+            lCodeOffset = (uint32_t)lCode.size();
+            lCode.insert(lCode.end(), lInput.mCode, lInput.mCode + lInput.mCodeSize);
+            lCodeByHash.insert({ lCodeHash, (uint32_t)lEntries.size() });
+        }
+        lEntry.mCodeOffset = lCodeOffset;      // In uint32_t until the layout below
+        lEntry.mCodeSize = lInput.mCodeSize;
+        lEntries.push_back(lEntry);
+    }
+
+    // At most half full, a probe ends on an empty bucket
+    uint32_t lBucketCount = 1;
+    while (lBucketCount <= lEntries.size() * 2)
+        lBucketCount *= 2;
+    std::vector<uint32_t> lBuckets(lBucketCount, ~0u);
+    for (uint32_t i = 0; i < (uint32_t)lEntries.size(); ++i)
+    {
+        uint32_t lBucket = (uint32_t)lEntries[i].mNameHash & (lBucketCount - 1);
+        while (lBuckets[lBucket] != ~0u)
+            lBucket = (lBucket + 1) & (lBucketCount - 1);
+        lBuckets[lBucket] = i;
+    }
+
+    // Header | entries | buckets | reflections | names | spirv, the spirv last and 4 bytes aligned
+    while (lNames.size() % sizeof(uint32_t) != 0)
+        lNames.push_back(0);
+    const uint64_t lReflectionsBase = sizeof(Header) + lEntries.size() * sizeof(Entry) + lBuckets.size() * sizeof(uint32_t);
+    const uint64_t lNamesBase = lReflectionsBase + lReflections.size();
+    const uint64_t lCodeBase = lNamesBase + lNames.size();
+    const uint64_t lSize = lCodeBase + lCode.size() * sizeof(uint32_t);
+    if (lSize > UINT32_MAX)
+    {
+        printf("ShaderArchive : %s over 4 GB, offsets are 32 bits\n", pFilename.c_str());
+        return false;
+    }
+    for (Entry& lEntry : lEntries)
+    {
+        lEntry.mReflectionOffset += (uint32_t)lReflectionsBase;
+        lEntry.mNameOffset += (uint32_t)lNamesBase;
+        lEntry.mCodeOffset = (uint32_t)(lCodeBase + lEntry.mCodeOffset * sizeof(uint32_t));
+    }
+
+    Header lHeader = {};
+    lHeader.mMagic = cMagic;
+    lHeader.mVersion = cVersion;
+    lHeader.mShaderCount = (uint32_t)lEntries.size();
+    lHeader.mBucketCount = lBucketCount;
+    lHeader.mSize = lSize;
+
+    std::vector<uint8_t> lData;
+    lData.reserve((size_t)lSize);
+    append(lData, &lHeader, sizeof(lHeader));
+    append(lData, lEntries.data(), lEntries.size() * sizeof(Entry));
+    append(lData, lBuckets.data(), lBuckets.size() * sizeof(uint32_t));
+    append(lData, lReflections.data(), lReflections.size());
+    append(lData, lNames.data(), lNames.size());
+    append(lData, lCode.data(), lCode.size() * sizeof(uint32_t));
+    assert(lData.size() == lSize);
+
+    // Write aside then rename (see PipelineCache), a running process may have the archive mapped
+    const std::string lTempFilename = pFilename + ".tmp";
+    FILE* lFile = fopen(lTempFilename.c_str(), "wb");
+    if (lFile == nullptr)
+    {
+        printf("ShaderArchive : can't write %s\n", lTempFilename.c_str());
+        return false;
+    }
+    bool lWritten = fwrite(lData.data(), 1, lData.size(), lFile) == lData.size();
+    lWritten = fclose(lFile) == 0 && lWritten;
+
+    std::error_code lError;
+    if (lWritten)
+        std::filesystem::rename(lTempFilename, pFilename, lError);
+    if (!lWritten || lError)
+    {
+        printf("ShaderArchive : failed to save %s\n", pFilename.c_str());
+        std::filesystem::remove(lTempFilename, lError);
+        return false;
+    }
+
+    printf("ShaderArchive : %u shaders packed in %s (%u KB)\n", lHeader.mShaderCount, pFilename.c_str(), (uint32_t)(lSize / 1024));
+    return true;
+}
+
+/******************************************************************************/
+bool ShaderArchive::build(const std::string& pFilename, const std::string& pFolder)
+{
+    namespace fs = std::filesystem;
+    std::error_code lError;
+    const fs::file_time_type lArchiveTime = fs::last_write_time(pFilename, lError);
+    bool lOutdated = (bool)lError;
+
+    std::vector<fs::path> lPaths;
+    lError.clear();
+    for (fs::directory_iterator lIt(pFolder, lError), lEnd; !lError && lIt != lEnd; lIt.increment(lError))
+    {
+        if (!lIt->is_regular_file(lError) || lIt->path().extension() != ".spv")
+            continue;
+        lPaths.push_back(lIt->path());
+        lOutdated = lOutdated || lIt->last_write_time(lError) > lArchiveTime;
+    }
+
+    // A deleted or added spirv doesn't change the times: compare the names of the archive (no module created)
+    if (!lOutdated)
+    {
+        ShaderArchive lArchive;
+        lOutdated = !lArchive.init(VK_NULL_HANDLE, pFilename) || lArchive.mHeader->mShaderCount != lPaths.size();
+        for (size_t i = 0; !lOutdated && i < lPaths.size(); ++i)
+            lOutdated = !lArchive.contains(lPaths[i].stem().generic_string());
+        lArchive.destroy();
+    }
+    if (!lOutdated)
+        return true;
+
+    // Sorted, the same spirv gives the same archive
+    std::sort(lPaths.begin(), lPaths.end());
+    std::vector<MappedFile> lFiles(lPaths.size());
+    std::vector<Input> lInputs;
+    for (size_t i = 0; i < lPaths.size(); ++i)
+    {
+        const std::string lPath = lPaths[i].generic_string();
+        if (!lFiles[i].open(lPath.c_str()) || lFiles[i].mSize % sizeof(uint32_t) != 0)
+        {
+            printf("ShaderArchive : can't read %s\n", lPath.c_str());
+            continue;
+        }
+        lInputs.push_back({ lPaths[i].stem().generic_string(), (const uint32_t*)lFiles[i].mData, (uint32_t)(lFiles[i].mSize / sizeof(uint32_t)) });
+    }
+    return write(pFilename, lInputs);
+}
+
+/******************************************************************************/
+/******************************************************************************/
+/******************************************************************************/
+uint32_t ShaderArchive::find(const std::string& pName) const
+{
+    if (mHeader == nullptr)
+        return ~0u;
+
+    const uint64_t lHash = hashBytes(pName.data(), pName.size());
+    const uint32_t lMask = mHeader->mBucketCount - 1;
+    for (uint32_t lBucket = (uint32_t)lHash & lMask; ; lBucket = (lBucket + 1) & lMask)
+    {
+        const uint32_t lIndex = mBuckets[lBucket];
+        if (lIndex == ~0u)
+            return ~0u;
+        const Entry& lEntry = mEntries[lIndex];
+        if (lEntry.mNameHash == lHash && lEntry.mNameLength == pName.size() && memcmp(mFile.mData + lEntry.mNameOffset, pName.data(), pName.size()) == 0)
+            return lIndex;
+    }
+}
+
+/******************************************************************************/
+VulkanShader ShaderArchive::createShader(const Entry& pEntry) const
+{
+    VulkanShader lShader = {};
+    lShader.mStage = (VkShaderStageFlagBits)pEntry.mStage;
+
+    // Reflection from the archive, the spirv is not parsed
+    const Reflection* lReflection = (const Reflection*)(mFile.mData + pEntry.mReflectionOffset);
+    const ShaderReflection::Binding* lBindings = (const ShaderReflection::Binding*)(lReflection + 1);
+    lShader.mReflection.mPushConstantSize = lReflection->mPushConstantSize;
+    memcpy(lShader.mReflection.mLocalSize, lReflection->mLocalSize, sizeof(lReflection->mLocalSize));
+    memcpy(lShader.mReflection.mLocalSizeSpecIds, lReflection->mLocalSizeSpecIds, sizeof(lReflection->mLocalSizeSpecIds));
+    lShader.mReflection.mBindings.assign(lBindings, lBindings + lReflection->mBindingCount);
+
+    // Straight from the mapping, the shader objects read it there too (no copy in mCode)
+    const uint32_t* lCode = (const uint32_t*)(mFile.mData + pEntry.mCodeOffset);
+    VkShaderModuleCreateInfo lCreateInfo = { VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO };
+    lCreateInfo.codeSize = pEntry.mCodeSize * sizeof(uint32_t);
+    lCreateInfo.pCode = lCode;
+    VK_CHECK(vkCreateShaderModule(mDevice, &lCreateInfo, nullptr, &lShader.mShaderModule));
+    lShader.mMappedCode = lCode;
+    lShader.mMappedCodeSize = pEntry.mCodeSize;
+    return lShader;
+}
@@ -0,0 +1,104 @@
+#pragma once
+
+#include "vk_common.h"
+#include "VulkanShader.h"
+#include "MappedFile.h"
+
+#include <deque>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Spirv of many shaders packed in a single file, memory mapped once
+// The file holds a hashed index (name -> shader), the stage and reflection of each shader (no spirv parsing
+// at load) and the spirv, identical spirv stored once. Loading the shaders is a few page faults instead
+// of an open/read per file.
+// The shader modules are created on the first get() of a name; the names sharing the same spirv share
+// the module. The mapping, native endian, stays open until destroy(): the shaders point at their spirv in it
+// (VulkanShader::mMappedCode) for the shader objects.
+// Thread safe, except init/destroy.
+struct ShaderArchive
+{
+    struct Stats
+    {
+        uint32_t mShaders = 0;              // In the archive
+        uint32_t mModules = 0;              // Created
+        double mOpenMs = 0.0;
+        double mModuleMs = 0.0;             // Summed vkCreateShaderModule
+    };
+
+    // Spirv to pack, pCode not copied before write()
+    struct Input
+    {
+        std::string mName;
+        const uint32_t* mCode;
+        uint32_t mCodeSize;                 // In uint32_t
+    };
+
+    bool init(VkDevice pDevice, const std::string& pFilename);
+    void destroy();
+
+    inline bool contains(const std::string& pName) const { return find(pName) != ~0u; }
+    // Shader packed as pName, invalid shader if absent. The reference stays valid until destroy().
+    const VulkanShader& get(const std::string& pName);
+
+    Stats getStats() const;
+
+    static bool write(const std::string& pFilename, const std::vector<Input>& pInputs);
+    // Pack the spirv files of pFolder (name.glsl.spv packed as name.glsl) when pFilename is missing, older
+    // than one of them or doesn't hold the same names. A shipped build only ships the archive and calls init().
+    static bool build(const std::string& pFilename, const std::string& pFolder);
+
+    static const uint32_t cMagic = 0x41534b56;     // "VKSA"
+    static const uint32_t cVersion = 1;
+
+    struct Header
+    {
+        uint32_t mMagic;
+        uint32_t mVersion;
+        uint32_t mShaderCount;
+        uint32_t mBucketCount;              // Power of 2, open addressing
+        uint64_t mSize;                     // Of the file, truncation check
+    };
+
+    // Offsets in bytes from the start of the file
+    struct Entry
+    {
+        uint64_t mNameHash;
+        uint32_t mNameOffset;
+        uint32_t mNameLength;
+        uint32_t mCodeOffset;               // Shared by the identical spirv
+        uint32_t mCodeSize;                 // In uint32_t
+        uint32_t mReflectionOffset;
+        uint32_t mStage;                    // VkShaderStageFlagBits
+    };
+
+    // Followed by mBindingCount ShaderReflection::Binding
+    struct Reflection
+    {
+        uint32_t mPushConstantSize;
+        uint32_t mLocalSize[3];
+        uint32_t mLocalSizeSpecIds[3];
+        uint32_t mBindingCount;
+    };
+
+    // Index of the entry, ~0u if absent
+    uint32_t find(const std::string& pName) const;
+    VulkanShader createShader(const Entry& pEntry) const;
+
+    VkDevice mDevice = VK_NULL_HANDLE;
+    std::string mFilename;
+    MappedFile mFile;
+    const Header* mHeader = nullptr;
+    const Entry* mEntries = nullptr;
+    const uint32_t* mBuckets = nullptr;
+
+    mutable std::mutex mMutex;
+    std::vector<const VulkanShader*> mShaders;              // Per entry, once created
+    std::deque<VulkanShader> mModules;                      // Stable addresses
+    std::unordered_map<uint32_t, uint32_t> mModuleByCode;   // Entry::mCodeOffset -> mModules index
+    VulkanShader mInvalid = {};
+    double mOpenMs = 0.0;
+    double mModuleMs = 0.0;
+};
@@ -0,0 +1,629 @@
+#include "VulkanShaderCompiler.h"
+#include "MappedFile.h"
+
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+#include <chrono>
+#include <filesystem>
+#include <thread>
+
+#ifdef VULKANCORE_SHADERC
+#include <shaderc/shaderc.h>
+#endif
+#ifdef VULKANCORE_SPIRV_TOOLS
+#include <spirv-tools/libspirv.h>
+#endif
+
+namespace
+{
+    const uint32_t cSpirvMagic = 0x07230203;
+    const uint32_t cMaxIncludeDepth = 32;
+
+    bool readText(const std::string& pPath, std::string& pText)
+    {
+        FILE* lFile = fopen(pPath.c_str(), "rb");
+        if (lFile == nullptr)
+            return false;
+        fseek(lFile, 0, SEEK_END);
+        const long lSize = ftell(lFile);
+        fseek(lFile, 0, SEEK_SET);
+        pText.resize(lSize > 0 ? (size_t)lSize : 0);
+        const bool lRead = pText.empty() || fread(&pText[0], 1, pText.size(), lFile) == pText.size();
+        fclose(lFile);
+        return lRead;
+    }
+
+    void hashBytes(uint64_t& pHash, const void* pData, size_t pSize)
+    {
+        // FNV-1a
+        const uint8_t* lBytes = (const uint8_t*)pData;
+        for (size_t i = 0; i < pSize; ++i)
+            pHash = (pHash ^ lBytes[i]) * 1099511628211ull;
+    }
+
+    void hashString(uint64_t& pHash, const std::string& pValue)
+    {
+        // With the terminator, "ab" + "c" and "a" + "bc" differ
+        hashBytes(pHash, pValue.c_str(), pValue.size() + 1);
+    }
+
+#ifdef VULKANCORE_SHADERC
+    // Stage from name.<stage>.glsl
+    bool getShaderKind(const std::string& pFilename, shaderc_shader_kind& pKind)
+    {
+        struct Extension { const char* mName; shaderc_shader_kind mKind; };
+        const Extension cExtensions[] =
+        {
+            { ".vert.glsl", shaderc_vertex_shader },
+            { ".frag.glsl", shaderc_fragment_shader },
+            { ".comp.glsl", shaderc_compute_shader },
+            { ".geom.glsl", shaderc_geometry_shader },
+            { ".tesc.glsl", shaderc_tess_control_shader },
+            { ".tese.glsl", shaderc_tess_evaluation_shader },
+            { ".task.glsl", shaderc_task_shader },
+            { ".mesh.glsl", shaderc_mesh_shader },
+        };
+        for (const Extension& lExtension : cExtensions)
+        {
+            const size_t lLength = strlen(lExtension.mName);
+            if (pFilename.size() > lLength && pFilename.compare(pFilename.size() - lLength, lLength, lExtension.mName) == 0)
+            {
+                pKind = lExtension.mKind;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // The includes are served from the sources read for the key, the compiled text is the hashed one
+    struct IncludeContext
+    {
+        const ShaderCompiler* mCompiler;
+        const ShaderCompiler::Sources* mSources;
+    };
+
+    struct IncludeResult
+    {
+        shaderc_include_result mResult;
+        std::string mName;
+        std::string mError;
+    };
+
+    shaderc_include_result* onInclude(void* pUserData, const char* pRequested, int /*pType*/, const char* pRequesting, size_t /*pDepth*/)
+    {
+        const IncludeContext* lContext = (const IncludeContext*)pUserData;
+        IncludeResult* lInclude = new IncludeResult;
+        lInclude->mResult = {};
+        lInclude->mResult.user_data = lInclude;
+
+        const std::string lPath = lContext->mCompiler->resolveInclude(pRequested, pRequesting);
+        const ShaderCompiler::SourceFile* lFile = lPath.empty() ? nullptr : lContext->mSources->find(lPath);
+        if (lFile == nullptr)
+        {
+            // Empty source_name and the error message as content
+            lInclude->mError = std::string("can't find ") + pRequested;
+            lInclude->mResult.content = lInclude->mError.c_str();
+            lInclude->mResult.content_length = lInclude->mError.size();
+            return &lInclude->mResult;
+        }
+        lInclude->mName = lFile->mPath;
+        lInclude->mResult.source_name = lInclude->mName.c_str();
+        lInclude->mResult.source_name_length = lInclude->mName.size();
+        lInclude->mResult.content = lFile->mText.c_str();
+        lInclude->mResult.content_length = lFile->mText.size();
+        return &lInclude->mResult;
+    }
+
+    void onIncludeRelease(void* /*pUserData*/, shaderc_include_result* pResult)
+    {
+        delete (IncludeResult*)pResult->user_data;
+    }
+#endif
+}
+
+/******************************************************************************/
+const ShaderCompiler::SourceFile* ShaderCompiler::Sources::find(const std::string& pPath) const
+{
+    for (const SourceFile& lFile : mFiles)
+    {
+        if (lFile.mPath == pPath)
+            return &lFile;
+    }
+    return nullptr;
+}
+
+/******************************************************************************/
+void ShaderCompiler::init(const Settings& pSettings)
+{
+    mSettings = pSettings;
+    mWorkers.init(pSettings.mThreadCount, "ShaderCompiler");
+    mCompiled = 0;
+    mCacheHits = 0;
+    mFailed = 0;
+    mCompileNs = 0;
+    mOptimizeNs = 0;
+    mModuleNs = 0;
+    mReport.clear();
+
+#ifdef VULKANCORE_SHADERC
+    mCompiler = shaderc_compiler_initialize();
+    assert(mCompiler && "ShaderCompiler : shaderc initialization failed");
+#else
+    printf("ShaderCompiler : built without shaderc, only the cached and prebuilt spirv can be loaded\n");
+#endif
+}
+
+/******************************************************************************/
+void ShaderCompiler::shutdown()
+{
+    mWorkers.shutdown();
+
+    const Stats lStats = getStats();
+    printf("ShaderCompiler : %u compiled, %u from cache, %u failed (%.1f ms, optimization %.1f ms), modules created in %.1f ms\n",
+        lStats.mCompiled, lStats.mCacheHits, lStats.mFailed, lStats.mCompileMs, lStats.mOptimizeMs, lStats.mModuleMs);
+    writeReport();
+
+#ifdef VULKANCORE_SHADERC
+    if (mCompiler != nullptr)
+        shaderc_compiler_release((shaderc_compiler_t)mCompiler);
+#endif
+    mCompiler = nullptr;
+}
+
+/******************************************************************************/
+ShaderCompiler::Result ShaderCompiler::compile(const std::string& pFilename, const std::vector<Define>& pDefines)
+{
+    const auto lStart = std::chrono::steady_clock::now();
+
+    Result lResult;
+    lResult.mFilename = pFilename;
+
+    Sources lSources;
+    if (!readSources(pFilename, lSources))
+    {
+        lResult.mErrors = "can't read " + mSettings.mShaderPath + pFilename;
+        printf("ShaderCompiler : %s\n", lResult.mErrors.c_str());
+        ++mFailed;
+        return lResult;
+    }
+    for (size_t i = 1; i < lSources.mFiles.size(); ++i)
+        lResult.mIncludes.push_back(lSources.mFiles[i].mPath);
+
+    lResult.mHash = computeHash(lSources, pDefines);
+    if (loadCache(lResult.mHash, lResult.mCode))
+    {
+        lResult.mFromCache = true;
+        ++mCacheHits;
+    }
+    else if (compileSource(lSources, pDefines, lResult))
+    {
+        lResult.mUnoptimizedSize = (uint32_t)(lResult.mCode.size() * sizeof(uint32_t));
+        const auto lOptimizeStart = std::chrono::steady_clock::now();
+        if (!optimizeSpirv(lResult.mCode, lResult.mErrors))
+            printf("ShaderCompiler : %s not optimized\n%s\n", pFilename.c_str(), lResult.mErrors.c_str());
+        mOptimizeNs += (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - lOptimizeStart).count();
+
+        ++mCompiled;
+        // Without compiler the spirv is the prebuilt one, not built from the hashed sources
+        if (mCompiler != nullptr)
+            saveCache(lResult.mHash, lResult.mCode);
+        mCompileNs += (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - lStart).count();
+    }
+    else
+    {
+        printf("ShaderCompiler : %s failed\n%s\n", pFilename.c_str(), lResult.mErrors.c_str());
+        lResult.mCode.clear();
+        ++mFailed;
+        return lResult;
+    }
+
+    const std::string lName = getReportName(pFilename, pDefines);
+    lResult.mStats = analyzeSpirv(lResult.mCode.data(), (uint32_t)lResult.mCode.size());
+    if (!lResult.mFromCache)
+    {
+        const ShaderStats& lStats = lResult.mStats;
+        printf("ShaderCompiler : %s %u -> %u bytes, %u instructions, %u loops, %u samples, ~%u registers\n", lName.c_str(),
+            lResult.mUnoptimizedSize, lStats.mSize, lStats.mInstructionCount, lStats.mLoopCount, lStats.mTextureSampleCount, lStats.mRegisterEstimate);
+    }
+    addReport(lName, lResult);
+    return lResult;
+}
+
+/******************************************************************************/
+std::shared_future<ShaderCompiler::Result> ShaderCompiler::compileAsync(const std::string& pFilename, const std::vector<Define>& pDefines)
+{
+    return mWorkers.submit([this, pFilename, pDefines]() { return compile(pFilename, pDefines); }).share();
+}
+
+/******************************************************************************/
+VulkanShader ShaderCompiler::load(VkDevice pDevice, const std::string& pFilename, const std::vector<Define>& pDefines)
+{
+    const Result lResult = compile(pFilename, pDefines);
+    if (!lResult.isValid())
+        return VulkanShader{};
+
+    const auto lStart = std::chrono::steady_clock::now();
+    VulkanShader lShader = VulkanShader::loadFromCode(pDevice, lResult.mCode.data(), lResult.mCode.size());
+    const uint64_t lModuleNs = (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - lStart).count();
+    mModuleNs += lModuleNs;
+
+    std::lock_guard<std::mutex> lLock(mReportMutex);
+    mReport[getReportName(pFilename, pDefines)].mModuleMs = (double)lModuleNs / 1000000.0;
+    return lShader;
+}
+
+/******************************************************************************/
+void ShaderCompiler::waitIdle()
+{
+    mWorkers.waitIdle();
+}
+
+/******************************************************************************/
+ShaderCompiler::Stats ShaderCompiler::getStats() const
+{
+    Stats lStats;
+    lStats.mCompiled = mCompiled.load();
+    lStats.mCacheHits = mCacheHits.load();
+    lStats.mFailed = mFailed.load();
+    lStats.mCompileMs = (double)mCompileNs.load() / 1000000.0;
+    lStats.mOptimizeMs = (double)mOptimizeNs.load() / 1000000.0;
+    lStats.mModuleMs = (double)mModuleNs.load() / 1000000.0;
+    return lStats;
+}
+
+/******************************************************************************/
+std::string ShaderCompiler::getPath(const std::string& pFilename) const
+{
+    return std::filesystem::path(mSettings.mShaderPath + pFilename).lexically_normal().generic_string();
+}
+
+/******************************************************************************/
+/******************************************************************************/
+/******************************************************************************/
+bool ShaderCompiler::readSources(const std::string& pFilename, Sources& pSources) const
+{
+    SourceFile lFile;
+    lFile.mPath = getPath(pFilename);
+    if (!readText(lFile.mPath, lFile.mText))
+        return false;
+
+    pSources.mFiles.push_back(std::move(lFile));
+    scanIncludes(pSources.mFiles[0].mPath, pSources.mFiles[0].mText, pSources, 0);
+    return true;
+}
+
+/******************************************************************************/
+void ShaderCompiler::scanIncludes(const std::string& pPath, const std::string& pText, Sources& pSources, uint32_t pDepth) const
+{
+    if (pDepth >= cMaxIncludeDepth)
+        return;
+
+    // #include "name" or <name> at the start of a line, the compiler reports the malformed ones
+    size_t lLine = 0;
+    while (lLine < pText.size())
+    {
+        size_t lEnd = pText.find('\n', lLine);
+        if (lEnd == std::string::npos)
+            lEnd = pText.size();
+
+        size_t i = pText.find_first_not_of(" \t", lLine);
+        if (i < lEnd && pText[i] == '#')
+        {
+            i = pText.find_first_not_of(" \t", i + 1);
+            if (i < lEnd && pText.compare(i, 7, "include") == 0)
+            {
+                i = pText.find_first_not_of(" \t", i + 7);
+                if (i < lEnd && (pText[i] == '"' || pText[i] == '<'))
+                {
+                    const size_t lClose = pText.find(pText[i] == '"' ? '"' : '>', i + 1);
+                    if (lClose < lEnd)
+                    {
+                        const std::string lPath = resolveInclude(pText.substr(i + 1, lClose - i - 1), pPath);
+                        if (!lPath.empty() && pSources.find(lPath) == nullptr)
+                        {
+                            SourceFile lFile;
+                            lFile.mPath = lPath;
+                            if (readText(lPath, lFile.mText))
+                            {
+                                pSources.mFiles.push_back(std::move(lFile));
+                                // Copy, the vector may grow during the recursion
+                                const SourceFile lInclude = pSources.mFiles.back();
+                                scanIncludes(lInclude.mPath, lInclude.mText, pSources, pDepth + 1);
+                            }
+                        }
+                    }
+                }
+            }
+        }
+        lLine = lEnd + 1;
+    }
+}
+
+/******************************************************************************/
+std::string ShaderCompiler::resolveInclude(const std::string& pName, const std::string& pIncluder) const
+{
+    std::error_code lError;
+    const std::filesystem::path lCandidates[2] =
+    {
+        std::filesystem::path(pIncluder).parent_path() / pName,
+        std::filesystem::path(mSettings.mShaderPath) / pName,
+    };
+    for (const std::filesystem::path& lCandidate : lCandidates)
+    {
+        if (std::filesystem::is_regular_file(lCandidate, lError))
+            return lCandidate.lexically_normal().generic_string();
+    }
+    return std::string();
+}
+
+/******************************************************************************/
+uint64_t ShaderCompiler::computeHash(const Sources& pSources, const std::vector<Define>& pDefines) const
+{
+    uint64_t lHash = 14695981039346656037ull;
+#ifdef VULKANCORE_SPIRV_TOOLS
+    const uint32_t lOptimizer = 1;
+#else
+    const uint32_t lOptimizer = 0;
+#endif
+    const uint32_t lOptions[4] = { cCacheVersion, mSettings.mOptimize ? 1u : 0u, mSettings.mDebugInfo ? 1u : 0u, lOptimizer };
+    hashBytes(lHash, lOptions, sizeof(lOptions));
+    // The stage comes from the name
+    hashString(lHash, std::filesystem::path(pSources.mFiles[0].mPath).filename().generic_string());
+    for (const Define& lDefine : pDefines)
+    {
+        hashString(lHash, lDefine.mName);
+        hashString(lHash, lDefine.mValue);
+    }
+    for (const SourceFile& lFile : pSources.mFiles)
+        hashString(lHash, lFile.mText);
+    return lHash;
+}
+
+/******************************************************************************/
+std::string ShaderCompiler::getCacheFilename(uint64_t pHash) const
+{
+    char lName[32];
+    snprintf(lName, sizeof(lName), "%016llx.spv", (unsigned long long)pHash);
+    return mSettings.mCachePath + lName;
+}
+
+/******************************************************************************/
+bool ShaderCompiler::loadCache(uint64_t pHash, std::vector<uint32_t>& pCode) const
+{
+    if (mSettings.mCachePath.empty())
+        return false;
+
+    MappedFile lFile;
+    if (!lFile.open(getCacheFilename(pHash).c_str()))
+        return false;
+
+    uint32_t lMagic = 0;
+    if (lFile.mSize < 5 * sizeof(uint32_t) || lFile.mSize % sizeof(uint32_t) != 0)
+        return false;
+    memcpy(&lMagic, lFile.mData, sizeof(lMagic));
+    if (lMagic != cSpirvMagic)
+        return false;
+
+    pCode.resize(lFile.mSize / sizeof(uint32_t));
+    memcpy(pCode.data(), lFile.mData, lFile.mSize);
+    return true;
+}
+
+/******************************************************************************/
+void ShaderCompiler::saveCache(uint64_t pHash, const std::vector<uint32_t>& pCode) const
+{
+    if (mSettings.mCachePath.empty())
+        return;
+
+    std::error_code lError;
+    std::filesystem::create_directories(mSettings.mCachePath, lError);
+
+    // Write aside then rename (see PipelineCache), two workers may compile the same shader
+    const std::string lFilename = getCacheFilename(pHash);
+    const std::string lTempFilename = lFilename + "." + std::to_string(std::hash<std::thread::id>()(std::this_thread::get_id())) + ".tmp";
+    FILE* lFile = fopen(lTempFilename.c_str(), "wb");
+    if (lFile == nullptr)
+    {
+        printf("ShaderCompiler : can't write %s\n", lTempFilename.c_str());
+        return;
+    }
+    bool lWritten = fwrite(pCode.data(), sizeof(uint32_t), pCode.size(), lFile) == pCode.size();
+    lWritten = fclose(lFile) == 0 && lWritten;
+
+    if (lWritten)
+        std::filesystem::rename(lTempFilename, lFilename, lError);
+    if (!lWritten || lError)
+    {
+        printf("ShaderCompiler : failed to save %s\n", lFilename.c_str());
+        std::filesystem::remove(lTempFilename, lError);
+    }
+}
+
+/******************************************************************************/
+bool ShaderCompiler::compileSource(const Sources& pSources, const std::vector<Define>& pDefines, Result& pResult) const
+{
+    const SourceFile& lSource = pSources.mFiles[0];
+
+#ifdef VULKANCORE_SHADERC
+    shaderc_shader_kind lKind;
+    if (!getShaderKind(lSource.mPath, lKind))
+    {
+        pResult.mErrors = "unknown stage, expected name.<vert|frag|comp|geom|tesc|tese|task|mesh>.glsl";
+        return false;
+    }
+
+    shaderc_compile_options_t lOptions = shaderc_compile_options_initialize();
+    shaderc_compile_options_set_target_env(lOptions, shaderc_target_env_vulkan, shaderc_env_version_vulkan_1_3);
+#ifdef VULKANCORE_SPIRV_TOOLS
+    // Optimized after, the size before the optimization is reported
+    shaderc_compile_options_set_optimization_level(lOptions, shaderc_optimization_level_zero);
+#else
+    shaderc_compile_options_set_optimization_level(lOptions, mSettings.mOptimize ? shaderc_optimization_level_performance : shaderc_optimization_level_zero);
+#endif
+    if (mSettings.mDebugInfo)
+        shaderc_compile_options_set_generate_debug_info(lOptions);
+    for (const Define& lDefine : pDefines)
+        shaderc_compile_options_add_macro_definition(lOptions, lDefine.mName.c_str(), lDefine.mName.size(), lDefine.mValue.c_str(), lDefine.mValue.size());
+
+    IncludeContext lContext = { this, &pSources };
+    shaderc_compile_options_set_include_callbacks(lOptions, onInclude, onIncludeRelease, &lContext);
+
+    shaderc_compilation_result_t lCompilation = shaderc_compile_into_spv((shaderc_compiler_t)mCompiler, lSource.mText.c_str(), lSource.mText.size(),
+        lKind, lSource.mPath.c_str(), "main", lOptions);
+
+    const bool lSuccess = shaderc_result_get_compilation_status(lCompilation) == shaderc_compilation_status_success;
+    pResult.mErrors = shaderc_result_get_error_message(lCompilation);
+    if (lSuccess)
+    {
+        const uint32_t* lCode = (const uint32_t*)shaderc_result_get_bytes(lCompilation);
+        pResult.mCode.assign(lCode, lCode + shaderc_result_get_length(lCompilation) / sizeof(uint32_t));
+    }
+    shaderc_result_release(lCompilation);
+    shaderc_compile_options_release(lOptions);
+    return lSuccess;
+#else
+    // The spirv built with the project, only without defines
+    if (!pDefines.empty())
+    {
+        pResult.mErrors = "defines need the runtime compiler (shaderc)";
+        return false;
+    }
+    MappedFile lFile;
+    if (!lFile.open((lSource.mPath + ".spv").c_str()) || lFile.mSize % sizeof(uint32_t) != 0)
+    {
+        pResult.mErrors = "no runtime compiler (shaderc) and no " + lSource.mPath + ".spv";
+        return false;
+    }
+    pResult.mCode.resize(lFile.mSize / sizeof(uint32_t));
+    memcpy(pResult.mCode.data(), lFile.mData, lFile.mSize);
+    return true;
+#endif
+}
+
+/******************************************************************************/
+bool ShaderCompiler::optimizeSpirv(std::vector<uint32_t>& pCode, std::string& pErrors) const
+{
+#ifdef VULKANCORE_SPIRV_TOOLS
+    if (!mSettings.mOptimize && mSettings.mDebugInfo)
+        return true;
+
+    spv_optimizer_t* lOptimizer = spvOptimizerCreate(SPV_ENV_VULKAN_1_3);
+    if (!mSettings.mDebugInfo)
+        spvOptimizerRegisterPassFromFlag(lOptimizer, "--strip-debug");
+    if (mSettings.mOptimize)
+        spvOptimizerRegisterPerformancePasses(lOptimizer);
+
+    spv_optimizer_options lOptions = spvOptimizerOptionsCreate();
+    spv_binary lBinary = nullptr;
+    const spv_result_t lResult = spvOptimizerRun(lOptimizer, pCode.data(), pCode.size(), &lBinary, lOptions);
+    if (lResult == SPV_SUCCESS)
+        pCode.assign(lBinary->code, lBinary->code + lBinary->wordCount);
+    else
+        pErrors += "spirv-opt failed (" + std::to_string((int)lResult) + "), the unoptimized spirv is kept\n";
+
+    spvBinaryDestroy(lBinary);
+    spvOptimizerOptionsDestroy(lOptions);
+    spvOptimizerDestroy(lOptimizer);
+    return lResult == SPV_SUCCESS;
+#else
+    // Optimized by shaderc when available
+    (void)pCode;
+    (void)pErrors;
+    return true;
+#endif
+}
+
+/******************************************************************************/
+std::string ShaderCompiler::getReportName(const std::string& pFilename, const std::vector<Define>& pDefines) const
+{
+    // name.glsl or name.glsl[A=1 B]
+    std::string lName = pFilename;
+    for (size_t i = 0; i < pDefines.size(); ++i)
+    {
+        lName += i == 0 ? "[" : " ";
+        lName += pDefines[i].mName;
+        if (!pDefines[i].mValue.empty())
+            lName += "=" + pDefines[i].mValue;
+    }
+    if (!pDefines.empty())
+        lName += "]";
+    return lName;
+}
+
+/******************************************************************************/
+void ShaderCompiler::addReport(const std::string& pName, const Result& pResult)
+{
+    std::lock_guard<std::mutex> lLock(mReportMutex);
+    ReportEntry& lEntry = mReport[pName];
+    lEntry.mStats = pResult.mStats;
+    // From the cache the size before optimization is not known, keep the one of a compilation
+    if (pResult.mUnoptimizedSize != 0)
+        lEntry.mUnoptimizedSize = pResult.mUnoptimizedSize;
+}
+
+/******************************************************************************/
+void ShaderCompiler::writeReport()
+{
+    if (mSettings.mReportFilename.empty())
+        return;
+
+    std::lock_guard<std::mutex> lLock(mReportMutex);
+    if (mReport.empty())
+        return;
+
+    // The previous report is the reference of the regressions
+    std::map<std::string, ReportEntry> lPrevious;
+    if (FILE* lFile = fopen(mSettings.mReportFilename.c_str(), "r"))
+    {
+        char lLine[512];
+        while (fgets(lLine, sizeof(lLine), lFile) != nullptr)
+        {
+            char lName[256];
+            ReportEntry lEntry;
+            ShaderStats& lStats = lEntry.mStats;
+            if (sscanf(lLine, "%255[^,],%u,%u,%u,%u,%u,%u,%lf", lName, &lStats.mSize, &lEntry.mUnoptimizedSize, &lStats.mInstructionCount,
+                &lStats.mLoopCount, &lStats.mTextureSampleCount, &lStats.mRegisterEstimate, &lEntry.mModuleMs) == 8)
+                lPrevious[lName] = lEntry;
+        }
+        fclose(lFile);
+    }
+
+    const float lThreshold = 1.0f + mSettings.mRegressionThreshold;
+    for (auto& lIt : mReport)
+    {
+        ReportEntry& lEntry = lIt.second;
+        auto lPreviousIt = lPrevious.find(lIt.first);
+        if (lPreviousIt == lPrevious.end())
+            continue;
+
+        const ShaderStats& lNow = lEntry.mStats;
+        const ShaderStats& lBefore = lPreviousIt->second.mStats;
+        if (lNow.mInstructionCount > lBefore.mInstructionCount * lThreshold || lNow.mRegisterEstimate > lBefore.mRegisterEstimate * lThreshold
+            || lNow.mTextureSampleCount > lBefore.mTextureSampleCount || lNow.mLoopCount > lBefore.mLoopCount)
+        {
+            printf("ShaderCompiler : %s regression, instructions %u -> %u, registers %u -> %u, samples %u -> %u, loops %u -> %u\n", lIt.first.c_str(),
+                lBefore.mInstructionCount, lNow.mInstructionCount, lBefore.mRegisterEstimate, lNow.mRegisterEstimate,
+                lBefore.mTextureSampleCount, lNow.mTextureSampleCount, lBefore.mLoopCount, lNow.mLoopCount);
+        }
+        // Loaded from the cache, the unoptimized size is the one of the previous run if the spirv is the same
+        if (lEntry.mUnoptimizedSize == 0 && lBefore.mSize == lNow.mSize)
+            lEntry.mUnoptimizedSize = lPreviousIt->second.mUnoptimizedSize;
+    }
+
+    FILE* lFile = fopen(mSettings.mReportFilename.c_str(), "w");
+    if (lFile == nullptr)
+    {
+        printf("ShaderCompiler : can't write %s\n", mSettings.mReportFilename.c_str());
+        return;
+    }
+    fprintf(lFile, "shader,bytes,unoptimized_bytes,instructions,loops,samples,registers,module_ms\n");
+    for (const auto& lIt : mReport)
+    {
+        const ReportEntry& lEntry = lIt.second;
+        const ShaderStats& lStats = lEntry.mStats;
+        fprintf(lFile, "%s,%u,%u,%u,%u,%u,%u,%.3f\n", lIt.first.c_str(), lStats.mSize, lEntry.mUnoptimizedSize, lStats.mInstructionCount,
+            lStats.mLoopCount, lStats.mTextureSampleCount, lStats.mRegisterEstimate, lEntry.mModuleMs);
+    }
+    fclose(lFile);
+}
@@ -0,0 +1,136 @@
+#pragma once
+
+#include "vk_common.h"
+#include "VulkanShader.h"
+#include "ThreadPool.h"
+
+#include <atomic>
+#include <future>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// GLSL compiled to spirv at runtime, with an on disk cache of the spirv
+// The stage comes from the file name (name.<vert|frag|comp|...>.glsl), #include "file" is searched
+// next to the including file then in Settings::mShaderPath.
+// The cache key hashes the source, the defines, the content of every file included and the compile options:
+// a change in a shared header recompiles the shaders using it, the others come from the cache.
+// The key is computed without compiling, the includes are scanned from the source (a conditional include
+// is always part of the key, at worst an unneeded recompile).
+// Without shaderc (VULKANCORE_SHADERC not defined) only the cache and the spirv built with the project
+// (name.glsl.spv) can be used, and the defines are not supported.
+// With SPIRV-Tools (VULKANCORE_SPIRV_TOOLS) the spirv goes through the spirv-opt performance passes
+// and the debug info is stripped, else shaderc optimizes and the names are kept.
+// Each shader is measured (see analyzeSpirv) and written to Settings::mReportFilename on shutdown,
+// the growth since the previous report is logged as a regression.
+// Thread safe, except init/shutdown.
+struct ShaderCompiler
+{
+    struct Settings
+    {
+        std::string mShaderPath = "../Shaders/";
+        std::string mCachePath = "shader_cache/";   // Empty = no cache
+        bool mOptimize = true;
+        bool mDebugInfo = false;                    // False strips the debug info (names, lines) from the spirv
+        uint32_t mThreadCount = 0;                  // Compile workers, 0 = hardware concurrency minus one
+        std::string mReportFilename = "shader_report.csv";     // Empty = no report
+        float mRegressionThreshold = 0.1f;          // Growth of a cost reported as a regression
+    };
+
+    struct Define
+    {
+        std::string mName;
+        std::string mValue;
+    };
+
+    struct Result
+    {
+        std::string mFilename;
+        std::vector<uint32_t> mCode;
+        std::vector<std::string> mIncludes;     // Paths of the files included (recursively), for the hot reload
+        uint64_t mHash = 0;                     // Cache key
+        bool mFromCache = false;
+        std::string mErrors;                    // Compile errors and warnings
+        uint32_t mUnoptimizedSize = 0;          // Bytes before the optimization, 0 from the cache
+        ShaderStats mStats;
+
+        inline bool isValid() const { return !mCode.empty(); }
+    };
+
+    struct Stats
+    {
+        uint32_t mCompiled = 0;
+        uint32_t mCacheHits = 0;
+        uint32_t mFailed = 0;
+        double mCompileMs = 0.0;                // Summed over the workers
+        double mOptimizeMs = 0.0;               // Part of mCompileMs
+        double mModuleMs = 0.0;                 // vkCreateShaderModule of load()
+    };
+
+    void init(const Settings& pSettings);
+    void shutdown();
+
+    // pFilename is relative to mShaderPath
+    Result compile(const std::string& pFilename, const std::vector<Define>& pDefines = {});
+    std::shared_future<Result> compileAsync(const std::string& pFilename, const std::vector<Define>& pDefines = {});
+
+    // Compile and create the shader module, invalid shader if the compilation failed
+    VulkanShader load(VkDevice pDevice, const std::string& pFilename, const std::vector<Define>& pDefines = {});
+
+    void waitIdle();
+    Stats getStats() const;
+
+    // Normalized path of a file of mShaderPath, as in Result::mIncludes
+    std::string getPath(const std::string& pFilename) const;
+
+    static const uint32_t cCacheVersion = 2;    // Part of the key, bump to invalidate the caches
+
+    // Last measure of each shader variant
+    struct ReportEntry
+    {
+        ShaderStats mStats;
+        uint32_t mUnoptimizedSize = 0;
+        double mModuleMs = 0.0;
+    };
+
+    // Source of pFilename and its includes, read once per compile
+    struct SourceFile
+    {
+        std::string mPath;
+        std::string mText;
+    };
+    struct Sources
+    {
+        std::vector<SourceFile> mFiles;         // [0] the shader, then the includes in scan order
+
+        const SourceFile* find(const std::string& pPath) const;
+    };
+
+    bool readSources(const std::string& pFilename, Sources& pSources) const;
+    void scanIncludes(const std::string& pPath, const std::string& pText, Sources& pSources, uint32_t pDepth) const;
+    std::string resolveInclude(const std::string& pName, const std::string& pIncluder) const;
+    uint64_t computeHash(const Sources& pSources, const std::vector<Define>& pDefines) const;
+    std::string getCacheFilename(uint64_t pHash) const;
+    bool loadCache(uint64_t pHash, std::vector<uint32_t>& pCode) const;
+    void saveCache(uint64_t pHash, const std::vector<uint32_t>& pCode) const;
+    bool compileSource(const Sources& pSources, const std::vector<Define>& pDefines, Result& pResult) const;
+    bool optimizeSpirv(std::vector<uint32_t>& pCode, std::string& pErrors) const;
+    std::string getReportName(const std::string& pFilename, const std::vector<Define>& pDefines) const;
+    void addReport(const std::string& pName, const Result& pResult);
+    void writeReport();
+
+    Settings mSettings;
+    ThreadPool mWorkers;
+    void* mCompiler = nullptr;                  // shaderc_compiler_t
+
+    std::atomic<uint32_t> mCompiled{ 0 };
+    std::atomic<uint32_t> mCacheHits{ 0 };
+    std::atomic<uint32_t> mFailed{ 0 };
+    std::atomic<uint64_t> mCompileNs{ 0 };
+    std::atomic<uint64_t> mOptimizeNs{ 0 };
+    std::atomic<uint64_t> mModuleNs{ 0 };
+
+    std::mutex mReportMutex;
+    std::map<std::string, ReportEntry> mReport;     // Sorted, the report diffs well
+};
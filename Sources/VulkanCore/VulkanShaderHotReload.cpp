@@ -0,0 +1,298 @@
+#include "VulkanShaderHotReload.h"
+#include "VulkanDevice.h"
+
+#include <assert.h>
+#include <stdio.h>
+#include <algorithm>
+#include <filesystem>
+#include <unordered_map>
+
+#ifdef __linux__
+#include <sys/inotify.h>
+#include <poll.h>
+#include <unistd.h>
+#endif
+
+namespace
+{
+    void addUnique(std::vector<std::string>& pPaths, const std::string& pPath)
+    {
+        if (std::find(pPaths.begin(), pPaths.end(), pPath) == pPaths.end())
+            pPaths.push_back(pPath);
+    }
+}
+
+/******************************************************************************/
+void ShaderHotReload::init(VulkanDevice* pDevice, ShaderCompiler* pCompiler, const Settings& pSettings)
+{
+    assert(mDevice == nullptr && "ShaderHotReload : already initialized");
+    mDevice = pDevice;
+    mCompiler = pCompiler;
+    mSettings = pSettings;
+    mStop = false;
+    mFrame = 0;
+    mStats = Stats();
+    mWatcher = std::thread([this]() { watchLoop(); });
+}
+
+/******************************************************************************/
+void ShaderHotReload::shutdown()
+{
+    if (mDevice == nullptr)
+        return;
+
+    mStop = true;
+    if (mWatcher.joinable())
+        mWatcher.join();
+    // The reloads in flight reference this
+    mCompiler->waitIdle();
+
+    for (const Swap& lSwap : mSwaps)
+        vkDestroyPipeline(*mDevice, lSwap.mPipeline, nullptr);
+    for (const Retired& lRetired : mRetired)
+        vkDestroyPipeline(*mDevice, lRetired.mPipeline, nullptr);
+    mSwaps.clear();
+    mRetired.clear();
+    mWatches.clear();
+
+    printf("ShaderHotReload : %u reloads, %u failures\n", mStats.mReloads, mStats.mFailures);
+    mDevice = nullptr;
+    mCompiler = nullptr;
+}
+
+/******************************************************************************/
+void ShaderHotReload::add(PipelineHandle pHandle, const std::vector<std::string>& pFilenames, BuildPipeline&& pBuild, const std::vector<ShaderCompiler::Define>& pDefines)
+{
+    assert(pHandle.isValid() && !pFilenames.empty());
+
+    std::shared_ptr<Watch> lWatch = std::make_shared<Watch>();
+    lWatch->mHandle = pHandle;
+    lWatch->mFilenames = pFilenames;
+    lWatch->mDefines = pDefines;
+    lWatch->mBuild = std::move(pBuild);
+
+    // The includes of the current version, from the spirv cache when the shaders were just loaded
+    for (const std::string& lFilename : pFilenames)
+    {
+        addUnique(lWatch->mDependencies, mCompiler->getPath(lFilename));
+        const ShaderCompiler::Result lResult = mCompiler->compile(lFilename, pDefines);
+        for (const std::string& lInclude : lResult.mIncludes)
+            addUnique(lWatch->mDependencies, lInclude);
+    }
+
+    std::lock_guard<std::mutex> lLock(mMutex);
+    mWatches.push_back(std::move(lWatch));
+}
+
+/******************************************************************************/
+void ShaderHotReload::remove(PipelineHandle pHandle)
+{
+    std::lock_guard<std::mutex> lLock(mMutex);
+    for (size_t i = 0; i < mWatches.size(); ++i)
+    {
+        if (mWatches[i]->mHandle == pHandle)
+        {
+            // A reload in flight still holds it, its pipeline is dropped
+            mWatches[i]->mRemoved = true;
+            mWatches.erase(mWatches.begin() + i);
+            return;
+        }
+    }
+}
+
+/******************************************************************************/
+void ShaderHotReload::beginFrame()
+{
+    std::lock_guard<std::mutex> lLock(mMutex);
+    ++mFrame;
+
+    size_t lKept = 0;
+    for (size_t i = 0; i < mRetired.size(); ++i)
+    {
+        if (mRetired[i].mFrame + mSettings.mFramesInFlight <= mFrame)
+            vkDestroyPipeline(*mDevice, mRetired[i].mPipeline, nullptr);
+        else
+            mRetired[lKept++] = mRetired[i];
+    }
+    mRetired.resize(lKept);
+
+    // The command buffers recorded from now use the new pipelines, the pending ones keep the previous
+    for (const Swap& lSwap : mSwaps)
+    {
+        if (lSwap.mWatch->mRemoved || !mDevice->mPipelinePool.isAlive(lSwap.mWatch->mHandle))
+        {
+            vkDestroyPipeline(*mDevice, lSwap.mPipeline, nullptr);
+            continue;
+        }
+        mRetired.push_back({ mFrame, mDevice->replacePipeline(lSwap.mWatch->mHandle, lSwap.mPipeline) });
+
+        ++mStats.mReloads;
+        mStats.mLastReloadMs = std::chrono::duration<double, std::milli>(Clock::now() - lSwap.mChanged).count();
+        printf("ShaderHotReload : %s reloaded in %.1f ms\n", lSwap.mWatch->mFilenames[0].c_str(), mStats.mLastReloadMs);
+    }
+    mSwaps.clear();
+}
+
+/******************************************************************************/
+ShaderHotReload::Stats ShaderHotReload::getStats() const
+{
+    std::lock_guard<std::mutex> lLock(mMutex);
+    return mStats;
+}
+
+/******************************************************************************/
+/******************************************************************************/
+/******************************************************************************/
+void ShaderHotReload::watchLoop()
+{
+    const std::string lFolder = mCompiler->mSettings.mShaderPath;
+    std::vector<std::string> lChanged;
+    Clock::time_point lFirstChange;
+
+#ifdef __linux__
+    const int lFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    const int lWd = lFd >= 0 ? inotify_add_watch(lFd, lFolder.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE) : -1;
+    if (lWd < 0)
+    {
+        printf("ShaderHotReload : can't watch %s, hot reload disabled\n", lFolder.c_str());
+        if (lFd >= 0)
+            close(lFd);
+        return;
+    }
+
+    alignas(inotify_event) char lBuffer[4096];
+    while (!mStop)
+    {
+        // Short timeout to see mStop, then wait for the writes to settle before reloading
+        pollfd lPoll = { lFd, POLLIN, 0 };
+        if (poll(&lPoll, 1, lChanged.empty() ? 100 : (int)mSettings.mDebounceMs) > 0)
+        {
+            ssize_t lSize;
+            while ((lSize = read(lFd, lBuffer, sizeof(lBuffer))) > 0)
+            {
+                for (const char* lData = lBuffer; lData < lBuffer + lSize; )
+                {
+                    const inotify_event* lEvent = (const inotify_event*)lData;
+                    if (lEvent->len > 0 && (lEvent->mask & IN_ISDIR) == 0)
+                    {
+                        if (lChanged.empty())
+                            lFirstChange = Clock::now();
+                        addUnique(lChanged, mCompiler->getPath(lEvent->name));
+                    }
+                    lData += sizeof(inotify_event) + lEvent->len;
+                }
+            }
+            continue;
+        }
+        if (!lChanged.empty())
+        {
+            onFilesChanged(lChanged, lFirstChange);
+            lChanged.clear();
+        }
+    }
+    close(lFd);
+#else
+    std::unordered_map<std::string, std::filesystem::file_time_type> lTimes;
+    bool lFirstScan = true;
+    while (!mStop)
+    {
+        std::error_code lError;
+        for (std::filesystem::directory_iterator lIt(lFolder, lError), lEnd; !lError && lIt != lEnd; lIt.increment(lError))
+        {
+            if (!lIt->is_regular_file(lError))
+                continue;
+            const std::string lPath = mCompiler->getPath(lIt->path().filename().generic_string());
+            const std::filesystem::file_time_type lTime = lIt->last_write_time(lError);
+            auto lKnown = lTimes.find(lPath);
+            if (lKnown == lTimes.end() || lKnown->second != lTime)
+            {
+                if (!lFirstScan)
+                    addUnique(lChanged, lPath);
+                lTimes[lPath] = lTime;
+            }
+        }
+        lFirstScan = false;
+
+        if (!lChanged.empty())
+        {
+            onFilesChanged(lChanged, Clock::now());
+            lChanged.clear();
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(mSettings.mPollMs));
+    }
+#endif
+}
+
+/******************************************************************************/
+void ShaderHotReload::onFilesChanged(const std::vector<std::string>& pPaths, Clock::time_point pChanged)
+{
+    std::vector<std::pair<std::shared_ptr<Watch>, uint32_t>> lReloads;
+    {
+        std::lock_guard<std::mutex> lLock(mMutex);
+        for (const std::shared_ptr<Watch>& lWatch : mWatches)
+        {
+            for (const std::string& lPath : pPaths)
+            {
+                if (std::find(lWatch->mDependencies.begin(), lWatch->mDependencies.end(), lPath) != lWatch->mDependencies.end())
+                {
+                    lReloads.push_back({ lWatch, ++lWatch->mGeneration });
+                    break;
+                }
+            }
+        }
+    }
+    if (lReloads.empty())
+        return;
+
+    printf("ShaderHotReload : %s changed, %u pipelines to rebuild\n", pPaths[0].c_str(), (uint32_t)lReloads.size());
+    for (auto& lReload : lReloads)
+    {
+        std::shared_ptr<Watch> lWatch = lReload.first;
+        const uint32_t lGeneration = lReload.second;
+        mCompiler->mWorkers.enqueue([this, lWatch, lGeneration, pChanged]() { reload(lWatch, lGeneration, pChanged); });
+    }
+}
+
+/******************************************************************************/
+void ShaderHotReload::reload(std::shared_ptr<Watch> pWatch, uint32_t pGeneration, Clock::time_point pChanged)
+{
+    // mFilenames, mDefines and mBuild are never modified after add()
+    std::vector<VulkanShader> lShaders;
+    std::vector<std::string> lDependencies;
+    bool lCompiled = true;
+    for (const std::string& lFilename : pWatch->mFilenames)
+    {
+        const ShaderCompiler::Result lResult = mCompiler->compile(lFilename, pWatch->mDefines);
+        addUnique(lDependencies, mCompiler->getPath(lFilename));
+        for (const std::string& lInclude : lResult.mIncludes)
+            addUnique(lDependencies, lInclude);
+        if (!lResult.isValid())
+        {
+            lCompiled = false;
+            break;
+        }
+        lShaders.push_back(VulkanShader::loadFromCode(*mDevice, lResult.mCode.data(), lResult.mCode.size()));
+    }
+
+    VkPipeline lPipeline = lCompiled ? pWatch->mBuild(lShaders.data(), (uint32_t)lShaders.size()) : VK_NULL_HANDLE;
+    for (const VulkanShader& lShader : lShaders)
+        vkDestroyShaderModule(*mDevice, lShader.mShaderModule, nullptr);
+
+    std::unique_lock<std::mutex> lLock(mMutex);
+    if (lCompiled)
+        pWatch->mDependencies = std::move(lDependencies);
+    if (lPipeline == VK_NULL_HANDLE)
+    {
+        ++mStats.mFailures;
+        printf("ShaderHotReload : %s not reloaded, the previous pipeline is kept\n", pWatch->mFilenames[0].c_str());
+        return;
+    }
+    if (pWatch->mRemoved || pGeneration != pWatch->mGeneration)
+    {
+        // Removed, or edited again meanwhile: the newer reload wins
+        lLock.unlock();
+        vkDestroyPipeline(*mDevice, lPipeline, nullptr);
+        return;
+    }
+    mSwaps.push_back({ pWatch, lPipeline, pChanged });
+}
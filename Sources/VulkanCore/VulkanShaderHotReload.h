@@ -0,0 +1,103 @@
+#pragma once
+
+#include "vk_common.h"
+#include "VulkanHandle.h"
+#include "VulkanShaderCompiler.h"
+
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+struct VulkanDevice;
+
+// Reload of the shaders edited on disk, without restarting
+// A watcher thread reports the files written in the shader folder of the ShaderCompiler (inotify on Linux,
+// modification time polling elsewhere, subfolders are not watched). The pipelines using a changed file,
+// directly or through an include, recompile their shaders and rebuild on the compiler workers.
+// beginFrame() swaps the rebuilt pipelines in their PipelinePool slot: the PipelineHandle stays valid and
+// the previous pipeline is destroyed Settings::mFramesInFlight frames later.
+// A compile or pipeline creation error keeps the previous pipeline, the next save tries again.
+// Thread safe, except init/shutdown.
+struct ShaderHotReload
+{
+    struct Settings
+    {
+        uint32_t mFramesInFlight = 3;       // Frames before a replaced pipeline is no more in use
+        uint32_t mDebounceMs = 50;          // Editors write a file in several steps
+        uint32_t mPollMs = 250;             // Without inotify
+    };
+
+    struct Stats
+    {
+        uint32_t mReloads = 0;
+        uint32_t mFailures = 0;
+        double mLastReloadMs = 0.0;         // File written to pipeline swapped
+    };
+
+    // Create the pipeline from the shaders, in the order of the filenames given to add(). VK_NULL_HANDLE on error.
+    // Called on a worker thread, the shader modules are destroyed after the call.
+    using BuildPipeline = std::function<VkPipeline(const VulkanShader* pShaders, uint32_t pShaderCount)>;
+
+    void init(VulkanDevice* pDevice, ShaderCompiler* pCompiler, const Settings& pSettings);
+    // After vkDeviceWaitIdle
+    void shutdown();
+
+    // Rebuild pHandle when one of pFilenames (relative to the compiler shader path) or their includes change
+    void add(PipelineHandle pHandle, const std::vector<std::string>& pFilenames, BuildPipeline&& pBuild, const std::vector<ShaderCompiler::Define>& pDefines = {});
+    // Before the destruction of the pipeline
+    void remove(PipelineHandle pHandle);
+
+    // Once per frame, after the fence wait of the frame
+    void beginFrame();
+
+    Stats getStats() const;
+
+    using Clock = std::chrono::steady_clock;
+
+    struct Watch
+    {
+        PipelineHandle mHandle;
+        std::vector<std::string> mFilenames;
+        std::vector<ShaderCompiler::Define> mDefines;
+        BuildPipeline mBuild;
+        std::vector<std::string> mDependencies;     // Paths of the shaders and their includes
+        uint32_t mGeneration = 0;                   // Of the last reload requested, the older ones are dropped
+        bool mRemoved = false;
+    };
+
+    struct Swap
+    {
+        std::shared_ptr<Watch> mWatch;
+        VkPipeline mPipeline;
+        Clock::time_point mChanged;
+    };
+
+    struct Retired
+    {
+        uint64_t mFrame;
+        VkPipeline mPipeline;
+    };
+
+    void watchLoop();
+    void onFilesChanged(const std::vector<std::string>& pPaths, Clock::time_point pChanged);
+    void reload(std::shared_ptr<Watch> pWatch, uint32_t pGeneration, Clock::time_point pChanged);
+
+    VulkanDevice* mDevice = nullptr;
+    ShaderCompiler* mCompiler = nullptr;
+    Settings mSettings;
+
+    std::thread mWatcher;
+    std::atomic<bool> mStop{ false };
+
+    mutable std::mutex mMutex;
+    std::vector<std::shared_ptr<Watch>> mWatches;
+    std::vector<Swap> mSwaps;           // Rebuilt, swapped by the next beginFrame
+    std::vector<Retired> mRetired;
+    uint64_t mFrame = 0;
+    Stats mStats;
+};
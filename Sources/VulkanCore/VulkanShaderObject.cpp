@@ -0,0 +1,165 @@
+#include "VulkanShaderObject.h"
+#include "VulkanDevice.h"
+#include "VulkanPipeline.h"
+
+#include <assert.h>
+#include <algorithm>
+
+/******************************************************************************/
+bool ShaderObjects::isSupported(const VulkanDevice& pDevice)
+{
+    return pDevice.mShaderBackend == VulkanDevice::ShaderBackend::ShaderObjects;
+}
+
+/******************************************************************************/
+void ShaderObjects::create(VulkanDevice* pDevice, const VulkanShader* const* pShaders, uint32_t pShaderCount,
+    const PipelineLayoutCache::Layout& pLayout, const VkSpecializationInfo* pSpecialization)
+{
+    assert(isSupported(*pDevice));
+    assert(pShaderCount > 0 && pShaderCount <= cMaxStages);
+    assert(mShaderCount == 0 && "ShaderObjects : already created");
+
+    // Pipeline order (the stage bits are in this order), each stage gives the next one
+    const VulkanShader* lShaders[cMaxStages];
+    std::copy(pShaders, pShaders + pShaderCount, lShaders);
+    std::sort(lShaders, lShaders + pShaderCount, [](const VulkanShader* a, const VulkanShader* b) { return a->mStage < b->mStage; });
+
+    const bool lCompute = lShaders[0]->mStage == VK_SHADER_STAGE_COMPUTE_BIT;
+    assert(!lCompute || pShaderCount == 1);
+
+    VkShaderCreateInfoEXT lCreateInfos[cMaxStages];
+    for (uint32_t i = 0; i < pShaderCount; ++i)
+    {
+        const VulkanShader& lShader = *lShaders[i];
+        assert(lShader.code() != nullptr);
+
+        VkShaderCreateInfoEXT& lInfo = lCreateInfos[i];
+        lInfo = { VK_STRUCTURE_TYPE_SHADER_CREATE_INFO_EXT };
+        lInfo.flags = pShaderCount > 1 ? VK_SHADER_CREATE_LINK_STAGE_BIT_EXT : 0;
+        lInfo.stage = lShader.mStage;
+        lInfo.nextStage = i + 1 < pShaderCount ? lShaders[i + 1]->mStage : 0;
+        lInfo.codeType = VK_SHADER_CODE_TYPE_SPIRV_EXT;
+        lInfo.codeSize = lShader.codeSize() * sizeof(uint32_t);
+        lInfo.pCode = lShader.code();
+        lInfo.pName = "main";
+        lInfo.setLayoutCount = pLayout.mSetCount;
+        lInfo.pSetLayouts = pLayout.mSetLayouts;
+        lInfo.pushConstantRangeCount = pLayout.mPushConstants.size > 0 ? 1 : 0;
+        lInfo.pPushConstantRanges = &pLayout.mPushConstants;
+        lInfo.pSpecializationInfo = pSpecialization;
+    }
+    VK_CHECK(vkCreateShadersEXT(*pDevice, pShaderCount, lCreateInfos, nullptr, mShaders));
+    mShaderCount = pShaderCount;
+
+    mBindCount = 0;
+    auto lAddBindStage = [&](VkShaderStageFlagBits pStage)
+    {
+        mBindStages[mBindCount] = pStage;
+        mBindShaders[mBindCount] = VK_NULL_HANDLE;
+        for (uint32_t i = 0; i < pShaderCount; ++i)
+        {
+            if (lShaders[i]->mStage == pStage)
+                mBindShaders[mBindCount] = mShaders[i];
+        }
+        ++mBindCount;
+    };
+    if (lCompute)
+    {
+        lAddBindStage(VK_SHADER_STAGE_COMPUTE_BIT);
+        return;
+    }
+
+    // A stage left bound by a previous draw would be used, the stages of the enabled features must be unbound
+    lAddBindStage(VK_SHADER_STAGE_VERTEX_BIT);
+    if (pDevice->mEnabledDeviceFeatures.tessellationShader)
+    {
+        lAddBindStage(VK_SHADER_STAGE_TESSELLATION_CONTROL_BIT);
+        lAddBindStage(VK_SHADER_STAGE_TESSELLATION_EVALUATION_BIT);
+    }
+    if (pDevice->mEnabledDeviceFeatures.geometryShader)
+        lAddBindStage(VK_SHADER_STAGE_GEOMETRY_BIT);
+    lAddBindStage(VK_SHADER_STAGE_FRAGMENT_BIT);
+}
+
+/******************************************************************************/
+void ShaderObjects::destroy(VkDevice pDevice)
+{
+    for (uint32_t i = 0; i < mShaderCount; ++i)
+        vkDestroyShaderEXT(pDevice, mShaders[i], nullptr);
+    mShaderCount = 0;
+    mBindCount = 0;
+}
+
+/******************************************************************************/
+void ShaderObjects::bind(VkCommandBuffer pCmd) const
+{
+    assert(isValid());
+    vkCmdBindShadersEXT(pCmd, mBindCount, mBindStages, mBindShaders);
+}
+
+/******************************************************************************/
+void ShaderObjects::setState(VkCommandBuffer pCmd, const PipelineBuilder& pState, VkExtent2D pExtent)
+{
+    VkViewport lViewport = { 0.0f, 0.0f, (float)pExtent.width, (float)pExtent.height, 0.0f, 1.0f };
+    VkRect2D lScissor = { { 0, 0 }, pExtent };
+    vkCmdSetViewportWithCount(pCmd, 1, &lViewport);
+    vkCmdSetScissorWithCount(pCmd, 1, &lScissor);
+
+    // Vertex input, no vertex buffer (see PipelineBuilder::build)
+    vkCmdSetVertexInputEXT(pCmd, 0, nullptr, 0, nullptr);
+    vkCmdSetPrimitiveTopology(pCmd, pState.mInputAssembly.topology);
+    vkCmdSetPrimitiveRestartEnable(pCmd, pState.mInputAssembly.primitiveRestartEnable);
+
+    // Rasterization, wide lines are not enabled
+    const VkPipelineRasterizationStateCreateInfo& lRasterizer = pState.mRasterizer;
+    vkCmdSetRasterizerDiscardEnable(pCmd, lRasterizer.rasterizerDiscardEnable);
+    vkCmdSetPolygonModeEXT(pCmd, lRasterizer.polygonMode);
+    vkCmdSetCullMode(pCmd, lRasterizer.cullMode);
+    vkCmdSetFrontFace(pCmd, lRasterizer.frontFace);
+    vkCmdSetLineWidth(pCmd, 1.0f);
+    vkCmdSetDepthBiasEnable(pCmd, lRasterizer.depthBiasEnable);
+    if (lRasterizer.depthBiasEnable)
+        vkCmdSetDepthBias(pCmd, lRasterizer.depthBiasConstantFactor, lRasterizer.depthBiasClamp, lRasterizer.depthBiasSlopeFactor);
+
+    // Multisampling
+    const VkPipelineMultisampleStateCreateInfo& lMultisampling = pState.mMultisampling;
+    const VkSampleCountFlagBits lSamples = lMultisampling.rasterizationSamples != 0 ? lMultisampling.rasterizationSamples : VK_SAMPLE_COUNT_1_BIT;
+    const VkSampleMask lSampleMask[2] = { ~0u, ~0u };     // Up to 64 samples
+    vkCmdSetRasterizationSamplesEXT(pCmd, lSamples);
+    vkCmdSetSampleMaskEXT(pCmd, lSamples, lMultisampling.pSampleMask != nullptr ? lMultisampling.pSampleMask : lSampleMask);
+    vkCmdSetAlphaToCoverageEnableEXT(pCmd, lMultisampling.alphaToCoverageEnable);
+
+    // Depth/stencil
+    const VkPipelineDepthStencilStateCreateInfo& lDepthStencil = pState.mDepthStencil;
+    vkCmdSetDepthTestEnable(pCmd, lDepthStencil.depthTestEnable);
+    vkCmdSetDepthWriteEnable(pCmd, lDepthStencil.depthWriteEnable);
+    vkCmdSetDepthCompareOp(pCmd, lDepthStencil.depthCompareOp);
+    vkCmdSetDepthBoundsTestEnable(pCmd, lDepthStencil.depthBoundsTestEnable);
+    if (lDepthStencil.depthBoundsTestEnable)
+        vkCmdSetDepthBounds(pCmd, lDepthStencil.minDepthBounds, lDepthStencil.maxDepthBounds);
+    vkCmdSetStencilTestEnable(pCmd, lDepthStencil.stencilTestEnable);
+    if (lDepthStencil.stencilTestEnable)
+    {
+        const VkStencilOpState& lFront = lDepthStencil.front;
+        const VkStencilOpState& lBack = lDepthStencil.back;
+        vkCmdSetStencilOp(pCmd, VK_STENCIL_FACE_FRONT_BIT, lFront.failOp, lFront.passOp, lFront.depthFailOp, lFront.compareOp);
+        vkCmdSetStencilOp(pCmd, VK_STENCIL_FACE_BACK_BIT, lBack.failOp, lBack.passOp, lBack.depthFailOp, lBack.compareOp);
+        vkCmdSetStencilCompareMask(pCmd, VK_STENCIL_FACE_FRONT_BIT, lFront.compareMask);
+        vkCmdSetStencilCompareMask(pCmd, VK_STENCIL_FACE_BACK_BIT, lBack.compareMask);
+        vkCmdSetStencilWriteMask(pCmd, VK_STENCIL_FACE_FRONT_BIT, lFront.writeMask);
+        vkCmdSetStencilWriteMask(pCmd, VK_STENCIL_FACE_BACK_BIT, lBack.writeMask);
+        vkCmdSetStencilReference(pCmd, VK_STENCIL_FACE_FRONT_BIT, lFront.reference);
+        vkCmdSetStencilReference(pCmd, VK_STENCIL_FACE_BACK_BIT, lBack.reference);
+    }
+
+    // Color blending, a single attachment (see PipelineBuilder::build)
+    if (pState.mRenderInfo.colorAttachmentCount == 0)
+        return;
+    const VkPipelineColorBlendAttachmentState& lBlend = pState.mColorBlendAttachment;
+    VkBool32 lBlendEnable = lBlend.blendEnable;
+    VkColorBlendEquationEXT lEquation = { lBlend.srcColorBlendFactor, lBlend.dstColorBlendFactor, lBlend.colorBlendOp,
+        lBlend.srcAlphaBlendFactor, lBlend.dstAlphaBlendFactor, lBlend.alphaBlendOp };
+    vkCmdSetColorBlendEnableEXT(pCmd, 0, 1, &lBlendEnable);
+    vkCmdSetColorBlendEquationEXT(pCmd, 0, 1, &lEquation);
+    vkCmdSetColorWriteMaskEXT(pCmd, 0, 1, &lBlend.colorWriteMask);
+}
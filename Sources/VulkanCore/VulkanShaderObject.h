@@ -0,0 +1,43 @@
+#pragma once
+
+#include "vk_common.h"
+#include "VulkanShader.h"
+#include "VulkanPipelineLayout.h"
+
+struct VulkanDevice;
+struct PipelineBuilder;
+
+// Shaders bound without pipeline (VK_EXT_shader_object, VulkanDevice::ShaderBackend::ShaderObjects)
+// Created from the spirv of the shaders (VulkanShader::code()) with the sets and push constants of a reflected
+// layout (PipelineLayoutCache), the descriptors are bound with the pipeline layout as usual.
+// The graphics stages created together are linked (VK_SHADER_CREATE_LINK_STAGE_BIT_EXT) so the driver can
+// optimize across them like in a pipeline. No state is baked: setState() records the state of a PipelineBuilder
+// as dynamic state before the draws, the same description serves both backends.
+struct ShaderObjects
+{
+    static const uint32_t cMaxStages = 5;   // Vertex, tessellation control/evaluation, geometry, fragment
+
+    static bool isSupported(const VulkanDevice& pDevice);
+
+    // All graphics stages or a single compute shader. pSpecialization (optional) applies to all the stages.
+    void create(VulkanDevice* pDevice, const VulkanShader* const* pShaders, uint32_t pShaderCount,
+        const PipelineLayoutCache::Layout& pLayout, const VkSpecializationInfo* pSpecialization = nullptr);
+    void destroy(VkDevice pDevice);
+
+    inline bool isValid() const { return mShaderCount > 0; }
+
+    // Bind the shaders, the stages without shader of the enabled features are unbound
+    void bind(VkCommandBuffer pCmd) const;
+
+    // Record the state described by pState (mShaderStages and mPipelineLayout are ignored), viewport and scissor cover pExtent.
+    // Everything a draw needs with shader objects is set, nothing is tracked.
+    static void setState(VkCommandBuffer pCmd, const PipelineBuilder& pState, VkExtent2D pExtent);
+
+    VkShaderEXT mShaders[cMaxStages] = {};
+    uint32_t mShaderCount = 0;
+
+    // Stages given to vkCmdBindShadersEXT, VK_NULL_HANDLE for the unused ones
+    VkShaderStageFlagBits mBindStages[cMaxStages] = {};
+    VkShaderEXT mBindShaders[cMaxStages] = {};
+    uint32_t mBindCount = 0;
+};
@@ -0,0 +1,167 @@
+#include "VulkanShaderPermutations.h"
+
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+
+/******************************************************************************/
+bool ShaderPermutations::init(VkDevice pDevice, ShaderCompiler* pCompiler, const std::string& pFilename)
+{
+    assert(mCompiler == nullptr && "ShaderPermutations : already initialized");
+    mDevice = pDevice;
+    mCompiler = pCompiler;
+    mFilename = pFilename;
+    mKeywords.clear();
+    mFailed = 0;
+
+    ShaderCompiler::Sources lSources;
+    if (!mCompiler->readSources(pFilename, lSources))
+    {
+        printf("ShaderPermutations : can't read %s\n", pFilename.c_str());
+        return false;
+    }
+    return parseKeywords(lSources.mFiles[0].mText);
+}
+
+/******************************************************************************/
+void ShaderPermutations::destroy()
+{
+    // The compilations still running only reference the compiler and their future
+    for (const VulkanShader& lModule : mModules)
+        vkDestroyShaderModule(mDevice, lModule.mShaderModule, nullptr);
+    mModules.clear();
+    mModuleByHash.clear();
+    mVariants.clear();
+    mCompiler = nullptr;
+}
+
+/******************************************************************************/
+ShaderPermutations::Mask ShaderPermutations::getMask(const std::string& pKeyword) const
+{
+    for (uint32_t i = 0; i < (uint32_t)mKeywords.size(); ++i)
+    {
+        if (mKeywords[i] == pKeyword)
+            return 1u << i;
+    }
+    return 0;
+}
+
+/******************************************************************************/
+void ShaderPermutations::request(const Mask* pMasks, uint32_t pCount)
+{
+    std::lock_guard<std::mutex> lLock(mMutex);
+    for (uint32_t i = 0; i < pCount; ++i)
+        requestLocked(pMasks[i]);
+}
+
+/******************************************************************************/
+const VulkanShader& ShaderPermutations::get(Mask pMask)
+{
+    std::shared_future<ShaderCompiler::Result> lResult;
+    {
+        std::lock_guard<std::mutex> lLock(mMutex);
+        requestLocked(pMask);
+        const Variant& lVariant = mVariants[pMask];
+        if (lVariant.mShader != nullptr)
+            return *lVariant.mShader;
+        lResult = lVariant.mResult;
+    }
+
+    // Not under the lock, the other variants can be requested meanwhile
+    lResult.wait();
+
+    std::lock_guard<std::mutex> lLock(mMutex);
+    Variant& lVariant = mVariants[pMask];
+    if (lVariant.mShader == nullptr)
+        lVariant.mShader = resolve(lResult.get());
+    return *lVariant.mShader;
+}
+
+/******************************************************************************/
+ShaderPermutations::Stats ShaderPermutations::getStats() const
+{
+    std::lock_guard<std::mutex> lLock(mMutex);
+    Stats lStats;
+    lStats.mVariants = (uint32_t)mVariants.size();
+    lStats.mModules = (uint32_t)mModules.size();
+    lStats.mFailed = mFailed;
+    return lStats;
+}
+
+/******************************************************************************/
+/******************************************************************************/
+/******************************************************************************/
+bool ShaderPermutations::parseKeywords(const std::string& pSource)
+{
+    const size_t lStart = pSource.find("@keywords");
+    if (lStart == std::string::npos)
+        return true;    // Single variant, mask 0
+
+    size_t lEnd = pSource.find('\n', lStart);
+    if (lEnd == std::string::npos)
+        lEnd = pSource.size();
+
+    size_t i = lStart + strlen("@keywords");
+    while (i < lEnd)
+    {
+        i = pSource.find_first_not_of(" \t\r", i);
+        if (i >= lEnd)
+            break;
+        const size_t lWordEnd = std::min(pSource.find_first_of(" \t\r\n", i), lEnd);
+        mKeywords.push_back(pSource.substr(i, lWordEnd - i));
+        i = lWordEnd;
+    }
+
+    if (mKeywords.size() > cMaxKeywords)
+    {
+        printf("ShaderPermutations : %s declares %u keywords, %u max\n", mFilename.c_str(), (uint32_t)mKeywords.size(), cMaxKeywords);
+        mKeywords.resize(cMaxKeywords);
+        return false;
+    }
+    return true;
+}
+
+/******************************************************************************/
+void ShaderPermutations::requestLocked(Mask pMask)
+{
+    assert((mKeywords.size() >= cMaxKeywords || (pMask >> mKeywords.size()) == 0) && "ShaderPermutations : undeclared keyword in the mask");
+    if (mVariants.find(pMask) != mVariants.end())
+        return;
+
+    std::vector<ShaderCompiler::Define> lDefines;
+    for (uint32_t i = 0; i < (uint32_t)mKeywords.size(); ++i)
+    {
+        if (pMask & (1u << i))
+            lDefines.push_back({ mKeywords[i], "1" });
+    }
+    mVariants[pMask].mResult = mCompiler->compileAsync(mFilename, lDefines);
+}
+
+/******************************************************************************/
+const VulkanShader* ShaderPermutations::resolve(const ShaderCompiler::Result& pResult)
+{
+    if (!pResult.isValid())
+    {
+        ++mFailed;
+        return &mInvalid;
+    }
+
+    // FNV-1a of the spirv, the code is compared on a hash match
+    uint64_t lHash = 14695981039346656037ull;
+    const uint8_t* lBytes = (const uint8_t*)pResult.mCode.data();
+    for (size_t i = 0; i < pResult.mCode.size() * sizeof(uint32_t); ++i)
+        lHash = (lHash ^ lBytes[i]) * 1099511628211ull;
+
+    auto lRange = mModuleByHash.equal_range(lHash);
+    for (auto lIt = lRange.first; lIt != lRange.second; ++lIt)
+    {
+        const VulkanShader& lModule = mModules[lIt->second];
+        if (lModule.mCode == pResult.mCode)
+            return &lModule;
+    }
+
+    mModules.push_back(VulkanShader::loadFromCode(mDevice, pResult.mCode.data(), pResult.mCode.size()));
+    mModuleByHash.insert({ lHash, (uint32_t)mModules.size() - 1 });
+    return &mModules.back();
+}
@@ -0,0 +1,70 @@
+#pragma once
+
+#include "vk_common.h"
+#include "VulkanShader.h"
+#include "VulkanShaderCompiler.h"
+
+#include <deque>
+#include <future>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Variants of a shader selected by a mask of feature keywords
+// The shader declares its keywords in a comment line of its source: // @keywords OBJECT_SBO VERTEX_COLOR ...
+// The keyword i is the bit i of the mask, a variant is compiled with #define <keyword> 1 for each bit set:
+// the code under #ifdef is stripped from the variants not using it, instead of a runtime branch.
+// The variants are compiled in parallel on the ShaderCompiler workers (from its spirv cache when unchanged).
+// Variants producing the same spirv (ex: a keyword unused by this stage) share their VkShaderModule.
+// Thread safe, except init/destroy.
+struct ShaderPermutations
+{
+    using Mask = uint32_t;
+    static const uint32_t cMaxKeywords = 32;
+
+    struct Stats
+    {
+        uint32_t mVariants = 0;         // Masks requested
+        uint32_t mModules = 0;          // Distinct spirv, <= mVariants
+        uint32_t mFailed = 0;
+    };
+
+    // pFilename relative to the compiler shader path
+    bool init(VkDevice pDevice, ShaderCompiler* pCompiler, const std::string& pFilename);
+    void destroy();
+
+    // Bit of the keyword, 0 when the shader doesn't declare it (the feature doesn't exist in this shader)
+    Mask getMask(const std::string& pKeyword) const;
+    inline const std::vector<std::string>& getKeywords() const { return mKeywords; }
+
+    // Start the compilation of the variants known to be needed (ex: the materials of a scene), does not block
+    void request(const Mask* pMasks, uint32_t pCount);
+    // Variant of pMask, compiled now if it was not requested. Invalid shader if the compilation failed.
+    // The reference stays valid until destroy().
+    const VulkanShader& get(Mask pMask);
+
+    Stats getStats() const;
+
+    struct Variant
+    {
+        std::shared_future<ShaderCompiler::Result> mResult;
+        const VulkanShader* mShader = nullptr;     // Once resolved
+    };
+
+    bool parseKeywords(const std::string& pSource);
+    void requestLocked(Mask pMask);
+    const VulkanShader* resolve(const ShaderCompiler::Result& pResult);
+
+    VkDevice mDevice = VK_NULL_HANDLE;
+    ShaderCompiler* mCompiler = nullptr;
+    std::string mFilename;
+    std::vector<std::string> mKeywords;
+
+    mutable std::mutex mMutex;
+    std::unordered_map<Mask, Variant> mVariants;
+    std::deque<VulkanShader> mModules;                      // Stable addresses
+    std::unordered_multimap<uint64_t, uint32_t> mModuleByHash;  // Hash of the spirv -> mModules index
+    VulkanShader mInvalid = {};
+    uint32_t mFailed = 0;
+};
@@ -0,0 +1,258 @@
+#include "VulkanTexture.h"
+#include "VulkanDevice.h"
+#include "VulkanHelper.h"
+
+#include <assert.h>
+#include <stdio.h>
+
+static const uint32_t cMaxLevelsPerDispatch = 4;
+static const uint32_t cDownsampleGroupSize = 8;
+
+// Must match Shaders/downsample.comp.glsl
+struct DownsamplePushConstants
+{
+    int32_t mSrcSize[2];
+    int32_t mSrcLevel;
+    int32_t mLevelCount;
+};
+
+/******************************************************************************/
+void MipmapGenerator::init(VulkanDevice* pDevice, const std::string& pShaderPath)
+{
+    mDevice = pDevice;
+    VkDevice lDevice = mDevice->mLogicalDevice;
+
+    // The compute path is optional, the blit path works without it
+    if (mDevice->mMaxPushDescriptors < 1 + cMaxLevelsPerDispatch)
+    {
+        printf("MipmapGenerator : VK_KHR_push_descriptor not supported, only blittable formats will have mips\n");
+        return;
+    }
+    mDownsampleShader = VulkanShader::loadFromFile(lDevice, pShaderPath + "downsample.comp.glsl.spv");
+    if (!mDownsampleShader.isValid())
+    {
+        printf("MipmapGenerator : downsample.comp.glsl.spv not found, only blittable formats will have mips\n");
+        return;
+    }
+
+    VkDescriptorSetLayoutBinding lBindings[2] = {};
+    lBindings[0].binding = 0;
+    lBindings[0].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    lBindings[0].descriptorCount = 1;
+    lBindings[0].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+    lBindings[1].binding = 1;
+    lBindings[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+    lBindings[1].descriptorCount = cMaxLevelsPerDispatch;
+    lBindings[1].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+
+    // Push descriptors, no pool needed for a one shot job
+    VkDescriptorSetLayoutCreateInfo lLayoutInfo = { VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO };
+    lLayoutInfo.flags = VK_DESCRIPTOR_SET_LAYOUT_CREATE_PUSH_DESCRIPTOR_BIT_KHR;
+    lLayoutInfo.bindingCount = ARRAY_COUNT(lBindings);
+    lLayoutInfo.pBindings = lBindings;
+    VK_CHECK(vkCreateDescriptorSetLayout(lDevice, &lLayoutInfo, nullptr, &mSetLayout));
+
+    VkPushConstantRange lPushConstantRange = vkh::pushConstantRange(VK_SHADER_STAGE_COMPUTE_BIT, sizeof(DownsamplePushConstants));
+    VkPipelineLayoutCreateInfo lPipelineLayoutInfo = vkh::pipelineLayoutCreateInfo(&mSetLayout, 1, &lPushConstantRange, 1);
+    VK_CHECK(vkCreatePipelineLayout(lDevice, &lPipelineLayoutInfo, nullptr, &mPipelineLayout));
+
+    VkPipelineShaderStageCreateInfo lStage = vkh::pipelineShaderStageCreateInfo(mDownsampleShader.mStage, mDownsampleShader.mShaderModule);
+    VkComputePipelineCreateInfo lPipelineInfo = vkh::computePipelineCreateInfo(mPipelineLayout, lStage);
+    VkPipeline lPipeline = mDevice->createComputePipeline(lPipelineInfo);
+    mPipeline = mDevice->addPipeline(lPipeline, mPipelineLayout, VK_PIPELINE_BIND_POINT_COMPUTE);
+
+    // texelFetch only, the filtering is done in the shader
+    VkSamplerCreateInfo lSamplerInfo = { VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO };
+    lSamplerInfo.magFilter = VK_FILTER_NEAREST;
+    lSamplerInfo.minFilter = VK_FILTER_NEAREST;
+    lSamplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+    lSamplerInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    lSamplerInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    lSamplerInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    lSamplerInfo.maxLod = VK_LOD_CLAMP_NONE;
+    VK_CHECK(vkCreateSampler(lDevice, &lSamplerInfo, nullptr, &mPointSampler));
+}
+
+/******************************************************************************/
+void MipmapGenerator::destroy()
+{
+    VkDevice lDevice = mDevice->mLogicalDevice;
+    releaseTransientViews();
+
+    if (mPipeline.isValid())
+        mDevice->destroyPipeline(mPipeline);
+    mPipeline = PipelineHandle();
+
+    mDevice->destroySampler(mPointSampler);
+    vkDestroyPipelineLayout(lDevice, mPipelineLayout, nullptr);
+    vkDestroyDescriptorSetLayout(lDevice, mSetLayout, nullptr);
+    if (mDownsampleShader.isValid())
+        vkDestroyShaderModule(lDevice, mDownsampleShader.mShaderModule, nullptr);
+
+    mPointSampler = VK_NULL_HANDLE;
+    mPipelineLayout = VK_NULL_HANDLE;
+    mSetLayout = VK_NULL_HANDLE;
+    mDownsampleShader = {};
+}
+
+/******************************************************************************/
+bool MipmapGenerator::supportBlit(VkFormat pFormat) const
+{
+    return mDevice->isFormatSupported(pFormat, VK_FORMAT_FEATURE_BLIT_SRC_BIT | VK_FORMAT_FEATURE_BLIT_DST_BIT | VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT);
+}
+
+/******************************************************************************/
+bool MipmapGenerator::supportCompute(VkFormat pFormat) const
+{
+    if (!mPipeline.isValid() || !mDevice->mEnabledDeviceFeatures.shaderStorageImageWriteWithoutFormat)
+        return false;
+
+    return mDevice->isFormatSupported(pFormat, VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT | VK_FORMAT_FEATURE_STORAGE_IMAGE_BIT);
+}
+
+/******************************************************************************/
+VkImageUsageFlags MipmapGenerator::requiredUsage(VkFormat pFormat) const
+{
+    if (supportBlit(pFormat))
+        return VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+    if (supportCompute(pFormat))
+        return VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+    return 0;
+}
+
+/******************************************************************************/
+void MipmapGenerator::generate(VkCommandBuffer pCmd, ImageHandle pImage, VkImageLayout pFinalLayout)
+{
+    VkImage lImage = mDevice->getImage(pImage);
+    VkExtent3D lExtent = mDevice->getImageExtent(pImage);
+    VkFormat lFormat = mDevice->getImageFormat(pImage);
+    uint32_t lMipLevels = mDevice->getImageMipLevels(pImage);
+
+    if (lMipLevels <= 1)
+    {
+        vkh::transitionImage(pCmd, lImage, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, pFinalLayout);
+        return;
+    }
+
+    if (supportBlit(lFormat))
+    {
+        vkh::generateMipmapsBlit(pCmd, lImage, { lExtent.width, lExtent.height }, lMipLevels, pFinalLayout);
+        return;
+    }
+
+    if (!supportCompute(lFormat))
+    {
+        // Only the level 0 is valid, the other levels content is undefined
+        printf("MipmapGenerator : format %d can't be blitted nor written as storage image, mips are not generated\n", (int)lFormat);
+        assert(!"MipmapGenerator : unsupported format");
+        vkh::transitionImage(pCmd, lImage, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, pFinalLayout, 0, 1);
+        vkh::transitionImage(pCmd, lImage, VK_IMAGE_LAYOUT_UNDEFINED, pFinalLayout, 1, lMipLevels - 1);
+        return;
+    }
+
+    // Compute path, the whole chain stay in GENERAL during the generation
+    VkDevice lDevice = mDevice->mLogicalDevice;
+    vkh::transitionImage(pCmd, lImage, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_GENERAL, 0, 1);
+    vkh::transitionImage(pCmd, lImage, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL, 1, lMipLevels - 1);
+
+    VkImageView lLevelViews[cMaxLevelsPerDispatch] = {};
+    vkCmdBindPipeline(pCmd, VK_PIPELINE_BIND_POINT_COMPUTE, mDevice->getPipeline(mPipeline));
+
+    for (uint32_t lSrcLevel = 0; lSrcLevel + 1 < lMipLevels; lSrcLevel += cMaxLevelsPerDispatch)
+    {
+        uint32_t lLevelCount = lMipLevels - 1 - lSrcLevel;
+        if (lLevelCount > cMaxLevelsPerDispatch)
+            lLevelCount = cMaxLevelsPerDispatch;
+
+        // One view per destination level, the unused slots repeat the last one (never written)
+        for (uint32_t i = 0; i < cMaxLevelsPerDispatch; ++i)
+        {
+            if (i < lLevelCount)
+            {
+                VkImageViewCreateInfo lViewInfo = vkh::imageViewCreateInfo(lImage, lFormat);
+                lViewInfo.subresourceRange.baseMipLevel = lSrcLevel + 1 + i;
+                VK_CHECK(vkCreateImageView(lDevice, &lViewInfo, nullptr, &lLevelViews[i]));
+                mTransientViews.push_back(lLevelViews[i]);
+            }
+            else
+            {
+                lLevelViews[i] = lLevelViews[lLevelCount - 1];
+            }
+        }
+
+        VkDescriptorImageInfo lSourceInfo = { mPointSampler, mDevice->getImageView(pImage), VK_IMAGE_LAYOUT_GENERAL };
+        VkDescriptorImageInfo lDestInfos[cMaxLevelsPerDispatch];
+        for (uint32_t i = 0; i < cMaxLevelsPerDispatch; ++i)
+            lDestInfos[i] = { VK_NULL_HANDLE, lLevelViews[i], VK_IMAGE_LAYOUT_GENERAL };
+
+        VkWriteDescriptorSet lWrites[2] = {};
+        lWrites[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        lWrites[0].dstBinding = 0;
+        lWrites[0].descriptorCount = 1;
+        lWrites[0].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+        lWrites[0].pImageInfo = &lSourceInfo;
+        lWrites[1].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        lWrites[1].dstBinding = 1;
+        lWrites[1].descriptorCount = cMaxLevelsPerDispatch;
+        lWrites[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+        lWrites[1].pImageInfo = lDestInfos;
+        vkCmdPushDescriptorSetKHR(pCmd, VK_PIPELINE_BIND_POINT_COMPUTE, mPipelineLayout, 0, ARRAY_COUNT(lWrites), lWrites);
+
+        uint32_t lSrcWidth = lExtent.width >> lSrcLevel;
+        uint32_t lSrcHeight = lExtent.height >> lSrcLevel;
+        DownsamplePushConstants lConstants;
+        lConstants.mSrcSize[0] = (int32_t)(lSrcWidth > 0 ? lSrcWidth : 1);
+        lConstants.mSrcSize[1] = (int32_t)(lSrcHeight > 0 ? lSrcHeight : 1);
+        lConstants.mSrcLevel = (int32_t)lSrcLevel;
+        lConstants.mLevelCount = (int32_t)lLevelCount;
+        vkCmdPushConstants(pCmd, mPipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(lConstants), &lConstants);
+
+        // One thread per texel of the first destination level
+        uint32_t lDstWidth = lConstants.mSrcSize[0] > 1 ? lConstants.mSrcSize[0] / 2 : 1;
+        uint32_t lDstHeight = lConstants.mSrcSize[1] > 1 ? lConstants.mSrcSize[1] / 2 : 1;
+        vkCmdDispatch(pCmd, (lDstWidth + cDownsampleGroupSize - 1) / cDownsampleGroupSize, (lDstHeight + cDownsampleGroupSize - 1) / cDownsampleGroupSize, 1);
+
+        // The last written level is the source of the next dispatch
+        vkh::transitionImage(pCmd, lImage, VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_LAYOUT_GENERAL);
+    }
+
+    vkh::transitionImage(pCmd, lImage, VK_IMAGE_LAYOUT_GENERAL, pFinalLayout);
+}
+
+/******************************************************************************/
+void MipmapGenerator::releaseTransientViews()
+{
+    for (VkImageView lView : mTransientViews)
+        vkDestroyImageView(mDevice->mLogicalDevice, lView, nullptr);
+    mTransientViews.clear();
+}
+
+/******************************************************************************/
+/******************************************************************************/
+/******************************************************************************/
+ImageHandle createTexture2D(VulkanDevice* pDevice, VkCommandBuffer pCmd, MipmapGenerator& pMipmapGenerator, BufferHandle pStaging, VkExtent2D pExtent, VkFormat pFormat)
+{
+    VkImageUsageFlags lUsages = VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT | pMipmapGenerator.requiredUsage(pFormat);
+    uint32_t lMipLevels = vkh::mipLevelCount(pExtent);
+    VkImageCreateInfo lImageInfo = vkh::imageCreateInfo(pFormat, lUsages, { pExtent.width, pExtent.height, 1 }, lMipLevels);
+
+    ImageHandle lTexture = pDevice->createImage(lImageInfo, VK_IMAGE_ASPECT_COLOR_BIT);
+    if (!lTexture.isValid())
+        return lTexture;
+
+    VkImage lImage = pDevice->getImage(lTexture);
+
+    // Upload level 0
+    vkh::transitionImage(pCmd, lImage, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 0, 1);
+
+    VkBufferImageCopy lCopyRegion = {};
+    lCopyRegion.bufferOffset = 0;
+    lCopyRegion.bufferRowLength = 0;
+    lCopyRegion.bufferImageHeight = 0;
+    lCopyRegion.imageSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1 };
+    lCopyRegion.imageExtent = { pExtent.width, pExtent.height, 1 };
+    vkCmdCopyBufferToImage(pCmd, pDevice->getBuffer(pStaging), lImage, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &lCopyRegion);
+
+    pMipmapGenerator.generate(pCmd, lTexture, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+    return lTexture;
+}
@@ -0,0 +1,49 @@
+#pragma once
+
+#include "vk_common.h"
+#include "VulkanHandle.h"
+#include "VulkanShader.h"
+
+#include <string>
+#include <vector>
+
+struct VulkanDevice;
+
+// Build the mip chain of the textures on the gpu after the upload of the level 0
+// Use a vkCmdBlitImage2 chain when the format support it, else a compute downsampler
+// (Shaders/downsample.comp.glsl, up to 4 levels per dispatch) for the formats
+// that can be written as storage image.
+struct MipmapGenerator
+{
+    void init(VulkanDevice* pDevice, const std::string& pShaderPath);
+    void destroy();
+
+    bool supportBlit(VkFormat pFormat) const;
+    bool supportCompute(VkFormat pFormat) const;
+
+    // Usage flags the image need for the generation path of its format
+    VkImageUsageFlags requiredUsage(VkFormat pFormat) const;
+
+    // Record the generation, level 0 is expected in VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL
+    // All the levels end in pFinalLayout
+    void generate(VkCommandBuffer pCmd, ImageHandle pImage, VkImageLayout pFinalLayout);
+
+    // The compute path create a view per level, destroy them once the command buffer has completed
+    void releaseTransientViews();
+
+    VulkanDevice* mDevice = nullptr;
+
+    // Compute path
+    VulkanShader mDownsampleShader = {};
+    VkDescriptorSetLayout mSetLayout = VK_NULL_HANDLE;      // Push descriptor layout
+    VkPipelineLayout mPipelineLayout = VK_NULL_HANDLE;
+    PipelineHandle mPipeline;
+    VkSampler mPointSampler = VK_NULL_HANDLE;
+    std::vector<VkImageView> mTransientViews;
+};
+
+// Create a sampled 2D texture with a full mip chain
+// Record the copy of the level 0 from pStaging (tightly packed pixels) and the mip generation,
+// pStaging must be kept alive until pCmd has completed.
+// The texture ends in VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL
+ImageHandle createTexture2D(VulkanDevice* pDevice, VkCommandBuffer pCmd, MipmapGenerator& pMipmapGenerator, BufferHandle pStaging, VkExtent2D pExtent, VkFormat pFormat);
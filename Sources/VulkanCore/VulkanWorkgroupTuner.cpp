@@ -0,0 +1,328 @@
+#include "VulkanWorkgroupTuner.h"
+#include "VulkanDevice.h"
+#include "VulkanHelper.h"
+#include "MappedFile.h"
+
+#include <assert.h>
+#include <float.h>
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <filesystem>
+
+namespace
+{
+    struct FileHeader
+    {
+        uint32_t mMagic;
+        uint32_t mVersion;
+        uint32_t mEntryCount;
+    };
+
+    // Candidate local sizes by number of specialized axes
+    const uint32_t cSizes1D[][1] = { { 32 }, { 64 }, { 128 }, { 256 }, { 512 }, { 1024 } };
+    const uint32_t cSizes2D[][2] = { { 8, 4 }, { 8, 8 }, { 16, 4 }, { 16, 8 }, { 16, 16 }, { 32, 4 }, { 32, 8 }, { 32, 16 }, { 64, 4 } };
+    const uint32_t cSizes3D[][3] = { { 4, 4, 4 }, { 8, 4, 4 }, { 8, 8, 4 }, { 8, 8, 8 }, { 16, 4, 4 }, { 16, 8, 4 } };
+}
+
+/******************************************************************************/
+void WorkgroupTuner::Specialization::init(const VulkanShader& pShader, const Config& pConfig)
+{
+    uint32_t lCount = 0;
+    for (uint32_t i = 0; i < 3; ++i)
+    {
+        const uint32_t lSpecId = pShader.mReflection.mLocalSizeSpecIds[i];
+        if (lSpecId == ~0u)
+            continue;
+        mValues[lCount] = pConfig.mLocalSize[i];
+        mEntries[lCount] = { lSpecId, lCount * (uint32_t)sizeof(uint32_t), sizeof(uint32_t) };
+        ++lCount;
+    }
+    mInfo = {};
+    mInfo.mapEntryCount = lCount;
+    mInfo.pMapEntries = mEntries;
+    mInfo.dataSize = lCount * sizeof(uint32_t);
+    mInfo.pData = mValues;
+
+    mSubgroupSize = { VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_REQUIRED_SUBGROUP_SIZE_CREATE_INFO };
+    mSubgroupSize.requiredSubgroupSize = pConfig.mSubgroupSize;
+
+    mStage = vkh::pipelineShaderStageCreateInfo(pShader.mStage, pShader.mShaderModule, "main", lCount > 0 ? &mInfo : nullptr);
+    if (pConfig.mSubgroupSize != 0)
+        mStage.pNext = &mSubgroupSize;
+}
+
+/******************************************************************************/
+void WorkgroupTuner::init(VulkanDevice* pDevice, const Settings& pSettings)
+{
+    assert(mDevice == nullptr && "WorkgroupTuner : already initialized");
+    mDevice = pDevice;
+    mSettings = pSettings;
+    mDirty = false;
+    load();
+}
+
+/******************************************************************************/
+void WorkgroupTuner::shutdown()
+{
+    if (mDevice == nullptr)
+        return;
+
+    if (mDirty)
+        save();
+
+    if (mCommandPool != VK_NULL_HANDLE)
+    {
+        vkDestroyQueryPool(*mDevice, mQueryPool, nullptr);
+        vkDestroyFence(*mDevice, mFence, nullptr);
+        vkDestroyCommandPool(*mDevice, mCommandPool, nullptr);
+        mCommandPool = VK_NULL_HANDLE;
+    }
+    mEntries.clear();
+    mDevice = nullptr;
+}
+
+/******************************************************************************/
+WorkgroupTuner::Config WorkgroupTuner::getConfig(const std::string& pName, const VulkanShader& pShader, VkPipelineLayout pLayout, const RecordDispatch& pRecord)
+{
+    assert(pShader.mStage == VK_SHADER_STAGE_COMPUTE_BIT);
+    assert(pName.size() < cMaxNameLength && "WorkgroupTuner : kernel name too long");
+
+    Config lDefault;
+    for (uint32_t i = 0; i < 3; ++i)
+        lDefault.mLocalSize[i] = pShader.mReflection.mLocalSize[i] > 0 ? pShader.mReflection.mLocalSize[i] : 1;
+    if (!pShader.mReflection.hasSpecializedLocalSize())
+        return lDefault;
+
+    std::lock_guard<std::mutex> lLock(mMutex);
+    if (Entry* lEntry = findEntry(pName))
+        return lEntry->mConfig;
+
+    const uint32_t lGraphicsFamily = mDevice->getQueueFamilyIndex(VulkanQueueType::Graphics);
+    if (mDevice->mQueueFamilyProperties[lGraphicsFamily].timestampValidBits == 0)
+    {
+        printf("WorkgroupTuner : no timestamp support, %s uses its default local size\n", pName.c_str());
+        return lDefault;
+    }
+
+    std::vector<Config> lCandidates;
+    getCandidates(pShader, lCandidates);
+
+    Config lBest = lDefault;
+    lBest.mMicroseconds = FLT_MAX;
+    for (Config& lCandidate : lCandidates)
+    {
+        lCandidate.mMicroseconds = measure(pShader, pLayout, lCandidate, pRecord);
+        if (lCandidate.mMicroseconds < lBest.mMicroseconds)
+            lBest = lCandidate;
+    }
+    if (lBest.mMicroseconds == FLT_MAX)
+        return lDefault;
+
+    printf("WorkgroupTuner : %s local size %ux%ux%u, subgroup size %u : %.2f us (%u candidates)\n", pName.c_str(),
+        lBest.mLocalSize[0], lBest.mLocalSize[1], lBest.mLocalSize[2], lBest.mSubgroupSize, lBest.mMicroseconds, (uint32_t)lCandidates.size());
+
+    const VkPhysicalDeviceProperties& lProperties = mDevice->mPhysicalDeviceProperties;
+    Entry lEntry = {};
+    lEntry.mVendorID = lProperties.vendorID;
+    lEntry.mDeviceID = lProperties.deviceID;
+    lEntry.mDriverVersion = lProperties.driverVersion;
+    snprintf(lEntry.mName, cMaxNameLength, "%s", pName.c_str());
+    lEntry.mConfig = lBest;
+    mEntries.push_back(lEntry);
+    mDirty = true;
+    return lBest;
+}
+
+/******************************************************************************/
+bool WorkgroupTuner::save()
+{
+    std::lock_guard<std::mutex> lLock(mMutex);
+    mDirty = false;
+
+    FileHeader lHeader = { cMagic, cVersion, (uint32_t)mEntries.size() };
+
+    // Write aside then replace, the previous file stays valid until the rename (see PipelineCache)
+    const std::string lTempFilename = mSettings.mFilename + ".tmp";
+    FILE* lFile = fopen(lTempFilename.c_str(), "wb");
+    if (lFile == nullptr)
+    {
+        printf("WorkgroupTuner : can't write %s\n", lTempFilename.c_str());
+        return false;
+    }
+    bool lWritten = fwrite(&lHeader, sizeof(lHeader), 1, lFile) == 1
+        && (mEntries.empty() || fwrite(mEntries.data(), sizeof(Entry), mEntries.size(), lFile) == mEntries.size());
+    lWritten = fflush(lFile) == 0 && lWritten;
+    lWritten = fclose(lFile) == 0 && lWritten;
+
+    std::error_code lError;
+    if (lWritten)
+        std::filesystem::rename(lTempFilename, mSettings.mFilename, lError);
+    if (!lWritten || lError)
+    {
+        printf("WorkgroupTuner : failed to save %s\n", mSettings.mFilename.c_str());
+        std::filesystem::remove(lTempFilename, lError);
+        return false;
+    }
+    return true;
+}
+
+/******************************************************************************/
+/******************************************************************************/
+/******************************************************************************/
+bool WorkgroupTuner::load()
+{
+    MappedFile lFile;
+    if (!lFile.open(mSettings.mFilename.c_str()))
+        return false;
+
+    FileHeader lHeader;
+    if (lFile.mSize < sizeof(lHeader))
+    {
+        printf("WorkgroupTuner : %s truncated, ignored\n", mSettings.mFilename.c_str());
+        return false;
+    }
+    memcpy(&lHeader, lFile.mData, sizeof(lHeader));
+    if (lHeader.mMagic != cMagic || lHeader.mVersion != cVersion || lFile.mSize != sizeof(lHeader) + (size_t)lHeader.mEntryCount * sizeof(Entry))
+    {
+        printf("WorkgroupTuner : %s invalid or outdated, ignored\n", mSettings.mFilename.c_str());
+        return false;
+    }
+
+    mEntries.resize(lHeader.mEntryCount);
+    if (lHeader.mEntryCount > 0)
+        memcpy(mEntries.data(), lFile.mData + sizeof(lHeader), lHeader.mEntryCount * sizeof(Entry));
+    for (Entry& lEntry : mEntries)
+        lEntry.mName[cMaxNameLength - 1] = 0;
+    return true;
+}
+
+/******************************************************************************/
+WorkgroupTuner::Entry* WorkgroupTuner::findEntry(const std::string& pName)
+{
+    // A new driver may change the fastest configuration
+    const VkPhysicalDeviceProperties& lProperties = mDevice->mPhysicalDeviceProperties;
+    for (Entry& lEntry : mEntries)
+    {
+        if (lEntry.mVendorID == lProperties.vendorID && lEntry.mDeviceID == lProperties.deviceID
+            && lEntry.mDriverVersion == lProperties.driverVersion && pName == lEntry.mName)
+            return &lEntry;
+    }
+    return nullptr;
+}
+
+/******************************************************************************/
+void WorkgroupTuner::getCandidates(const VulkanShader& pShader, std::vector<Config>& pCandidates) const
+{
+    const ShaderReflection& lReflection = pShader.mReflection;
+    const VkPhysicalDeviceLimits& lLimits = mDevice->mPhysicalDeviceProperties.limits;
+
+    uint32_t lAxisCount = 0;
+    for (uint32_t i = 0; i < 3; ++i)
+        lAxisCount += lReflection.mLocalSizeSpecIds[i] != ~0u ? 1 : 0;
+
+    const uint32_t* lSizes = lAxisCount == 1 ? &cSizes1D[0][0] : lAxisCount == 2 ? &cSizes2D[0][0] : &cSizes3D[0][0];
+    const uint32_t lSizeCount = lAxisCount == 1 ? (uint32_t)(sizeof(cSizes1D) / sizeof(cSizes1D[0]))
+        : lAxisCount == 2 ? (uint32_t)(sizeof(cSizes2D) / sizeof(cSizes2D[0])) : (uint32_t)(sizeof(cSizes3D) / sizeof(cSizes3D[0]));
+
+    // Subgroup size chosen by the driver, and each size it can be forced to
+    std::vector<uint32_t> lSubgroupSizes = { 0 };
+    for (uint32_t lSize = mDevice->mMinSubgroupSize; lSize != 0 && lSize <= mDevice->mMaxSubgroupSize; lSize *= 2)
+        lSubgroupSizes.push_back(lSize);
+
+    for (uint32_t s = 0; s < lSizeCount; ++s)
+    {
+        // The candidate sizes go to the specialized axes, the other axes keep their fixed size
+        Config lConfig;
+        const uint32_t* lSize = lSizes + s * lAxisCount;
+        uint32_t lInvocations = 1;
+        bool lValid = true;
+        for (uint32_t i = 0, lAxis = 0; i < 3; ++i)
+        {
+            lConfig.mLocalSize[i] = lReflection.mLocalSizeSpecIds[i] != ~0u ? lSize[lAxis++] : std::max(lReflection.mLocalSize[i], 1u);
+            lValid = lValid && lConfig.mLocalSize[i] <= lLimits.maxComputeWorkGroupSize[i];
+            lInvocations *= lConfig.mLocalSize[i];
+        }
+        if (!lValid || lInvocations > lLimits.maxComputeWorkGroupInvocations)
+            continue;
+
+        for (uint32_t lSubgroupSize : lSubgroupSizes)
+        {
+            if (lSubgroupSize != 0 && lInvocations > lSubgroupSize * mDevice->mMaxComputeWorkgroupSubgroups)
+                continue;
+            lConfig.mSubgroupSize = lSubgroupSize;
+            pCandidates.push_back(lConfig);
+        }
+    }
+}
+
+/******************************************************************************/
+float WorkgroupTuner::measure(const VulkanShader& pShader, VkPipelineLayout pLayout, const Config& pConfig, const RecordDispatch& pRecord)
+{
+    if (mCommandPool == VK_NULL_HANDLE)
+    {
+        mCommandPool = vkh::createCommandPool(*mDevice, mDevice->getQueueFamilyIndex(VulkanQueueType::Graphics), VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT);
+        VkCommandBufferAllocateInfo lCmdAllocInfo = vkh::commandBufferAllocateInfo(mCommandPool, 1, VK_COMMAND_BUFFER_LEVEL_PRIMARY);
+        VK_CHECK(vkAllocateCommandBuffers(*mDevice, &lCmdAllocInfo, &mCommandBuffer));
+        mFence = vkh::createFence(*mDevice, 0);
+
+        VkQueryPoolCreateInfo lQueryInfo = { VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO };
+        lQueryInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+        lQueryInfo.queryCount = 2;
+        VK_CHECK(vkCreateQueryPool(*mDevice, &lQueryInfo, nullptr, &mQueryPool));
+    }
+
+    Specialization lSpecialization;
+    lSpecialization.init(pShader, pConfig);
+    VkComputePipelineCreateInfo lPipelineInfo = vkh::computePipelineCreateInfo(pLayout, lSpecialization.mStage);
+    VkPipeline lPipeline = mDevice->createComputePipeline(lPipelineInfo);
+    if (lPipeline == VK_NULL_HANDLE)
+        return FLT_MAX;
+
+    // The dispatches are serialized, as the kernel would run in a frame
+    VkMemoryBarrier2 lBarrier = { VK_STRUCTURE_TYPE_MEMORY_BARRIER_2 };
+    lBarrier.srcStageMask = VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT;
+    lBarrier.srcAccessMask = VK_ACCESS_2_SHADER_WRITE_BIT;
+    lBarrier.dstStageMask = VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT;
+    lBarrier.dstAccessMask = VK_ACCESS_2_SHADER_READ_BIT | VK_ACCESS_2_SHADER_WRITE_BIT;
+    VkDependencyInfo lDependency = { VK_STRUCTURE_TYPE_DEPENDENCY_INFO };
+    lDependency.memoryBarrierCount = 1;
+    lDependency.pMemoryBarriers = &lBarrier;
+
+    VK_CHECK(vkResetCommandBuffer(mCommandBuffer, 0));
+    VkCommandBufferBeginInfo lBeginInfo = vkh::commandBufferBeginInfo(VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT);
+    VK_CHECK(vkBeginCommandBuffer(mCommandBuffer, &lBeginInfo));
+    vkCmdResetQueryPool(mCommandBuffer, mQueryPool, 0, 2);
+    vkCmdBindPipeline(mCommandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, lPipeline);
+
+    // Not timed, the first dispatch may pay for the pipeline upload or the caches
+    pRecord(mCommandBuffer, pConfig);
+    vkCmdPipelineBarrier2(mCommandBuffer, &lDependency);
+
+    vkCmdWriteTimestamp2(mCommandBuffer, VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT, mQueryPool, 0);
+    for (uint32_t i = 0; i < mSettings.mIterations; ++i)
+    {
+        pRecord(mCommandBuffer, pConfig);
+        vkCmdPipelineBarrier2(mCommandBuffer, &lDependency);
+    }
+    vkCmdWriteTimestamp2(mCommandBuffer, VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT, mQueryPool, 1);
+    VK_CHECK(vkEndCommandBuffer(mCommandBuffer));
+
+    VkCommandBufferSubmitInfo lCmdInfo = vkh::commandBufferSubmitInfo(mCommandBuffer);
+    VkSubmitInfo2 lSubmitInfo = vkh::submitInfo(&lCmdInfo, nullptr, nullptr);
+    VK_CHECK(vkQueueSubmit2(mDevice->getQueue(VulkanQueueType::Graphics), 1, &lSubmitInfo, mFence));
+    VK_CHECK(vkWaitForFences(*mDevice, 1, &mFence, VK_TRUE, UINT64_MAX));
+    VK_CHECK(vkResetFences(*mDevice, 1, &mFence));
+    vkDestroyPipeline(*mDevice, lPipeline, nullptr);
+
+    uint64_t lTimestamps[2] = {};
+    VkResult lResult = vkGetQueryPoolResults(*mDevice, mQueryPool, 0, 2, sizeof(lTimestamps), lTimestamps, sizeof(uint64_t), VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WAIT_BIT);
+    if (lResult != VK_SUCCESS)
+        return FLT_MAX;
+
+    const uint32_t lValidBits = mDevice->mQueueFamilyProperties[mDevice->getQueueFamilyIndex(VulkanQueueType::Graphics)].timestampValidBits;
+    const uint64_t lMask = lValidBits >= 64 ? ~0ull : (1ull << lValidBits) - 1;
+    const uint64_t lTicks = (lTimestamps[1] - lTimestamps[0]) & lMask;
+    const double lNs = (double)lTicks * mDevice->mPhysicalDeviceProperties.limits.timestampPeriod;
+    return (float)(lNs / 1000.0 / std::max(mSettings.mIterations, 1u));
+}
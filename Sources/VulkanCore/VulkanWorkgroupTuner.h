@@ -0,0 +1,92 @@
+#pragma once
+
+#include "vk_common.h"
+#include "VulkanShader.h"
+
+#include <functional>
+#include <mutex>
+#include <string>
+#include <vector>
+
+struct VulkanDevice;
+
+// Workgroup size of the compute kernels, measured on the device
+// The kernels give their local size with specialization constants (layout(local_size_x_id = 0, ...) in,
+// see ShaderReflection::mLocalSizeSpecIds). On the first use of a kernel, getConfig() times the candidate sizes,
+// and the required subgroup sizes when subgroupSizeControl is supported, with timestamp queries and keeps the fastest.
+// The winners are saved per device (vendor, device id, driver version) and kernel name: the next runs
+// and the other kernels of the same name use them without measuring.
+// Thread safe, the tuning itself is serialized.
+struct WorkgroupTuner
+{
+    struct Settings
+    {
+        std::string mFilename = "workgroup_tuning.bin";
+        uint32_t mIterations = 16;      // Dispatches timed per candidate
+    };
+
+    struct Config
+    {
+        uint32_t mLocalSize[3] = { 1, 1, 1 };
+        uint32_t mSubgroupSize = 0;     // 0 = chosen by the driver
+        float mMicroseconds = 0.0f;     // Per dispatch, 0 when not measured
+
+        inline uint32_t groupCount(uint32_t pSize, uint32_t pAxis) const { return (pSize + mLocalSize[pAxis] - 1) / mLocalSize[pAxis]; }
+    };
+
+    // Stage of a compute pipeline with the local size and subgroup size of a Config
+    // mStage points in the structure, keep it alive (and in place) until the pipeline is created.
+    struct Specialization
+    {
+        uint32_t mValues[3];
+        VkSpecializationMapEntry mEntries[3];
+        VkSpecializationInfo mInfo;
+        VkPipelineShaderStageRequiredSubgroupSizeCreateInfo mSubgroupSize;
+        VkPipelineShaderStageCreateInfo mStage;
+
+        void init(const VulkanShader& pShader, const Config& pConfig);
+    };
+
+    // Record one dispatch with the pipeline bound: descriptors, push constants and vkCmdDispatch with the group count of pConfig
+    using RecordDispatch = std::function<void(VkCommandBuffer pCmd, const Config& pConfig)>;
+
+    void init(VulkanDevice* pDevice, const Settings& pSettings);
+    void shutdown();
+
+    // Fastest config of the kernel pName, tuned on the first call on this device (blocking: the candidates are
+    // submitted on the graphics queue and waited). Kernels with a fixed local size return the reflected one.
+    Config getConfig(const std::string& pName, const VulkanShader& pShader, VkPipelineLayout pLayout, const RecordDispatch& pRecord);
+
+    bool save();
+
+    static const uint32_t cMagic = 0x54574b56;  // VKWT
+    static const uint32_t cVersion = 1;
+    static const uint32_t cMaxNameLength = 64;
+
+    struct Entry
+    {
+        uint32_t mVendorID;
+        uint32_t mDeviceID;
+        uint32_t mDriverVersion;
+        char mName[cMaxNameLength];
+        Config mConfig;
+    };
+
+    bool load();
+    Entry* findEntry(const std::string& pName);    // Of this device, mMutex locked
+    void getCandidates(const VulkanShader& pShader, std::vector<Config>& pCandidates) const;
+    float measure(const VulkanShader& pShader, VkPipelineLayout pLayout, const Config& pConfig, const RecordDispatch& pRecord);
+
+    VulkanDevice* mDevice = nullptr;
+    Settings mSettings;
+
+    std::mutex mMutex;
+    std::vector<Entry> mEntries;        // All the devices
+    bool mDirty = false;
+
+    // Timing resources, created with the first tuning
+    VkCommandPool mCommandPool = VK_NULL_HANDLE;
+    VkCommandBuffer mCommandBuffer = VK_NULL_HANDLE;
+    VkFence mFence = VK_NULL_HANDLE;
+    VkQueryPool mQueryPool = VK_NULL_HANDLE;
+};